@@ -0,0 +1,383 @@
+/*
+    This file is part of ethminer.
+
+    ethminer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ethminer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    ethminer-hostbench : times the host side hot paths (stratum parsing,
+    work dispatch, solution verification, hex conversions) and counts the
+    heap allocations they make. No device is needed.
+*/
+
+#include <CLI/CLI.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#include <json/json.h>
+
+#include <libethcore/EthashAux.h>
+#include <libethcore/Farm.h>
+#include <libpoolprotocols/TrafficCapture.h>
+#include <libpoolprotocols/stratum/StratumParser.h>
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+// Global vars
+bool g_exitOnError = false;
+boost::asio::io_service g_io_service;
+
+// Every heap allocation of the process is counted
+static std::atomic<uint64_t> s_allocations = {0};
+
+void* operator new(size_t _size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(_size ? _size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t _size)
+{
+    return operator new(_size);
+}
+
+void* operator new(size_t _size, const std::nothrow_t&) noexcept
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(_size ? _size : 1);
+}
+
+void* operator new[](size_t _size, const std::nothrow_t& _tag) noexcept
+{
+    return operator new(_size, _tag);
+}
+
+void operator delete(void* _p) noexcept
+{
+    std::free(_p);
+}
+
+void operator delete[](void* _p) noexcept
+{
+    std::free(_p);
+}
+
+void operator delete(void* _p, size_t) noexcept
+{
+    std::free(_p);
+}
+
+void operator delete[](void* _p, size_t) noexcept
+{
+    std::free(_p);
+}
+
+namespace
+{
+// Lines received from pools, one per message kind ethminer handles most
+const char* c_corpus[] = {
+    // EthereumStratum/1.0.0
+    R"({"id":null,"method":"mining.notify","params":["bf0488aa","abad8f99f3918bf903c6a909d9bbc0fdfa5a2f4b9cb1196175ec825c6610126c","645cf20198c2f3861e947d4f67e3ab63b7b2e24dcc9095bd9123e7b33371f6cc",true]})",
+    R"({"id":null,"method":"mining.set_difficulty","params":[0.5]})",
+    // Stratum / eth-proxy
+    R"({"id":0,"jsonrpc":"2.0","result":["0x645cf20198c2f3861e947d4f67e3ab63b7b2e24dcc9095bd9123e7b33371f6cc","0xabad8f99f3918bf903c6a909d9bbc0fdfa5a2f4b9cb1196175ec825c6610126c","0x0000000112e0be826d694b2e62d01511f12a6061fbaec8bc02357593e70e52ba","0x8ef1b3"]})",
+    R"({"id":"2","jsonrpc":"2.0","method":"mining.notify","params":["0x645cf201","0x645cf20198c2f3861e947d4f67e3ab63b7b2e24dcc9095bd9123e7b33371f6cc","0xabad8f99f3918bf903c6a909d9bbc0fdfa5a2f4b9cb1196175ec825c6610126c","0x0000000112e0be826d694b2e62d01511f12a6061fbaec8bc02357593e70e52ba"]})",
+    // Share responses
+    R"({"id":40,"jsonrpc":"2.0","result":true})",
+    R"({"id":41,"jsonrpc":"2.0","result":false,"error":[23,"Low difficulty share",null]})",
+};
+
+struct BenchResult
+{
+    string name;
+    uint64_t ops = 0;
+    double nsPerOp = 0;
+    double allocsPerOp = 0;
+};
+
+/*
+    Runs _op doubling the count of calls till they last at least _minMs.
+    Allocations are sampled over the same, final, run.
+*/
+BenchResult measure(const string& _name, const std::function<void()>& _op, unsigned _minMs)
+{
+    _op();  // Warms caches and lazily built state
+
+    BenchResult r;
+    r.name = _name;
+    for (uint64_t n = 1;; n *= 2)
+    {
+        uint64_t allocs = s_allocations.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < n; i++)
+            _op();
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start)
+                      .count();
+        if (ns >= int64_t(_minMs) * 1000000 || n >= (uint64_t(1) << 32))
+        {
+            r.ops = n;
+            r.nsPerOp = double(ns) / n;
+            r.allocsPerOp = double(s_allocations.load(std::memory_order_relaxed) - allocs) / n;
+            return r;
+        }
+    }
+}
+
+// Exposes the work accessors the search loops use. Never started
+class BenchMiner : public Miner
+{
+public:
+    BenchMiner() : Miner("bench-", 0) {}
+
+    void kick_miner() override {}
+    WorkPackage copy() const { return work(); }
+    std::shared_ptr<const WorkPackage> current() const { return workPtr(); }
+
+protected:
+    bool initDevice() override { return true; }
+    bool initEpoch_internal() override { return true; }
+    void workLoop() override {}
+};
+
+vector<string> loadCorpus(const string& _path)
+{
+    vector<string> lines;
+    if (_path.empty())
+    {
+        for (auto line : c_corpus)
+            lines.push_back(line);
+        return lines;
+    }
+
+    vector<TrafficCapture::Record> records;
+    string error;
+    if (!TrafficCapture::load(_path, records, error))
+        throw std::runtime_error(error);
+    for (auto& r : records)
+        if (r.direction == TrafficCapture::Inbound && !r.text.empty())
+            lines.push_back(std::move(r.text));
+    if (lines.empty())
+        throw std::runtime_error("No inbound line in " + _path);
+    return lines;
+}
+
+WorkPackage makeWork(int _epoch)
+{
+    WorkPackage wp;
+    wp.header = h256::random();
+    wp.seed = h256::random();
+    wp.epoch = _epoch;
+    wp.block = _epoch * 30000;
+    wp.boundary = h256(dev::getTargetFromDiff(1));
+    return wp;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    unsigned minMs = 500;
+    string corpusFile;
+    string filter;
+    string format = "table";
+    string output;
+
+    CLI::App app("ethminer-hostbench - times ethminer host side hot paths");
+    app.add_option("--min-time", minMs, "Milliseconds each benchmark runs at least", true)
+        ->check(CLI::Range(1, 60000));
+    app.add_option("--corpus", corpusFile, "Capture (see ethminer --capture) to parse lines of");
+    app.add_option("--filter", filter, "Only run benchmarks whose name contains this");
+    app.add_set("--format", format, {"table", "csv", "json"}, "Output format", true);
+    app.add_option("-o,--output", output, "Output file (default stdout)");
+
+    try
+    {
+        app.parse(argc, argv);
+    }
+    catch (const CLI::ParseError& e)
+    {
+        return app.exit(e);
+    }
+
+    vector<string> corpus;
+    try
+    {
+        corpus = loadCorpus(corpusFile);
+    }
+    catch (const std::exception& e)
+    {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    // Farm and its verifiers post to the io service
+    boost::asio::io_service::work work(g_io_service);
+    std::thread io_thread{boost::bind(&boost::asio::io_service::run, &g_io_service)};
+
+    // No device is subscribed : only the host side of the Farm runs
+    std::map<string, DeviceDescriptor> devices;
+    FarmSettings farmSettings;
+    Farm farm(devices, farmSettings, CUSettings(), CLSettings(), CPSettings());
+
+    std::mutex solvedMutex;
+    std::condition_variable solvedSignal;
+    uint64_t solved = 0;
+    farm.onSolutionFound([&](const Solution&) {
+        std::lock_guard<std::mutex> l(solvedMutex);
+        solved++;
+        solvedSignal.notify_all();
+    });
+
+    vector<BenchResult> results;
+    auto run = [&](const string& _name, const std::function<void()>& _op) {
+        if (filter.empty() || _name.find(filter) != string::npos)
+            results.push_back(measure(_name, _op, minMs));
+    };
+
+    // Stratum : fast path tokenizer, then as it goes on with hashes,
+    // and the json tree processResponse() gets otherwise
+    size_t line = 0;
+    run("stratum.parse", [&]() {
+        auto const& s = corpus[line++ % corpus.size()];
+        StratumParser::Message msg;
+        StratumParser::parse(s.data(), s.data() + s.size(), msg);
+    });
+    run("stratum.parse_hashes", [&]() {
+        auto const& s = corpus[line++ % corpus.size()];
+        StratumParser::Message msg;
+        if (StratumParser::parse(s.data(), s.data() + s.size(), msg))
+        {
+            h256 hash;
+            for (unsigned i = 0; i < msg.count; i++)
+                StratumParser::toHash(msg.values[i], hash);
+        }
+    });
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    run("stratum.json", [&]() {
+        auto const& s = corpus[line++ % corpus.size()];
+        Json::Value jMsg;
+        std::string what;
+        reader->parse(s.data(), s.data() + s.size(), &jMsg, &what);
+    });
+
+    // Dispatch : the epoch is set once, jobs then only change header
+    WorkPackage wp = makeWork(0);
+    farm.setWork(wp);
+    run("farm.setWork", [&]() {
+        wp.header.data()[0]++;
+        farm.setWork(wp);
+    });
+
+    BenchMiner miner;
+    miner.setWork(wp);
+    run("miner.setWork", [&]() { miner.setWork(wp); });
+    auto shared = std::make_shared<const WorkPackage>(wp);
+    run("miner.setWork_shared", [&]() { miner.setWork(shared); });
+    run("miner.work", [&]() { miner.copy(); });
+    run("miner.workPtr", [&]() { miner.current(); });
+
+    // Verification
+    uint64_t nonce = 0;
+    run("ethash.eval", [&]() { EthashAux::eval(wp.epoch, wp.header, nonce++); });
+
+    // Any nonce meets this boundary so every solution goes all the way :
+    // verifier, io service and solution handler
+    auto easy = std::make_shared<WorkPackage>(wp);
+    easy->boundary = h256(dev::getTargetFromDiff(0));
+    run("farm.submitProof", [&]() {
+        uint64_t target;
+        {
+            std::lock_guard<std::mutex> l(solvedMutex);
+            target = solved + 1;
+        }
+        farm.submitProof(Solution{nonce++, h256(), easy, std::chrono::steady_clock::now(), 0});
+        std::unique_lock<std::mutex> l(solvedMutex);
+        solvedSignal.wait(l, [&]() { return solved >= target; });
+    });
+
+    // Hex conversions
+    string hex = wp.header.hex(HexPrefix::Add);
+    run("hex.toHex", [&]() { toHex(wp.header.ref()); });
+    run("hex.h256.hex", [&]() { wp.header.hex(HexPrefix::Add); });
+    run("hex.fromHex", [&]() { fromHex(hex); });
+    run("hex.h256_from_string", [&]() { h256 h(hex); });
+    char hexBuffer[64];
+    h256 parsed;
+    run("hex.toHex_buffer", [&]() { wp.header.hex(hexBuffer); });
+    run("hex.fromHex_buffer", [&]() { fromHex(hexBuffer, 32, parsed.data()); });
+
+    g_io_service.stop();
+    io_thread.join();
+
+    std::ofstream file;
+    if (!output.empty())
+    {
+        file.open(output, std::ios::trunc);
+        if (!file)
+        {
+            cerr << "Unable to open " << output << endl;
+            return 1;
+        }
+    }
+    ostream& out = output.empty() ? cout : file;
+
+    if (format == "json")
+    {
+        Json::Value jResults(Json::arrayValue);
+        for (auto const& r : results)
+        {
+            Json::Value jResult(Json::objectValue);
+            jResult["name"] = r.name;
+            jResult["ops"] = Json::Value::UInt64(r.ops);
+            jResult["ns_per_op"] = r.nsPerOp;
+            jResult["allocs_per_op"] = r.allocsPerOp;
+            jResults.append(jResult);
+        }
+        Json::StreamWriterBuilder writer;
+        writer["indentation"] = "  ";
+        out << Json::writeString(writer, jResults) << endl;
+    }
+    else if (format == "csv")
+    {
+        out << "name,ops,ns_per_op,allocs_per_op" << endl;
+        for (auto const& r : results)
+            out << r.name << "," << r.ops << "," << fixed << setprecision(1) << r.nsPerOp << ","
+                << setprecision(2) << r.allocsPerOp << endl;
+    }
+    else
+    {
+        out << left << setw(24) << "benchmark" << right << setw(12) << "ops" << setw(14)
+            << "ns/op" << setw(14) << "allocs/op" << endl;
+        for (auto const& r : results)
+            out << left << setw(24) << r.name << right << setw(12) << r.ops << setw(14) << fixed
+                << setprecision(1) << r.nsPerOp << setw(14) << setprecision(2) << r.allocsPerOp
+                << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,453 @@
+/*
+    This file is part of ethminer.
+
+    ethminer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ethminer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    ethminer-bench : times the search kernels of each backend on their own.
+
+    Every point of the parameter grid runs a fresh Farm with a single
+    device subscribed, builds the DAG of the requested epoch and hashes a
+    job whose boundary can't be met. Results are written as CSV or JSON.
+*/
+
+#include <CLI/CLI.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+
+#include <json/json.h>
+
+#include <libethcore/Farm.h>
+#include <libethcore/MinerProfile.h>
+#if ETH_ETHASHCL
+#include <libethash-cl/CLMiner.h>
+#endif
+#if ETH_ETHASHCUDA
+#include <libethash-cuda/CUDAMiner.h>
+#endif
+#if ETH_ETHASHCPU
+#include <libethash-cpu/CPUMiner.h>
+#endif
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+// Global vars
+bool g_exitOnError = false;
+boost::asio::io_service g_io_service;
+
+namespace
+{
+// Ethash reads 64 DAG items of 128 bytes per hash
+constexpr double c_dagBytesPerHash = 64.0 * 128.0;
+
+struct BenchSettings
+{
+    int epoch = 0;
+    unsigned seconds = 20;     // Measure window of each point
+    unsigned warmup = 6;       // Past DAG generation. More than the Farm collect interval
+    unsigned dagTimeout = 600;  // Seconds allowed to build the DAG
+    string format = "csv";
+    string output;  // Empty for stdout
+};
+
+struct Point
+{
+    string backend;
+    unsigned device = 0;  // Index in the devices collection
+    string name;
+
+    // Parameters (0 or empty when not applicable to the backend)
+    unsigned grid = 0;
+    unsigned block = 0;
+    unsigned local = 0;
+    unsigned multiplier = 0;
+    unsigned streams = 0;
+    string engine;
+    uint64_t batch = 0;  // Nonces per kernel launch
+
+    bool ok = false;
+    double hashrate = 0;     // Hashes per second
+    double dagMs = 0;        // Work set -> device searching the new DAG
+    uint64_t dagRate = 0;    // DAG bytes generated per second as seen by the miner
+    double overheadUs = -1;  // Fixed cost of a launch, fitted over the batches of the group
+};
+
+bool runPoint(Point& _point, std::map<string, DeviceDescriptor> _devices,
+    DeviceSubscriptionTypeEnum _type, const CUSettings& _cu, const CLSettings& _cl,
+    const CPSettings& _cp, const BenchSettings& _settings)
+{
+    // Only the device under test is subscribed
+    for (auto& device : _devices)
+        device.second.subscriptionType = DeviceSubscriptionTypeEnum::None;
+    auto it = _devices.begin();
+    std::advance(it, _point.device);
+    it->second.subscriptionType = _type;
+
+    Farm farm(_devices, FarmSettings(), _cu, _cl, _cp);
+    farm.start();
+    auto miner = farm.getMiner(0);
+    if (!miner)
+        return false;
+
+    WorkPackage wp;
+    wp.header = h256::random();
+    wp.seed = h256::random();
+    wp.epoch = _settings.epoch;
+    wp.block = _settings.epoch * 30000;
+    wp.boundary = h256();  // Nothing is ever found : devices just hash
+
+    auto start = std::chrono::steady_clock::now();
+    farm.setWork(wp);
+
+    while (miner->readyEpoch() != _settings.epoch)
+    {
+        if (miner->paused() ||
+            std::chrono::steady_clock::now() - start > std::chrono::seconds(_settings.dagTimeout))
+        {
+            cwarn << _point.backend << " device " << _point.device
+                  << " did not get ready. Skipping point";
+            farm.stop();
+            return false;
+        }
+        this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    _point.dagMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start)
+                       .count();
+    _point.dagRate = miner->RetrieveDagRate();
+
+    // The hashrate of a miner is measured over the Farm collect interval :
+    // past the warmup samples only cover searching
+    this_thread::sleep_for(std::chrono::seconds(_settings.warmup));
+    double sum = 0;
+    unsigned samples = 0;
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(_settings.seconds);
+    while (std::chrono::steady_clock::now() < end)
+    {
+        this_thread::sleep_for(std::chrono::milliseconds(500));
+        sum += miner->RetrieveHashRate();
+        samples++;
+    }
+    farm.stop();
+
+    _point.hashrate = samples ? sum / samples : 0;
+    _point.ok = (_point.hashrate > 0);
+    return _point.ok;
+}
+
+/*
+    Time per launch is batch / hashrate. Over batches of the same backend,
+    device and streams it is fitted as overhead + batch / peak : the
+    intercept is the cost of a launch the streams do not hide.
+*/
+void fitOverheads(vector<Point>& _points)
+{
+    map<string, vector<Point*>> groups;
+    for (auto& p : _points)
+        if (p.ok && p.batch)
+            groups[p.backend + ":" + to_string(p.device) + ":" + to_string(p.streams)].push_back(
+                &p);
+
+    for (auto& group : groups)
+    {
+        auto& pts = group.second;
+        double n = pts.size(), sx = 0, sy = 0, sxx = 0, sxy = 0;
+        for (auto p : pts)
+        {
+            double x = double(p->batch);
+            double y = x / p->hashrate * 1e6;
+            sx += x;
+            sy += y;
+            sxx += x * x;
+            sxy += x * y;
+        }
+        double den = n * sxx - sx * sx;
+        if (n < 2 || den <= 0)
+            continue;  // Needs at least two batch sizes
+        double slope = (n * sxy - sx * sy) / den;
+        double intercept = (sy - slope * sx) / n;
+        for (auto p : pts)
+            p->overheadUs = std::max(intercept, 0.0);
+    }
+}
+
+void writeCsv(ostream& _out, const vector<Point>& _points)
+{
+    auto opt = [](unsigned _v) { return _v ? to_string(_v) : string(); };
+
+    _out << "backend,device,name,grid,block,local,multiplier,streams,engine,batch,ok,"
+            "hashrate,dag_bandwidth,dag_ms,dag_rate,launch_overhead_us"
+         << endl;
+    for (auto const& p : _points)
+    {
+        _out << p.backend << "," << p.device << ",\"" << p.name << "\"," << opt(p.grid) << ","
+             << opt(p.block) << "," << opt(p.local) << "," << opt(p.multiplier) << ","
+             << opt(p.streams) << "," << p.engine << "," << (p.batch ? to_string(p.batch) : "")
+             << "," << (p.ok ? 1 : 0) << "," << uint64_t(p.hashrate) << ","
+             << uint64_t(p.hashrate * c_dagBytesPerHash) << "," << uint64_t(p.dagMs) << ","
+             << p.dagRate << ",";
+        if (p.overheadUs >= 0)
+            _out << boost::str(boost::format("%0.1f") % p.overheadUs);
+        _out << endl;
+    }
+}
+
+void writeJson(ostream& _out, int _epoch, const vector<Point>& _points)
+{
+    Json::Value jRoot(Json::objectValue);
+    jRoot["epoch"] = _epoch;
+
+    Json::Value jPoints(Json::arrayValue);
+    for (auto const& p : _points)
+    {
+        Json::Value jPoint(Json::objectValue);
+        jPoint["backend"] = p.backend;
+        jPoint["device"] = p.device;
+        jPoint["name"] = p.name;
+
+        Json::Value jParams(Json::objectValue);
+        if (p.grid)
+            jParams["grid"] = p.grid;
+        if (p.block)
+            jParams["block"] = p.block;
+        if (p.local)
+            jParams["local"] = p.local;
+        if (p.multiplier)
+            jParams["multiplier"] = p.multiplier;
+        if (p.streams)
+            jParams["streams"] = p.streams;
+        if (!p.engine.empty())
+            jParams["engine"] = p.engine;
+        jPoint["params"] = jParams;
+        if (p.batch)
+            jPoint["batch"] = Json::Value::UInt64(p.batch);
+
+        jPoint["ok"] = p.ok;
+        jPoint["hashrate"] = p.hashrate;
+        jPoint["dag_bandwidth"] = p.hashrate * c_dagBytesPerHash;
+        jPoint["dag_ms"] = p.dagMs;
+        jPoint["dag_rate"] = Json::Value::UInt64(p.dagRate);
+        if (p.overheadUs >= 0)
+            jPoint["launch_overhead_us"] = p.overheadUs;
+        jPoints.append(jPoint);
+    }
+    jRoot["points"] = jPoints;
+
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "  ";
+    _out << Json::writeString(writer, jRoot) << endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    BenchSettings settings;
+    CUSettings cuSettings;
+    CLSettings clSettings;
+    CPSettings cpSettings;
+
+    vector<unsigned> devices;
+    vector<unsigned> cuGrids = {cuSettings.gridSize};
+    vector<unsigned> cuBlocks = {cuSettings.blockSize};
+    vector<unsigned> cuStreams = {cuSettings.streams};
+    vector<unsigned> clLocals = {clSettings.localWorkSize};
+    vector<unsigned> clMultipliers = {clSettings.globalWorkSizeMultiplier};
+    vector<unsigned> clStreams = {clSettings.streams};
+    vector<string> cpEngines = {cpSettings.engine};
+
+    bool cuda = false, opencl = false, cpu = false, list = false;
+
+    CLI::App app("ethminer-bench - times the search kernels of each backend");
+    app.add_flag("-U,--cuda", cuda, "Benchmark CUDA devices");
+    app.add_flag("-G,--opencl", opencl, "Benchmark OpenCL devices");
+    app.add_flag("--cpu", cpu, "Benchmark CPUs");
+    app.add_flag("-L,--list-devices", list, "List detected devices and exit");
+    app.add_option("--devices", devices, "Indexes of the devices to benchmark (default all)");
+    app.add_option("--epoch", settings.epoch, "Epoch of the DAG", true)
+        ->check(CLI::Range(0, 2047));
+    app.add_option("--seconds", settings.seconds, "Measure window of each point", true)
+        ->check(CLI::Range(1, 3600));
+    app.add_option("--warmup", settings.warmup, "Seconds hashed before measuring", true)
+        ->check(CLI::Range(0, 600));
+    app.add_option("--dag-timeout", settings.dagTimeout, "Seconds allowed to build the DAG", true)
+        ->check(CLI::Range(1, 3600));
+    app.add_option("--cu-grid-sizes", cuGrids, "CUDA grid sizes", true);
+    app.add_option("--cu-block-sizes", cuBlocks, "CUDA block sizes", true);
+    app.add_option("--cu-streams", cuStreams, "CUDA streams", true);
+    app.add_option("--cl-local-work", clLocals, "OpenCL local work sizes", true);
+    app.add_option("--cl-global-work", clMultipliers, "OpenCL global work size multipliers", true);
+    app.add_option("--cl-streams", clStreams, "OpenCL streams", true);
+    app.add_option("--cp-engines", cpEngines, "CPU search engines", true);
+    app.add_set("--format", settings.format, {"csv", "json"}, "Output format", true);
+    app.add_option("-o,--output", settings.output, "Output file (default stdout)");
+
+    try
+    {
+        app.parse(argc, argv);
+    }
+    catch (const CLI::ParseError& e)
+    {
+        return app.exit(e);
+    }
+
+    if (!cuda && !opencl && !cpu)
+        cuda = opencl = true;
+
+    // Launch parameters are the ones of the grid : never the tuned ones
+    MinerProfile::setFile(
+        (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string());
+    cuSettings.autoTune = false;
+    clSettings.autoTune = false;
+
+    // Farm telemetry needs the io service running
+    boost::asio::io_service::work work(g_io_service);
+    std::thread io_thread{boost::bind(&boost::asio::io_service::run, &g_io_service)};
+
+    std::map<string, DeviceDescriptor> collection;
+#if ETH_ETHASHCL
+    if (opencl)
+        CLMiner::enumDevices(collection);
+#endif
+#if ETH_ETHASHCUDA
+    if (cuda)
+        CUDAMiner::enumDevices(collection);
+#endif
+#if ETH_ETHASHCPU
+    if (cpu)
+        CPUMiner::enumDevices(collection, cpSettings);
+#endif
+
+    if (list || collection.empty())
+    {
+        if (collection.empty())
+            cerr << "No usable devices found" << endl;
+        unsigned i = 0;
+        for (auto const& device : collection)
+            cout << i++ << " " << device.first << " " << device.second.name << endl;
+        g_io_service.stop();
+        io_thread.join();
+        return collection.empty() ? 1 : 0;
+    }
+
+    vector<Point> points;
+    unsigned index = 0;
+    for (auto const& device : collection)
+    {
+        unsigned i = index++;
+        if (!devices.empty() && std::find(devices.begin(), devices.end(), i) == devices.end())
+            continue;
+
+        Point base;
+        base.device = i;
+        base.name = device.second.name;
+
+#if ETH_ETHASHCUDA
+        if (cuda && device.second.cuDetected)
+        {
+            for (auto grid : cuGrids)
+                for (auto block : cuBlocks)
+                    for (auto streams : cuStreams)
+                    {
+                        Point p = base;
+                        p.backend = "cuda";
+                        p.grid = grid;
+                        p.block = block;
+                        p.streams = streams;
+                        p.batch = uint64_t(grid) * block;
+                        CUSettings cu = cuSettings;
+                        cu.gridSize = grid;
+                        cu.blockSize = block;
+                        cu.streams = streams;
+                        runPoint(p, collection, DeviceSubscriptionTypeEnum::Cuda, cu, clSettings,
+                            cpSettings, settings);
+                        points.push_back(p);
+                    }
+            continue;
+        }
+#endif
+#if ETH_ETHASHCL
+        if (opencl && device.second.clDetected)
+        {
+            for (auto local : clLocals)
+                for (auto multiplier : clMultipliers)
+                    for (auto streams : clStreams)
+                    {
+                        Point p = base;
+                        p.backend = "opencl";
+                        p.local = local;
+                        p.multiplier = multiplier;
+                        p.streams = streams;
+                        p.batch = uint64_t(((local + 7) / 8) * 8) * multiplier;
+                        CLSettings cl = clSettings;
+                        cl.localWorkSize = local;
+                        cl.globalWorkSizeMultiplier = multiplier;
+                        cl.streams = streams;
+                        runPoint(p, collection, DeviceSubscriptionTypeEnum::OpenCL, cuSettings, cl,
+                            cpSettings, settings);
+                        points.push_back(p);
+                    }
+            continue;
+        }
+#endif
+#if ETH_ETHASHCPU
+        if (cpu && device.second.type == DeviceTypeEnum::Cpu)
+        {
+            for (auto const& engine : cpEngines)
+            {
+                Point p = base;
+                p.backend = "cpu";
+                p.engine = engine;
+                CPSettings cp = cpSettings;
+                cp.engine = engine;
+                runPoint(p, collection, DeviceSubscriptionTypeEnum::Cpu, cuSettings, clSettings,
+                    cp, settings);
+                points.push_back(p);
+            }
+        }
+#endif
+    }
+
+    g_io_service.stop();
+    io_thread.join();
+
+    fitOverheads(points);
+
+    std::ofstream file;
+    if (!settings.output.empty())
+    {
+        file.open(settings.output, std::ios::trunc);
+        if (!file)
+        {
+            cerr << "Unable to open " << settings.output << endl;
+            return 1;
+        }
+    }
+    ostream& out = settings.output.empty() ? cout : file;
+    if (settings.format == "json")
+        writeJson(out, settings.epoch, points);
+    else
+        writeCsv(out, points);
+
+    return 0;
+}
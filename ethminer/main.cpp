@@ -19,12 +19,15 @@
 
 #include <ethminer/buildinfo.h>
 #include <condition_variable>
+#include <future>
 
 #ifndef ENABLE_VIRTUAL_TERMINAL_PROCESSING
 #define ENABLE_VIRTUAL_TERMINAL_PROCESSING 0x0004
 #endif
 
 #include <libethcore/Farm.h>
+#include <libethcore/DagCache.h>
+#include <libethcore/MinerProfile.h>
 #if ETH_ETHASHCL
 #include <libethash-cl/CLMiner.h>
 #endif
@@ -78,7 +81,8 @@ public:
     {
         None,
         Simulation,
-        Mining
+        Mining,
+        Proxy
     };
 
     MinerCLI() : m_cliDisplayTimer(g_io_service), m_io_strand(g_io_service)
@@ -107,8 +111,10 @@ public:
     {
         if (!ec && g_running)
         {
-            string logLine =
-                PoolManager::p().isConnected() ? Farm::f().Telemetry().str() : "Not connected";
+            string logLine = "Not connected";
+            if (PoolManager::p().isConnected())
+                logLine =
+                    StratumProxy::p() ? StratumProxy::p()->str() : Farm::f().Telemetry().str();
             minelog << logLine;
 
 #if ETH_DBUS
@@ -246,12 +252,16 @@ public:
 
         app.add_option("--ergodicity", m_FarmSettings.ergodicity, "", true)->check(CLI::Range(0, 2));
 
+        app.add_flag("--nonce-weighting", m_FarmSettings.nonceWeighting, "");
+
         app.add_flag("-V,--version", version, "Show program version");
 
         app.add_option("-v,--verbosity", g_logOptions, "", true)->check(CLI::Range(LOG_NEXT - 1));
 
         app.add_option("--farm-recheck", m_PoolSettings.getWorkPollInterval, "", true)->check(CLI::Range(1, 99999));
 
+        app.add_flag("--farm-longpoll", m_PoolSettings.getWorkLongPoll, "");
+
         app.add_option("--farm-retries", m_PoolSettings.connectionMaxRetries, "", true)->check(CLI::Range(0, 99999));
 
         app.add_option("--retry-delay", m_PoolSettings.delayBeforeRetry, "", true)
@@ -270,6 +280,9 @@ public:
 
         app.add_option("--HWMON", m_FarmSettings.hwMon, "", true)->check(CLI::Range(0, 2));
 
+        app.add_option("--hwmon-interval", m_FarmSettings.hwMonInterval, "", true)
+            ->check(CLI::Range(500, 60000));
+
         app.add_flag("--exit", g_exitOnError, "");
 
         vector<string> pools;
@@ -278,12 +291,26 @@ public:
         app.add_option("--failover-timeout", m_PoolSettings.poolFailoverTimeout, "", true)
             ->check(CLI::Range(0, 999));
 
+        app.add_option("--pool-standby", m_PoolSettings.hotStandby, "", true)
+            ->check(CLI::Range(0, 8));
+
+        app.add_option("--pool-latency", m_PoolSettings.latencyProbeInterval, "", true)
+            ->check(CLI::Range(0, 3600));
+
+        app.add_option("--proxy-port", m_proxy_port, "", true)->check(CLI::Range(1, 65535));
+
+        app.add_option("--proxy-address", m_proxy_address, "", true);
+
+        app.add_option("--capture", m_PoolSettings.captureFile, "", true);
+
         app.add_flag("--nocolor", g_logNoColor, "");
 
         app.add_flag("--syslog", g_logSyslog, "");
 
         app.add_flag("--stdout", g_logStdout, "");
 
+        app.add_flag("--log-async", g_logAsync, "");
+
 #if API_CORE
 
         app.add_option("--api-bind", m_api_bind, "", true)
@@ -317,7 +344,7 @@ public:
 
         app.add_option("--opencl-device,--opencl-devices,--cl-devices", m_CLSettings.devices, "");
 
-        app.add_option("--cl-global-work", m_CLSettings.globalWorkSize, "", true);
+        app.add_option("--cl-global-work", m_CLSettings.globalWorkSizeMultiplier, "", true);
 
         app.add_set("--cl-local-work", m_CLSettings.localWorkSize, {64, 128, 256}, "", true);
 
@@ -325,6 +352,16 @@ public:
 
         app.add_flag("--cl-noexit", m_CLSettings.noExit, "");
 
+        app.add_flag("--cl-nocache", m_CLSettings.noCache, "");
+
+        app.add_flag("--cl-light-gen", m_CLSettings.lightGen, "");
+
+        app.add_option("--cl-streams", m_CLSettings.streams, "", true)->check(CLI::Range(1, 16));
+
+        app.add_flag("--cl-autotune", m_CLSettings.autoTune, "");
+
+        app.add_option("--cl-cache-dir", m_CLSettings.cacheDir, "");
+
 #endif
 
 #if ETH_ETHASHCUDA
@@ -344,17 +381,67 @@ public:
         app.add_option("--cuda-streams,--cu-streams", m_CUSettings.streams, "", true)
             ->check(CLI::Range(1, 99));
 
+        app.add_flag("--cu-dag-prefetch", m_CUSettings.dagPrefetch, "");
+
+        app.add_flag("--cu-event-loop", m_CUSettings.eventLoop, "");
+
+        app.add_flag("--cu-noexit", m_CUSettings.noExit, "");
+
+        app.add_flag("--cu-jit", m_CUSettings.jit, "");
+
+        app.add_flag("--cu-graphs", m_CUSettings.graphs, "");
+
+        app.add_flag("--cu-light-gen", m_CUSettings.lightGen, "");
+
+        app.add_flag("--cu-autotune", m_CUSettings.autoTune, "");
+
+        app.add_set("--cuda-parallel-hash,--cu-parallel-hash", m_CUSettings.parallelHash,
+            {1, 2, 4, 8}, "", true);
+
+        string dagAccess = "plain";
+        app.add_set("--cu-dag-access", dagAccess, {"plain", "ldg", "l2persist"}, "", true);
+
 #endif
 
 #if ETH_ETHASHCPU
 
         app.add_option("--cpu-devices,--cp-devices", m_CPSettings.devices, "");
 
+        app.add_set("--cp-engine", m_CPSettings.engine,
+            {"auto", "avx512", "avx2", "generic", "scalar"}, "", true);
+
+        app.add_flag("--cp-numa", m_CPSettings.numa, "");
+
+        string hugePages = "thp";
+        app.add_set("--cp-hugepages", hugePages, {"off", "thp", "2m", "1g"}, "", true);
+
+        app.add_set("--cp-placement", m_CPSettings.placement, {"logical", "cores"}, "", true);
+
+        app.add_option("--cp-reserve", m_CPSettings.reserve, "", true);
+
+        app.add_option("--cp-cores", m_CPSettings.cores, "");
+
 #endif
 
         app.add_flag("--noeval", m_FarmSettings.noEval, "");
 
-        app.add_option("-L,--dag-load-mode", m_FarmSettings.dagLoadMode, "", true)->check(CLI::Range(1));
+        app.add_option("--verify-threads", m_FarmSettings.verifyThreads, "", true)
+            ->check(CLI::Range(1, 16));
+
+        app.add_option("-L,--dag-load-mode", m_FarmSettings.dagLoadMode, "", true)->check(CLI::Range(2));
+
+        app.add_flag("--epoch-overlap", m_FarmSettings.epochOverlap, "");
+
+        string tuneProfile;
+        app.add_option("--tune-profile", tuneProfile, "");
+
+        string dagCacheDir;
+        app.add_option("--dag-cache-dir", dagCacheDir, "");
+
+        app.add_option("--epoch-cache-mem", m_FarmSettings.epochCacheMem, "", true);
+
+        app.add_option("--stale-drop", m_FarmSettings.staleDrop, "", true)
+            ->check(CLI::Range(0, 2));
 
         bool cl_miner = false;
         app.add_flag("-G,--opencl", cl_miner, "");
@@ -366,11 +453,40 @@ public:
 #if ETH_ETHASHCPU
         app.add_flag("--cpu", cpu_miner, "");
 #endif
-        auto sim_opt = app.add_option("-Z,--simulation,-M,--benchmark", m_PoolSettings.benchmarkBlock, "", true);
+        auto sim_opt = app.add_option("-Z,--simulation,-M,--benchmark", m_PoolSettings.simulation.block, "", true);
+
+        app.add_option("--bench-job-interval", m_PoolSettings.simulation.jobInterval, "", true)
+            ->check(CLI::Range(0, 3600000));
+        app.add_option("--bench-difficulty", m_PoolSettings.simulation.difficulty, "", true)
+            ->check(CLI::Range(0.0001, 1e12));
+        app.add_option("--bench-epoch-interval", m_PoolSettings.simulation.epochInterval, "", true)
+            ->check(CLI::Range(0, 86400));
+        app.add_option("--bench-duration", m_PoolSettings.simulation.duration, "", true)
+            ->check(CLI::Range(0, 604800));
+        app.add_option("--bench-report", m_PoolSettings.simulation.reportFile, "", true);
+
+        auto replay_opt = app.add_option("--replay", m_PoolSettings.replayFile, "", true);
+        app.add_option("--replay-speed", m_PoolSettings.replaySpeed, "", true)
+            ->check(CLI::Range(0.01, 1000.0));
 
         app.add_option("--tstop", m_FarmSettings.tempStop, "", true)->check(CLI::Range(30, 100));
         app.add_option("--tstart", m_FarmSettings.tempStart, "", true)->check(CLI::Range(30, 100));
 
+        app.add_option("--power-cap", m_FarmSettings.powerCap, "", true)
+            ->check(CLI::Range(0, 1000));
+        app.add_option("--temp-target", m_FarmSettings.tempTarget, "", true)
+            ->check(CLI::Range(0, 100));
+
+        app.add_option("--gpu-cores", m_FarmSettings.gpuThreads.cores, "");
+        app.add_option("--gpu-nice", m_FarmSettings.gpuThreads.nice, "", true)
+            ->check(CLI::Range(-20, 19));
+        app.add_option("--gpu-fifo", m_FarmSettings.gpuThreads.fifo, "", true)
+            ->check(CLI::Range(0, 99));
+        app.add_flag("--gpu-numa", m_FarmSettings.gpuNumaLocal, "");
+        app.add_option("--io-cores", m_ioThreadPolicy.cores, "");
+        app.add_option("--io-nice", m_ioThreadPolicy.nice, "", true)->check(CLI::Range(-20, 19));
+        app.add_option("--io-fifo", m_ioThreadPolicy.fifo, "", true)->check(CLI::Range(0, 99));
+
 
         // Exception handling is held at higher level
         app.parse(argc, argv);
@@ -389,6 +505,11 @@ public:
             return false;
         }
 
+#if ETH_ETHASHCL
+        m_CLSettings.globalWorkSet = app.count("--cl-global-work") > 0;
+        m_CLSettings.localWorkSet = app.count("--cl-local-work") > 0;
+#endif
+
 
 #ifndef DEV_BUILD
 
@@ -419,13 +540,17 @@ public:
             Operation mode Stratum or GetWork do need at least one
         */
 
-        if (sim_opt->count())
+        if (sim_opt->count() || replay_opt->count())
         {
             m_mode = OperationMode::Simulation;
             pools.clear();
             m_PoolSettings.connections.push_back(
                 std::shared_ptr<URI>(new URI("simulation://localhost:0", true)));
         }
+        else if (m_proxy_port)
+        {
+            m_mode = OperationMode::Proxy;
+        }
         else
         {
             m_mode = OperationMode::Mining;
@@ -470,6 +595,9 @@ public:
         }
 
 
+        MinerProfile::setFile(tuneProfile);
+        DagCache::setDirectory(dagCacheDir);
+
 #if ETH_ETHASHCUDA
         if (sched == "auto")
             m_CUSettings.schedule = 0;
@@ -479,6 +607,24 @@ public:
             m_CUSettings.schedule = 2;
         else if (sched == "sync")
             m_CUSettings.schedule = 4;
+
+        if (dagAccess == "plain")
+            m_CUSettings.dagAccess = 0;
+        else if (dagAccess == "ldg")
+            m_CUSettings.dagAccess = 1;
+        else if (dagAccess == "l2persist")
+            m_CUSettings.dagAccess = 2;
+#endif
+
+#if ETH_ETHASHCPU
+        if (hugePages == "off")
+            m_CPSettings.hugePages = 0;
+        else if (hugePages == "thp")
+            m_CPSettings.hugePages = 1;
+        else if (hugePages == "2m")
+            m_CPSettings.hugePages = 2;
+        else if (hugePages == "1g")
+            m_CPSettings.hugePages = 3;
 #endif
 
         if (m_FarmSettings.tempStop)
@@ -492,6 +638,12 @@ public:
             }
         }
 
+        // Governor needs readings of what it controls
+        if (m_FarmSettings.powerCap)
+            m_FarmSettings.hwMon = 2;
+        else if (m_FarmSettings.tempTarget)
+            m_FarmSettings.hwMon = std::max((unsigned int)m_FarmSettings.hwMon, 1U);
+
         // Output warnings if any
         if (warnings.size())
         {
@@ -507,18 +659,59 @@ public:
 
     void execute()
     {
+        // A proxy does not mine : no device is needed
+        if (m_mode == OperationMode::Proxy)
+        {
+            run();
+            return;
+        }
+
+        // Backends are probed concurrently (driver initialization may take
+        // seconds each). CUDA entries are merged over OpenCL ones afterwards
+        // as if they had been enumerated in sequence
+        auto enumStart = std::chrono::steady_clock::now();
+        auto msSince = [](std::chrono::steady_clock::time_point _since) {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - _since)
+                .count();
+        };
+        std::stringstream enumTimes;
+#if ETH_ETHASHCUDA
+        std::map<string, DeviceDescriptor> cuDevices;
+        std::future<int64_t> cuEnum;
+        if (m_minerType == MinerType::CUDA || m_minerType == MinerType::Mixed)
+            cuEnum = std::async(std::launch::async, [&cuDevices, &msSince]() {
+                auto start = std::chrono::steady_clock::now();
+                CUDAMiner::enumCudaDevices(cuDevices);
+                return msSince(start);
+            });
+#endif
 #if ETH_ETHASHCL
         if (m_minerType == MinerType::CL || m_minerType == MinerType::Mixed)
+        {
+            auto start = std::chrono::steady_clock::now();
             CLMiner::enumDevices(m_DevicesCollection);
+            enumTimes << ", OpenCL " << msSince(start) << " ms";
+        }
 #endif
 #if ETH_ETHASHCUDA
-        if (m_minerType == MinerType::CUDA || m_minerType == MinerType::Mixed)
-            CUDAMiner::enumDevices(m_DevicesCollection);
+        if (cuEnum.valid())
+        {
+            enumTimes << ", CUDA " << cuEnum.get() << " ms";
+            CUDAMiner::mergeDevices(cuDevices, m_DevicesCollection);
+        }
 #endif
 #if ETH_ETHASHCPU
         if (m_minerType == MinerType::CPU)
-            CPUMiner::enumDevices(m_DevicesCollection);
+        {
+            auto start = std::chrono::steady_clock::now();
+            CPUMiner::enumDevices(m_DevicesCollection, m_CPSettings);
+            enumTimes << ", CPU " << msSince(start) << " ms";
+        }
 #endif
+        if (!m_shouldListDevices && enumTimes.tellp() > 0)
+            cnote << "Devices enumerated in " << msSince(enumStart) << " ms ("
+                  << enumTimes.str().substr(2) << ")";
 
         // Can't proceed without any GPU
         if (!m_DevicesCollection.size())
@@ -741,6 +934,11 @@ public:
         if (!subscribedDevices)
             throw std::runtime_error("No mining device selected. Aborting ...");
 
+        run();
+    }
+
+    void run()
+    {
         // Enable
         g_running = true;
 
@@ -751,6 +949,10 @@ public:
         signal(SIGINT, MinerCLI::signalHandler);
         signal(SIGTERM, MinerCLI::signalHandler);
 
+        // The io service thread is running since construction
+        if (!m_ioThreadPolicy.empty())
+            g_io_service.post([this]() { applyThreadPolicy(m_ioThreadPolicy); });
+
         // Initialize Farm
         new Farm(m_DevicesCollection, m_FarmSettings, m_CUSettings, m_CLSettings, m_CPSettings);
 
@@ -846,6 +1048,37 @@ public:
                  << "    -Z,--simulation     UINT [0 ..] Default not set" << endl
                  << "                        Mining test. Used to test hashing speed." << endl
                  << "                        Specify the block number to test on." << endl
+                 << endl
+                 << "    --bench-job-interval UINT [0 .. 3600000] Default = 0" << endl
+                 << "                        Milliseconds between new jobs. 0 keeps the" << endl
+                 << "                        first job for the whole test" << endl
+                 << endl
+                 << "    --bench-difficulty  FLOAT Default = 1" << endl
+                 << "                        Difficulty of the test jobs" << endl
+                 << endl
+                 << "    --bench-epoch-interval UINT [0 .. 86400] Default = 0" << endl
+                 << "                        Seconds before moving to the next epoch. Each" << endl
+                 << "                        move forces a new DAG build. 0 = one epoch" << endl
+                 << endl
+                 << "    --bench-duration    UINT [0 .. 604800] Default = 0" << endl
+                 << "                        Seconds the test lasts before ethminer exits." << endl
+                 << "                        0 = until interrupted" << endl
+                 << endl
+                 << "    --bench-report      FILE Default not set" << endl
+                 << "                        Writes the results as JSON into FILE when the" << endl
+                 << "                        test ends : max, mean and effective hashrate," << endl
+                 << "                        solutions found vs expected, DAG build times" << endl
+                 << "                        and job switch latency" << endl
+                 << endl
+                 << "    --replay            FILE Default not set" << endl
+                 << "                        Mining test. Replays the jobs of a capture" << endl
+                 << "                        (see --capture) with their original timing" << endl
+                 << "                        and reports solutions, stale ratio and job" << endl
+                 << "                        switch latency when the capture is over" << endl
+                 << endl
+                 << "    --replay-speed      FLOAT [0.01 .. 1000] Default = 1" << endl
+                 << "                        Speed factor of the replay. 2 replays twice" << endl
+                 << "                        as fast as the capture was taken" << endl
                  << endl;
         }
 
@@ -902,7 +1135,32 @@ public:
                  << "    --cl-nobin          FLAG" << endl
                  << "                        Use openCL kernel. Do not load binary kernel" << endl
                  << "    --cl-noexit         FLAG" << endl
-                 << "                        Don't use fast exit algorithm" << endl;
+                 << "                        Don't use fast exit algorithm" << endl
+                 << "    --cl-streams        INT [1 .. 16] Default = 2" << endl
+                 << "                        Set the number of command queues used to overlap"
+                 << endl
+                 << "                        kernel runs and results read back" << endl
+                 << "    --cl-autotune       FLAG" << endl
+                 << "                        Sweep local work size, fast exit and global work"
+                 << endl
+                 << "                        size on each device and store the best values in"
+                 << endl
+                 << "                        the tuning profile (see --tune-profile). Stored"
+                 << endl
+                 << "                        values are loaded automatically on later runs"
+                 << endl
+                 << "    --cl-nocache        FLAG" << endl
+                 << "                        Always build the OpenCL kernel from source." << endl
+                 << "                        Do not load nor store compiled programs" << endl
+                 << "    --cl-cache-dir      TEXT Default = '<home>/.ethminer/cl-cache'" << endl
+                 << "                        Directory compiled OpenCL programs are cached in"
+                 << endl
+                 << "    --cl-light-gen      FLAG" << endl
+                 << "                        Build the light cache on device from the epoch"
+                 << endl
+                 << "                        seed. Checked against the host one when there is"
+                 << endl
+                 << "                        one; with --noeval the host builds none" << endl;
         }
 
         if (ctx == "cu")
@@ -923,6 +1181,15 @@ public:
                  << endl
                  << "    --cu-parallel-hash  UINT {1,2,4,8} Default = 4" << endl
                  << "                        Set the number of hashes per kernel" << endl
+                 << "    --cu-dag-access     TEXT {plain,ldg,l2persist} Default = 'plain'" << endl
+                 << "                        Set how the search kernel reads the DAG" << endl
+                 << "                        'plain'     Regular global memory loads" << endl
+                 << "                        'ldg'       Loads through the read-only data cache"
+                 << endl
+                 << "                        'l2persist' Regular loads with an L2 persisting"
+                 << endl
+                 << "                                    window over the DAG (Compute 8.0+)"
+                 << endl
                  << "    --cu-streams        INT [1 .. 99] Default = 2" << endl
                  << "                        Set the number of streams per GPU" << endl
                  << "    --cu-schedule       TEXT Default = 'sync'" << endl
@@ -951,6 +1218,43 @@ public:
                     "results"
                  << endl
                  << "                                from the device" << endl
+                 << "    --cu-dag-prefetch   FLAG" << endl
+                 << "                        Generate next epoch's DAG in background while"
+                 << endl
+                 << "                        mining if the GPU has enough spare memory" << endl
+                 << "    --cu-event-loop     FLAG" << endl
+                 << "                        Relaunch each stream as soon as it completes instead"
+                 << endl
+                 << "                        of waiting for streams in order" << endl
+                 << "    --cu-noexit         FLAG" << endl
+                 << "                        Don't use fast exit algorithm" << endl
+                 << "    --cu-jit            FLAG" << endl
+                 << "                        Compile at runtime a search kernel specialized"
+                 << endl
+                 << "                        for current epoch. Falls back to built-in kernel"
+                 << endl
+                 << "                        on failure" << endl
+                 << "    --cu-graphs         FLAG" << endl
+                 << "                        Relaunch batches of built-in kernel through CUDA"
+                 << endl
+                 << "                        graphs updated in place (requires CUDA 10.1)"
+                 << endl
+                 << "    --cu-light-gen      FLAG" << endl
+                 << "                        Build the light cache on device from the epoch"
+                 << endl
+                 << "                        seed. Checked against the host one when there is"
+                 << endl
+                 << "                        one; with --noeval the host builds none" << endl
+                 << "    --cu-autotune       FLAG" << endl
+                 << "                        Sweep grid size, block size, kernel variant"
+                 << endl
+                 << "                        (parallel hash, dag access) and streams on each"
+                 << endl
+                 << "                        device and store the best values in the tuning"
+                 << endl
+                 << "                        profile (see --tune-profile). Stored values are"
+                 << endl
+                 << "                        loaded automatically on later runs" << endl
                  << endl;
         }
 
@@ -965,6 +1269,40 @@ public:
                  << "                        Space separated list of device indexes to use" << endl
                  << "                        eg --cp-devices 0 2 3" << endl
                  << "                        If not set all available CPUs will be used" << endl
+                 << "    --cp-engine         TEXT {auto,avx512,avx2,generic,scalar} Default = 'scalar'"
+                 << endl
+                 << "                        Hashing engine. 'scalar' uses ethash::search over"
+                 << endl
+                 << "                        ethash's lazily built dataset. Multi lane engines"
+                 << endl
+                 << "                        hash several nonces at a time over a fully built"
+                 << endl
+                 << "                        dataset. 'auto' picks the best one the CPU supports"
+                 << endl
+                 << "    --cp-numa           FLAG Build one dataset replica per NUMA node" << endl
+                 << "                        Each miner uses the replica local to the cpu" << endl
+                 << "                        it is bound to" << endl
+                 << "    --cp-hugepages      TEXT {off,thp,2m,1g} Default = 'thp'" << endl
+                 << "                        Pages backing the dataset. 'thp' advises transparent"
+                 << endl
+                 << "                        huge pages. '2m' and '1g' need huge pages reserved"
+                 << endl
+                 << "                        (vm.nr_hugepages) and fall back to smaller ones" << endl
+                 << "    --cp-placement      TEXT {logical,cores} Default = 'logical'" << endl
+                 << "                        Cpus miners are bound to. 'logical' uses all" << endl
+                 << "                        allowed cpus, 'cores' one per physical core" << endl
+                 << "                        so SMT siblings don't compete for memory" << endl
+                 << "                        bandwidth" << endl
+                 << "                        Only cpus in the process affinity mask (cpuset)"
+                 << endl
+                 << "                        are used" << endl
+                 << "    --cp-reserve        UINT Default = 0" << endl
+                 << "                        Number of physical cores (with their siblings)"
+                 << endl
+                 << "                        left free for GPU host threads and network" << endl
+                 << "    --cp-cores          UINT {} Default not set" << endl
+                 << "                        Space separated list of cpus to bind to" << endl
+                 << "                        Overrides --cp-placement and --cp-reserve" << endl
                  << endl;
         }
 
@@ -982,6 +1320,9 @@ public:
                  << endl
                  << "                        Value expressed in milliseconds" << endl
                  << "                        It has no meaning in stratum mode" << endl
+                 << "    --farm-longpoll     FLAG Hold a getWork request open for new work on" << endl
+                 << "                        nodes advertising X-Long-Polling. Regular polls" << endl
+                 << "                        go on over the persistent connection" << endl
                  << "    --farm-retries      INT[1 .. 99999] Default = 3" << endl
                  << "                        Set number of reconnection retries to same pool"
                  << endl
@@ -993,6 +1334,29 @@ public:
                  << "                        reconnect to the primary (the first) connection."
                  << endl
                  << "                        before switching to a fail-over connection" << endl
+                 << "    --pool-standby      INT[0 .. 8] Default = 0" << endl
+                 << "                        Number of pools following the active one kept"
+                 << endl
+                 << "                        connected and authorized in background. On" << endl
+                 << "                        failure mining switches to the first of them" << endl
+                 << "                        without waiting for a new connection" << endl
+                 << "    --pool-latency      INT[0 .. 3600] Default = 0" << endl
+                 << "                        Seconds between round trip probes of all the" << endl
+                 << "                        addresses pools resolve to. When set ethminer" << endl
+                 << "                        connects to the nearest addresses first and" << endl
+                 << "                        switches to a pool found clearly nearer than" << endl
+                 << "                        the active one" << endl
+                 << "    --proxy-port        INT[1 .. 65535] Default not set" << endl
+                 << "                        Do not mine : serve the pool's work to other" << endl
+                 << "                        miners connecting to this port with" << endl
+                 << "                        EthereumStratum/1.0.0 (stratum2+tcp://)." << endl
+                 << "                        All of them share the connection to the pool" << endl
+                 << "                        each within its own extranonce" << endl
+                 << "    --proxy-address     IP Default = 0.0.0.0" << endl
+                 << "                        Address the proxy listens on" << endl
+                 << "    --capture           FILE Default not set" << endl
+                 << "                        Records every line exchanged with pools and" << endl
+                 << "                        its timing into FILE. See --replay" << endl
                  << "    --work-timeout      INT[180 .. 99999] Default = 180" << endl
                  << "                        If no new work received from pool after this" << endl
                  << "                        amount of time the connection is dropped" << endl
@@ -1007,6 +1371,10 @@ public:
                  << "                        0 No monitoring" << endl
                  << "                        1 Monitor temperature and fan percentage" << endl
                  << "                        2 As 1 plus monitor power drain" << endl
+                 << "    --hwmon-interval    INT[500 .. 60000] Default = 2000" << endl
+                 << "                        Milliseconds between readings of GPU sensors."
+                 << endl
+                 << "                        Sensors are read on a dedicated thread" << endl
                  << "    --exit              FLAG Stop ethminer whenever an error is encountered"
                  << endl
                  << "    --ergodicity        INT[0 .. 2] Default = 0" << endl
@@ -1018,6 +1386,10 @@ public:
                     "connection"
                  << endl
                  << "                        2 A search segment is picked on every new job" << endl
+                 << "    --nonce-weighting   FLAG Size nonce segments of devices after their"
+                 << endl
+                 << "                        hashrates instead of giving them equal ones"
+                 << endl
                  << endl
                  << "    --nocolor           FLAG Monochrome display log lines" << endl
                  << "    --syslog            FLAG Use syslog appropriate output (drop timestamp "
@@ -1025,19 +1397,60 @@ public:
                  << endl
                  << "                        channel prefix)" << endl
                  << "    --stdout            FLAG Log to stdout instead of stderr" << endl
+                 << "    --log-async         FLAG Output log lines from a dedicated thread so" << endl
+                 << "                        slow consoles never stall mining. Lines are" << endl
+                 << "                        dropped (and counted) if it can't keep up" << endl
                  << "    --noeval            FLAG By-pass host software re-evaluation of GPUs"
                  << endl
                  << "                        found nonces. Trims some ms. from submission" << endl
                  << "                        time but it may increase rejected solution rate."
                  << endl
+                 << "    --verify-threads    INT[1 .. 16] Default = 2" << endl
+                 << "                        Threads re-evaluating found nonces, apart from"
+                 << endl
+                 << "                        the one handling network connections" << endl
                  << "    --list-devices      FLAG Lists the detected OpenCL/CUDA devices and "
                     "exits"
                  << endl
                  << "                        Must be combined with -G or -U or -X flags" << endl
-                 << "    -L,--dag-load-mode  INT[0 .. 1] Default = 0" << endl
+                 << "    -L,--dag-load-mode  INT[0 .. 2] Default = 0" << endl
                  << "                        Set DAG load mode. Can be one of:" << endl
                  << "                        0 Parallel load mode (each GPU independently)" << endl
                  << "                        1 Sequential load mode (one GPU after another)" << endl
+                 << "                        2 Single build mode (one CUDA GPU builds the DAG" << endl
+                 << "                          and the others copy it peer to peer or" << endl
+                 << "                          through host memory)" << endl
+                 << "    --epoch-overlap     FLAG With load mode 0, let CUDA miners build the"
+                 << endl
+                 << "                        new DAG in background on epoch changes and hash"
+                 << endl
+                 << "                        previous epoch's last job meanwhile. By default"
+                 << endl
+                 << "                        all miners stop till they get their new DAG"
+                 << endl
+                 << "    --tune-profile      TEXT Default = '<home>/.ethminer/profile.json'" << endl
+                 << "                        File where per device tuning results are stored"
+                 << endl
+                 << "    --dag-cache-dir     TEXT Default not set" << endl
+                 << "                        Directory where light caches and CPU datasets are"
+                 << endl
+                 << "                        stored once per epoch and memory mapped on later"
+                 << endl
+                 << "                        starts. Disabled if not set" << endl
+                 << "    --epoch-cache-mem   UINT Default = 0" << endl
+                 << "                        Megabytes of host memory light caches and CPU"
+                 << endl
+                 << "                        datasets of past epochs may take. Least recently"
+                 << endl
+                 << "                        used ones are released beyond. Unbounded if 0"
+                 << endl
+                 << "    --stale-drop        UINT[0 .. 2] Default = 0" << endl
+                 << "                        Solutions of stale jobs not submitted to pool" << endl
+                 << "                        0 Submit them all" << endl
+                 << "                        1 Drop those of jobs the pool declared invalid"
+                 << endl
+                 << "                          (clean_jobs flag or reconnection)" << endl
+                 << "                        2 Drop those of any superseded job" << endl
                  << endl
                  << "    --tstart            UINT[30 .. 100] Default = 0" << endl
                  << "                        Suspend mining on GPU which temperature is above"
@@ -1051,6 +1464,43 @@ public:
                  << endl
                  << "                        drops below this threshold. Implies --HWMON 1" << endl
                  << "                        Must be lower than --tstart" << endl
+                 << "    --power-cap         UINT[0 .. 1000] Default = 0" << endl
+                 << "                        Watts each GPU should stay below. Mining is"
+                 << endl
+                 << "                        duty cycled (idle between kernels) to meet it."
+                 << endl
+                 << "                        Implies --HWMON 2. If zero no cap is applied"
+                 << endl
+                 << "    --temp-target       UINT[0 .. 100] Default = 0" << endl
+                 << "                        Temperature each GPU should stay below, by duty"
+                 << endl
+                 << "                        cycling as above. Set it below --tstart to avoid"
+                 << endl
+                 << "                        hard suspensions. Implies --HWMON 1" << endl
+                 << "    --gpu-cores         UINT {} Default not set" << endl
+                 << "                        Cpus CUDA and OpenCL host threads may run on"
+                 << endl
+                 << "    --gpu-nice          INT[-20 .. 19] Default = 0" << endl
+                 << "                        Nice value of GPU host threads (on Windows"
+                 << endl
+                 << "                        negative raises and positive lowers priority)"
+                 << endl
+                 << "    --gpu-fifo          UINT[0 .. 99] Default = 0" << endl
+                 << "                        Run GPU host threads with this real-time"
+                 << endl
+                 << "                        SCHED_FIFO priority (time critical on Windows)."
+                 << endl
+                 << "                        Needs privileges. If zero normal scheduling"
+                 << endl
+                 << "    --gpu-numa          FLAG Run each GPU host thread on the cpus of the"
+                 << endl
+                 << "                        NUMA node its GPU is attached to (Linux)" << endl
+                 << "    --io-cores          UINT {} Default not set" << endl
+                 << "    --io-nice           INT[-20 .. 19] Default = 0" << endl
+                 << "    --io-fifo           UINT[0 .. 99] Default = 0" << endl
+                 << "                        Same as above for the thread handling network"
+                 << endl
+                 << "                        connections and the api" << endl
                  << "    -v,--verbosity      INT[0 .. 255] Default = 0 " << endl
                  << "                        Set output verbosity level. Use the sum of :" << endl
                  << "                        1   to log stratum json messages" << endl
@@ -1211,6 +1661,13 @@ public:
 private:
     void doMiner()
     {
+        std::unique_ptr<StratumProxy> proxy;
+        if (m_mode == OperationMode::Proxy)
+        {
+            proxy.reset(new StratumProxy(m_proxy_address, m_proxy_port));
+            if (!proxy->start())
+                throw std::runtime_error("Unable to start stratum proxy. Aborting ...");
+        }
 
         new PoolManager(m_PoolSettings);
         if (m_mode != OperationMode::Simulation)
@@ -1248,12 +1705,17 @@ private:
         if (PoolManager::p().isRunning())
             PoolManager::p().stop();
 
+        // Once PoolManager no longer gives it work
+        if (proxy)
+            proxy->stop();
+
         cnote << "Terminated!";
         return;
     }
 
     // Global boost's io_service
     std::thread m_io_thread;                        // The IO service thread
+    ThreadPolicy m_ioThreadPolicy;                  // How the IO service thread is scheduled
     boost::asio::deadline_timer m_cliDisplayTimer;  // The timer which ticks display lines
     boost::asio::io_service::strand m_io_strand;    // A strand to serialize posts in
                                                     // multithreaded environment
@@ -1280,6 +1742,10 @@ private:
     unsigned m_cliDisplayInterval =
         5;  // Display stats/info on cli interface every this number of seconds
 
+    // -- Proxy mode related params
+    unsigned m_proxy_port = 0;            // Listening port of the stratum proxy (0 = mine)
+    string m_proxy_address = "0.0.0.0";  // Listening address of the stratum proxy
+
     // -- CLI Flow control
     mutex m_climtx;
 
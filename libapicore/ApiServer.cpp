@@ -1,5 +1,7 @@
 #include "ApiServer.h"
 
+#include <climits>
+
 #include <ethminer/buildinfo.h>
 
 #include <libethcore/Farm.h>
@@ -222,11 +224,125 @@ static bool parseRequestId(Json::Value& jRequest, Json::Value& jResponse)
     return false;
 }
 
+static Json::Value getLatencyJson(const LatencyHistogram::Snapshot& _latency)
+{
+    Json::Value jRes;
+    jRes["count"] = (Json::UInt64)_latency.count;
+    jRes["mean_us"] = (Json::UInt64)_latency.mean();
+    jRes["p50_us"] = (Json::UInt64)_latency.percentile(0.5);
+    jRes["p90_us"] = (Json::UInt64)_latency.percentile(0.9);
+    jRes["p99_us"] = (Json::UInt64)_latency.percentile(0.99);
+    jRes["max_us"] = (Json::UInt64)_latency.max;
+    return jRes;
+}
+
+static Json::Value getLatencyJson(const TelemetryAccountType& _account)
+{
+    Json::Value jRes;
+    jRes["switch"] = getLatencyJson(_account.switchLatency);
+    jRes["submit"] = getLatencyJson(_account.submitLatency);
+    jRes["accept"] = getLatencyJson(_account.acceptLatency);
+    return jRes;
+}
+
+// Events which can be subscribed to (see miner_subscribe)
+static const char* const c_apiEvents[] = {"solution", "pool", "epoch", "dag", "pause"};
+
+// How often the state is sampled to raise events
+static const unsigned c_eventSamplingMs = 250;
+
+/*
+ * Prometheus text exposition helpers
+ */
+static std::string promLabel(const std::string& _value)
+{
+    std::string ret;
+    ret.reserve(_value.size());
+    for (char c : _value)
+    {
+        if (c == '\\' || c == '"')
+            ret.push_back('\\');
+        if (c == '\n')
+            ret.append("\\n");
+        else
+            ret.push_back(c);
+    }
+    return ret;
+}
+
+static void promFamily(
+    std::ostream& _out, const char* _name, const char* _type, const char* _help)
+{
+    _out << "# HELP " << _name << " " << _help << "\n"
+         << "# TYPE " << _name << " " << _type << "\n";
+}
+
+static void promHistogram(std::ostream& _out, const char* _name, const std::string& _labels,
+    const LatencyHistogram::Snapshot& _latency)
+{
+    // Internal buckets are folded to powers of 2 from ~1ms to ~67s
+    // so each series has a reasonable number of buckets
+    std::string sep = _labels.empty() ? "" : ",";
+    uint64_t cumulated = 0;
+    for (unsigned i = 0; i + 1 < LatencyHistogram::Buckets; i++)
+    {
+        cumulated += _latency.buckets[i];
+        uint64_t upper = LatencyHistogram::upperBound(i);
+        if (upper < (1 << 10) || (upper & (upper - 1)))
+            continue;
+        _out << _name << "_bucket{" << _labels << sep << "le=\"" << upper / 1e6 << "\"} "
+             << cumulated << "\n";
+        if (upper >= (1 << 26))
+            break;
+    }
+    _out << _name << "_bucket{" << _labels << sep << "le=\"+Inf\"} " << _latency.count << "\n"
+         << _name << "_sum{" << _labels << "} " << _latency.total / 1e6 << "\n"
+         << _name << "_count{" << _labels << "} " << _latency.count << "\n";
+}
+
+static Json::Value getHistoryJson(const HashrateHistory& _history, unsigned _samples)
+{
+    Json::Value jRes;
+    jRes["ema_1m"] = _history.ema1m();
+    jRes["ema_15m"] = _history.ema15m();
+    jRes["ema_1h"] = _history.ema1h();
+    jRes["p5"] = _history.percentile(0.05);
+    jRes["p50"] = _history.percentile(0.5);
+    jRes["p95"] = _history.percentile(0.95);
+
+    if (_samples)
+    {
+        Json::Value jSamples = Json::Value(Json::arrayValue);
+        std::vector<HashrateSample> samples = _history.samples();
+        size_t first = samples.size() > _samples ? samples.size() - _samples : 0;
+        for (size_t i = first; i < samples.size(); i++)
+        {
+            const HashrateSample& sample = samples[i];
+            Json::Value jSample = Json::Value(Json::arrayValue);
+            jSample.append((Json::UInt64)sample.tstamp);
+            jSample.append(sample.hashrate);
+            jSample.append((Json::UInt64)sample.hashes);
+            jSample.append(sample.accepted);
+            jSample.append(sample.rejected);
+            jSample.append(sample.failed);
+            jSample.append(sample.tempC);
+            jSample.append(sample.powerW);
+            jSamples.append(jSample);
+        }
+        jRes["samples"] = jSamples;
+    }
+    return jRes;
+}
+
+ApiStatSnapshotPtr ApiServer::s_snapshot;
+std::atomic<uint64_t> ApiServer::s_snapshotVersion = {0};
+
 ApiServer::ApiServer(string address, int portnum, string password)
   : m_password(std::move(password)),
     m_address(address),
     m_acceptor(g_io_service),
-    m_io_strand(g_io_service)
+    m_io_strand(g_io_service),
+    m_eventTimer(g_io_service)
 {
     if (portnum < 0)
     {
@@ -270,6 +386,147 @@ void ApiServer::start()
           << (m_password.empty() ? "." : ". Authentication needed.");
     m_running.store(true, std::memory_order_relaxed);
     m_workThread = std::thread{boost::bind(&ApiServer::begin_accept, this)};
+
+    // Requests are served with what has been collected last
+    Farm::f().onTelemetryCollected(&ApiServer::publishSnapshot);
+
+    m_eventTimer.expires_from_now(boost::posix_time::milliseconds(c_eventSamplingMs));
+    m_eventTimer.async_wait(m_io_strand.wrap(
+        boost::bind(&ApiServer::sampleEvents, this, boost::asio::placeholders::error)));
+}
+
+void ApiServer::sampleEvents(const boost::system::error_code& ec)
+{
+    if (ec || !isRunning())
+        return;
+
+    // Nothing to do (not even keeping state) till someone subscribes
+    bool any = false;
+    for (auto const& session : m_sessions)
+        any |= session->subscribed();
+
+    if (any)
+    {
+        auto now = std::chrono::steady_clock::now();
+
+        /* Sample state under each event key */
+        std::map<std::string, Json::Value> state;
+        {
+            Json::Value jPool;
+            auto connection = PoolManager::p().getActiveConnection();
+            jPool["uri"] = connection ? connection->str() : "";
+            jPool["connected"] = PoolManager::p().isConnected();
+            jPool["switches"] = PoolManager::p().getConnectionSwitches();
+            state["pool"] = jPool;
+
+            Json::Value jEpoch;
+            jEpoch["epoch"] = PoolManager::p().getCurrentEpoch();
+            jEpoch["changes"] = PoolManager::p().getEpochChanges();
+            state["epoch"] = jEpoch;
+        }
+        auto const& telemetry = Farm::f().Telemetry();
+        for (auto const& miner : Farm::f().getMiners())
+        {
+            unsigned i = miner->Index();
+            std::string suffix = "." + std::to_string(i);
+
+            if (i < telemetry.miners.size())
+            {
+                auto const& solutions = telemetry.miners[i].solutions;
+                Json::Value jSolution;
+                jSolution["_index"] = i;
+                jSolution["accepted"] = solutions.accepted;
+                jSolution["rejected"] = solutions.rejected;
+                jSolution["wasted"] = solutions.wasted;
+                jSolution["failed"] = solutions.failed;
+                jSolution["dropped"] = solutions.dropped;
+                jSolution["stale"] = solutions.stale;
+                state["solution" + suffix] = jSolution;
+            }
+
+            Json::Value jDag;
+            jDag["_index"] = i;
+            jDag["epoch"] = miner->readyEpoch();
+            jDag["progress"] = miner->RetrieveDagProgress();
+            state["dag" + suffix] = jDag;
+
+            Json::Value jPause;
+            jPause["_index"] = i;
+            jPause["paused"] = miner->paused();
+            jPause["reason"] = miner->paused() ? miner->pausedString() : Json::Value::null;
+            state["pause" + suffix] = jPause;
+        }
+
+        /* Raise events on changes, but not on what is first seen */
+        Json::StreamWriterBuilder builder;
+        builder.settings_["indentation"] = "";
+        for (auto& kv : state)
+        {
+            auto it = m_eventState.find(kv.first);
+            if (it == m_eventState.end() || it->second == kv.second)
+                continue;
+
+            std::string event = kv.first.substr(0, kv.first.find('.'));
+            Json::Value jNotification;
+            jNotification["jsonrpc"] = "2.0";
+            jNotification["method"] = "miner_event";
+            jNotification["params"] = kv.second;
+            jNotification["params"]["event"] = event;
+            std::string line = Json::writeString(builder, jNotification) + "\n";
+            for (auto const& session : m_sessions)
+                if (session->subscribedTo(event))
+                    session->notify(kv.first, line);
+        }
+        m_eventState.swap(state);
+
+        /* Periodic telemetry */
+        std::string telemetry_line;
+        for (auto const& session : m_sessions)
+        {
+            if (!session->telemetryDue(now))
+                continue;
+            if (telemetry_line.empty())
+                telemetry_line = "{\"jsonrpc\":\"2.0\",\"method\":\"miner_telemetry\",\"params\":" +
+                                 ApiServer::snapshot()->detail + "}\n";
+            session->notifyTelemetry(now, telemetry_line);
+        }
+    }
+    else
+    {
+        m_eventState.clear();
+    }
+
+    m_eventTimer.expires_from_now(boost::posix_time::milliseconds(c_eventSamplingMs));
+    m_eventTimer.async_wait(m_io_strand.wrap(
+        boost::bind(&ApiServer::sampleEvents, this, boost::asio::placeholders::error)));
+}
+
+ApiStatSnapshotPtr ApiServer::snapshot()
+{
+    auto snapshot = std::atomic_load_explicit(&s_snapshot, std::memory_order_acquire);
+    if (!snapshot)
+    {
+        publishSnapshot();
+        snapshot = std::atomic_load_explicit(&s_snapshot, std::memory_order_acquire);
+    }
+    return snapshot;
+}
+
+void ApiServer::publishSnapshot()
+{
+    Json::StreamWriterBuilder builder;
+    builder.settings_["indentation"] = "";
+
+    Json::Value jDetail = ApiConnection::getMinerStatDetail();
+    auto snapshot = std::make_shared<ApiStatSnapshot>();
+    snapshot->version = s_snapshotVersion.fetch_add(1, std::memory_order_relaxed) + 1;
+    snapshot->stat1 = Json::writeString(builder, ApiConnection::getMinerStat1());
+    snapshot->detail = Json::writeString(builder, jDetail);
+    snapshot->html = ApiConnection::getHttpMinerStatDetail(jDetail);
+    snapshot->metrics = ApiConnection::getPrometheusMetrics();
+
+    std::atomic_store_explicit(
+        &s_snapshot, ApiStatSnapshotPtr(std::move(snapshot)), std::memory_order_release);
 }
 
 void ApiServer::stop()
@@ -280,6 +537,7 @@ void ApiServer::stop()
 
     m_acceptor.cancel();
     m_acceptor.close();
+    m_eventTimer.cancel();
     m_workThread.join();
     m_running.store(false, std::memory_order_relaxed);
 
@@ -449,12 +707,14 @@ void ApiConnection::processRequest(Json::Value& jRequest, Json::Value& jResponse
     cnote << "API : Method " << _method << " requested";
     if (_method == "miner_getstat1")
     {
-        jResponse["result"] = getMinerStat1();
+        auto snapshot = ApiServer::snapshot();
+        m_rawResult = std::shared_ptr<const std::string>(snapshot, &snapshot->stat1);
     }
 
     else if (_method == "miner_getstatdetail")
     {
-        jResponse["result"] = getMinerStatDetail();
+        auto snapshot = ApiServer::snapshot();
+        m_rawResult = std::shared_ptr<const std::string>(snapshot, &snapshot->detail);
     }
 
     else if (_method == "miner_shuffle")
@@ -494,7 +754,11 @@ void ApiConnection::processRequest(Json::Value& jRequest, Json::Value& jResponse
     else if (_method == "miner_getconnections")
     {
         // Returns a list of configured pools
-        jResponse["result"] = PoolManager::p().getConnectionsJson();
+        Json::Value jConnections = PoolManager::p().getConnectionsJson();
+        for (auto& jConn : jConnections)
+            jConn["latency"] = getLatencyJson(
+                PoolManager::p().getAcceptLatency(jConn["index"].asUInt()));
+        jResponse["result"] = jConnections;
     }
 
     else if (_method == "miner_addconnection")
@@ -713,6 +977,41 @@ void ApiConnection::processRequest(Json::Value& jRequest, Json::Value& jResponse
         }
     }
 
+    else if (_method == "miner_gethashratehistory")
+    {
+        // Optional device index and number of recent samples to report
+        Json::Value jRequestParams;
+        if (!getRequestValue("params", jRequestParams, jRequest, true, jResponse))
+            return;
+
+        unsigned index = UINT_MAX, samples = 0;
+        if (!getRequestValue("index", index, jRequestParams, true, jResponse))
+            return;
+        if (!getRequestValue("samples", samples, jRequestParams, true, jResponse))
+            return;
+
+        Json::Value jRes;
+        Json::Value jDevices = Json::Value(Json::arrayValue);
+        for (auto const& miner : Farm::f().getMiners())
+        {
+            if (index != UINT_MAX && miner->Index() != index)
+                continue;
+            Json::Value jDevice = getHistoryJson(*miner->hashrateHistory(), samples);
+            jDevice["_index"] = miner->Index();
+            jDevices.append(jDevice);
+        }
+        if (index != UINT_MAX && jDevices.empty())
+        {
+            jResponse["error"]["code"] = -422;
+            jResponse["error"]["message"] = "Index out of bounds";
+            return;
+        }
+        jRes["devices"] = jDevices;
+        if (index == UINT_MAX)
+            jRes["farm"] = getHistoryJson(*Farm::f().hashrateHistory(), samples);
+        jResponse["result"] = jRes;
+    }
+
     else if (_method == "miner_setverbosity")
     {
         if (!checkApiWriteAccess(m_readonly, jResponse))
@@ -738,6 +1037,60 @@ void ApiConnection::processRequest(Json::Value& jRequest, Json::Value& jResponse
         jResponse["result"] = true;
     }
 
+    else if (_method == "miner_subscribe")
+    {
+        // Optional telemetry interval (seconds) and list of events
+        Json::Value jRequestParams;
+        if (!getRequestValue("params", jRequestParams, jRequest, true, jResponse))
+            return;
+
+        unsigned interval = 0;
+        if (!getRequestValue("interval", interval, jRequestParams, true, jResponse))
+            return;
+
+        std::set<std::string> events;
+        if (jRequestParams.isMember("events"))
+        {
+            Json::Value jEvents = jRequestParams["events"];
+            if (!jEvents.isArray())
+            {
+                jResponse["error"]["code"] = -32602;
+                jResponse["error"]["message"] = "Invalid type of value 'events'";
+                return;
+            }
+            for (auto const& jEvent : jEvents)
+            {
+                std::string event = jEvent.isString() ? jEvent.asString() : "";
+                if (std::find_if(std::begin(c_apiEvents), std::end(c_apiEvents),
+                        [&event](const char* _e) { return event == _e; }) ==
+                    std::end(c_apiEvents))
+                {
+                    jResponse["error"]["code"] = -422;
+                    jResponse["error"]["message"] = "Unknown event '" + event + "'";
+                    return;
+                }
+                events.insert(event);
+            }
+        }
+        else
+        {
+            events.insert(std::begin(c_apiEvents), std::end(c_apiEvents));
+        }
+
+        m_subEvents.swap(events);
+        m_subInterval = std::chrono::seconds(interval);
+        m_subTelemetryDue = std::chrono::steady_clock::now();
+        jResponse["result"] = true;
+    }
+
+    else if (_method == "miner_unsubscribe")
+    {
+        m_subEvents.clear();
+        m_subInterval = std::chrono::milliseconds(0);
+        m_pendingNotifications.clear();
+        jResponse["result"] = true;
+    }
+
     else
     {
         // Any other method not found
@@ -805,7 +1158,7 @@ void ApiConnection::onRecvSocketDataCompleted(
             }
 
             // Do we support path ?
-            if (http_path != "/" && http_path != "/getstat1")
+            if (http_path != "/" && http_path != "/getstat1" && http_path != "/metrics")
             {
                 std::string what =
                     "The requested resource " + http_path + " not found on this server";
@@ -830,17 +1183,21 @@ void ApiConnection::onRecvSocketDataCompleted(
 
             std::stringstream ss;  // Builder of the response
 
-            if (http_method == "GET" && (http_path == "/" || http_path == "/getstat1"))
+            if (http_method == "GET")
             {
                 try
                 {
-                    std::string body = getHttpMinerStatDetail();
+                    auto snapshot = ApiServer::snapshot();
+                    bool metrics = (http_path == "/metrics");
+                    const std::string& body = metrics ? snapshot->metrics : snapshot->html;
                     ss.clear();
                     ss << http_ver << " "
                        << "200 Ok Error\r\n"
                        << "Server: " << ethminer_get_buildinfo()->project_name_with_version
                        << "\r\n"
-                       << "Content-Type: text/html; charset=utf-8\r\n"
+                       << "Content-Type: "
+                       << (metrics ? "text/plain; version=0.0.4" : "text/html")
+                       << "; charset=utf-8\r\n"
                        << "Content-Length: " << body.size() << "\r\n\r\n"
                        << body << "\r\n";
                 }
@@ -881,6 +1238,7 @@ void ApiConnection::onRecvSocketDataCompleted(
                         Json::Value jMsg;
                         Json::Value jRes;
                         Json::Reader jRdr;
+                        m_rawResult.reset();
                         if (jRdr.parse(line, jMsg))
                         {
                             try
@@ -890,6 +1248,7 @@ void ApiConnection::onRecvSocketDataCompleted(
                             }
                             catch (const std::exception& _ex)
                             {
+                                m_rawResult.reset();
                                 jRes = Json::Value();
                                 jRes["jsonrpc"] = "2.0";
                                 jRes["id"] = Json::Value::null;
@@ -934,27 +1293,78 @@ void ApiConnection::sendSocketData(Json::Value const& jReq, bool _disconnect)
 {
     if (!m_socket.is_open())
         return;
-    std::stringstream line;
-    line << Json::writeString(m_jSwBuilder, jReq) << std::endl;
-    sendSocketData(line.str(), _disconnect);
+    std::string line = Json::writeString(m_jSwBuilder, jReq);
+    if (m_rawResult)
+    {
+        // Shared results are already serialized : splice them in
+        // place of the closing brace (members are sorted, result is last)
+        line.pop_back();
+        line.append(",\"result\":").append(*m_rawResult).push_back('}');
+        m_rawResult.reset();
+    }
+    line.push_back('\n');
+    sendSocketData(line, _disconnect);
 }
 
 void ApiConnection::sendSocketData(std::string const& _s, bool _disconnect)
 {
     if (!m_socket.is_open())
         return;
+    m_outbound.append(_s);
+    m_disconnectAfterSend |= _disconnect;
+    flushSocketData();
+}
+
+void ApiConnection::notify(const std::string& _key, const std::string& _line)
+{
+    if (!m_socket.is_open())
+        return;
+
+    // A peer not reading fast enough only gets the latest of each
+    m_pendingNotifications[_key] = _line;
+    flushSocketData();
+}
+
+void ApiConnection::notifyTelemetry(
+    std::chrono::steady_clock::time_point _now, const std::string& _line)
+{
+    if (!telemetryDue(_now))
+        return;
+    m_subTelemetryDue = _now + m_subInterval;
+    notify("telemetry", _line);
+}
+
+void ApiConnection::flushSocketData()
+{
+    if (m_sending || !m_socket.is_open())
+        return;
+
+    // Notifications go after any response already queued
+    for (auto const& kv : m_pendingNotifications)
+        m_outbound.append(kv.second);
+    m_pendingNotifications.clear();
+    if (m_outbound.empty())
+        return;
+
     std::ostream os(&m_sendBuffer);
-    os << _s;
+    os << m_outbound;
+    m_outbound.clear();
+    m_sending = true;
 
     async_write(m_socket, m_sendBuffer,
         m_io_strand.wrap(boost::bind(&ApiConnection::onSendSocketDataCompleted, this,
-            boost::asio::placeholders::error, _disconnect)));
+            boost::asio::placeholders::error, m_disconnectAfterSend)));
 }
 
 void ApiConnection::onSendSocketDataCompleted(const boost::system::error_code& ec, bool _disconnect)
 {
+    m_sending = false;
     if (ec || _disconnect)
+    {
         disconnect();
+        return;
+    }
+    flushSocketData();
 }
 
 Json::Value ApiConnection::getMinerStat1()
@@ -1052,6 +1462,21 @@ Json::Value ApiConnection::getMinerStatDetailPerMiner(
 
     hwinfo["sensors"] = sensors;
 
+    // Extended sensors (0 when not reported by the device)
+    Json::Value clocks = Json::Value(Json::arrayValue);
+    clocks.append(_t.miners.at(_index).sensors.coreClock);
+    clocks.append(_t.miners.at(_index).sensors.memClock);
+    hwinfo["clocks"] = clocks;
+    hwinfo["memtemp"] = _t.miners.at(_index).sensors.memTempC;
+    hwinfo["throttle"] = toHex(_t.miners.at(_index).sensors.throttleReasons, HexPrefix::Add);
+
+    /* Efficiency governor */
+    Json::Value governor;
+    governor["duty"] = _t.miners.at(_index).duty;
+    governor["limit"] = _t.miners.at(_index).dutyLimit;
+    double powerW = _t.miners.at(_index).sensors.powerW;
+    governor["efficiency"] = (powerW > 0.0 ? _t.miners.at(_index).hashrate / powerW : 0.0);
+
     /* Mining Info */
     Json::Value mininginfo;
     Json::Value jshares = Json::Value(Json::arrayValue);
@@ -1066,14 +1491,25 @@ Json::Value ApiConnection::getMinerStatDetailPerMiner(
                                                              // share
 
     mininginfo["shares"] = jshares;
+    mininginfo["dropped"] = _t.miners.at(_index).solutions.dropped;
+    mininginfo["stale"] = _t.miners.at(_index).solutions.stale;
     mininginfo["paused"] = _miner->paused();
     mininginfo["pause_reason"] = _miner->paused() ? _miner->pausedString() : Json::Value::null;
+    mininginfo["dag_progress"] = _miner->RetrieveDagProgress();
+    mininginfo["dag_rate"] = (Json::UInt64)_miner->RetrieveDagRate();
+    mininginfo["latency"] = getLatencyJson(_t.miners.at(_index));
+    mininginfo["hashrate_stats"] = getHistoryJson(*_miner->hashrateHistory(), 0);
 
     /* Nonce infos */
-    auto segment_width = Farm::f().get_segment_width();
-    uint64_t gpustartnonce = Farm::f().get_nonce_scrambler() + ((uint64_t)_index << segment_width);
+    uint64_t gpustartnonce, segment_size;
+    if (!Farm::f().get_nonce_segment(_index, gpustartnonce, segment_size))
+    {
+        auto segment_width = Farm::f().get_segment_width();
+        gpustartnonce = Farm::f().get_nonce_scrambler() + ((uint64_t)_index << segment_width);
+        segment_size = uint64_t(1) << segment_width;
+    }
     jsegment.append(toHex(uint64_t(gpustartnonce), HexPrefix::Add));
-    jsegment.append(toHex(uint64_t(gpustartnonce + (1LL << segment_width)), HexPrefix::Add));
+    jsegment.append(toHex(uint64_t(gpustartnonce + segment_size), HexPrefix::Add));
     mininginfo["segment"] = jsegment;
 
     /* Hash & Share infos */
@@ -1081,13 +1517,13 @@ Json::Value ApiConnection::getMinerStatDetailPerMiner(
 
     jRes["hardware"] = hwinfo;
     jRes["mining"] = mininginfo;
+    jRes["governor"] = governor;
 
     return jRes;
 }
 
-std::string ApiConnection::getHttpMinerStatDetail()
+std::string ApiConnection::getHttpMinerStatDetail(const Json::Value& jStat)
 {
-    Json::Value jStat = getMinerStatDetail();
     uint64_t durationSeconds = jStat["host"]["runtime"].asUInt64();
     int hours = (int)(durationSeconds / 3600);
     durationSeconds -= (hours * 3600);
@@ -1229,6 +1665,19 @@ Json::Value ApiConnection::getMinerStatDetail()
             hostinfo["name"] = Json::Value::null;
     }
 
+    {
+        // Host memory taken by light caches and CPU datasets
+        auto cache = EpochManager::m().stats();
+        Json::Value cacheinfo;
+        cacheinfo["contexts"] = cache.contexts;
+        cacheinfo["full_contexts"] = cache.fullContexts;
+        cacheinfo["cached"] = (Json::UInt64)cache.cached;
+        cacheinfo["resident"] = (Json::UInt64)cache.resident;
+        cacheinfo["budget"] = (Json::UInt64)cache.budget;
+        cacheinfo["evictions"] = (Json::UInt64)cache.evictions;
+        hostinfo["epoch_cache"] = cacheinfo;
+    }
+
 
     /* Connection info */
     Json::Value connectioninfo;
@@ -1236,6 +1685,8 @@ Json::Value ApiConnection::getMinerStatDetail()
     connectioninfo["uri"] = connection->str();
     connectioninfo["connected"] = PoolManager::p().isConnected();
     connectioninfo["switches"] = PoolManager::p().getConnectionSwitches();
+    auto connectionIdx = PoolManager::p().getActiveConnectionIdx();
+    connectioninfo["latency"] = getLatencyJson(PoolManager::p().getAcceptLatency(connectionIdx));
 
     /* Mining Info */
     Json::Value mininginfo;
@@ -1254,6 +1705,15 @@ Json::Value ApiConnection::getMinerStatDetail()
     sharesinfo.append(uint64_t(solution_lastupdated.count()));  // interval in seconds from last
                                                                 // found share
     mininginfo["shares"] = sharesinfo;
+    mininginfo["dropped"] = t.farm.solutions.dropped;
+    mininginfo["stale"] = t.farm.solutions.stale;
+
+    Json::Value verifyinfo;
+    verifyinfo["count"] = (Json::UInt64)Farm::f().getVerifyCount();
+    verifyinfo["time_us"] = (Json::UInt64)Farm::f().getVerifyTime();
+    mininginfo["verification"] = verifyinfo;
+    mininginfo["latency"] = getLatencyJson(t.farm);
+    mininginfo["hashrate_stats"] = getHistoryJson(*Farm::f().hashrateHistory(), 0);
 
     /* Monitors Info */
     Json::Value monitorinfo;
@@ -1279,3 +1739,203 @@ Json::Value ApiConnection::getMinerStatDetail()
 
     return jRes;
 }
+
+/**
+ * @brief Return the statistics in Prometheus text exposition format
+ *
+ * Served on http path /metrics so a scraper can be pointed straight at
+ * the api port. Like the other statistics it is only built once per
+ * telemetry collection.
+ */
+std::string ApiConnection::getPrometheusMetrics()
+{
+    TelemetryType t = Farm::f().Telemetry();
+    auto miners = Farm::f().getMiners();
+
+    std::vector<std::string> labels;
+    for (auto& miner : miners)
+    {
+        DeviceDescriptor d = miner->getDescriptor();
+        std::string name = (d.clDetected ? d.clName : d.cuName);
+        labels.push_back("device=\"" + std::to_string(miner->Index()) + "\",pci=\"" +
+                         promLabel(d.uniqueId) + "\",name=\"" + promLabel(name) + "\"");
+    }
+    auto perMiner = [&](std::function<void(const std::string&, const TelemetryAccountType&,
+                            std::shared_ptr<Miner>)>
+                            _f) {
+        for (size_t i = 0; i < miners.size() && i < t.miners.size(); i++)
+            _f(labels[i], t.miners[i], miners[i]);
+    };
+    static const std::pair<const char*, SolutionAccountingEnum> results[] = {
+        {"accepted", SolutionAccountingEnum::Accepted},
+        {"rejected", SolutionAccountingEnum::Rejected},
+        {"wasted", SolutionAccountingEnum::Wasted}, {"failed", SolutionAccountingEnum::Failed},
+        {"dropped", SolutionAccountingEnum::Dropped}};
+    auto shares = [](const SolutionAccountType& _s, SolutionAccountingEnum _r) {
+        switch (_r)
+        {
+        case SolutionAccountingEnum::Accepted:
+            return _s.accepted;
+        case SolutionAccountingEnum::Rejected:
+            return _s.rejected;
+        case SolutionAccountingEnum::Wasted:
+            return _s.wasted;
+        case SolutionAccountingEnum::Dropped:
+            return _s.dropped;
+        default:
+            return _s.failed;
+        }
+    };
+
+    std::ostringstream out;
+    out.precision(9);
+
+    promFamily(out, "ethminer_info", "gauge", "Version of the miner");
+    out << "ethminer_info{version=\""
+        << promLabel(ethminer_get_buildinfo()->project_name_with_version) << "\"} 1\n";
+    promFamily(out, "ethminer_uptime_seconds", "counter", "Time since mining started");
+    out << "ethminer_uptime_seconds "
+        << std::chrono::duration_cast<std::chrono::seconds>(
+               std::chrono::steady_clock::now() - t.start)
+               .count()
+        << "\n";
+
+    /* Farm */
+    promFamily(out, "ethminer_hashrate", "gauge", "Hashes per second of the whole farm");
+    out << "ethminer_hashrate " << t.farm.hashrate << "\n";
+    promFamily(out, "ethminer_shares_total", "counter", "Solutions of the farm by outcome");
+    for (auto& r : results)
+        out << "ethminer_shares_total{result=\"" << r.first << "\"} "
+            << shares(t.farm.solutions, r.second) << "\n";
+    promFamily(out, "ethminer_shares_stale_total", "counter",
+        "Solutions submitted for a job superseded meanwhile");
+    out << "ethminer_shares_stale_total " << t.farm.solutions.stale << "\n";
+    promFamily(out, "ethminer_work_switch_latency_seconds", "histogram",
+        "Time from work published to device searching it");
+    promHistogram(out, "ethminer_work_switch_latency_seconds", "", t.farm.switchLatency);
+    promFamily(out, "ethminer_solution_submit_latency_seconds", "histogram",
+        "Time from solution found to handed to the pool client");
+    promHistogram(out, "ethminer_solution_submit_latency_seconds", "", t.farm.submitLatency);
+    promFamily(out, "ethminer_solution_accept_latency_seconds", "histogram",
+        "Time from solution submitted to accepted by the pool");
+    promHistogram(out, "ethminer_solution_accept_latency_seconds", "", t.farm.acceptLatency);
+    promFamily(out, "ethminer_verifications_total", "counter", "Solutions verified on host");
+    out << "ethminer_verifications_total " << Farm::f().getVerifyCount() << "\n";
+
+    /* Pool */
+    auto connection = PoolManager::p().getActiveConnection();
+    std::string pool = "pool=\"" + promLabel(connection ? connection->Host() : "") + "\"";
+    promFamily(out, "ethminer_pool_connected", "gauge", "Whether the pool is connected");
+    out << "ethminer_pool_connected{" << pool << "} " << PoolManager::p().isConnected() << "\n";
+    promFamily(out, "ethminer_pool_switches_total", "counter", "Pool connection switches");
+    out << "ethminer_pool_switches_total " << PoolManager::p().getConnectionSwitches() << "\n";
+    promFamily(out, "ethminer_pool_difficulty", "gauge", "Current share difficulty");
+    out << "ethminer_pool_difficulty{" << pool << "} " << PoolManager::p().getCurrentDifficulty()
+        << "\n";
+    promFamily(out, "ethminer_pool_accept_latency_seconds", "histogram",
+        "Time from solution submitted to accepted by the active pool");
+    promHistogram(out, "ethminer_pool_accept_latency_seconds", pool,
+        PoolManager::p().getAcceptLatency(PoolManager::p().getActiveConnectionIdx()));
+
+    /* DAG */
+    promFamily(out, "ethminer_epoch", "gauge", "Current epoch");
+    out << "ethminer_epoch " << PoolManager::p().getCurrentEpoch() << "\n";
+    promFamily(out, "ethminer_epoch_changes_total", "counter", "Epoch changes");
+    out << "ethminer_epoch_changes_total " << PoolManager::p().getEpochChanges() << "\n";
+    promFamily(out, "ethminer_device_dag_epoch", "gauge", "Epoch of the DAG ready on device");
+    perMiner([&](const std::string& _l, const TelemetryAccountType&, std::shared_ptr<Miner> _m) {
+        out << "ethminer_device_dag_epoch{" << _l << "} " << _m->readyEpoch() << "\n";
+    });
+    promFamily(
+        out, "ethminer_device_dag_progress_percent", "gauge", "Progress of the last DAG build");
+    perMiner([&](const std::string& _l, const TelemetryAccountType&, std::shared_ptr<Miner> _m) {
+        out << "ethminer_device_dag_progress_percent{" << _l << "} " << _m->RetrieveDagProgress()
+            << "\n";
+    });
+    promFamily(out, "ethminer_device_dag_rate_bytes_per_second", "gauge",
+        "Throughput of the last DAG build");
+    perMiner([&](const std::string& _l, const TelemetryAccountType&, std::shared_ptr<Miner> _m) {
+        out << "ethminer_device_dag_rate_bytes_per_second{" << _l << "} " << _m->RetrieveDagRate()
+            << "\n";
+    });
+    auto cache = EpochManager::m().stats();
+    promFamily(out, "ethminer_epoch_cache_bytes", "gauge",
+        "Host memory of epoch contexts, held by the cache or still in use");
+    out << "ethminer_epoch_cache_bytes{state=\"cached\"} " << cache.cached << "\n"
+        << "ethminer_epoch_cache_bytes{state=\"resident\"} " << cache.resident << "\n";
+    promFamily(out, "ethminer_epoch_cache_budget_bytes", "gauge",
+        "Host memory epoch contexts may take (0 = unbounded)");
+    out << "ethminer_epoch_cache_budget_bytes " << cache.budget << "\n";
+    promFamily(out, "ethminer_epoch_cache_evictions_total", "counter", "Epoch contexts evicted");
+    out << "ethminer_epoch_cache_evictions_total " << cache.evictions << "\n";
+
+    /* Devices */
+    promFamily(out, "ethminer_device_hashrate", "gauge", "Hashes per second of the device");
+    perMiner([&](const std::string& _l, const TelemetryAccountType& _t, std::shared_ptr<Miner>) {
+        out << "ethminer_device_hashrate{" << _l << "} " << _t.hashrate << "\n";
+    });
+    promFamily(out, "ethminer_device_paused", "gauge", "Whether the device is paused");
+    perMiner([&](const std::string& _l, const TelemetryAccountType&, std::shared_ptr<Miner> _m) {
+        out << "ethminer_device_paused{" << _l << "} " << _m->paused() << "\n";
+    });
+    promFamily(out, "ethminer_device_shares_total", "counter", "Solutions of the device by outcome");
+    perMiner([&](const std::string& _l, const TelemetryAccountType& _t, std::shared_ptr<Miner>) {
+        for (auto& r : results)
+            out << "ethminer_device_shares_total{" << _l << ",result=\"" << r.first << "\"} "
+                << shares(_t.solutions, r.second) << "\n";
+    });
+    promFamily(out, "ethminer_device_shares_stale_total", "counter",
+        "Solutions of the device submitted for a job superseded meanwhile");
+    perMiner([&](const std::string& _l, const TelemetryAccountType& _t, std::shared_ptr<Miner>) {
+        out << "ethminer_device_shares_stale_total{" << _l << "} " << _t.solutions.stale << "\n";
+    });
+    promFamily(out, "ethminer_device_duty_percent", "gauge",
+        "Percent of time searching allowed by the efficiency governor");
+    perMiner([&](const std::string& _l, const TelemetryAccountType& _t, std::shared_ptr<Miner>) {
+        out << "ethminer_device_duty_percent{" << _l << "} " << _t.duty << "\n";
+    });
+    promFamily(out, "ethminer_device_work_switch_latency_seconds", "histogram",
+        "Time from work published to device searching it");
+    perMiner([&](const std::string& _l, const TelemetryAccountType& _t, std::shared_ptr<Miner>) {
+        promHistogram(out, "ethminer_device_work_switch_latency_seconds", _l, _t.switchLatency);
+    });
+    promFamily(out, "ethminer_device_solution_submit_latency_seconds", "histogram",
+        "Time from solution found to handed to the pool client");
+    perMiner([&](const std::string& _l, const TelemetryAccountType& _t, std::shared_ptr<Miner>) {
+        promHistogram(out, "ethminer_device_solution_submit_latency_seconds", _l, _t.submitLatency);
+    });
+
+    /* Hardware monitors */
+    if (t.hwmon)
+    {
+        struct Sensor
+        {
+            const char* name;
+            const char* help;
+            std::function<double(const HwSensorsType&)> value;
+        };
+        static const Sensor sensors[] = {
+            {"ethminer_device_temperature_celsius", "GPU temperature",
+                [](const HwSensorsType& _s) { return _s.tempC; }},
+            {"ethminer_device_memory_temperature_celsius", "Memory temperature (0 if unknown)",
+                [](const HwSensorsType& _s) { return _s.memTempC; }},
+            {"ethminer_device_fan_percent", "Fan speed",
+                [](const HwSensorsType& _s) { return _s.fanP; }},
+            {"ethminer_device_power_watts", "Power draw",
+                [](const HwSensorsType& _s) { return _s.powerW; }},
+            {"ethminer_device_core_clock_mhz", "Core clock (0 if unknown)",
+                [](const HwSensorsType& _s) { return _s.coreClock; }},
+            {"ethminer_device_memory_clock_mhz", "Memory clock (0 if unknown)",
+                [](const HwSensorsType& _s) { return _s.memClock; }}};
+        for (auto& sensor : sensors)
+        {
+            promFamily(out, sensor.name, "gauge", sensor.help);
+            perMiner([&](const std::string& _l, const TelemetryAccountType& _t,
+                         std::shared_ptr<Miner>) {
+                out << sensor.name << "{" << _l << "} " << sensor.value(_t.sensors) << "\n";
+            });
+        }
+    }
+
+    return out.str();
+}
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <map>
 #include <regex>
+#include <set>
 
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
@@ -18,6 +20,20 @@ using namespace std::chrono;
 
 using boost::asio::ip::tcp;
 
+/**
+ * @brief Statistics served by the API. Built once per telemetry collection
+ * and shared, already serialized, by all connections
+ */
+struct ApiStatSnapshot
+{
+    uint64_t version = 0;
+    std::string stat1;   // Result of miner_getstat1
+    std::string detail;  // Result of miner_getstatdetail
+    std::string html;    // Body of the http page
+    std::string metrics; // Body of /metrics (Prometheus text format)
+};
+using ApiStatSnapshotPtr = std::shared_ptr<const ApiStatSnapshot>;
+
 class ApiConnection
 {
 public:
@@ -28,7 +44,12 @@ public:
 
     void start();
 
-    Json::Value getMinerStat1();
+    static Json::Value getMinerStat1();
+    static Json::Value getMinerStatDetail();
+    static Json::Value getMinerStatDetailPerMiner(
+        const TelemetryType& _t, std::shared_ptr<Miner> _miner);
+    static std::string getHttpMinerStatDetail(const Json::Value& jStat);
+    static std::string getPrometheusMetrics();
 
     using Disconnected = std::function<void(int const&)>;
     void onDisconnected(Disconnected const& _handler) { m_onDisconnected = _handler; }
@@ -37,6 +58,27 @@ public:
 
     tcp::socket& socket() { return m_socket; }
 
+    /**
+     * @brief Whether this connection gets notifications (see miner_subscribe)
+     */
+    bool subscribed() const { return !m_subEvents.empty() || m_subInterval.count(); }
+    bool subscribedTo(const std::string& _event) const { return m_subEvents.count(_event) > 0; }
+
+    /**
+     * @brief Pushes a notification. Until the peer reads what has been sent
+     * already, notifications with the same _key replace each other.
+     */
+    void notify(const std::string& _key, const std::string& _line);
+
+    /**
+     * @brief Pushes _line as periodic telemetry if subscribed and due
+     */
+    void notifyTelemetry(std::chrono::steady_clock::time_point _now, const std::string& _line);
+    bool telemetryDue(std::chrono::steady_clock::time_point _now) const
+    {
+        return m_subInterval.count() && _now >= m_subTelemetryDue;
+    }
+
 private:
     void disconnect();
     void processRequest(Json::Value& jRequest, Json::Value& jResponse);
@@ -45,13 +87,9 @@ private:
         const boost::system::error_code& ec, std::size_t bytes_transferred);
     void sendSocketData(Json::Value const& jReq, bool _disconnect = false);
     void sendSocketData(std::string const& _s, bool _disconnect = false);
+    void flushSocketData();
     void onSendSocketDataCompleted(const boost::system::error_code& ec, bool _disconnect = false);
 
-    Json::Value getMinerStatDetail();
-    Json::Value getMinerStatDetailPerMiner(const TelemetryType& _t, std::shared_ptr<Miner> _miner);
-
-    std::string getHttpMinerStatDetail();
-
     Disconnected m_onDisconnected;
 
     int m_sessionId;
@@ -64,6 +102,21 @@ private:
 
     std::string m_message;  // The internal message string buffer
 
+    // Serialized result spliced into the next response
+    std::shared_ptr<const std::string> m_rawResult;
+
+    // Writes are serialized : whatever comes in while one is
+    // in flight waits for it to complete
+    bool m_sending = false;
+    bool m_disconnectAfterSend = false;
+    std::string m_outbound;
+    std::map<std::string, std::string> m_pendingNotifications;
+
+    // Subscription (see miner_subscribe)
+    std::set<std::string> m_subEvents;
+    std::chrono::milliseconds m_subInterval = std::chrono::milliseconds(0);
+    std::chrono::steady_clock::time_point m_subTelemetryDue;
+
     bool m_readonly = false;
     std::string m_password = "";
 
@@ -79,9 +132,20 @@ public:
     void start();
     void stop();
 
+    /**
+     * @brief Latest statistics snapshot. Built on the spot if none yet
+     */
+    static ApiStatSnapshotPtr snapshot();
+
+    /**
+     * @brief Builds and publishes a new statistics snapshot
+     */
+    static void publishSnapshot();
+
 private:
     void begin_accept();
     void handle_accept(std::shared_ptr<ApiConnection> session, boost::system::error_code ec);
+    void sampleEvents(const boost::system::error_code& ec);
 
     int lastSessionId = 0;
 
@@ -94,4 +158,12 @@ private:
     tcp::acceptor m_acceptor;
     boost::asio::io_service::strand m_io_strand;
     std::vector<std::shared_ptr<ApiConnection>> m_sessions;
+
+    // Subscriptions are served by sampling state : an event
+    // is raised whenever the state under its key changes
+    boost::asio::deadline_timer m_eventTimer;
+    std::map<std::string, Json::Value> m_eventState;
+
+    static ApiStatSnapshotPtr s_snapshot;
+    static std::atomic<uint64_t> s_snapshotVersion;
 };
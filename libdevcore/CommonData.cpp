@@ -17,12 +17,176 @@
 
 #include <cstdlib>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DEV_HEX_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define DEV_HEX_NEON 1
+#endif
+
 #include "CommonData.h"
 #include "Exceptions.h"
 
 using namespace std;
 using namespace dev;
 
+namespace
+{
+const char c_hexDigits[] = "0123456789abcdef";
+
+// Value of each character as an hex digit, 0xff if it is not one
+struct HexTable
+{
+    uint8_t values[256];
+    HexTable()
+    {
+        memset(values, 0xff, sizeof(values));
+        for (int i = 0; i < 10; i++)
+            values['0' + i] = uint8_t(i);
+        for (int i = 0; i < 6; i++)
+            values['a' + i] = values['A' + i] = uint8_t(10 + i);
+    }
+};
+const HexTable c_hexTable;
+
+inline bool fromHexScalar(char const* _in, size_t _size, byte* _out) noexcept
+{
+    uint8_t invalid = 0;
+    for (size_t i = 0; i < _size; i++)
+    {
+        uint8_t h = c_hexTable.values[uint8_t(_in[2 * i])];
+        uint8_t l = c_hexTable.values[uint8_t(_in[2 * i + 1])];
+        invalid |= (h | l) & 0xf0;
+        _out[i] = byte((h << 4) | (l & 0x0f));
+    }
+    return !invalid;
+}
+
+inline void toHexScalar(byte const* _data, size_t _size, char* _out) noexcept
+{
+    for (size_t i = 0; i < _size; i++)
+    {
+        _out[2 * i] = c_hexDigits[_data[i] >> 4];
+        _out[2 * i + 1] = c_hexDigits[_data[i] & 0x0f];
+    }
+}
+
+#if DEV_HEX_SSE2
+
+// 16 characters to their nibble values. Clears _valid lanes of non hex digits
+inline __m128i hexValues(__m128i _c, __m128i& _valid)
+{
+    __m128i lower = _mm_or_si128(_c, _mm_set1_epi8(0x20));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(_c, _mm_set1_epi8('0' - 1)),
+        _mm_cmplt_epi8(_c, _mm_set1_epi8('9' + 1)));
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+        _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    _valid = _mm_and_si128(_valid, _mm_or_si128(digit, alpha));
+    return _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(_c, _mm_set1_epi8('0'))),
+        _mm_and_si128(alpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+}
+
+// 8 pairs of nibble values (high first) to 8 bytes in the low 16 bit halves
+inline __m128i hexPairs(__m128i _v)
+{
+    return _mm_and_si128(_mm_or_si128(_mm_slli_epi16(_v, 4), _mm_srli_epi16(_v, 8)),
+        _mm_set1_epi16(0x00ff));
+}
+
+#endif
+}  // namespace
+
+void dev::toHex(byte const* _data, size_t _size, char* _out) noexcept
+{
+    size_t i = 0;
+#if DEV_HEX_SSE2
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i alpha = _mm_set1_epi8('a' - '0' - 10);
+    for (; i + 16 <= _size; i += 16)
+    {
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_data + i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(b, 4), mask);
+        __m128i lo = _mm_and_si128(b, mask);
+        hi = _mm_add_epi8(_mm_add_epi8(hi, zero), _mm_and_si128(_mm_cmpgt_epi8(hi, nine), alpha));
+        lo = _mm_add_epi8(_mm_add_epi8(lo, zero), _mm_and_si128(_mm_cmpgt_epi8(lo, nine), alpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(_out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(_out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+#elif DEV_HEX_NEON
+    const uint8x16_t digits = vld1q_u8(reinterpret_cast<const uint8_t*>(c_hexDigits));
+    for (; i + 16 <= _size; i += 16)
+    {
+        uint8x16_t b = vld1q_u8(_data + i);
+        uint8x16x2_t chars;
+        chars.val[0] = vqtbl1q_u8(digits, vshrq_n_u8(b, 4));
+        chars.val[1] = vqtbl1q_u8(digits, vandq_u8(b, vdupq_n_u8(0x0f)));
+        vst2q_u8(reinterpret_cast<uint8_t*>(_out + 2 * i), chars);
+    }
+#endif
+    toHexScalar(_data + i, _size - i, _out + 2 * i);
+}
+
+bool dev::fromHex(char const* _in, size_t _size, byte* _out) noexcept
+{
+    size_t i = 0;
+#if DEV_HEX_SSE2
+    __m128i valid = _mm_set1_epi8(-1);
+    for (; i + 16 <= _size; i += 16)
+    {
+        __m128i c0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_in + 2 * i));
+        __m128i c1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_in + 2 * i + 16));
+        __m128i b0 = hexPairs(hexValues(c0, valid));
+        __m128i b1 = hexPairs(hexValues(c1, valid));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(_out + i), _mm_packus_epi16(b0, b1));
+    }
+    if (_mm_movemask_epi8(valid) != 0xffff)
+        return false;
+#elif DEV_HEX_NEON
+    uint8x16_t valid = vdupq_n_u8(0xff);
+    for (; i + 16 <= _size; i += 16)
+    {
+        uint8x16x2_t c = vld2q_u8(reinterpret_cast<const uint8_t*>(_in + 2 * i));
+        uint8x16_t v[2];
+        for (int k = 0; k < 2; k++)
+        {
+            uint8x16_t lower = vorrq_u8(c.val[k], vdupq_n_u8(0x20));
+            uint8x16_t digit = vsubq_u8(c.val[k], vdupq_n_u8('0'));
+            uint8x16_t alpha = vsubq_u8(lower, vdupq_n_u8('a'));
+            uint8x16_t isDigit = vcltq_u8(digit, vdupq_n_u8(10));
+            uint8x16_t isAlpha = vcltq_u8(alpha, vdupq_n_u8(6));
+            valid = vandq_u8(valid, vorrq_u8(isDigit, isAlpha));
+            v[k] = vbslq_u8(isDigit, digit, vaddq_u8(alpha, vdupq_n_u8(10)));
+        }
+        vst1q_u8(_out + i, vorrq_u8(vshlq_n_u8(v[0], 4), vandq_u8(v[1], vdupq_n_u8(0x0f))));
+    }
+    if (vminvq_u8(valid) != 0xff)
+        return false;
+#endif
+    return fromHexScalar(_in + 2 * i, _size - i, _out + i);
+}
+
+std::string dev::toHexNumber(uint64_t _n, int _digits, HexPrefix _prefix)
+{
+    char buf[18];
+    char* end = buf + sizeof(buf);
+    char* p = end;
+    do
+    {
+        *--p = c_hexDigits[_n & 0x0f];
+        _n >>= 4;
+    } while (_n);
+    while (end - p < _digits && p > buf)
+        *--p = '0';
+    std::string ret = (_prefix == HexPrefix::Add) ? "0x" : "";
+    if (_digits > int(sizeof(buf)))
+        ret.append(_digits - sizeof(buf), '0');
+    ret.append(p, end);
+    return ret;
+}
+
 int dev::fromHex(char _i, WhenError _throw)
 {
     if (_i >= '0' && _i <= '9')
@@ -40,29 +204,24 @@ int dev::fromHex(char _i, WhenError _throw)
 bytes dev::fromHex(std::string const& _s, WhenError _throw)
 {
     unsigned s = (_s[0] == '0' && _s[1] == 'x') ? 2 : 0;
-    std::vector<uint8_t> ret;
-    ret.reserve((_s.size() - s + 1) / 2);
+    std::vector<uint8_t> ret((_s.size() - s + 1) / 2);
+    size_t o = 0;
 
     if (_s.size() % 2)
     {
         int h = fromHex(_s[s++], WhenError::DontThrow);
         if (h != -1)
-            ret.push_back(h);
+            ret[o++] = byte(h);
         else if (_throw == WhenError::Throw)
             BOOST_THROW_EXCEPTION(BadHexCharacter());
         else
             return bytes();
     }
-    for (unsigned i = s; i < _s.size(); i += 2)
+    if (!fromHex(_s.data() + s, ret.size() - o, ret.data() + o))
     {
-        int h = fromHex(_s[i], WhenError::DontThrow);
-        int l = fromHex(_s[i + 1], WhenError::DontThrow);
-        if (h != -1 && l != -1)
-            ret.push_back((byte)(h * 16 + l));
-        else if (_throw == WhenError::Throw)
+        if (_throw == WhenError::Throw)
             BOOST_THROW_EXCEPTION(BadHexCharacter());
-        else
-            return bytes();
+        return bytes();
     }
     return ret;
 }
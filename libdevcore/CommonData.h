@@ -63,14 +63,29 @@ enum class ScaleSuffix
 template <class T>
 std::string toHex(T const& _data, int _w = 2, HexPrefix _prefix = HexPrefix::DontAdd)
 {
-    std::ostringstream ret;
+    static const char digits[] = "0123456789abcdef";
+    std::string ret = (_prefix == HexPrefix::Add) ? "0x" : "";
     unsigned ii = 0;
     for (auto i : _data)
-        ret << std::hex << std::setfill('0') << std::setw(ii++ ? 2 : _w)
-            << (int)(typename std::make_unsigned<decltype(i)>::type)i;
-    return (_prefix == HexPrefix::Add) ? "0x" + ret.str() : ret.str();
+    {
+        auto b = (uint8_t)(typename std::make_unsigned<decltype(i)>::type)i;
+        if (!ii++ && _w != 2)
+        {
+            std::ostringstream first;
+            first << std::hex << std::setfill('0') << std::setw(_w) << (int)b;
+            ret += first.str();
+            continue;
+        }
+        ret.push_back(digits[b >> 4]);
+        ret.push_back(digits[b & 0x0f]);
+    }
+    return ret;
 }
 
+/// Writes the 2 * _size lowercase hex digits of _data into _out (no terminator).
+/// Vectorized where SSE2 or NEON are available.
+void toHex(byte const* _data, size_t _size, char* _out) noexcept;
+
 /// Converts a (printable) ASCII hex character into the correspnding integer value.
 /// @example fromHex('A') == 10 && fromHex('f') == 15 && fromHex('5') == 5
 int fromHex(char _i, WhenError _throw);
@@ -81,6 +96,11 @@ int fromHex(char _i, WhenError _throw);
 /// throw an exception.
 bytes fromHex(std::string const& _s, WhenError _throw = WhenError::DontThrow);
 
+/// Parses the 2 * _size hex digits (no prefix) at _in into the _size bytes at _out.
+/// Vectorized where SSE2 or NEON are available.
+/// @returns false if any of the characters is not an hex digit
+bool fromHex(char const* _in, size_t _size, byte* _out) noexcept;
+
 /// Converts byte array to a string containing the same (binary) data. Unless
 /// the byte array happens to contain ASCII data, this won't be printable.
 inline std::string asString(bytes const& _b)
@@ -165,14 +185,15 @@ inline std::string toHex(u256 val, HexPrefix prefix = HexPrefix::DontAdd)
     return (prefix == HexPrefix::Add) ? "0x" + str : str;
 }
 
+/// Hex representation of _n, zero padded to at least _digits digits
+std::string toHexNumber(uint64_t _n, int _digits, HexPrefix _prefix);
+
 inline std::string toHex(uint64_t _n, HexPrefix _prefix = HexPrefix::DontAdd, int _bytes = 16)
 {
     // sizeof returns the number of bytes (not the number of bits)
     // thus if CHAR_BIT != 8 sizeof(uint64_t) will return != 8
     // Use fixed constant multiplier of 16
-    std::ostringstream ret;
-    ret << std::hex << std::setfill('0') << std::setw(_bytes) << _n;
-    return (_prefix == HexPrefix::Add) ? "0x" + ret.str() : ret.str();
+    return toHexNumber(_n, _bytes, _prefix);
 }
 
 inline std::string toHex(uint32_t _n, HexPrefix _prefix = HexPrefix::DontAdd, int _bytes = 8)
@@ -180,9 +201,7 @@ inline std::string toHex(uint32_t _n, HexPrefix _prefix = HexPrefix::DontAdd, in
     // sizeof returns the number of bytes (not the number of bits)
     // thus if CHAR_BIT != 8 sizeof(uint64_t) will return != 4
     // Use fixed constant multiplier of 8
-    std::ostringstream ret;
-    ret << std::hex << std::setfill('0') << std::setw(_bytes) << _n;
-    return (_prefix == HexPrefix::Add) ? "0x" + ret.str() : ret.str();
+    return toHexNumber(_n, _bytes, _prefix);
 }
 
 inline std::string toCompactHex(uint64_t _n, HexPrefix _prefix = HexPrefix::DontAdd)
@@ -133,9 +133,24 @@ public:
     }
 
     /// Explicitly construct, copying from a  string.
-    explicit FixedHash(std::string const& _s)
-      : FixedHash(fromHex(_s, WhenError::Throw), FailIfDifferent)
-    {}
+    explicit FixedHash(std::string const& _s) : FixedHash(_s.data(), _s.size()) {}
+
+    /// Explicitly construct, parsing in place the _len hex chars (optionally 0x
+    /// prefixed) at _s. Empty hash if they are not exactly N bytes.
+    explicit FixedHash(char const* _s, size_t _len)
+    {
+        if (_len >= 2 && _s[0] == '0' && _s[1] == 'x')
+        {
+            _s += 2;
+            _len -= 2;
+        }
+        if (_len == 2 * N && fromHex(_s, N, m_data.data()))
+            return;
+
+        // Wrong size or bad chars : as from bytes with FailIfDifferent
+        m_data.fill(0);
+        fromHex(std::string(_s, _len), WhenError::Throw);
+    }
 
     /// Convert to arithmetic type.
     operator Arith() const { return fromBigEndian<Arith>(m_data); }
@@ -213,7 +228,17 @@ public:
     std::string abridged() const { return toHex(ref().cropped(0, 4)) + k_ellipsis; }
 
     /// @returns the hash as a user-readable hex string.
-    std::string hex(HexPrefix _prefix = HexPrefix::DontAdd) const { return toHex(ref(), 2, _prefix); }
+    std::string hex(HexPrefix _prefix = HexPrefix::DontAdd) const
+    {
+        size_t p = (_prefix == HexPrefix::Add) ? 2 : 0;
+        std::string ret(p + 2 * N, 'x');
+        ret[0] = '0';
+        toHex(m_data.data(), N, &ret[p]);
+        return ret;
+    }
+
+    /// Writes the 2 * N hex digits of the hash into _out (no prefix, no terminator)
+    void hex(char* _out) const { toHex(m_data.data(), N, _out); }
 
     /// @returns a mutable byte vector_ref to the object's data.
     bytesRef ref() { return bytesRef(m_data.data(), N); }
@@ -0,0 +1,155 @@
+/*
+    This file is part of ethminer.
+
+    ethminer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ethminer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace dev
+{
+/**
+ * @brief Lock free histogram of latencies.
+ *
+ * Each power of 2 of microseconds is split in 4 buckets, so quantiles
+ * are reported within 25%. The last bucket holds anything longer than
+ * ~30 minutes. Recording is a handful of relaxed atomic increments so
+ * it can stay enabled in release builds.
+ */
+class LatencyHistogram
+{
+public:
+    static constexpr unsigned Buckets = 124;
+
+    /// Copyable picture of a histogram (or of the sum of some)
+    struct Snapshot
+    {
+        uint64_t count = 0;
+        uint64_t total = 0;  // Microseconds
+        uint64_t max = 0;    // Microseconds
+        uint64_t buckets[Buckets] = {};
+
+        Snapshot& operator+=(const Snapshot& _other)
+        {
+            count += _other.count;
+            total += _other.total;
+            max = std::max(max, _other.max);
+            for (unsigned i = 0; i < Buckets; i++)
+                buckets[i] += _other.buckets[i];
+            return *this;
+        }
+
+        uint64_t mean() const { return count ? total / count : 0; }
+
+        /// Upper bound (us) of the bucket holding the _p (0..1) quantile
+        uint64_t percentile(double _p) const
+        {
+            if (!count)
+                return 0;
+            uint64_t rank = std::max<uint64_t>(1, uint64_t(_p * count + 0.5));
+            uint64_t seen = 0;
+            for (unsigned i = 0; i < Buckets; i++)
+            {
+                seen += buckets[i];
+                if (seen >= rank)
+                    return std::min(max, upperBound(i));
+            }
+            return max;
+        }
+
+        /// Short human readable form : p50/p99 in milliseconds
+        std::string str() const
+        {
+            if (!count)
+                return "-";
+            return ms(percentile(0.5)) + "/" + ms(percentile(0.99));
+        }
+
+    private:
+        static std::string ms(uint64_t _us)
+        {
+            if (_us < 10000)
+                return std::to_string(_us / 1000) + "." + std::to_string(_us / 100 % 10);
+            return std::to_string(_us / 1000);
+        }
+    };
+
+    LatencyHistogram() = default;
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void record(uint64_t _us) noexcept
+    {
+        m_buckets[bucket(_us)].fetch_add(1, std::memory_order_relaxed);
+        m_total.fetch_add(_us, std::memory_order_relaxed);
+        uint64_t max = m_max.load(std::memory_order_relaxed);
+        while (_us > max && !m_max.compare_exchange_weak(max, _us, std::memory_order_relaxed))
+        {
+        }
+        m_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    template <class Rep, class Period>
+    void record(std::chrono::duration<Rep, Period> _elapsed) noexcept
+    {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(_elapsed).count();
+        record(us > 0 ? uint64_t(us) : 0);
+    }
+
+    Snapshot snapshot() const noexcept
+    {
+        Snapshot s;
+        s.count = m_count.load(std::memory_order_relaxed);
+        s.total = m_total.load(std::memory_order_relaxed);
+        s.max = m_max.load(std::memory_order_relaxed);
+        for (unsigned i = 0; i < Buckets; i++)
+            s.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+        return s;
+    }
+
+    static uint64_t upperBound(unsigned _bucket)
+    {
+        if (_bucket < 4)
+            return _bucket + 1;
+        if (_bucket + 1 >= Buckets)
+            return UINT64_MAX;
+        unsigned msb = _bucket / 4 + 1;
+        return uint64_t(5 + _bucket % 4) << (msb - 2);
+    }
+
+private:
+    static unsigned bucket(uint64_t _us)
+    {
+        if (_us < 4)
+            return unsigned(_us);
+        unsigned msb = 0;
+        for (uint64_t v = _us; v > 1; v >>= 1)
+            msb++;
+        unsigned b = (msb - 1) * 4 + unsigned((_us >> (msb - 2)) & 3);
+        return b < Buckets ? b : Buckets - 1;
+    }
+
+    std::atomic<uint64_t> m_buckets[Buckets] = {};
+    std::atomic<uint64_t> m_count = {0};
+    std::atomic<uint64_t> m_total = {0};
+    std::atomic<uint64_t> m_max = {0};
+};
+
+}  // namespace dev
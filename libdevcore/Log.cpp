@@ -17,8 +17,15 @@
 
 #include "Log.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 #ifdef __APPLE__
 #include <pthread.h>
@@ -36,6 +43,7 @@ unsigned g_logOptions = 0;
 bool g_logNoColor = false;
 bool g_logSyslog = false;
 bool g_logStdout = false;
+bool g_logAsync = false;
 
 const char* LogChannel::name()
 {
@@ -50,21 +58,48 @@ const char* NoteChannel::name()
     return EthBlue " i";
 }
 
+namespace
+{
+/// Time of the day as formatted in log lines. Formatting happens once
+/// per second and thread at most
+const char* logTimestamp()
+{
+    thread_local time_t lastTime = 0;
+    thread_local char buf[24] = {0};
+    time_t rawTime = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    if (rawTime != lastTime)
+    {
+        lastTime = rawTime;
+        if (strftime(buf, 24, "%X", localtime(&rawTime)) == 0)
+            buf[0] = '\0';  // empty if case strftime fails
+    }
+    return buf;
+}
+
+/// Thread name padded as in log lines, cached till the thread is renamed
+thread_local std::string t_logThreadName;
+
+const std::string& logThreadName()
+{
+    if (t_logThreadName.empty())
+    {
+        std::stringstream ss;
+        ss << std::left << std::setw(8) << getThreadName();
+        t_logThreadName = ss.str();
+    }
+    return t_logThreadName;
+}
+}  // namespace
+
 LogOutputStreamBase::LogOutputStreamBase(char const* _id)
 {
     static std::locale logLocl = std::locale("");
         m_sstr.imbue(logLocl);
         if (g_logSyslog)
-            m_sstr << std::left << std::setw(8) << getThreadName() << " " EthReset;
+            m_sstr << logThreadName() << " " EthReset;
         else
-        {
-            time_t rawTime = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-            char buf[24];
-            if (strftime(buf, 24, "%X", localtime(&rawTime)) == 0)
-                buf[0] = '\0';  // empty if case strftime fails
-            m_sstr << _id << " " EthViolet << buf << " " EthBlue << std::left << std::setw(8)
-                   << getThreadName() << " " EthReset;
-        }
+            m_sstr << _id << " " EthViolet << logTimestamp() << " " EthBlue << logThreadName()
+                   << " " EthReset;
 }
 
 /// Associate a name with each thread for nice logging.
@@ -92,6 +127,7 @@ string dev::getThreadName()
 
 void dev::setThreadName(char const* _n)
 {
+    t_logThreadName.clear();
 #if defined(__linux__)
     pthread_setname_np(pthread_self(), _n);
 #elif defined(__APPLE__)
@@ -101,7 +137,7 @@ void dev::setThreadName(char const* _n)
 #endif
 }
 
-void dev::simpleDebugOut(std::string const& _s)
+static void writeOut(std::string const& _s)
 {
     try
     {
@@ -132,3 +168,164 @@ void dev::simpleDebugOut(std::string const& _s)
         return;
     }
 }
+
+namespace
+{
+/**
+ * @brief Asynchronous log backend.
+ *
+ * Each logging thread owns a single producer / single consumer ring of
+ * lines, so queueing a line takes no lock. One writer thread drains all
+ * rings, restores the order lines were queued in, and writes them out.
+ * When a ring is full the line is dropped and accounted : logging never
+ * blocks the miners or the io service.
+ */
+class LogWriter
+{
+public:
+    static LogWriter& w()
+    {
+        // Never destroyed : threads may still log while statics go away.
+        // What is queued is output on exit.
+        static LogWriter* writer = []() {
+            auto w = new LogWriter;
+            std::atexit([]() { LogWriter::w().flush(); });
+            return w;
+        }();
+        return *writer;
+    }
+
+    void push(std::string const& _s)
+    {
+        Ring& ring = threadRing();
+        uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+        if (tail - ring.head.load(std::memory_order_acquire) >= c_ringSize)
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        ring.lines[tail % c_ringSize] = {m_sequence.fetch_add(1, std::memory_order_relaxed), _s};
+        ring.tail.store(tail + 1, std::memory_order_release);
+    }
+
+    void flush()
+    {
+        uint64_t target = m_sequence.load(std::memory_order_relaxed);
+        std::unique_lock<std::mutex> l(m_mutex);
+        m_flushed.wait_for(l, std::chrono::seconds(2), [&]() { return m_written >= target; });
+    }
+
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    static const uint64_t c_ringSize = 1024;
+
+    struct Ring
+    {
+        std::atomic<uint64_t> head = {0};
+        std::atomic<uint64_t> tail = {0};
+        std::pair<uint64_t, std::string> lines[c_ringSize];
+    };
+
+    LogWriter() { std::thread(&LogWriter::writeLoop, this).detach(); }
+
+    Ring& threadRing()
+    {
+        thread_local std::shared_ptr<Ring> ring;
+        if (!ring)
+        {
+            ring = std::make_shared<Ring>();
+            std::lock_guard<std::mutex> l(m_mutex);
+            m_rings.push_back(ring);
+        }
+        return *ring;
+    }
+
+    bool drain()
+    {
+        std::vector<std::shared_ptr<Ring>> rings;
+        {
+            std::lock_guard<std::mutex> l(m_mutex);
+            // Forget rings of threads which are gone, once emptied
+            m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(),
+                              [](const std::shared_ptr<Ring>& _r) {
+                                  return _r.use_count() == 1 &&
+                                         _r->head.load(std::memory_order_relaxed) ==
+                                             _r->tail.load(std::memory_order_acquire);
+                              }),
+                m_rings.end());
+            rings = m_rings;
+        }
+
+        m_batch.clear();
+        for (auto& ring : rings)
+        {
+            uint64_t head = ring->head.load(std::memory_order_relaxed);
+            uint64_t tail = ring->tail.load(std::memory_order_acquire);
+            for (; head < tail; head++)
+                m_batch.push_back(std::move(ring->lines[head % c_ringSize]));
+            ring->head.store(head, std::memory_order_release);
+        }
+        if (m_batch.empty())
+            return false;
+
+        std::sort(m_batch.begin(), m_batch.end(),
+            [](const std::pair<uint64_t, std::string>& _a,
+                const std::pair<uint64_t, std::string>& _b) { return _a.first < _b.first; });
+        for (auto const& line : m_batch)
+            writeOut(line.second);
+
+        std::lock_guard<std::mutex> l(m_mutex);
+        m_written += m_batch.size();
+        m_flushed.notify_all();
+        return true;
+    }
+
+    void writeLoop()
+    {
+        setThreadName("log");
+        uint64_t reported = 0;
+        while (true)
+        {
+            if (!drain())
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+            uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+            if (dropped != reported)
+            {
+                writeOut(EthRed " X " EthReset + std::to_string(dropped - reported) +
+                         " log lines dropped (" + std::to_string(dropped) + " since start)");
+                reported = dropped;
+            }
+        }
+    }
+
+    std::atomic<uint64_t> m_sequence = {0};
+    std::atomic<uint64_t> m_dropped = {0};
+
+    std::mutex m_mutex;
+    std::condition_variable m_flushed;
+    uint64_t m_written = 0;
+    std::vector<std::shared_ptr<Ring>> m_rings;
+    std::vector<std::pair<uint64_t, std::string>> m_batch;
+};
+}  // namespace
+
+void dev::simpleDebugOut(std::string const& _s)
+{
+    if (g_logAsync)
+        LogWriter::w().push(_s);
+    else
+        writeOut(_s);
+}
+
+void dev::flushLog()
+{
+    if (g_logAsync)
+        LogWriter::w().flush();
+}
+
+uint64_t dev::droppedLogLines()
+{
+    return g_logAsync ? LogWriter::w().dropped() : 0;
+}
@@ -56,12 +56,20 @@ extern unsigned g_logOptions;
 extern bool g_logNoColor;
 extern bool g_logSyslog;
 extern bool g_logStdout;
+extern bool g_logAsync;
 
 namespace dev
 {
 /// A simple log-output function that prints log messages to stdout.
+/// When g_logAsync is set the line is only queued for the log writer thread
 void simpleDebugOut(std::string const&);
 
+/// Waits till the log writer thread has output all lines queued so far
+void flushLog();
+
+/// Number of log lines dropped since start because the writer could not keep up
+uint64_t droppedLogLines();
+
 /// Set the current thread's log name.
 void setThreadName(char const* _n);
 
@@ -19,15 +19,201 @@
  * @date 2014
  */
 
+#include <algorithm>
 #include <chrono>
+#include <fstream>
 #include <thread>
 
+#if defined(__linux__)
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
 #include "Log.h"
 #include "Worker.h"
 
 using namespace std;
 using namespace dev;
 
+#if defined(__linux__)
+/*
+ * cpus listed in a sysfs cpulist file ("0-7,16-23")
+ */
+static vector<unsigned> readCpuList(string const& _path)
+{
+    vector<unsigned> cpus;
+    ifstream file(_path);
+    string list;
+    if (!(file >> list))
+        return cpus;
+    size_t pos = 0;
+    while (pos < list.size())
+    {
+        size_t end = list.find(',', pos);
+        if (end == string::npos)
+            end = list.size();
+        string range = list.substr(pos, end - pos);
+        unsigned first, last;
+        int n = sscanf(range.c_str(), "%u-%u", &first, &last);
+        if (n == 1)
+            last = first;
+        if (n >= 1)
+            for (unsigned cpu = first; cpu <= last; cpu++)
+                cpus.push_back(cpu);
+        pos = end + 1;
+    }
+    return cpus;
+}
+#endif
+
+int dev::pciNumaNode(string const& _pciId)
+{
+#if defined(__linux__)
+    // Our ids have no domain : look for a device with a matching suffix
+    string path;
+    if (_pciId.size() > 8)
+    {
+        path = "/sys/bus/pci/devices/" + _pciId;
+    }
+    else if (DIR* dir = opendir("/sys/bus/pci/devices"))
+    {
+        string suffix = ":" + _pciId;
+        while (struct dirent* entry = readdir(dir))
+        {
+            string name = entry->d_name;
+            if (name.size() > suffix.size() &&
+                name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+            {
+                path = "/sys/bus/pci/devices/" + name;
+                break;
+            }
+        }
+        closedir(dir);
+    }
+    int node = -1;
+    if (!path.empty())
+        ifstream(path + "/numa_node") >> node;
+    return node;
+#else
+    (void)_pciId;
+    return -1;
+#endif
+}
+
+bool dev::applyThreadPolicy(ThreadPolicy const& _policy)
+{
+    bool ok = true;
+    if (_policy.empty())
+        return ok;
+
+#if defined(__linux__)
+    vector<unsigned> cpus = _policy.cores;
+    if (_policy.numaNode >= 0)
+    {
+        auto local = readCpuList(
+            "/sys/devices/system/node/node" + to_string(_policy.numaNode) + "/cpulist");
+        if (cpus.empty())
+        {
+            cpus = local;
+        }
+        else
+        {
+            vector<unsigned> selected;
+            for (auto cpu : cpus)
+                if (find(local.begin(), local.end(), cpu) != local.end())
+                    selected.push_back(cpu);
+            cpus = selected.empty() ? cpus : selected;
+        }
+    }
+    if (cpus.size())
+    {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        for (auto cpu : cpus)
+            if (cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &cpuset);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+        if (err)
+        {
+            cwarn << "Unable to set cpu affinity : " << strerror(err);
+            ok = false;
+        }
+    }
+    if (_policy.fifo)
+    {
+        struct sched_param param;
+        param.sched_priority = int(_policy.fifo);
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err)
+        {
+            cwarn << "Unable to set SCHED_FIFO priority " << _policy.fifo << " : "
+                  << strerror(err) << " (needs CAP_SYS_NICE)";
+            ok = false;
+        }
+    }
+    if (_policy.nice)
+    {
+        // On Linux nice values are per thread
+        if (setpriority(PRIO_PROCESS, pid_t(syscall(SYS_gettid)), _policy.nice))
+        {
+            cwarn << "Unable to set nice " << _policy.nice << " : " << strerror(errno);
+            ok = false;
+        }
+    }
+#elif defined(_WIN32)
+    if (_policy.cores.size())
+    {
+        DWORD_PTR mask = 0;
+        for (auto cpu : _policy.cores)
+            if (cpu < sizeof(DWORD_PTR) * 8)
+                mask |= DWORD_PTR(1) << cpu;
+        if (!SetThreadAffinityMask(GetCurrentThread(), mask))
+        {
+            cwarn << "Unable to set cpu affinity : error " << GetLastError();
+            ok = false;
+        }
+    }
+    if (_policy.numaNode >= 0)
+    {
+        GROUP_AFFINITY affinity;
+        if (!GetNumaNodeProcessorMaskEx(USHORT(_policy.numaNode), &affinity) ||
+            !SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr))
+        {
+            cwarn << "Unable to bind to NUMA node " << _policy.numaNode << " : error "
+                  << GetLastError();
+            ok = false;
+        }
+    }
+    if (_policy.fifo || _policy.nice)
+    {
+        int priority = _policy.fifo ?
+                           THREAD_PRIORITY_TIME_CRITICAL :
+                           (_policy.nice <= -10 ?
+                                   THREAD_PRIORITY_HIGHEST :
+                                   (_policy.nice < 0 ?
+                                           THREAD_PRIORITY_ABOVE_NORMAL :
+                                           (_policy.nice < 10 ? THREAD_PRIORITY_BELOW_NORMAL :
+                                                                THREAD_PRIORITY_LOWEST)));
+        if (!SetThreadPriority(GetCurrentThread(), priority))
+        {
+            cwarn << "Unable to set thread priority : error " << GetLastError();
+            ok = false;
+        }
+    }
+#else
+    cwarn << "Thread scheduling policies are not supported on this platform";
+    ok = false;
+#endif
+    return ok;
+}
+
 void Worker::startWorking()
 {
     DEV_BUILD_LOG_PROGRAMFLOW(cnote, "Worker::startWorking() begin");
@@ -43,6 +229,7 @@ void Worker::startWorking()
         m_state = WorkerState::Starting;
         m_work.reset(new thread([&]() {
             setThreadName(m_name.c_str());
+            applyThreadPolicy(m_policy);
             //			cnote << "Thread begins";
             while (m_state != WorkerState::Killing)
             {
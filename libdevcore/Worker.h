@@ -26,6 +26,7 @@
 #include <cassert>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "Guards.h"
 
@@ -42,6 +43,25 @@ enum class WorkerState
     Killing
 };
 
+/// How a thread is to be scheduled
+struct ThreadPolicy
+{
+    std::vector<unsigned> cores;  // Cpus the thread may run on (empty = any)
+    int numaNode = -1;            // Only the cpus of this NUMA node (-1 = any)
+    int nice = 0;                 // -20 .. 19 (Windows : mapped to a thread priority)
+    unsigned fifo = 0;            // SCHED_FIFO priority 1 .. 99 (Windows : time critical)
+
+    bool empty() const { return cores.empty() && numaNode < 0 && !nice && !fifo; }
+};
+
+/// Applies _policy to the calling thread. Warns about what can't be applied
+/// @returns true if all of it could be
+bool applyThreadPolicy(ThreadPolicy const& _policy);
+
+/// NUMA node the PCI device _pciId ([domain:]bus:device.function) is attached to.
+/// -1 if unknown
+int pciNumaNode(std::string const& _pciId);
+
 class Worker
 {
 public:
@@ -64,10 +84,14 @@ public:
     /// Whether or not this worker should stop
     bool shouldStop() const { return m_state != WorkerState::Started; }
 
+    /// Sets how the worker thread is scheduled. Takes effect on startWorking()
+    void setThreadPolicy(ThreadPolicy const& _policy) { m_policy = _policy; }
+
 private:
     virtual void workLoop() = 0;
 
     std::string m_name;
+    ThreadPolicy m_policy;
 
     mutable Mutex x_work;                 ///< Lock for the network existence.
     std::unique_ptr<std::thread> m_work;  ///< The network thread.
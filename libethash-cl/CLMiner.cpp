@@ -4,9 +4,11 @@
 /// @copyright GNU General Public License
 
 #include <boost/dll.hpp>
+#include <boost/filesystem.hpp>
 
 #include <libethcore/Farm.h>
 #include <ethash/ethash.hpp>
+#include <ethash/keccak.hpp>
 
 #include "CLMiner.h"
 #include "ethash.h"
@@ -24,6 +26,11 @@ namespace eth
 // to the assembly code for the binary kernels.
 const size_t c_maxSearchResults = 4;
 
+// DAG and light buffers are allocated with room for
+// this number of following epochs
+#define DAG_HEADROOM_EPOCHS 4
+#define DAG_HEADROOM_RESERVE (256ULL * 1024 * 1024)  // Kept for the driver
+
 struct CLChannel : public LogChannel
 {
     static const char* name() { return EthOrange "cl"; }
@@ -209,6 +216,63 @@ void addDefinition(string& _source, char const* _id, unsigned _value)
     _source.insert(_source.begin(), buf, buf + strlen(buf));
 }
 
+/**
+ * Returns the file a program built from _code with _options for _device
+ * is cached in. Name is a hash of everything affecting the binary
+ * (device, driver, definitions and source, build options)
+ */
+std::string programCacheFile(
+    cl::Device const& _device, std::string const& _code, char const* _options, string _dir)
+{
+    std::string key = _device.getInfo<CL_DEVICE_NAME>() + '\n' +
+                      _device.getInfo<CL_DEVICE_VERSION>() + '\n' +
+                      _device.getInfo<CL_DRIVER_VERSION>() + '\n' + _options + '\n' + _code;
+    ethash::hash256 hash =
+        ethash::keccak256(reinterpret_cast<const uint8_t*>(key.data()), key.size());
+
+    if (_dir.empty())
+        _dir = (boost::filesystem::path(MinerProfile::dataDir()) / "cl-cache").string();
+    return (boost::filesystem::path(_dir) /
+            ("ethash_" + toHex(bytesConstRef(hash.bytes, 16)) + ".bin"))
+        .string();
+}
+
+bool loadProgramBinary(std::string const& _file, vector<unsigned char>& _binary)
+{
+    std::ifstream in(_file, ios::in | ios::binary);
+    if (!in)
+        return false;
+    _binary.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return !_binary.empty();
+}
+
+bool saveProgramBinary(std::string const& _file, cl::Program const& _program)
+{
+    vector<vector<unsigned char>> binaries = _program.getInfo<CL_PROGRAM_BINARIES>();
+    if (binaries.size() != 1 || binaries[0].empty())
+        return false;
+
+    // Write to a temporary file then rename so concurrent
+    // miners never load a partially written binary
+    boost::system::error_code ec;
+    boost::filesystem::path path(_file);
+    boost::filesystem::create_directories(path.parent_path(), ec);
+    boost::filesystem::path temp = path;
+    temp += boost::filesystem::unique_path(".%%%%%%");
+    {
+        std::ofstream out(temp.string(), ios::out | ios::binary | ios::trunc);
+        if (!out)
+            return false;
+        out.write(reinterpret_cast<const char*>(binaries[0].data()), binaries[0].size());
+        if (!out)
+            return false;
+    }
+    boost::filesystem::rename(temp, path, ec);
+    if (ec)
+        boost::filesystem::remove(temp, ec);
+    return !ec;
+}
+
 std::vector<cl::Platform> getPlatforms()
 {
     vector<cl::Platform> platforms;
@@ -258,6 +322,7 @@ CLMiner::CLMiner(unsigned _index, CLSettings _settings, DeviceDescriptor& _devic
     m_deviceDescriptor = _device;
     m_settings.localWorkSize = ((m_settings.localWorkSize + 7) / 8) * 8;
     m_settings.globalWorkSize = m_settings.localWorkSize * m_settings.globalWorkSizeMultiplier;
+    m_settings.streams = std::max(m_settings.streams, 1U);
 }
 
 CLMiner::~CLMiner()
@@ -292,141 +357,198 @@ void CLMiner::workLoop()
 
     uint64_t startNonce = 0;
 
-    // The work package currently processed by GPU.
-    WorkPackage current;
-    current.header = h256();
+    // The work package currently processed by GPU and
+    // the generation it has been published with.
+    std::shared_ptr<const WorkPackage> current = std::make_shared<const WorkPackage>();
+    uint64_t currentGeneration = 0;
+
+    // Batches are queued in round robin over the streams (each with its
+    // own queue, header and search buffer). Results of a batch are read
+    // back (non blocking) while the following ones are already queued
+    // so the device never drains
+    struct Batch
+    {
+        std::shared_ptr<const WorkPackage> work;
+        uint64_t startNonce = 0;
+        h256 header;  // Last header uploaded to stream's buffer
+        cl::Event read;
+        bool pending = false;
+    };
+    const unsigned streams = m_settings.streams;
+    vector<Batch> batches(streams);
+    vector<SearchResults> results(streams);
+    unsigned slot = 0;
+
+    auto collect = [&](unsigned _slot) {
+        Batch& batch = batches[_slot];
+        if (!batch.pending)
+            return;
+        batch.read.wait();
+        batch.pending = false;
+
+        uint32_t count = std::min<uint32_t>(results[_slot].count, c_maxSearchResults);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint64_t nonce = batch.startNonce + results[_slot].rslt[i].gid;
+            if (nonce != m_lastNonce)
+            {
+                m_lastNonce = nonce;
+                h256 mix;
+                memcpy(mix.data(), (char*)results[_slot].rslt[i].mix,
+                    sizeof(results[_slot].rslt[i].mix));
+
+                Farm::f().submitProof(Solution{
+                    nonce, mix, batch.work, std::chrono::steady_clock::now(), m_index});
+                cllog << EthWhite << "Job: " << batch.work->header.abridged() << " Sol: 0x"
+                      << toHex(nonce) << EthReset;
+            }
+        }
+
+        // Report hash count
+        if (m_settings.noExit)
+            updateHashRate(m_settings.globalWorkSize, 1);
+        else
+            updateHashRate(m_settings.localWorkSize, results[_slot].hashCount);
+    };
+
+    auto collectAll = [&]() {
+        for (unsigned i = 0; i < streams; i++)
+            collect((slot + i) % streams);
+    };
 
     if (!initDevice())
     return;
 
+    // Compile kernels right away : this overlaps with pool connection,
+    // light cache building and DAG generation of other devices. Should
+    // it fail it's retried, and eventually reported, by initEpoch
+    initContext();
+
     try
     {
         while (!shouldStop())
         {
-
-            // Read results.
-            volatile SearchResults results;
-
-            if (m_queue.size())
-            {
-                // no need to read the abort flag.
-                m_queue[0].enqueueReadBuffer(m_searchBuffer[0], CL_TRUE,
-                    offsetof(SearchResults, count),
-                    (m_settings.noExit ? 1 : 2) * sizeof(results.count), (void*)&results.count);
-                if (results.count)
-                {
-                    if (results.count > c_maxSearchResults) {
-                        results.count = c_maxSearchResults;
-                    }
-
-                    m_queue[0].enqueueReadBuffer(m_searchBuffer[0], CL_TRUE, 0,
-                        results.count * sizeof(results.rslt[0]), (void*)&results);
-                    // Reset search buffer if any solution found.
-                    if (m_settings.noExit)
-                        m_queue[0].enqueueWriteBuffer(m_searchBuffer[0], CL_FALSE,
-                            offsetof(SearchResults, count), sizeof(results.count), zerox3);
-                }
-                // clean the solution count, hash count, and abort flag
-                if (!m_settings.noExit)
-                    m_queue[0].enqueueWriteBuffer(m_searchBuffer[0], CL_FALSE,
-                        offsetof(SearchResults, count), sizeof(zerox3), zerox3);
-            }
-            else
-                results.count = 0;
-
             // Wait for work or 3 seconds (whichever the first)
-            const WorkPackage w = work();
+            uint64_t generation;
+            auto wp = workPtr(&generation);
+            const WorkPackage& w = *wp;
             if (!w)
             {
+                collectAll();
                 boost::system_time const timeout =
                     boost::get_system_time() + boost::posix_time::seconds(3);
                 boost::mutex::scoped_lock l(x_work);
-                m_new_work_signal.timed_wait(l, timeout);
+                m_new_work_signal.timed_wait(
+                    l, timeout, [&]() { return workGeneration() != generation || shouldStop(); });
                 continue;
             }
 
-            if (current.header != w.header)
+            if (currentGeneration != generation)
             {
-
-                if (current.epoch != w.epoch)
+                const bool epochChanged = current->epoch != w.epoch;
+                if (epochChanged)
                 {
+                    // Batches in flight use buffers about to be released
+                    collectAll();
+
                     m_abortqueue.clear();
 
                     if (!initEpoch())
                         break;  // This will simply exit the thread
 
                     m_abortqueue.push_back(cl::CommandQueue(m_context[0], m_device));
+
+                    // Tune work sizes against the real DAG
+                    if (m_settings.autoTune && !m_tuned && !paused())
+                    {
+                        autoTune();
+                        m_tuned = true;
+                    }
+
+                    for (auto& batch : batches)
+                        batch.header = h256();
                 }
 
                 // Upper 64 bits of the boundary.
                 const uint64_t target = (uint64_t)(u64)((u256)w.boundary >> 192);
                 assert(target > 0);
 
-                startNonce = w.startNonce;
+                // Same job republished (i.e. with a new boundary) resumes
+                // where it was instead of searching its nonces again
+                if (current->header != w.header || current->startNonce != w.startNonce)
+                    startNonce = w.startNonce;
 
-                // Update header constant buffer.
-                m_queue[0].enqueueWriteBuffer(
-                    m_header[0], CL_FALSE, 0, w.header.size, w.header.data());
-                // zero the result count
-                m_queue[0].enqueueWriteBuffer(m_searchBuffer[0], CL_FALSE,
-                    offsetof(SearchResults, count),
-                    m_settings.noExit ? sizeof(zerox3[0]) : sizeof(zerox3), zerox3);
-
-                m_searchKernel.setArg(0, m_searchBuffer[0]);  // Supply output buffer to kernel.
-                m_searchKernel.setArg(1, m_header[0]);        // Supply header buffer to kernel.
                 m_searchKernel.setArg(2, m_dag[0]);           // Supply DAG buffer to kernel.
                 m_searchKernel.setArg(3, m_dag[1]);           // Supply DAG buffer to kernel.
                 m_searchKernel.setArg(4, m_dagItems);
                 m_searchKernel.setArg(6, target);
 
+                // Epoch switches are accounted by DAG generation
+                uint64_t switchTime = recordWorkSwitch(generation, !epochChanged);
+                (void)switchTime;
 #ifdef DEV_BUILD
                 if (g_logOptions & LOG_SWITCH)
-                    cllog << "Switch time: "
-                          << std::chrono::duration_cast<std::chrono::microseconds>(
-                                 std::chrono::steady_clock::now() - m_workSwitchStart)
-                                 .count()
-                          << " us.";
+                    cllog << "Switch time: " << switchTime << " us.";
 #endif
             }
 
-            // Run the kernel.
-            m_searchKernel.setArg(5, startNonce);
-            m_queue[0].enqueueNDRangeKernel(
-                m_searchKernel, cl::NullRange, m_settings.globalWorkSize, m_settings.localWorkSize);
+            // Search buffer is idle here (its batch has been collected) : zero
+            // the result count, hash count and abort flag ahead of the kernel
+            // on its own queue. kick_miner() waits for the reset so it can't
+            // be overwritten by it
+            {
+                cl::Event reset;
+                m_queue[slot].enqueueWriteBuffer(m_searchBuffer[slot], CL_FALSE,
+                    offsetof(SearchResults, count),
+                    m_settings.noExit ? sizeof(zerox3[0]) : sizeof(zerox3), zerox3, nullptr,
+                    &reset);
+                boost::mutex::scoped_lock l(x_abortReset);
+                m_abortReset.resize(streams);
+                m_abortReset[slot] = reset;
+            }
 
-            if (results.count)
+            // Kernel now processing newest work
+            current = wp;
+            currentGeneration = generation;
+            Batch& batch = batches[slot];
+            batch.work = current;
+            batch.startNonce = startNonce;
+            batch.pending = true;
+
+            // Update stream's header constant buffer. Kernels of other
+            // streams may still be reading theirs.
+            if (batch.header != current->header)
             {
-                // Report results while the kernel is running.
-                for (uint32_t i = 0; i < results.count; i++)
-                {
-                    uint64_t nonce = current.startNonce + results.rslt[i].gid;
-                    if (nonce != m_lastNonce)
-                    {
-                        m_lastNonce = nonce;
-                        h256 mix;
-                        memcpy(mix.data(), (char*)results.rslt[i].mix, sizeof(results.rslt[i].mix));
-
-                        Farm::f().submitProof(Solution{
-                            nonce, mix, current, std::chrono::steady_clock::now(), m_index});
-                        cllog << EthWhite << "Job: " << current.header.abridged() << " Sol: 0x"
-                              << toHex(nonce) << EthReset;
-                    }
-                }
+                batch.header = current->header;
+                m_queue[slot].enqueueWriteBuffer(
+                    m_header[slot], CL_FALSE, 0, batch.header.size, batch.header.data());
             }
 
-            current = w;  // kernel now processing newest work
-            current.startNonce = startNonce;
+            // Run the kernel and queue read back of its results.
+            m_searchKernel.setArg(0, m_searchBuffer[slot]);  // Supply output buffer to kernel.
+            m_searchKernel.setArg(1, m_header[slot]);        // Supply header buffer to kernel.
+            m_searchKernel.setArg(5, startNonce);
+            m_queue[slot].enqueueNDRangeKernel(
+                m_searchKernel, cl::NullRange, m_settings.globalWorkSize, m_settings.localWorkSize);
+            m_queue[slot].enqueueReadBuffer(m_searchBuffer[slot], CL_FALSE, 0,
+                sizeof(SearchResults), &results[slot], nullptr, &batch.read);
+            m_queue[slot].flush();
+
             // Increase start nonce for following kernel execution.
             startNonce += m_settings.globalWorkSize;
-            // Report hash count
-            if (m_settings.noExit)
-                updateHashRate(m_settings.globalWorkSize, 1);
-            else
-                updateHashRate(m_settings.localWorkSize, results.hashCount);
+
+            // Report results of oldest batch while the others are running.
+            slot = (slot + 1) % streams;
+            collect(slot);
+
+            // Eventually idle before queueing next one (see --power-cap)
+            throttle();
         }
 
-        if (m_queue.size())
-            m_queue[0].finish();
+        collectAll();
+
+        for (auto& queue : m_queue)
+            queue.finish();
 
         clear_buffer();
     }
@@ -443,8 +565,18 @@ void CLMiner::kick_miner()
     // Memory for abort Cannot be static because crashes on macOS.
     const uint32_t one = 1;
     if (!m_settings.noExit && !m_abortqueue.empty())
-        m_abortqueue[0].enqueueWriteBuffer(
-            m_searchBuffer[0], CL_TRUE, offsetof(SearchResults, abort), sizeof(one), &one);
+    {
+        boost::mutex::scoped_lock l(x_abortReset);
+        for (size_t i = 0; i < m_searchBuffer.size(); i++)
+        {
+            std::vector<cl::Event> reset;
+            if (i < m_abortReset.size() && m_abortReset[i]())
+                reset.push_back(m_abortReset[i]);
+            m_abortqueue[0].enqueueWriteBuffer(m_searchBuffer[i], CL_TRUE,
+                offsetof(SearchResults, abort), sizeof(one), &one,
+                reset.empty() ? nullptr : &reset);
+        }
+    }
 
     m_new_work_signal.notify_one();
 }
@@ -700,38 +832,335 @@ bool CLMiner::initDevice()
               << m_settings.globalWorkSize / m_settings.localWorkSize;
     }
 
+    // Apply tuned work sizes (if any) unless
+    // we have been asked to tune again
+    ProfileValues profile;
+    if (!m_settings.autoTune && MinerProfile::load(profileKey(), profile))
+        applyProfile(profile);
 
     return true;
 
 }
 
-bool CLMiner::initEpoch_internal()
+std::string CLMiner::profileKey()
 {
-    auto startInit = std::chrono::steady_clock::now();
-    size_t RequiredMemory = (m_epochContext.dagSize);
+    return "opencl:" + m_deviceDescriptor.uniqueId + ":" + m_deviceDescriptor.clName + ":" +
+           m_device.getInfo<CL_DRIVER_VERSION>();
+}
 
-    // Release the pause flag if any
-    resume(MinerPauseEnum::PauseDueToInsufficientMemory);
-    resume(MinerPauseEnum::PauseDueToInitEpochError);
+void CLMiner::applyProfile(const ProfileValues& _profile)
+{
+    auto global = _profile.find("global");
+    auto local = _profile.find("local");
+    auto noExit = _profile.find("noexit");
+    if (global == _profile.end() || local == _profile.end() || noExit == _profile.end())
+        return;
 
-    // Check whether the current device has sufficient memory every time we recreate the dag
-    if (m_deviceDescriptor.totalMemory < RequiredMemory)
+    // Discard anything out of the ranges accepted on command line
+    if ((local->second != 64 && local->second != 128 && local->second != 256) ||
+        !global->second || global->second > 0xFFFFFFFFULL || global->second % local->second)
+        return;
+
+    // Work sizes given on command line win over tuned ones
+    unsigned localWork =
+        m_settings.localWorkSet ? m_settings.localWorkSize : (unsigned)local->second;
+    uint64_t globalWork = m_settings.globalWorkSet ? m_settings.globalWorkSize : global->second;
+    globalWork = ((globalWork + localWork - 1) / localWork) * localWork;
+    if (globalWork > 0xFFFFFFFFULL)
+        return;
+
+    m_settings.localWorkSize = localWork;
+    m_settings.globalWorkSize = (unsigned)globalWork;
+    m_settings.globalWorkSizeMultiplier = m_settings.globalWorkSize / m_settings.localWorkSize;
+
+    // Fast exit can still be disabled on command line
+    m_settings.noExit = m_settings.noExit || noExit->second;
+
+    cllog << "Using tuned profile : global work " << m_settings.globalWorkSize << " local work "
+          << m_settings.localWorkSize << (m_settings.noExit ? " no exit" : " fast exit");
+}
+
+bool CLMiner::tuneMeasure(double& _hashrate)
+{
+    using namespace std::chrono;
+
+    // Memory for zero-ing buffers. Cannot be static or const because crashes on macOS.
+    uint32_t zerox3[3] = {0, 0, 0};
+    h256 header;
+    const unsigned streams = (unsigned)m_queue.size();
+
+    m_searchKernel.setArg(2, m_dag[0]);
+    m_searchKernel.setArg(3, m_dag[1]);
+    m_searchKernel.setArg(4, m_dagItems);
+    m_searchKernel.setArg(6, (uint64_t)0);
+    for (unsigned i = 0; i < streams; i++)
+        m_queue[i].enqueueWriteBuffer(m_header[i], CL_TRUE, 0, header.size, header.data());
+
+    // Abort flag is cleared on each run so an eventual
+    // kick_miner() does not let later runs exit early
+    uint64_t nonce = 0;
+    auto launch = [&](unsigned _stream) {
+        m_queue[_stream].enqueueWriteBuffer(m_searchBuffer[_stream], CL_FALSE,
+            offsetof(SearchResults, count), sizeof(zerox3), zerox3);
+        m_searchKernel.setArg(0, m_searchBuffer[_stream]);
+        m_searchKernel.setArg(1, m_header[_stream]);
+        m_searchKernel.setArg(5, nonce);
+        m_queue[_stream].enqueueNDRangeKernel(
+            m_searchKernel, cl::NullRange, m_settings.globalWorkSize, m_settings.localWorkSize);
+        m_queue[_stream].flush();
+        nonce += m_settings.globalWorkSize;
+    };
+
+    // Warm up then keep all streams busy in round
+    // robin (as workLoop() does) for a while
+    for (unsigned i = 0; i < streams; i++)
+        launch(i);
+    for (unsigned i = 0; i < streams; i++)
+        m_queue[i].finish();
+
+    uint64_t batches = 0;
+    auto start = steady_clock::now();
+    for (unsigned i = 0; i < streams; i++)
+        launch(i);
+    while (duration_cast<milliseconds>(steady_clock::now() - start).count() < 250)
     {
-        cllog << "Epoch " << m_epochContext.epochNumber << " requires "
-              << dev::getFormattedMemory((double)RequiredMemory) << " memory. Only "
-              << dev::getFormattedMemory((double)m_deviceDescriptor.totalMemory)
-              << " available on device.";
-        pause(MinerPauseEnum::PauseDueToInsufficientMemory);
-        return true;  // This will prevent to exit the thread and
-                      // Eventually resume mining when changing coin or epoch (NiceHash)
+        for (unsigned i = 0; i < streams; i++)
+        {
+            m_queue[i].finish();
+            batches++;
+            launch(i);
+        }
+        if (shouldStop())
+            return false;
+    }
+    for (unsigned i = 0; i < streams; i++)
+    {
+        m_queue[i].finish();
+        batches++;
     }
 
-    cllog << "Generating split DAG + Light (total): "
-          << dev::getFormattedMemory((double)RequiredMemory);
+    double us = (double)duration_cast<microseconds>(steady_clock::now() - start).count();
+    _hashrate = us ? ((double)batches * m_settings.globalWorkSize * 1.0e6) / us : 0.0;
+    return true;
+}
 
+void CLMiner::autoTune()
+{
+    struct Candidate
+    {
+        unsigned global;
+        unsigned local;
+        bool noExit;
+        double hashrate;
+    };
+
+    auto pickBest = [](const std::vector<Candidate>& _candidates) {
+        Candidate best = _candidates.front();
+        for (auto& c : _candidates)
+            if (c.hashrate > best.hashrate)
+                best = c;
+        return best;
+    };
+
+    // Local work size and fast exit are compile time
+    // definitions : program has to be rebuilt when they change
+    auto apply = [this](const Candidate& _c) {
+        bool rebuild =
+            m_settings.localWorkSize != _c.local || m_settings.noExit != _c.noExit;
+        m_settings.globalWorkSize = _c.global;
+        m_settings.localWorkSize = _c.local;
+        m_settings.noExit = _c.noExit;
+        m_settings.globalWorkSizeMultiplier = _c.global / _c.local;
+        if (!rebuild)
+            return true;
+        m_searchKernel = cl::Kernel();
+        m_dagKernel = cl::Kernel();
+        m_lightChainKernel = cl::Kernel();
+        m_lightRoundKernel = cl::Kernel();
+        return initProgram();
+    };
+
+    cllog << "Autotuning work sizes ...";
+    CLSettings original = m_settings;
+    Candidate initial = {original.globalWorkSize, original.localWorkSize, original.noExit, 0.0};
+    unsigned groups = original.globalWorkSize / original.localWorkSize;
+
+    std::vector<Candidate> candidates;
     try
     {
+        // Fast exit is only available where it's already enabled (AMD)
+        // Work sizes given on command line are not swept
+        for (unsigned local : {64U, 128U, 256U})
+            for (bool noExit : {true, false})
+            {
+                if ((!noExit && original.noExit) ||
+                    (original.localWorkSet && local != original.localWorkSize))
+                    continue;
+                Candidate c = {groups * local, local, noExit, 0.0};
+                if (!apply(c))
+                    continue;
+                if (!tuneMeasure(c.hashrate))
+                {
+                    apply(initial);
+                    return;
+                }
+                candidates.push_back(c);
+            }
+        if (candidates.empty())
+            throw cl::Error(CL_BUILD_PROGRAM_FAILURE, "No candidate could be built");
+
+        Candidate best = pickBest(candidates);
+        candidates.clear();
+        for (unsigned factor : {1U, 2U, 4U, 8U, 16U})
+        {
+            // From 1/4 to 4 times the initial number of work groups
+            if (original.globalWorkSet && factor != 4)
+                continue;
+            unsigned global = std::max(groups * factor / 4, 1U) * best.local;
+            Candidate c = {global, best.local, best.noExit, 0.0};
+            if (!apply(c))
+                continue;
+            if (!tuneMeasure(c.hashrate))
+            {
+                apply(initial);
+                return;
+            }
+            candidates.push_back(c);
+        }
+        if (!candidates.empty())
+            best = pickBest(candidates);
+
+        if (!apply(best))
+            throw cl::Error(CL_BUILD_PROGRAM_FAILURE, "Unable to build best candidate");
+
+        cllog << "Autotune : global work " << best.global << " local work " << best.local
+              << (best.noExit ? " no exit " : " fast exit ")
+              << dev::getFormattedHashes(best.hashrate);
+
+        ProfileValues profile = {{"global", best.global}, {"local", best.local},
+            {"noexit", best.noExit ? 1U : 0U}, {"hashrate", (uint64_t)best.hashrate}};
+        if (!MinerProfile::save(profileKey(), profile))
+            cllog << "Unable to save tuning profile";
+    }
+    catch (cl::Error const& _e)
+    {
+        cllog << ethCLErrorHelper("Autotune failed", _e);
+        apply(initial);
+    }
+}
 
+void CLMiner::generateLight()
+{
+    // Launches are kept short not to trip display watchdogs
+    const uint32_t items = m_epochContext.lightNumItems;
+    const uint32_t chunk = 16384;
+    auto start = std::chrono::steady_clock::now();
+
+    ethash::hash512 first = EthashAux::lightCacheFirstItem(m_epochContext.epochNumber);
+    m_queue[0].enqueueWriteBuffer(m_light[0], CL_TRUE, 0, sizeof(first), &first);
+    m_lightChainKernel.setArg(0, m_light[0]);
+    for (uint32_t base = 1; base < items; base += chunk)
+    {
+        m_lightChainKernel.setArg(1, base);
+        m_lightChainKernel.setArg(2, std::min(base + chunk, items));
+        m_queue[0].enqueueNDRangeKernel(m_lightChainKernel, cl::NullRange, 1, 1);
+    }
+    m_lightRoundKernel.setArg(0, m_light[0]);
+    m_lightRoundKernel.setArg(1, items);
+    for (int round = 0; round < 3; round++)
+        for (uint32_t base = 0; base < items; base += chunk)
+        {
+            m_lightRoundKernel.setArg(2, base);
+            m_lightRoundKernel.setArg(3, std::min(base + chunk, items));
+            m_queue[0].enqueueNDRangeKernel(m_lightRoundKernel, cl::NullRange, 1, 1);
+        }
+    m_queue[0].finish();
+    cllog << "Built light cache on device in "
+          << std::chrono::duration_cast<std::chrono::milliseconds>(
+                 std::chrono::steady_clock::now() - start)
+                 .count()
+          << " ms.";
+
+    // Checked against host one if there's one at hand
+    if (!m_epochContext.lightCache)
+        return;
+    std::vector<uint8_t> built(m_epochContext.lightSize);
+    m_queue[0].enqueueReadBuffer(m_light[0], CL_TRUE, 0, built.size(), built.data());
+    if (memcmp(built.data(), m_epochContext.lightCache, built.size()) != 0)
+    {
+        cwarn << "Light cache built on device does not match host one. Using host one";
+        m_queue[0].enqueueWriteBuffer(
+            m_light[0], CL_TRUE, 0, m_epochContext.lightSize, m_epochContext.lightCache);
+    }
+}
+
+void CLMiner::generateDag()
+{
+    // Queue all chunks at once. Host only waits on a few
+    // milestone events to report progress.
+    const uint32_t workItems = m_dagItems * 2;  // GPU computes partial 512-bit DAG items.
+    const uint32_t chunk = 10000 * m_settings.localWorkSize;
+    const uint32_t chunks = (workItems + chunk - 1) / chunk;
+    const uint32_t milestoneEvery = std::max(chunks / 10, 1U);
+
+    std::vector<std::pair<cl::Event, unsigned>> milestones;
+    m_dagProgress.store(0, std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 0; i < chunks; i++)
+    {
+        uint32_t base = i * chunk;
+        uint32_t size = std::min(chunk, workItems - base);
+        size = ((size + m_settings.localWorkSize - 1) / m_settings.localWorkSize) *
+               m_settings.localWorkSize;
+        m_dagKernel.setArg(0, base);
+        if ((i + 1) % milestoneEvery == 0 && (i + 1) != chunks)
+        {
+            cl::Event event;
+            m_queue[0].enqueueNDRangeKernel(
+                m_dagKernel, cl::NullRange, size, m_settings.localWorkSize, nullptr, &event);
+            milestones.push_back(std::make_pair(event, (i + 1) * 100 / chunks));
+        }
+        else
+            m_queue[0].enqueueNDRangeKernel(
+                m_dagKernel, cl::NullRange, size, m_settings.localWorkSize);
+    }
+    m_queue[0].flush();
+
+    auto lastLog = start;
+    for (auto& milestone : milestones)
+    {
+        milestone.first.wait();
+        m_dagProgress.store(milestone.second, std::memory_order_relaxed);
+
+        // Don't flood the log when generation is fast
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration_cast<std::chrono::seconds>(now - lastLog).count() >= 1)
+        {
+            lastLog = now;
+            double elapsed =
+                (double)std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count();
+            double done = (double)m_epochContext.dagSize * milestone.second / 100;
+            cllog << "DAG generation " << milestone.second << "% "
+                  << dev::getFormattedMemory(elapsed ? done * 1000 / elapsed : 0) << "/s ETA "
+                  << (unsigned)(elapsed * (100 - milestone.second) / milestone.second / 1000)
+                  << " s.";
+        }
+    }
+    m_queue[0].finish();
+    m_dagProgress.store(100, std::memory_order_relaxed);
+
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start)
+                  .count();
+    m_dagRate.store(us ? (uint64_t)(m_epochContext.dagSize * 1000000.0 / us) : 0,
+        std::memory_order_relaxed);
+}
+
+bool CLMiner::initProgram()
+{
+    try
+    {
         char options[256] = {0};
         int computeCapability = 0;
 #ifndef __clang__
@@ -746,14 +1175,6 @@ bool CLMiner::initEpoch_internal()
         }
 
 #endif
-        // create context
-        m_context.clear();
-        m_context.push_back(cl::Context(vector<cl::Device>(&m_device, &m_device + 1)));
-        m_queue.clear();
-        m_queue.push_back(cl::CommandQueue(m_context[0], m_device));
-
-
-        m_dagItems = m_epochContext.dagNumItems;
 
         // patch source code
         // note: The kernels here are simply compiled version of the respective .cl kernels
@@ -778,20 +1199,58 @@ bool CLMiner::initEpoch_internal()
             addDefinition(code, "FAST_EXIT", 1);
 
 
-        // create miner OpenCL program
-        cl::Program::Sources sources{{code.data(), code.size()}};
-        cl::Program program(m_context[0], sources), binaryProgram;
-        try
+        // create miner OpenCL program. Look for it in cache first
+        // as building from source may take several seconds
+        cl::Program program, binaryProgram;
+        bool cachedProgram = false;
+        std::string cacheFile;
+        if (!m_settings.noCache)
         {
-            program.build({m_device}, options);
+            vector<unsigned char> bin_data;
+            cacheFile = programCacheFile(m_device, code, options, m_settings.cacheDir);
+            if (loadProgramBinary(cacheFile, bin_data))
+            {
+                try
+                {
+                    cl::Program::Binaries blobs({bin_data});
+                    program = cl::Program(m_context[0], {m_device}, blobs);
+                    program.build({m_device}, options);
+                    cachedProgram = true;
+                    cllog << "Loaded cached OpenCL program " << cacheFile;
+                }
+                catch (cl::Error const&)
+                {
+                    cwarn << "Cached OpenCL program " << cacheFile
+                          << " is not valid. Rebuilding...";
+                }
+            }
         }
-        catch (cl::BuildError const& buildErr)
+
+        if (!cachedProgram)
         {
-            cwarn << "OpenCL kernel build log:\n"
-                  << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(m_device);
-            cwarn << "OpenCL kernel build error (" << buildErr.err() << "):\n" << buildErr.what();
-            pause(MinerPauseEnum::PauseDueToInitEpochError);
-            return true;
+            auto startBuild = std::chrono::steady_clock::now();
+            cl::Program::Sources sources{{code.data(), code.size()}};
+            program = cl::Program(m_context[0], sources);
+            try
+            {
+                program.build({m_device}, options);
+            }
+            catch (cl::BuildError const& buildErr)
+            {
+                cwarn << "OpenCL kernel build log:\n"
+                      << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(m_device);
+                cwarn << "OpenCL kernel build error (" << buildErr.err() << "):\n"
+                      << buildErr.what();
+                return false;
+            }
+            cllog << "Built OpenCL program in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::steady_clock::now() - startBuild)
+                         .count()
+                  << " ms.";
+
+            if (!cacheFile.empty() && !saveProgramBinary(cacheFile, program))
+                cwarn << "Unable to cache OpenCL program in " << cacheFile;
         }
 
         /* If we have a binary kernel, we load it in tandem with the opencl,
@@ -856,124 +1315,263 @@ bool CLMiner::initEpoch_internal()
             }
         }
 
-        // create buffer for dag
-        try
+        cllog << "Loading kernels";
+
+        // If we have a binary kernel to use, let's try it
+        // otherwise just do a normal opencl load
+        if (loadedBinary)
+            m_searchKernel = cl::Kernel(binaryProgram, "search");
+        else
+            m_searchKernel = cl::Kernel(program, "search");
+
+        m_dagKernel = cl::Kernel(program, "GenerateDAG");
+        m_lightChainKernel = cl::Kernel(program, "GenerateLightChain");
+        m_lightRoundKernel = cl::Kernel(program, "GenerateLightRound");
+    }
+    catch (cl::Error const& err)
+    {
+        cwarn << ethCLErrorHelper("Loading kernels failed", err);
+        m_searchKernel = cl::Kernel();
+        m_dagKernel = cl::Kernel();
+        m_lightChainKernel = cl::Kernel();
+        m_lightRoundKernel = cl::Kernel();
+        return false;
+    }
+    return true;
+}
+
+bool CLMiner::initContext()
+{
+    try
+    {
+        // Context, queue, kernels and small buffers do not depend on
+        // epoch : create them once and keep them while miner is running
+        if (m_context.empty())
         {
-            cllog << "Creating DAG buffer, size: "
-                  << dev::getFormattedMemory((double)m_epochContext.dagSize)
-                  << ", free: "
-                  << dev::getFormattedMemory(
-                         (double)(m_deviceDescriptor.totalMemory - RequiredMemory));
-            m_dag.clear();
-            if (m_epochContext.dagNumItems & 1)
-            {
-                m_dag.push_back(
-                    cl::Buffer(m_context[0], CL_MEM_READ_ONLY, m_epochContext.dagSize / 2 + 64));
-                m_dag.push_back(
-                    cl::Buffer(m_context[0], CL_MEM_READ_ONLY, m_epochContext.dagSize / 2 - 64));
-            }
-            else
+            m_context.push_back(cl::Context(vector<cl::Device>(&m_device, &m_device + 1)));
+
+            // create queue, header buffer and mining buffer for each stream
+            cllog << "Creating " << m_settings.streams << " streams";
+            for (unsigned i = 0; i < m_settings.streams; i++)
             {
-                m_dag.push_back(
-                    cl::Buffer(m_context[0], CL_MEM_READ_ONLY, (m_epochContext.dagSize) / 2));
-                m_dag.push_back(
-                    cl::Buffer(m_context[0], CL_MEM_READ_ONLY, (m_epochContext.dagSize) / 2));
+                m_queue.push_back(cl::CommandQueue(m_context[0], m_device));
+                m_header.push_back(cl::Buffer(m_context[0], CL_MEM_READ_ONLY, 32));
+                m_searchBuffer.emplace_back(
+                    m_context[0], CL_MEM_WRITE_ONLY, sizeof(SearchResults));
             }
-            cllog << "Creating light cache buffer, size: "
-                  << dev::getFormattedMemory((double)m_epochContext.lightSize);
-            m_light.clear();
-            bool light_on_host = false;
-            try
+        }
+    }
+    catch (cl::Error const& err)
+    {
+        cwarn << ethCLErrorHelper("Creating OpenCL context failed", err);
+        m_context.clear();
+        m_queue.clear();
+        m_header.clear();
+        m_searchBuffer.clear();
+        return false;
+    }
+
+    return m_searchKernel() || initProgram();
+}
+
+bool CLMiner::initEpoch_internal()
+{
+    auto startInit = std::chrono::steady_clock::now();
+    size_t RequiredMemory = (m_epochContext.dagSize);
+
+    // Release the pause flag if any
+    resume(MinerPauseEnum::PauseDueToInsufficientMemory);
+    resume(MinerPauseEnum::PauseDueToInitEpochError);
+
+    // Check whether the current device has sufficient memory every time we recreate the dag
+    if (m_deviceDescriptor.totalMemory < RequiredMemory)
+    {
+        cllog << "Epoch " << m_epochContext.epochNumber << " requires "
+              << dev::getFormattedMemory((double)RequiredMemory) << " memory. Only "
+              << dev::getFormattedMemory((double)m_deviceDescriptor.totalMemory)
+              << " available on device.";
+        pause(MinerPauseEnum::PauseDueToInsufficientMemory);
+        return true;  // This will prevent to exit the thread and
+                      // Eventually resume mining when changing coin or epoch (NiceHash)
+    }
+
+    try
+    {
+        // Normally done as soon as the device is initialized
+        if (!initContext())
+        {
+            pause(MinerPauseEnum::PauseDueToInitEpochError);
+            return true;
+        }
+
+        m_dagItems = m_epochContext.dagNumItems;
+
+        // DAG is split in two halves holding even and odd items. Allocate
+        // them with room for a few more epochs so next switches only have
+        // to regenerate contents
+        size_t dagHalfSize = ethash::get_full_dataset_size((m_dagItems + 1) / 2);
+        if (m_dag.size() != 2 || m_allocated_memory_dag < dagHalfSize ||
+            m_allocated_memory_light_cache < m_epochContext.lightSize)
+        {
+            // Headroom is capped by the largest buffer the device allows and only
+            // taken if it leaves what the driver keeps for itself. Exact sizes
+            // are tried again should the driver refuse it anyway
+            size_t lightSize = m_epochContext.lightSize;
+            size_t allocDagHalfSize = dagHalfSize;
+            size_t allocLightSize = lightSize;
+            if (m_dagHeadroom && m_epochContext.epochNumber >= 0)
             {
-                m_light.emplace_back(m_context[0], CL_MEM_READ_ONLY, m_epochContext.lightSize);
+                int headroomEpoch = m_epochContext.epochNumber + DAG_HEADROOM_EPOCHS;
+                int items = ethash::calculate_full_dataset_num_items(headroomEpoch);
+                size_t maxAlloc = m_deviceDescriptor.clMaxMemAlloc;
+                size_t headroomDagHalfSize = std::max(dagHalfSize,
+                    std::min(ethash::get_full_dataset_size((items + 1) / 2), maxAlloc));
+                size_t headroomLightSize = std::max(lightSize,
+                    std::min(ethash::get_light_cache_size(
+                                 ethash::calculate_light_cache_num_items(headroomEpoch)),
+                        maxAlloc));
+                if (m_deviceDescriptor.totalMemory >=
+                    headroomDagHalfSize * 2 + headroomLightSize + DAG_HEADROOM_RESERVE)
+                {
+                    allocDagHalfSize = headroomDagHalfSize;
+                    allocLightSize = headroomLightSize;
+                }
             }
-            catch (cl::Error const& err)
+
+            std::vector<std::pair<size_t, size_t>> allocSizes = {
+                {allocDagHalfSize, allocLightSize}};
+            if (allocDagHalfSize != dagHalfSize || allocLightSize != lightSize)
+                allocSizes.emplace_back(dagHalfSize, lightSize);
+
+            bool allocated = false;
+            for (auto const& allocSize : allocSizes)
             {
-                if ((err.err() == CL_OUT_OF_RESOURCES) || (err.err() == CL_OUT_OF_HOST_MEMORY))
+                allocDagHalfSize = allocSize.first;
+                allocLightSize = allocSize.second;
+                try
                 {
-                    // Ok, no room for light cache on GPU. Try allocating on host
-                    clog(WarnChannel) << "No room on GPU, allocating light cache on host";
-                    clog(WarnChannel) << "Generating DAG will take minutes instead of seconds";
-                    light_on_host = true;
+                    cllog << "Creating DAG buffer, size: "
+                          << dev::getFormattedMemory((double)(allocDagHalfSize * 2))
+                          << ", free: "
+                          << dev::getFormattedMemory(
+                                 (double)(m_deviceDescriptor.totalMemory - allocDagHalfSize * 2));
+
+                    // Release previous buffers before allocating new ones
+                    m_dag.clear();
+                    m_light.clear();
+                    m_allocated_memory_dag = 0;
+                    m_allocated_memory_light_cache = 0;
+
+                    m_dag.push_back(cl::Buffer(m_context[0], CL_MEM_READ_ONLY, allocDagHalfSize));
+                    m_dag.push_back(cl::Buffer(m_context[0], CL_MEM_READ_ONLY, allocDagHalfSize));
+                    cllog << "Creating light cache buffer, size: "
+                          << dev::getFormattedMemory((double)allocLightSize);
+                    bool light_on_host = false;
+                    // Written by kernels when built on device
+                    cl_mem_flags lightFlags =
+                        m_settings.lightGen ? CL_MEM_READ_WRITE : CL_MEM_READ_ONLY;
+                    try
+                    {
+                        m_light.emplace_back(m_context[0], lightFlags, allocLightSize);
+                    }
+                    catch (cl::Error const& err)
+                    {
+                        if ((err.err() == CL_OUT_OF_RESOURCES) ||
+                            (err.err() == CL_OUT_OF_HOST_MEMORY))
+                        {
+                            // Ok, no room for light cache on GPU. Try allocating on host
+                            clog(WarnChannel) << "No room on GPU, allocating light cache on host";
+                            clog(WarnChannel)
+                                << "Generating DAG will take minutes instead of seconds";
+                            light_on_host = true;
+                        }
+                        else
+                            throw;
+                    }
+                    if (light_on_host)
+                    {
+                        m_light.emplace_back(
+                            m_context[0], lightFlags | CL_MEM_ALLOC_HOST_PTR, allocLightSize);
+                        cllog << "WARNING: Generating DAG will take minutes, not seconds";
+                    }
+                    m_allocated_memory_dag = allocDagHalfSize;
+                    m_allocated_memory_light_cache = allocLightSize;
+                    allocated = true;
+                    break;
+                }
+                catch (cl::Error const& err)
+                {
+                    cwarn << ethCLErrorHelper("Creating DAG buffer failed", err);
+                    m_dag.clear();
+                    m_light.clear();
                 }
-                else
-                    throw;
             }
-            if (light_on_host)
+            if (!allocated)
             {
-                m_light.emplace_back(m_context[0], CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR,
-                    m_epochContext.lightSize);
-                cllog << "WARNING: Generating DAG will take minutes, not seconds";
+                pause(MinerPauseEnum::PauseDueToInitEpochError);
+                return true;
             }
-            cllog << "Loading kernels";
-
-            // If we have a binary kernel to use, let's try it
-            // otherwise just do a normal opencl load
-            if (loadedBinary)
-                m_searchKernel = cl::Kernel(binaryProgram, "search");
-            else
-                m_searchKernel = cl::Kernel(program, "search");
-
-            m_dagKernel = cl::Kernel(program, "GenerateDAG");
-
-            m_queue[0].enqueueWriteBuffer(
-                m_light[0], CL_TRUE, 0, m_epochContext.lightSize, m_epochContext.lightCache);
+            cllog << "Generating split DAG + Light (total): "
+                  << dev::getFormattedMemory((double)RequiredMemory);
         }
-        catch (cl::Error const& err)
+        else
         {
-            cwarn << ethCLErrorHelper("Creating DAG buffer failed", err);
-            pause(MinerPauseEnum::PauseDueToInitEpochError);
-            return true;
+            cllog << "Generating split DAG + Light (reusing buffers): "
+                  << dev::getFormattedMemory((double)RequiredMemory);
         }
-        // create buffer for header
-        cllog << "Creating buffer for header.";
-        m_header.clear();
-        m_header.push_back(cl::Buffer(m_context[0], CL_MEM_READ_ONLY, 32));
 
         m_searchKernel.setArg(1, m_header[0]);
         m_searchKernel.setArg(2, m_dag[0]);
         m_searchKernel.setArg(3, m_dag[1]);
         m_searchKernel.setArg(4, m_dagItems);
 
-        // create mining buffers
-        cllog << "Creating mining buffer";
-        m_searchBuffer.clear();
-        m_searchBuffer.emplace_back(m_context[0], CL_MEM_WRITE_ONLY, sizeof(SearchResults));
-
         m_dagKernel.setArg(1, m_light[0]);
         m_dagKernel.setArg(2, m_dag[0]);
         m_dagKernel.setArg(3, m_dag[1]);
         m_dagKernel.setArg(4, (uint32_t)(m_epochContext.lightSize / 64));
 
-        const uint32_t workItems = m_dagItems * 2;  // GPU computes partial 512-bit DAG items.
+        if (!acquireDagTurn())
+            return false;
 
-        uint32_t start;
-        const uint32_t chunk = 10000 * m_settings.localWorkSize;
-        for (start = 0; start <= workItems - chunk; start += chunk)
-        {
-            m_dagKernel.setArg(0, start);
-            m_queue[0].enqueueNDRangeKernel(
-                m_dagKernel, cl::NullRange, chunk, m_settings.localWorkSize);
-            m_queue[0].finish();
-        }
-        if (start < workItems)
-        {
-            uint32_t groupsLeft = workItems - start;
-            groupsLeft = (groupsLeft + m_settings.localWorkSize - 1) / m_settings.localWorkSize;
-            m_dagKernel.setArg(0, start);
-            m_queue[0].enqueueNDRangeKernel(m_dagKernel, cl::NullRange,
-                groupsLeft * m_settings.localWorkSize, m_settings.localWorkSize);
-            m_queue[0].finish();
-        }
+        // Light cache is only read by DAG generation : the in order queue
+        // runs it after the upload, which needs no wait of its own as the
+        // context holds the host copy and generateDag() finishes the queue
+        if (m_settings.lightGen || !m_epochContext.lightCache)
+            generateLight();
+        else
+            m_queue[0].enqueueWriteBuffer(
+                m_light[0], CL_FALSE, 0, m_epochContext.lightSize, m_epochContext.lightCache);
+        generateDag();
 
         auto dagTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startInit);
         cllog << dev::getFormattedMemory((double)m_epochContext.dagSize)
               << " of DAG data generated in "
-              << dagTime.count() << " ms.";
+              << dagTime.count() << " ms. ("
+              << dev::getFormattedMemory(dagTime.count() ?
+                                             (double)m_epochContext.dagSize * 1000 / dagTime.count() :
+                                             0.0)
+              << "/s)";
     }
     catch (cl::Error const& err)
     {
         cllog << ethCLErrorHelper("OpenCL init failed", err);
+
+        // Drivers may only back buffers on first use : once
+        // with exact sizes before giving up
+        bool headroom =
+            m_allocated_memory_dag > ethash::get_full_dataset_size((m_dagItems + 1) / 2) ||
+            m_allocated_memory_light_cache > m_epochContext.lightSize;
+        if (headroom && (err.err() == CL_MEM_OBJECT_ALLOCATION_FAILURE ||
+                            err.err() == CL_OUT_OF_RESOURCES))
+        {
+            cllog << "Retrying without DAG headroom";
+            m_dagHeadroom = false;
+            m_dag.clear();
+            m_light.clear();
+            m_allocated_memory_dag = 0;
+            m_allocated_memory_light_cache = 0;
+            return initEpoch_internal();
+        }
         pause(MinerPauseEnum::PauseDueToInitEpochError);
         return false;
     }
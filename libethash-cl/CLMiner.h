@@ -10,6 +10,7 @@
 #include <libdevcore/Worker.h>
 #include <libethcore/EthashAux.h>
 #include <libethcore/Miner.h>
+#include <libethcore/MinerProfile.h>
 
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/lexical_cast.hpp>
@@ -49,6 +50,8 @@ public:
 
     static void enumDevices(std::map<string, DeviceDescriptor>& _DevicesCollection);
 
+    bool buildsLight() const override { return m_settings.lightGen; }
+
 protected:
     bool initDevice() override;
 
@@ -60,11 +63,23 @@ private:
     
     void workLoop() override;
 
+    bool initContext();
+    bool initProgram();
+    void generateDag();
+    void generateLight();
+
+    std::string profileKey();
+    void applyProfile(const ProfileValues& _profile);
+    void autoTune();
+    bool tuneMeasure(double& _hashrate);
+
     vector<cl::Context> m_context;
     vector<cl::CommandQueue> m_queue;
     vector<cl::CommandQueue> m_abortqueue;
     cl::Kernel m_searchKernel;
     cl::Kernel m_dagKernel;
+    cl::Kernel m_lightChainKernel;
+    cl::Kernel m_lightRoundKernel;
     cl::Device m_device;
 
     vector<cl::Buffer> m_dag;
@@ -72,11 +87,26 @@ private:
     vector<cl::Buffer> m_header;
     vector<cl::Buffer> m_searchBuffer;
 
+    // Last abort word reset queued on each stream, which
+    // kick_miner() orders its abort writes after
+    vector<cl::Event> m_abortReset;
+    boost::mutex x_abortReset;
+
     void clear_buffer() {
+        m_searchKernel = cl::Kernel();
+        m_dagKernel = cl::Kernel();
+        m_lightChainKernel = cl::Kernel();
+        m_lightRoundKernel = cl::Kernel();
+        m_allocated_memory_dag = 0;
+        m_allocated_memory_light_cache = 0;
         m_dag.clear();
         m_light.clear();
         m_header.clear();
         m_searchBuffer.clear();
+        {
+            boost::mutex::scoped_lock l(x_abortReset);
+            m_abortReset.clear();
+        }
         m_queue.clear();
         m_context.clear();
         m_abortqueue.clear();
@@ -85,7 +115,11 @@ private:
     CLSettings m_settings;
 
     unsigned m_dagItems = 0;
+    size_t m_allocated_memory_dag = 0;  // Size of each of the two halves
+    size_t m_allocated_memory_light_cache = 0;
+    bool m_dagHeadroom = true;  // Cleared once the driver failed buffers with headroom
     uint64_t m_lastNonce = 0;
+    bool m_tuned = false;
 
 };
 
@@ -487,3 +487,29 @@ __kernel void GenerateDAG(uint start, __global const uint16 *_Cache, __global ui
     //if (NodeIdx < DAG_SIZE)
     DAG[(NodeIdx / 2) | (NodeIdx & 1)] = DAGNode;
 }
+
+// Light cache items depend on previous ones : both run on a single work item
+
+__kernel void GenerateLightChain(__global uint16 *_Cache, uint start, uint end)
+{
+    __global Node *Cache = (__global Node *) _Cache;
+    Node item = Cache[start - 1];
+    for (uint i = start; i < end; ++i) {
+        SHA3_512(item.qwords);
+        Cache[i] = item;
+    }
+}
+
+__kernel void GenerateLightRound(__global uint16 *_Cache, uint light_size, uint start, uint end)
+{
+    __global Node *Cache = (__global Node *) _Cache;
+    Node item;
+    for (uint i = start; i < end; ++i) {
+        uint v = Cache[i].dwords[0] % light_size;
+        uint w = (light_size + i - 1) % light_size;
+        for (uint k = 0; k < 4; ++k)
+            item.dqwords[k] = Cache[v].dqwords[k] ^ Cache[w].dqwords[k];
+        SHA3_512(item.qwords);
+        Cache[i] = item;
+    }
+}
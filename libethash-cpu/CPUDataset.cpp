@@ -0,0 +1,276 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+// From numaif.h : spares a dependency on libnuma
+#define ETH_MPOL_BIND 2
+#endif
+
+#include <ethash/keccak.hpp>
+
+#include "CPUDataset.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace
+{
+// Items generated at a time by a miner
+constexpr uint32_t c_chunkItems = 4096;
+
+// Number of parents mixed into each 512 bit dataset item
+constexpr uint32_t c_itemParents = 256;
+
+// Last epoch stored in the DagCache (replicas hold the same data)
+std::atomic<int> s_storedEpoch = {-1};
+
+inline uint32_t fnv1(uint32_t u, uint32_t v)
+{
+    return (u * 0x01000193) ^ v;
+}
+
+ethash::hash512 calculateItem512(const EpochContext& _ec, uint32_t _index)
+{
+    const uint32_t numCacheItems = uint32_t(_ec.lightNumItems);
+
+    ethash::hash512 mix = _ec.lightCache[_index % numCacheItems];
+    mix.word32s[0] ^= _index;
+    mix = ethash::keccak512(mix.bytes, sizeof(mix));
+
+    for (uint32_t j = 0; j < c_itemParents; j++)
+    {
+        uint32_t t = fnv1(_index ^ j, mix.word32s[j % 16]);
+        const ethash::hash512& parent = _ec.lightCache[t % numCacheItems];
+        for (size_t w = 0; w < 16; w++)
+            mix.word32s[w] = fnv1(mix.word32s[w], parent.word32s[w]);
+    }
+
+    return ethash::keccak512(mix.bytes, sizeof(mix));
+}
+
+#if defined(__linux__)
+
+// Binds [_addr, _addr + _size) to NUMA _node. Must happen before first touch.
+bool bindToNode(void* _addr, uint64_t _size, int _node)
+{
+    unsigned long mask[16] = {};
+    if (_node < 0 || _node >= int(sizeof(mask) * 8))
+        return false;
+    mask[_node / (sizeof(unsigned long) * 8)] |= 1UL << (_node % (sizeof(unsigned long) * 8));
+    return syscall(SYS_mbind, _addr, _size, ETH_MPOL_BIND, mask, sizeof(mask) * 8, 0) == 0;
+}
+
+#endif
+
+}  // namespace
+
+std::mutex CPUDataset::s_mutex;
+std::map<int, std::shared_ptr<CPUDataset>> CPUDataset::s_current;
+
+CPUDataset::CPUDataset(int _epoch, int _node, uint32_t _numItems)
+  : m_epoch(_epoch),
+    m_node(_node),
+    m_numItems(_numItems),
+    m_numChunks((_numItems + c_chunkItems - 1) / c_chunkItems)
+{}
+
+CPUDataset::~CPUDataset()
+{
+#if defined(__linux__)
+    if (m_mapSize)
+    {
+        munmap(m_items, m_mapSize);
+        return;
+    }
+#endif
+#if defined(_WIN32)
+    _aligned_free(m_items);
+#else
+    free(m_items);
+#endif
+}
+
+bool CPUDataset::allocate(unsigned _hugePages)
+{
+    const uint64_t size = this->size();
+
+#if defined(__linux__)
+    // Try the largest requested page size first, then smaller ones.
+    // Explicit huge pages need to be reserved (vm.nr_hugepages or
+    // hugepagesz/hugepages kernel parameters) otherwise mmap fails.
+    struct
+    {
+        unsigned pages;
+        uint64_t pageSize;
+        int flags;
+    } const attempts[] = {{Pages1G, 1ULL << 30, MAP_HUGETLB | MAP_HUGE_1GB},
+        {Pages2M, 2ULL << 20, MAP_HUGETLB | MAP_HUGE_2MB}, {PagesTransparent, 0, 0},
+        {PagesDefault, 0, 0}};
+
+    for (const auto& attempt : attempts)
+    {
+        if (attempt.pages > _hugePages)
+            continue;
+        if (attempt.pages == PagesDefault && m_node < 0)
+            break;  // Plain heap allocation below will do
+
+        uint64_t granularity = attempt.pageSize ? attempt.pageSize : 4096;
+        uint64_t mapSize = (size + granularity - 1) / granularity * granularity;
+        void* p = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | attempt.flags, -1, 0);
+        if (p == MAP_FAILED)
+            continue;
+        if (attempt.pages == PagesTransparent)
+            madvise(p, mapSize, MADV_HUGEPAGE);
+        if (m_node >= 0 && !bindToNode(p, mapSize, m_node))
+        {
+            munmap(p, mapSize);
+            continue;
+        }
+        m_items = static_cast<ethash::hash1024*>(p);
+        m_mapSize = mapSize;
+        m_pageSize = attempt.pageSize;
+        return true;
+    }
+#endif
+
+    void* p = nullptr;
+#if defined(_WIN32)
+    p = _aligned_malloc(size, 4096);
+#else
+    if (posix_memalign(&p, 4096, size) != 0)
+        p = nullptr;
+#endif
+    m_items = static_cast<ethash::hash1024*>(p);
+    return m_items != nullptr;
+}
+
+std::shared_ptr<CPUDataset> CPUDataset::acquire(int _epoch, int _node, unsigned _hugePages)
+{
+    std::lock_guard<std::mutex> l(s_mutex);
+    auto& current = s_current[_node];
+    if (current && current->epoch() == _epoch)
+        return current;
+
+    // Drop ours first : previous epoch memory is released
+    // as soon as the last miner using it switches over
+    current.reset();
+
+    std::shared_ptr<CPUDataset> dataset(new CPUDataset(
+        _epoch, _node, uint32_t(ethash::calculate_full_dataset_num_items(_epoch))));
+    if (!dataset->allocate(_hugePages))
+        return nullptr;
+    dataset->m_cached = DagCache::open(DagCache::Dataset, _epoch, dataset->size());
+    dataset->m_fromCache = bool(dataset->m_cached);
+    current = dataset;
+    return current;
+}
+
+unsigned CPUDataset::numaNodes()
+{
+    unsigned nodes = 0;
+#if defined(__linux__)
+    if (DIR* dir = opendir("/sys/devices/system/node"))
+    {
+        while (struct dirent* entry = readdir(dir))
+        {
+            unsigned n;
+            if (sscanf(entry->d_name, "node%u", &n) == 1)
+                nodes++;
+        }
+        closedir(dir);
+    }
+#endif
+    return nodes ? nodes : 1;
+}
+
+bool CPUDataset::generate(const EpochContext& _ec, const std::function<bool()>& _stop)
+{
+    const ethash::hash1024* cached =
+        m_cached ? static_cast<const ethash::hash1024*>(m_cached->data()) : nullptr;
+
+    // A chunk once picked is always completed : it takes
+    // a fraction of a second and leaves no holes in the dataset
+    while (!_stop())
+    {
+        uint32_t chunk = m_nextChunk.fetch_add(1, std::memory_order_relaxed);
+        if (chunk >= m_numChunks)
+            break;
+
+        uint32_t i = chunk * c_chunkItems;
+        uint32_t end = std::min(i + c_chunkItems, m_numItems);
+        if (cached)
+        {
+            memcpy(&m_items[i], &cached[i], (end - i) * sizeof(ethash::hash1024));
+        }
+        else
+        {
+            for (; i < end; i++)
+            {
+                m_items[i].hash512s[0] = calculateItem512(_ec, i * 2);
+                m_items[i].hash512s[1] = calculateItem512(_ec, i * 2 + 1);
+            }
+        }
+        m_doneChunks.fetch_add(1, std::memory_order_release);
+    }
+
+    // Wait for chunks still being processed by others
+    while (!ready())
+    {
+        if (_stop())
+            return false;
+        this_thread::sleep_for(chrono::milliseconds(20));
+    }
+
+    // First one out persists a freshly generated dataset
+    // and releases the mapping
+    if (!m_finalized.exchange(true))
+    {
+        if (!m_fromCache && DagCache::enabled() && s_storedEpoch.exchange(m_epoch) != m_epoch)
+            DagCache::store(DagCache::Dataset, m_epoch, m_items, size());
+        m_cached.reset();
+    }
+    return true;
+}
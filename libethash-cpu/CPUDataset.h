@@ -0,0 +1,115 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <ethash/ethash.hpp>
+
+#include <libethcore/DagCache.h>
+#include <libethcore/EthashAux.h>
+
+namespace dev
+{
+namespace eth
+{
+/*
+ * Fully materialized ethash dataset shared by all CPU miners working on
+ * the same epoch. Unlike ethash's lazily built full context items are
+ * laid out contiguously so the search engine can prefetch them.
+ *
+ * Generation is cooperative : every miner calling generate() picks
+ * chunks of items until none is left, then waits for the others.
+ *
+ * Optionally one replica is kept per NUMA node, bound to that node's
+ * memory, and backed by huge pages to spare TLB misses on random reads.
+ *
+ * When the DagCache is enabled chunks are copied from the cache file
+ * instead, or the dataset is stored there once generated.
+ */
+class CPUDataset
+{
+public:
+    ~CPUDataset();
+
+    // Backing pages
+    enum HugePages
+    {
+        PagesDefault = 0,      // Regular allocation
+        PagesTransparent = 1,  // Regular pages with transparent huge pages advised
+        Pages2M = 2,           // Explicit 2 MB huge pages
+        Pages1G = 3            // Explicit 1 GB huge pages
+    };
+
+    // Returns the dataset for _epoch local to NUMA _node (-1 = any node)
+    // allocating it if needed. Explicit huge pages fall back to smaller
+    // ones when not available.
+    // Returns nullptr if memory could not be allocated.
+    static std::shared_ptr<CPUDataset> acquire(
+        int _epoch, int _node = -1, unsigned _hugePages = PagesDefault);
+
+    // Number of configured NUMA nodes (1 if not NUMA or unknown)
+    static unsigned numaNodes();
+
+    // Contributes to generation. Returns true once the whole dataset is ready,
+    // false if _stop returned true meanwhile.
+    bool generate(const EpochContext& _ec, const std::function<bool()>& _stop);
+
+    bool ready() const { return m_doneChunks.load(std::memory_order_acquire) == m_numChunks; }
+    unsigned progress() const { return unsigned(m_doneChunks.load() * 100 / m_numChunks); }
+
+    int epoch() const { return m_epoch; }
+    uint32_t numItems() const { return m_numItems; }
+    uint64_t size() const { return uint64_t(m_numItems) * sizeof(ethash::hash1024); }
+    const ethash::hash1024* items() const { return m_items; }
+
+    int node() const { return m_node; }
+    // Size of pages actually backing the dataset (0 when transparent or unknown)
+    uint64_t pageSize() const { return m_pageSize; }
+    bool fromCache() const { return m_fromCache; }
+
+private:
+    CPUDataset(int _epoch, int _node, uint32_t _numItems);
+
+    bool allocate(unsigned _hugePages);
+
+    int m_epoch;
+    int m_node;
+    uint32_t m_numItems;
+    ethash::hash1024* m_items = nullptr;
+    uint64_t m_mapSize = 0;  // Non zero when memory was mapped
+    uint64_t m_pageSize = 0;
+
+    uint32_t m_numChunks;
+    std::atomic<uint32_t> m_nextChunk = {0};
+    std::atomic<uint32_t> m_doneChunks = {0};
+
+    std::shared_ptr<DagCacheFile> m_cached;  // Released once copied
+    bool m_fromCache = false;
+    std::atomic<bool> m_finalized = {false};
+
+    static std::mutex s_mutex;
+    static std::map<int, std::shared_ptr<CPUDataset>> s_current;  // By node
+};
+
+}  // namespace eth
+}  // namespace dev
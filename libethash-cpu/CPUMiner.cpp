@@ -24,6 +24,7 @@ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
 #if !defined(_GNU_SOURCE)
 #define _GNU_SOURCE /* we need sched_setaffinity() */
 #endif
+#include <dirent.h>
 #include <error.h>
 #include <sched.h>
 #include <unistd.h>
@@ -34,6 +35,9 @@ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <boost/version.hpp>
 
+#include <algorithm>
+#include <fstream>
+
 #if 0
 #include <boost/fiber/numa/pin_thread.hpp>
 #include <boost/fiber/numa/topology.hpp>
@@ -117,6 +121,28 @@ static size_t getTotalPhysAvailableMemory()
 #endif
 }
 
+/*
+ * returns the NUMA node a cpu belongs to (-1 if unknown)
+ */
+static int getCpuNode(unsigned _cpu)
+{
+#if defined(__linux__)
+    int node = -1;
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(_cpu);
+    if (DIR* dir = opendir(path.c_str()))
+    {
+        while (struct dirent* entry = readdir(dir))
+            if (sscanf(entry->d_name, "node%d", &node) == 1)
+                break;
+        closedir(dir);
+    }
+    return node;
+#else
+    (void)_cpu;
+    return -1;
+#endif
+}
+
 /*
  * return numbers of available CPUs
  */
@@ -161,6 +187,92 @@ unsigned CPUMiner::getNumDevices()
 }
 
 
+/*
+ * returns the cpus miners may be bound to according to placement settings
+ */
+static std::vector<unsigned> getPlacement(const CPSettings& _settings)
+{
+    std::vector<unsigned> cpus;
+#if defined(__linux__)
+    // Honour affinity mask inherited from cgroup cpuset, taskset, etc.
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+    {
+        for (unsigned cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            if (CPU_ISSET(cpu, &allowed))
+                cpus.push_back(cpu);
+    }
+    else
+    {
+        cwarn << "Error in func " << __FUNCTION__ << " at sched_getaffinity() \""
+              << strerror(errno) << "\"\n";
+    }
+#endif
+    if (cpus.empty())
+        for (unsigned cpu = 0; cpu < CPUMiner::getNumDevices(); cpu++)
+            cpus.push_back(cpu);
+
+    if (_settings.cores.size())
+    {
+        std::vector<unsigned> selected;
+        for (auto cpu : _settings.cores)
+        {
+            if (std::find(cpus.begin(), cpus.end(), cpu) != cpus.end())
+                selected.push_back(cpu);
+            else
+                cwarn << "Cpu " << cpu << " is not available to this process. Ignored.";
+        }
+        return selected;
+    }
+
+    // Group logical cpus by physical core preserving order
+    std::vector<std::vector<unsigned>> cores;
+#if defined(__linux__)
+    std::map<std::pair<int, int>, size_t> coreIndex;
+    for (auto cpu : cpus)
+    {
+        std::string topology = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+        int package = -1, core = -1;
+        std::ifstream(topology + "physical_package_id") >> package;
+        std::ifstream(topology + "core_id") >> core;
+        if (core < 0)
+        {
+            // Unknown topology : treat as a core of its own
+            cores.push_back({cpu});
+            continue;
+        }
+        auto key = std::make_pair(package, core);
+        auto it = coreIndex.find(key);
+        if (it == coreIndex.end())
+        {
+            coreIndex[key] = cores.size();
+            cores.push_back({cpu});
+        }
+        else
+        {
+            cores[it->second].push_back(cpu);
+        }
+    }
+#else
+    for (auto cpu : cpus)
+        cores.push_back({cpu});
+#endif
+
+    std::vector<unsigned> selected;
+    for (size_t i = _settings.reserve; i < cores.size(); i++)
+    {
+        if (_settings.placement == "cores")
+            selected.push_back(cores[i].front());
+        else
+            selected.insert(selected.end(), cores[i].begin(), cores[i].end());
+    }
+    if (selected.empty())
+        cwarn << "No cpu left for mining after reserving " << _settings.reserve << " cores";
+    return selected;
+}
+
+
 /* ######################## CPU Miner ######################## */
 
 struct CPUChannel : public LogChannel
@@ -225,6 +337,29 @@ bool CPUMiner::initDevice()
         // Handle Errorcode (GetLastError) ??
     }
 #endif
+
+    if (m_settings.engine != "scalar")
+    {
+        m_engine.reset(new CPUSearch(m_settings.engine));
+        if (m_settings.engine != "auto" && m_settings.engine != m_engine->name())
+            cwarn << "cp-" << m_index << " Engine " << m_settings.engine
+                  << " not supported. Available : " << CPUSearch::supported();
+        cpulog << "cp-" << m_index << " Using " << m_engine->name() << " engine ("
+               << m_engine->lanes() << " lanes)";
+
+        // Replicas are only worth it when there's more than one node
+        if (m_settings.numa && CPUDataset::numaNodes() > 1)
+        {
+            m_numaNode = getCpuNode(m_deviceDescriptor.cpCpuNumer);
+            if (m_numaNode < 0)
+                cwarn << "cp-" << m_index << " Unable to find NUMA node of cpu "
+                      << m_deviceDescriptor.cpCpuNumer;
+            else
+                cpulog << "cp-" << m_index << " Using dataset replica of NUMA node "
+                       << m_numaNode;
+        }
+    }
+
     DEV_BUILD_LOG_PROGRAMFLOW(cpulog, "cp-" << m_index << " CPUMiner::initDevice end");
     return true;
 }
@@ -239,6 +374,40 @@ bool CPUMiner::initDevice()
  */
 bool CPUMiner::initEpoch_internal()
 {
+    // ethash::search builds its dataset lazily
+    if (!m_engine)
+        return true;
+
+    auto startInit = std::chrono::steady_clock::now();
+
+    // Release previous epoch before allocating the new one
+    m_dataset.reset();
+    m_dataset =
+        CPUDataset::acquire(m_epochContext.epochNumber, m_numaNode, m_settings.hugePages);
+    if (!m_dataset)
+    {
+        cwarn << "cp-" << m_index << " Unable to allocate dataset. Falling back to ethash::search";
+        return true;
+    }
+
+    if (!acquireDagTurn())
+        return false;
+    if (!m_dataset->generate(m_epochContext, [this]() {
+            m_dagProgress.store(m_dataset->progress(), std::memory_order_relaxed);
+            return shouldStop();
+        }))
+        return false;
+
+    m_dagProgress.store(100, std::memory_order_relaxed);
+    cpulog << "cp-" << m_index << " Dataset of "
+           << dev::getFormattedMemory((double)m_dataset->size()) << " ready in "
+           << std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::steady_clock::now() - startInit)
+                  .count()
+           << " ms." << (m_dataset->fromCache() ? " (cached)" : "")
+           << (m_dataset->pageSize() ?
+                      " Pages : " + dev::getFormattedMemory((double)m_dataset->pageSize()) :
+                      "");
     return true;
 }
 
@@ -257,11 +426,25 @@ void CPUMiner::kick_miner()
 }
 
 
-void CPUMiner::search(const dev::eth::WorkPackage& w)
+void CPUMiner::search(std::shared_ptr<const WorkPackage> const& _wp)
 {
-    constexpr size_t blocksize = 30;
+    const WorkPackage& w = *_wp;
 
-    const auto& context = ethash::get_global_epoch_context_full(w.epoch);
+    // Multi lane engines need a multiple of their lanes
+    const size_t blocksize = m_dataset ? 64 : 30;
+
+    // Held while searching : the cache may evict it meanwhile
+    EpochManager::FullContextPtr context;
+    if (!m_dataset)
+    {
+        context = EpochManager::m().getFull(w.epoch);
+        if (!context)
+        {
+            cwarn << "cp-" << m_index << " Unable to allocate dataset of epoch " << w.epoch;
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            return;
+        }
+    }
     const auto header = ethash::hash256_from_bytes(w.header.data());
     const auto boundary = ethash::hash256_from_bytes(w.boundary.data());
     auto nonce = w.startNonce;
@@ -277,12 +460,26 @@ void CPUMiner::search(const dev::eth::WorkPackage& w)
         if (shouldStop())
             break;
 
+        bool found;
+        uint64_t solutionNonce;
+        ethash::hash256 mixHash;
+        if (m_dataset)
+        {
+            found = m_engine->search(
+                *m_dataset, header, boundary, nonce, blocksize, solutionNonce, mixHash);
+        }
+        else
+        {
+            auto r = ethash::search(*context, header, boundary, nonce, blocksize);
+            found = r.solution_found;
+            solutionNonce = r.nonce;
+            mixHash = r.mix_hash;
+        }
 
-        auto r = ethash::search(context, header, boundary, nonce, blocksize);
-        if (r.solution_found)
+        if (found)
         {
-            h256 mix{reinterpret_cast<byte*>(r.mix_hash.bytes), h256::ConstructFromPointer};
-            auto sol = Solution{r.nonce, mix, w, std::chrono::steady_clock::now(), m_index};
+            h256 mix{reinterpret_cast<byte*>(mixHash.bytes), h256::ConstructFromPointer};
+            auto sol = Solution{solutionNonce, mix, _wp, std::chrono::steady_clock::now(), m_index};
 
             cpulog << EthWhite << "Job: " << w.header.abridged()
                    << " Sol: " << toHex(sol.nonce, HexPrefix::Add) << EthReset;
@@ -292,6 +489,7 @@ void CPUMiner::search(const dev::eth::WorkPackage& w)
 
         // Update the hash rate
         updateHashRate(blocksize, 1);
+        throttle();
     }
 }
 
@@ -303,8 +501,7 @@ void CPUMiner::workLoop()
 {
     DEV_BUILD_LOG_PROGRAMFLOW(cpulog, "cp-" << m_index << " CPUMiner::workLoop() begin");
 
-    WorkPackage current;
-    current.header = h256();
+    std::shared_ptr<const WorkPackage> current = std::make_shared<const WorkPackage>();
 
     if (!initDevice())
         return;
@@ -312,20 +509,23 @@ void CPUMiner::workLoop()
     while (!shouldStop())
     {
         // Wait for work or 3 seconds (whichever the first)
-        const WorkPackage w = work();
+        uint64_t generation;
+        auto wp = workPtr(&generation);
+        const WorkPackage& w = *wp;
         if (!w)
         {
             boost::system_time const timeout =
                 boost::get_system_time() + boost::posix_time::seconds(3);
             boost::mutex::scoped_lock l(x_work);
-            m_new_work_signal.timed_wait(l, timeout);
+            m_new_work_signal.timed_wait(
+                l, timeout, [&]() { return workGeneration() != generation || shouldStop(); });
             continue;
         }
 
         if (w.algo == "ethash")
         {
             // Epoch change ?
-            if (current.epoch != w.epoch)
+            if (current->epoch != w.epoch)
             {
                 if (!initEpoch())
                     break;  // This will simply exit the thread
@@ -333,16 +533,18 @@ void CPUMiner::workLoop()
                 // As DAG generation takes a while we need to
                 // ensure we're on latest job, not on the one
                 // which triggered the epoch change
-                current = w;
+                recordWorkSwitch(generation, false);
+                current = wp;
                 continue;
             }
 
             // Persist most recent job.
             // Job's differences should be handled at higher level
-            current = w;
+            current = wp;
 
             // Start searching
-            search(w);
+            recordWorkSwitch(generation);
+            search(wp);
         }
         else
         {
@@ -354,17 +556,18 @@ void CPUMiner::workLoop()
 }
 
 
-void CPUMiner::enumDevices(std::map<string, DeviceDescriptor>& _DevicesCollection)
+void CPUMiner::enumDevices(
+    std::map<string, DeviceDescriptor>& _DevicesCollection, const CPSettings& _settings)
 {
-    unsigned numDevices = getNumDevices();
+    std::vector<unsigned> cpus = getPlacement(_settings);
 
-    for (unsigned i = 0; i < numDevices; i++)
+    for (auto cpu : cpus)
     {
         string uniqueId;
         ostringstream s;
         DeviceDescriptor deviceDescriptor;
 
-        s << "cpu-" << i;
+        s << "cpu-" << cpu;
         uniqueId = s.str();
         if (_DevicesCollection.find(uniqueId) != _DevicesCollection.end())
             deviceDescriptor = _DevicesCollection[uniqueId];
@@ -380,7 +583,7 @@ void CPUMiner::enumDevices(std::map<string, DeviceDescriptor>& _DevicesCollectio
         deviceDescriptor.type = DeviceTypeEnum::Cpu;
         deviceDescriptor.totalMemory = getTotalPhysAvailableMemory();
 
-        deviceDescriptor.cpCpuNumer = i;
+        deviceDescriptor.cpCpuNumer = cpu;
 
         _DevicesCollection[uniqueId] = deviceDescriptor;
     }
@@ -22,6 +22,10 @@ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
 #include <libethcore/Miner.h>
 
 #include <functional>
+#include <memory>
+
+#include "CPUDataset.h"
+#include "CPUSearch.h"
 
 namespace dev
 {
@@ -34,9 +38,10 @@ public:
     ~CPUMiner() override;
 
     static unsigned getNumDevices();
-    static void enumDevices(std::map<string, DeviceDescriptor>& _DevicesCollection);
+    static void enumDevices(
+        std::map<string, DeviceDescriptor>& _DevicesCollection, const CPSettings& _settings);
 
-    void search(const dev::eth::WorkPackage& w);
+    void search(std::shared_ptr<const WorkPackage> const& _wp);
 
 protected:
     bool initDevice() override;
@@ -47,6 +52,10 @@ private:
     atomic<bool> m_new_work = {false};
     void workLoop() override;
     CPSettings m_settings;
+
+    std::unique_ptr<CPUSearch> m_engine;  // Not set when using ethash::search
+    std::shared_ptr<CPUDataset> m_dataset;
+    int m_numaNode = -1;  // Replica to use when NUMA aware
 };
 
 
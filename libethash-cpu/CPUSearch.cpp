@@ -0,0 +1,336 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ Words are loaded from hashes in host order : as everywhere else
+ in ethminer a little endian host is assumed.
+*/
+
+#include <cstdlib>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#if defined(_M_X64) || defined(_M_IX86)
+#include <xmmintrin.h>
+#endif
+#define CPU_INLINE __forceinline
+#else
+#define CPU_INLINE inline __attribute__((always_inline))
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_X86_DISPATCH 1
+#endif
+
+#include "CPUSearch.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace
+{
+constexpr uint32_t c_datasetAccesses = 64;
+
+constexpr uint64_t c_roundConstants[24] = {0x0000000000000001ULL, 0x0000000000008082ULL,
+    0x800000000000808aULL, 0x8000000080008000ULL, 0x000000000000808bULL, 0x0000000080000001ULL,
+    0x8000000080008081ULL, 0x8000000000008009ULL, 0x000000000000008aULL, 0x0000000000000088ULL,
+    0x0000000080008009ULL, 0x000000008000000aULL, 0x000000008000808bULL, 0x800000000000008bULL,
+    0x8000000000008089ULL, 0x8000000000008003ULL, 0x8000000000008002ULL, 0x8000000000000080ULL,
+    0x000000000000800aULL, 0x800000008000000aULL, 0x8000000080008081ULL, 0x8000000000008080ULL,
+    0x0000000080000001ULL, 0x8000000080008008ULL};
+
+// Rotation offsets of lane x + 5y
+constexpr unsigned c_rho[25] = {0, 1, 62, 28, 27, 36, 44, 6, 55, 20, 3, 10, 43, 25, 39, 41, 45,
+    15, 21, 8, 18, 2, 61, 56, 14};
+
+// Destination of lane x + 5y : y + 5 * ((2x + 3y) % 5)
+constexpr unsigned c_pi[25] = {0, 10, 20, 5, 15, 16, 1, 11, 21, 6, 7, 17, 2, 12, 22, 23, 8, 18,
+    3, 13, 14, 24, 9, 19, 4};
+
+CPU_INLINE uint64_t rotl64(uint64_t _x, unsigned _s)
+{
+    return (_x << _s) | (_x >> ((64 - _s) & 63));
+}
+
+CPU_INLINE uint32_t fnv1(uint32_t _u, uint32_t _v)
+{
+    return (_u * 0x01000193) ^ _v;
+}
+
+CPU_INLINE uint64_t bswap64(uint64_t _x)
+{
+#if defined(_MSC_VER)
+    return _byteswap_uint64(_x);
+#else
+    return __builtin_bswap64(_x);
+#endif
+}
+
+CPU_INLINE void prefetch(const void* _p)
+{
+#if defined(_MSC_VER)
+#if defined(_M_X64) || defined(_M_IX86)
+    _mm_prefetch(static_cast<const char*>(_p), _MM_HINT_T0);
+#endif
+#else
+    __builtin_prefetch(_p);
+#endif
+}
+
+// keccak-f1600 permutation applied to N independent states.
+// Lane index is innermost so each step is a plain loop over
+// N words the compiler turns into vector instructions.
+template <unsigned N>
+CPU_INLINE void keccakf1600(uint64_t (&_st)[25][N])
+{
+    for (unsigned round = 0; round < 24; round++)
+    {
+        uint64_t c[5][N];
+        uint64_t b[25][N];
+
+        // Theta
+        for (unsigned x = 0; x < 5; x++)
+            for (unsigned l = 0; l < N; l++)
+                c[x][l] = _st[x][l] ^ _st[x + 5][l] ^ _st[x + 10][l] ^ _st[x + 15][l] ^
+                          _st[x + 20][l];
+        for (unsigned x = 0; x < 5; x++)
+            for (unsigned l = 0; l < N; l++)
+            {
+                uint64_t d = c[(x + 4) % 5][l] ^ rotl64(c[(x + 1) % 5][l], 1);
+                for (unsigned y = 0; y < 25; y += 5)
+                    _st[x + y][l] ^= d;
+            }
+
+        // Rho and pi
+        for (unsigned i = 0; i < 25; i++)
+            for (unsigned l = 0; l < N; l++)
+                b[c_pi[i]][l] = rotl64(_st[i][l], c_rho[i]);
+
+        // Chi
+        for (unsigned y = 0; y < 25; y += 5)
+            for (unsigned x = 0; x < 5; x++)
+                for (unsigned l = 0; l < N; l++)
+                    _st[x + y][l] =
+                        b[x + y][l] ^ (~b[(x + 1) % 5 + y][l] & b[(x + 2) % 5 + y][l]);
+
+        // Iota
+        for (unsigned l = 0; l < N; l++)
+            _st[0][l] ^= c_roundConstants[round];
+    }
+}
+
+template <unsigned N>
+CPU_INLINE bool searchLanes(const ethash::hash1024* _items, uint32_t _numItems,
+    const ethash::hash256& _header, const ethash::hash256& _boundary, uint64_t _startNonce,
+    size_t _count, uint64_t& _nonce, ethash::hash256& _mix)
+{
+    // Boundary is a big endian number
+    uint64_t boundary[4];
+    for (unsigned i = 0; i < 4; i++)
+        boundary[i] = bswap64(_boundary.word64s[i]);
+
+    for (size_t base = 0; base < _count; base += N)
+    {
+        uint64_t st[25][N];
+        uint64_t seed[8][N];
+        uint32_t seedInit[N];
+        uint32_t mix[N][32];
+        uint32_t cmix[N][8];
+
+        // keccak512(header .. nonce) : 40 bytes in a 72 bytes rate
+        for (unsigned i = 0; i < 25; i++)
+            for (unsigned l = 0; l < N; l++)
+                st[i][l] = 0;
+        for (unsigned l = 0; l < N; l++)
+        {
+            for (unsigned i = 0; i < 4; i++)
+                st[i][l] = _header.word64s[i];
+            st[4][l] = _startNonce + base + l;
+            st[5][l] = 0x01;
+            st[8][l] = 0x8000000000000000ULL;
+        }
+        keccakf1600<N>(st);
+
+        for (unsigned i = 0; i < 8; i++)
+            for (unsigned l = 0; l < N; l++)
+                seed[i][l] = st[i][l];
+
+        for (unsigned l = 0; l < N; l++)
+        {
+            for (unsigned w = 0; w < 16; w++)
+                mix[l][w] = mix[l][w + 16] = uint32_t(seed[w / 2][l] >> ((w & 1) * 32));
+            seedInit[l] = mix[l][0];
+        }
+
+        // Dataset lookups of all lanes are issued before any
+        // is consumed so their misses are served in parallel
+        for (uint32_t i = 0; i < c_datasetAccesses; i++)
+        {
+            const ethash::hash1024* item[N];
+            for (unsigned l = 0; l < N; l++)
+            {
+                item[l] = &_items[fnv1(i ^ seedInit[l], mix[l][i % 32]) % _numItems];
+                prefetch(item[l]->bytes);
+                prefetch(item[l]->bytes + 64);
+            }
+            for (unsigned l = 0; l < N; l++)
+                for (unsigned w = 0; w < 32; w++)
+                    mix[l][w] = fnv1(mix[l][w], item[l]->word32s[w]);
+        }
+
+        for (unsigned l = 0; l < N; l++)
+            for (unsigned w = 0; w < 8; w++)
+                cmix[l][w] = fnv1(fnv1(fnv1(mix[l][w * 4], mix[l][w * 4 + 1]), mix[l][w * 4 + 2]),
+                    mix[l][w * 4 + 3]);
+
+        // keccak256(seed .. cmix) : 96 bytes in a 136 bytes rate
+        for (unsigned i = 0; i < 25; i++)
+            for (unsigned l = 0; l < N; l++)
+                st[i][l] = i < 8 ? seed[i][l] : 0;
+        for (unsigned l = 0; l < N; l++)
+        {
+            for (unsigned i = 0; i < 4; i++)
+                st[8 + i][l] = uint64_t(cmix[l][i * 2]) | (uint64_t(cmix[l][i * 2 + 1]) << 32);
+            st[12][l] = 0x01;
+            st[16][l] = 0x8000000000000000ULL;
+        }
+        keccakf1600<N>(st);
+
+        for (unsigned l = 0; l < N && base + l < _count; l++)
+        {
+            bool found = true;
+            for (unsigned i = 0; i < 4; i++)
+            {
+                uint64_t h = bswap64(st[i][l]);
+                if (h != boundary[i])
+                {
+                    found = h < boundary[i];
+                    break;
+                }
+            }
+            if (found)
+            {
+                _nonce = _startNonce + base + l;
+                for (unsigned w = 0; w < 8; w++)
+                    _mix.word32s[w] = cmix[l][w];
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool searchGeneric(const ethash::hash1024* _items, uint32_t _numItems,
+    const ethash::hash256& _header, const ethash::hash256& _boundary, uint64_t _startNonce,
+    size_t _count, uint64_t& _nonce, ethash::hash256& _mix)
+{
+    return searchLanes<4>(
+        _items, _numItems, _header, _boundary, _startNonce, _count, _nonce, _mix);
+}
+
+#if CPU_X86_DISPATCH
+
+__attribute__((target("avx2"))) bool searchAvx2(const ethash::hash1024* _items,
+    uint32_t _numItems, const ethash::hash256& _header, const ethash::hash256& _boundary,
+    uint64_t _startNonce, size_t _count, uint64_t& _nonce, ethash::hash256& _mix)
+{
+    return searchLanes<4>(
+        _items, _numItems, _header, _boundary, _startNonce, _count, _nonce, _mix);
+}
+
+__attribute__((target("avx512f"))) bool searchAvx512(const ethash::hash1024* _items,
+    uint32_t _numItems, const ethash::hash256& _header, const ethash::hash256& _boundary,
+    uint64_t _startNonce, size_t _count, uint64_t& _nonce, ethash::hash256& _mix)
+{
+    return searchLanes<8>(
+        _items, _numItems, _header, _boundary, _startNonce, _count, _nonce, _mix);
+}
+
+bool haveAvx2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+bool haveAvx512()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+}
+
+#endif
+
+bool haveAny()
+{
+    return true;
+}
+
+struct Engine
+{
+    const char* name;
+    unsigned lanes;
+    CPUSearch::SearchFn search;
+    bool (*supported)();
+};
+
+// Ordered from the best to the most portable
+const Engine c_engines[] = {
+#if CPU_X86_DISPATCH
+    {"avx512", 8, searchAvx512, haveAvx512},
+    {"avx2", 4, searchAvx2, haveAvx2},
+#endif
+    {"generic", 4, searchGeneric, haveAny}};
+
+}  // namespace
+
+CPUSearch::CPUSearch(const std::string& _engine)
+{
+    const Engine* selected = nullptr;
+    for (const auto& engine : c_engines)
+    {
+        if (!engine.supported())
+            continue;
+        if (!selected)
+            selected = &engine;  // Best available
+        if (_engine == engine.name)
+        {
+            selected = &engine;
+            break;
+        }
+    }
+    m_search = selected->search;
+    m_name = selected->name;
+    m_lanes = selected->lanes;
+}
+
+bool CPUSearch::search(const CPUDataset& _dataset, const ethash::hash256& _header,
+    const ethash::hash256& _boundary, uint64_t _startNonce, size_t _count, uint64_t& _nonce,
+    ethash::hash256& _mix) const
+{
+    return m_search(_dataset.items(), _dataset.numItems(), _header, _boundary, _startNonce,
+        _count, _nonce, _mix);
+}
+
+std::string CPUSearch::supported()
+{
+    std::string names;
+    for (const auto& engine : c_engines)
+        if (engine.supported())
+            names += (names.empty() ? "" : ",") + std::string(engine.name);
+    return names;
+}
@@ -0,0 +1,66 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+
+#include "CPUDataset.h"
+
+namespace dev
+{
+namespace eth
+{
+/*
+ * Multi lane ethash search over a CPUDataset.
+ *
+ * Several nonces are hashed at a time : keccak-f1600 runs on all lanes
+ * at once (laid out to be vectorized for the instruction set selected at
+ * runtime) and dataset lookups of all lanes are issued together with
+ * prefetches so their memory latencies overlap.
+ */
+class CPUSearch
+{
+public:
+    // _engine is one of "auto", "avx512", "avx2" or "generic".
+    // Falls back to the best supported one if the requested is not available.
+    explicit CPUSearch(const std::string& _engine = "auto");
+
+    const char* name() const { return m_name; }
+    unsigned lanes() const { return m_lanes; }
+
+    // Hashes _count nonces starting from _startNonce.
+    // Returns true and the first solution found, if any.
+    bool search(const CPUDataset& _dataset, const ethash::hash256& _header,
+        const ethash::hash256& _boundary, uint64_t _startNonce, size_t _count, uint64_t& _nonce,
+        ethash::hash256& _mix) const;
+
+    // Engines which can run on this cpu
+    static std::string supported();
+
+    typedef bool (*SearchFn)(const ethash::hash1024* _items, uint32_t _numItems,
+        const ethash::hash256& _header, const ethash::hash256& _boundary, uint64_t _startNonce,
+        size_t _count, uint64_t& _nonce, ethash::hash256& _mix);
+
+private:
+    SearchFn m_search;
+    const char* m_name;
+    unsigned m_lanes;
+};
+
+}  // namespace eth
+}  // namespace dev
@@ -15,6 +15,7 @@ You should have received a copy of the GNU General Public License
 along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <libethcore/EpochManager.h>
 #include <libethcore/Farm.h>
 #include <ethash/ethash.hpp>
 
@@ -31,6 +32,16 @@ struct CUDAChannel : public LogChannel
 };
 #define cudalog clog(CUDAChannel)
 
+// Start pre-generating next epoch's DAG when less than this number
+// of blocks is left to the epoch boundary
+#define DAG_PREFETCH_BLOCKS 1000
+
+// Memory to be left free on device after allocation of next epoch's buffers
+#define DAG_PREFETCH_RESERVE (128ULL * 1024 * 1024)
+
+CUDAMiner::SharedDag CUDAMiner::s_sharedDag;
+boost::shared_mutex CUDAMiner::s_sharedDagMutex;
+
 CUDAMiner::CUDAMiner(unsigned _index, CUSettings _settings, DeviceDescriptor& _device)
   : Miner("cuda-", _index),
     m_settings(_settings),
@@ -45,6 +56,7 @@ CUDAMiner::~CUDAMiner()
     DEV_BUILD_LOG_PROGRAMFLOW(cudalog, "cuda-" << m_index << " CUDAMiner::~CUDAMiner() begin");
     stopWorking();
     kick_miner();
+    withdrawDag();
     DEV_BUILD_LOG_PROGRAMFLOW(cudalog, "cuda-" << m_index << " CUDAMiner::~CUDAMiner() end");
 }
 
@@ -63,6 +75,12 @@ bool CUDAMiner::initDevice()
     {
         CUDA_SAFE_CALL(cudaSetDevice(m_deviceDescriptor.cuDeviceIndex));
         CUDA_SAFE_CALL(cudaDeviceReset());
+
+        // Apply tuned launch parameters (if any) unless
+        // we have been asked to tune again
+        ProfileValues profile;
+        if (!m_settings.autoTune && MinerProfile::load(profileKey(), profile))
+            applyProfile(profile);
     }
     catch (const cuda_runtime_error& ec)
     {
@@ -79,7 +97,6 @@ bool CUDAMiner::initEpoch_internal()
     // If we get here it means epoch has changed so it's not necessary
     // to check again dag sizes. They're changed for sure
     bool retVar = false;
-    m_current_target = 0;
     auto startInit = std::chrono::steady_clock::now();
     size_t RequiredTotalMemory = (m_epochContext.dagSize + m_epochContext.lightSize);
     size_t RequiredDagMemory = m_epochContext.dagSize;
@@ -94,6 +111,25 @@ bool CUDAMiner::initEpoch_internal()
         hash128_t* dag;
         hash64_t* light;
 
+        // Peers must not copy from buffers we're about to release or overwrite
+        withdrawDag();
+
+        // If next epoch's DAG has been pre-generated in background
+        // we only have to switch pointers
+        if (switchToNextEpoch())
+        {
+            get_constants(&dag, NULL, NULL, NULL);
+            initJit(dag);
+            applyAccessPolicy();
+            publishDag(dag);
+            cudalog << "Switched to pre-generated DAG in "
+                    << std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::steady_clock::now() - startInit)
+                           .count()
+                    << " ms.";
+            return true;
+        }
+
         // If we have already enough memory allocated, we just have to
         // copy light_cache and regenerate the DAG
         if (m_allocated_memory_dag < m_epochContext.dagSize ||
@@ -101,8 +137,17 @@ bool CUDAMiner::initEpoch_internal()
         {
             // We need to reset the device and (re)create the dag
             // cudaDeviceReset() frees all previous allocated memory
+            {
+                boost::mutex::scoped_lock l(x_abort);
+                m_abort = nullptr;
+            }
             CUDA_SAFE_CALL(cudaDeviceReset());
-            CUDA_SAFE_CALL(cudaSetDeviceFlags(m_settings.schedule));
+            m_dag_stream = nullptr;
+            m_jit = jit_search_kernel();  // Module released by reset
+            m_graphs.clear();             // So are graphs,
+            m_params = nullptr;           // pinned memory
+            m_paramsUploaded = nullptr;   // and events
+            CUDA_SAFE_CALL(cudaSetDeviceFlags(m_settings.schedule | cudaDeviceMapHost));
             CUDA_SAFE_CALL(cudaDeviceSetCacheConfig(cudaFuncCachePreferL1));
 
             // Check whether the current device has sufficient memory every time we recreate the dag
@@ -135,14 +180,35 @@ bool CUDAMiner::initEpoch_internal()
                 CUDA_SAFE_CALL(
                     cudaMalloc(reinterpret_cast<void**>(&light), m_epochContext.lightSize));
             m_allocated_memory_light_cache = m_epochContext.lightSize;
+            m_light_on_host = lightOnHost;
             CUDA_SAFE_CALL(cudaMalloc(reinterpret_cast<void**>(&dag), m_epochContext.dagSize));
             m_allocated_memory_dag = m_epochContext.dagSize;
 
             // create mining buffers
+            // Mining streams get the highest priority so an eventual
+            // background DAG generation does not steal cycles from them
+            int leastPriority, greatestPriority;
+            CUDA_SAFE_CALL(cudaDeviceGetStreamPriorityRange(&leastPriority, &greatestPriority));
+            m_search_buf.resize(m_settings.streams);
+            m_streams.resize(m_settings.streams);
             for (unsigned i = 0; i != m_settings.streams; ++i)
             {
                 CUDA_SAFE_CALL(cudaMallocHost(&m_search_buf[i], sizeof(Search_results)));
-                CUDA_SAFE_CALL(cudaStreamCreateWithFlags(&m_streams[i], cudaStreamNonBlocking));
+                CUDA_SAFE_CALL(cudaStreamCreateWithPriority(
+                    &m_streams[i], cudaStreamNonBlocking, greatestPriority));
+            }
+
+            // create abort word
+            uint32_t* abortWord;
+            void* abortWordDevice;
+            CUDA_SAFE_CALL(cudaHostAlloc(
+                reinterpret_cast<void**>(&abortWord), sizeof(uint32_t), cudaHostAllocMapped));
+            *abortWord = 0;
+            CUDA_SAFE_CALL(cudaHostGetDevicePointer(&abortWordDevice, abortWord, 0));
+            m_abort_device = static_cast<uint32_t*>(abortWordDevice);
+            {
+                boost::mutex::scoped_lock l(x_abort);
+                m_abort = abortWord;
             }
         }
         else
@@ -152,20 +218,42 @@ bool CUDAMiner::initEpoch_internal()
             get_constants(&dag, NULL, &light, NULL);
         }
 
-        CUDA_SAFE_CALL(cudaMemcpy(reinterpret_cast<void*>(light), m_epochContext.lightCache,
-            m_epochContext.lightSize, cudaMemcpyHostToDevice));
-
         set_constants(dag, m_epochContext.dagNumItems, light,
             m_epochContext.lightNumItems);  // in ethash_cuda_miner_kernel.cu
+        initJit(dag);
 
-        ethash_generate_dag(
-            m_epochContext.dagSize, m_settings.gridSize, m_settings.blockSize, m_streams[0]);
+        auto startGen = std::chrono::steady_clock::now();
+        if (!m_dagFromPeer || !copyDagFromPeer(dag))
+        {
+            if (!acquireDagTurn())
+                return false;
+
+            // Light cache is only read by DAG generation : a copied
+            // DAG spares its transfer over PCIe
+            if (m_settings.lightGen || !m_epochContext.lightCache)
+                generateLight(light);
+            else
+                CUDA_SAFE_CALL(cudaMemcpy(reinterpret_cast<void*>(light),
+                    m_epochContext.lightCache, m_epochContext.lightSize, cudaMemcpyHostToDevice));
+            generateDag(dag, light);
+            publishDag(dag);
+        }
+        applyAccessPolicy();
+        auto genUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - startGen)
+                         .count();
+        m_dagRate.store(
+            genUs ? (uint64_t)(m_epochContext.dagSize * 1000000.0 / genUs) : 0,
+            std::memory_order_relaxed);
 
         cudalog << "Generated DAG + Light in "
                 << std::chrono::duration_cast<std::chrono::milliseconds>(
                        std::chrono::steady_clock::now() - startInit)
                        .count()
-                << " ms. "
+                << " ms. ("
+                << boost::str(boost::format("%0.2f") %
+                              (genUs ? (double)m_epochContext.dagSize / genUs / 1000.0 : 0.0))
+                << " GB/s) "
                 << dev::getFormattedMemory(
                        lightOnHost ? (double)(m_deviceDescriptor.totalMemory - RequiredDagMemory) :
                                      (double)(m_deviceDescriptor.totalMemory - RequiredTotalMemory))
@@ -187,65 +275,907 @@ bool CUDAMiner::initEpoch_internal()
 
 void CUDAMiner::workLoop()
 {
-    WorkPackage current;
-    current.header = h256();
-
-    m_search_buf.resize(m_settings.streams);
-    m_streams.resize(m_settings.streams);
+    std::shared_ptr<const WorkPackage> current = std::make_shared<const WorkPackage>();
 
     if (!initDevice())
         return;
 
+    m_search_buf.resize(m_settings.streams);
+    m_streams.resize(m_settings.streams);
+    m_stream_ctx.resize(m_settings.streams);
+    for (unsigned i = 0; i < m_settings.streams; i++)
+        m_stream_ctx[i] = {this, i, 0};
+
     try
     {
         while (!shouldStop())
         {
             // Wait for work or 3 seconds (whichever the first)
-            const WorkPackage w = work();
+            uint64_t generation;
+            auto wp = workPtr(&generation);
+            const WorkPackage& w = *wp;
             if (!w)
             {
+                servicePreparedEpoch();
                 boost::system_time const timeout =
                     boost::get_system_time() + boost::posix_time::seconds(3);
                 boost::mutex::scoped_lock l(x_work);
-                m_new_work_signal.timed_wait(l, timeout);
+                m_new_work_signal.timed_wait(
+                    l, timeout, [&]() { return workGeneration() != generation || shouldStop(); });
                 continue;
             }
 
             // Epoch change ?
-            if (current.epoch != w.epoch)
+            if (current->epoch != w.epoch)
             {
                 if (!initEpoch())
                     break;  // This will simply exit the thread
 
+                // Tune launch parameters against the real DAG
+                if (m_settings.autoTune && !m_tuned && !paused())
+                {
+                    autoTune();
+                    m_tuned = true;
+                }
+
                 // As DAG generation takes a while we need to
                 // ensure we're on latest job, not on the one
                 // which triggered the epoch change
-                current = w;
+                recordWorkSwitch(generation, false);
+                current = wp;
                 continue;
             }
 
             // Persist most recent job.
             // Job's differences should be handled at higher level
-            current = w;
-            uint64_t upper64OfBoundary = (uint64_t)(u64)((u256)current.boundary >> 192);
+            current = wp;
+
+            // Eventually start building next epoch's DAG
+            prefetchNextEpoch(w);
+
+            uint64_t upper64OfBoundary = (uint64_t)(u64)((u256)w.boundary >> 192);
+
+            // Previous search has been aborted : device is about to process new work
+            uint64_t switchTime = recordWorkSwitch(generation);
+            (void)switchTime;
+#ifdef DEV_BUILD
+            if (g_logOptions & LOG_SWITCH)
+                cudalog << "Switch time: " << switchTime << " us.";
+#endif
 
             // Eventually start searching
-            search(current.header.data(), upper64OfBoundary, current.startNonce, w);
+            if (m_settings.eventLoop)
+                search_events(w.header.data(), upper64OfBoundary, w.startNonce, wp);
+            else
+                search(w.header.data(), upper64OfBoundary, w.startNonce, wp);
         }
 
         // Reset miner and stop working
+        withdrawDag();
         CUDA_SAFE_CALL(cudaDeviceReset());
     }
     catch (cuda_runtime_error const& _e)
     {
+        withdrawDag();
         string _what = "GPU error: ";
         _what.append(_e.what());
         throw std::runtime_error(_what);
     }
 }
 
+void CUDAMiner::generateLight(hash64_t* light)
+{
+    auto start = std::chrono::steady_clock::now();
+    ethash::hash512 first = EthashAux::lightCacheFirstItem(m_epochContext.epochNumber);
+    ethash_generate_light_async(light, m_epochContext.lightNumItems,
+        *reinterpret_cast<hash64_t*>(&first), m_streams[0]);
+    CUDA_SAFE_CALL(cudaStreamSynchronize(m_streams[0]));
+    cudalog << "Built light cache on device in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now() - start)
+                   .count()
+            << " ms.";
+
+    // Checked against host one if there's one at hand
+    if (m_epochContext.lightCache &&
+        !lightMatches(light, m_epochContext.lightCache, m_epochContext.lightSize))
+    {
+        cwarn << "Light cache built on device does not match host one. Using host one";
+        CUDA_SAFE_CALL(cudaMemcpy(reinterpret_cast<void*>(light), m_epochContext.lightCache,
+            m_epochContext.lightSize, cudaMemcpyHostToDevice));
+    }
+}
+
+bool CUDAMiner::lightMatches(hash64_t* light, const ethash_hash512* _host, size_t _size)
+{
+    std::vector<uint8_t> built(_size);
+    CUDA_SAFE_CALL(cudaMemcpy(built.data(), reinterpret_cast<void*>(light), _size,
+        cudaMemcpyDeviceToHost));
+    return memcmp(built.data(), _host, _size) == 0;
+}
+
+void CUDAMiner::generateDag(hash128_t* dag, hash64_t* light)
+{
+    // Spread chunks over all mining streams and queue them all at once.
+    // Host only waits on a few milestone events to report progress.
+    const uint32_t work = (uint32_t)(m_epochContext.dagSize / sizeof(hash64_t));
+    const uint32_t run = m_settings.gridSize * m_settings.blockSize;
+    const uint32_t chunks = (work + run - 1) / run;
+    const uint32_t milestoneEvery = std::max(chunks / 10, 1U);
+
+    std::vector<std::pair<cudaEvent_t, unsigned>> milestones;
+    m_dagProgress.store(0, std::memory_order_relaxed);
+
+    try
+    {
+        for (uint32_t chunk = 0; chunk < chunks; chunk++)
+        {
+            cudaStream_t stream = m_streams[chunk % m_settings.streams];
+            uint32_t base = chunk * run;
+            ethash_generate_dag_chunk(dag, m_epochContext.dagNumItems, light,
+                m_epochContext.lightNumItems, base, std::min(run, work - base),
+                m_settings.blockSize, stream);
+
+            if ((chunk + 1) % milestoneEvery == 0 && (chunk + 1) != chunks)
+            {
+                cudaEvent_t event;
+                CUDA_SAFE_CALL(cudaEventCreateWithFlags(&event, cudaEventDisableTiming));
+                milestones.push_back(std::make_pair(event, (chunk + 1) * 100 / chunks));
+                CUDA_SAFE_CALL(cudaEventRecord(event, stream));
+            }
+        }
+
+        for (auto& milestone : milestones)
+        {
+            CUDA_SAFE_CALL(cudaEventSynchronize(milestone.first));
+            m_dagProgress.store(milestone.second, std::memory_order_relaxed);
+
+            // With light on host this takes minutes : let the user know
+            if (m_light_on_host)
+                cudalog << "DAG generation " << milestone.second << "%";
+        }
+
+        for (unsigned i = 0; i < m_settings.streams; i++)
+            CUDA_SAFE_CALL(cudaStreamSynchronize(m_streams[i]));
+    }
+    catch (...)
+    {
+        for (auto& milestone : milestones)
+            cudaEventDestroy(milestone.first);
+        throw;
+    }
+
+    for (auto& milestone : milestones)
+        CUDA_SAFE_CALL(cudaEventDestroy(milestone.first));
+    m_dagProgress.store(100, std::memory_order_relaxed);
+}
+
+void CUDAMiner::publishDag(hash128_t* dag)
+{
+    if (s_dagLoadMode != DAG_LOAD_MODE_SINGLE)
+        return;
+
+    boost::unique_lock<boost::shared_mutex> l(s_sharedDagMutex);
+    s_sharedDag.epoch = m_epochContext.epochNumber;
+    s_sharedDag.device = m_deviceDescriptor.cuDeviceIndex;
+    s_sharedDag.dag = dag;
+    s_sharedDag.size = m_epochContext.dagSize;
+}
+
+void CUDAMiner::withdrawDag()
+{
+    // Waits for peers still copying from us
+    boost::unique_lock<boost::shared_mutex> l(s_sharedDagMutex);
+    if (s_sharedDag.device == m_deviceDescriptor.cuDeviceIndex)
+        s_sharedDag = SharedDag();
+}
+
+bool CUDAMiner::copyDagFromPeer(hash128_t* dag)
+{
+    boost::shared_lock<boost::shared_mutex> l(s_sharedDagMutex);
+    int device = m_deviceDescriptor.cuDeviceIndex;
+    int peer = s_sharedDag.device;
+    if (s_sharedDag.epoch != m_epochContext.epochNumber || !s_sharedDag.dag ||
+        s_sharedDag.size != m_epochContext.dagSize || peer == device)
+        return false;
+
+    // Use direct access (NVLink / PCIe) if available. Otherwise
+    // the runtime stages the copy through host memory
+    int canAccessPeer = 0;
+    CUDA_SAFE_CALL(cudaDeviceCanAccessPeer(&canAccessPeer, device, peer));
+    if (canAccessPeer)
+    {
+        cudaError_t result = cudaDeviceEnablePeerAccess(peer, 0);
+        if (result == cudaErrorPeerAccessAlreadyEnabled)
+            cudaGetLastError();  // Clear error state
+        else if (result != cudaSuccess)
+            canAccessPeer = 0;
+    }
+
+    m_dagProgress.store(0, std::memory_order_relaxed);
+    auto startCopy = std::chrono::steady_clock::now();
+    CUDA_SAFE_CALL(cudaMemcpyPeerAsync(
+        dag, device, s_sharedDag.dag, peer, s_sharedDag.size, m_streams[0]));
+    CUDA_SAFE_CALL(cudaStreamSynchronize(m_streams[0]));
+    m_dagProgress.store(100, std::memory_order_relaxed);
+
+    cudalog << "Copied DAG from CUDA device " << peer << (canAccessPeer ? " (P2P)" : " (host)")
+            << " in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now() - startCopy)
+                   .count()
+            << " ms.";
+    return true;
+}
+
+void CUDAMiner::initJit(hash128_t* dag)
+{
+    m_jit_active = false;
+    if (!m_settings.jit)
+        return;
+
+    auto startJit = std::chrono::steady_clock::now();
+    std::string error;
+    if (!jit_load_search(m_jit, m_epochContext.epochNumber, m_epochContext.dagNumItems,
+            m_settings.blockSize, m_settings.parallelHash, m_settings.dagAccess == 1,
+            m_deviceDescriptor.cuComputeMajor, m_deviceDescriptor.cuComputeMinor, error))
+    {
+        cudalog << "Runtime compiled kernel not available (" << error
+                << "). Using built-in kernel";
+        return;
+    }
+
+    jit_set_dag(m_jit, dag);
+    m_jit_active = true;
+    cudalog << "Runtime compiled kernel loaded in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now() - startJit)
+                   .count()
+            << " ms.";
+}
+
+void CUDAMiner::runSearch(unsigned _index, uint64_t start_nonce)
+{
+    if (m_jit_active)
+        jit_run_search(m_jit, m_settings.gridSize, m_settings.blockSize, m_streams[_index],
+            m_search_buf[_index], start_nonce, m_abort_device);
+    else if (m_settings.graphs)
+        runGraph(_index, start_nonce);
+    else
+        run_ethash_search(m_settings.gridSize, m_settings.blockSize, m_streams[_index],
+            m_search_buf[_index], start_nonce, m_abort_device, m_settings.parallelHash,
+            m_settings.dagAccess == 1);
+}
+
+void CUDAMiner::runGraph(unsigned _index, uint64_t start_nonce)
+{
+#if CUDART_VERSION >= 10010
+    if (m_graphs.size() < m_streams.size())
+        m_graphs.resize(m_streams.size());
+
+    volatile Search_results* output = m_search_buf[_index];
+    volatile uint32_t* abort = m_abort_device;
+    void* args[] = {&output, &start_nonce, &abort};
+
+    cudaKernelNodeParams params = {};
+    params.func = const_cast<void*>(
+        ethash_search_function(m_settings.parallelHash, m_settings.dagAccess == 1));
+    params.gridDim = dim3(m_settings.gridSize);
+    params.blockDim = dim3(m_settings.blockSize);
+    params.sharedMemBytes = 0;
+    params.kernelParams = args;
+    params.extra = nullptr;
+
+    // Only arguments change from a batch to the next. Anything else
+    // (tuning, kernel variant) requires a new graph
+    SearchGraph& graph = m_graphs[_index];
+    if (graph.exec && graph.func == params.func && graph.gridSize == m_settings.gridSize &&
+        graph.blockSize == m_settings.blockSize)
+    {
+        CUDA_SAFE_CALL(cudaGraphExecKernelNodeSetParams(graph.exec, graph.node, &params));
+    }
+    else
+    {
+        if (graph.exec)
+            CUDA_SAFE_CALL(cudaGraphExecDestroy(graph.exec));
+        if (graph.graph)
+            CUDA_SAFE_CALL(cudaGraphDestroy(graph.graph));
+        graph = SearchGraph();
+        CUDA_SAFE_CALL(cudaGraphCreate(&graph.graph, 0));
+        CUDA_SAFE_CALL(cudaGraphAddKernelNode(&graph.node, graph.graph, nullptr, 0, &params));
+#if CUDART_VERSION >= 12000
+        CUDA_SAFE_CALL(cudaGraphInstantiate(&graph.exec, graph.graph, 0));
+#else
+        CUDA_SAFE_CALL(cudaGraphInstantiate(&graph.exec, graph.graph, nullptr, nullptr, 0));
+#endif
+        graph.func = params.func;
+        graph.gridSize = m_settings.gridSize;
+        graph.blockSize = m_settings.blockSize;
+    }
+    CUDA_SAFE_CALL(cudaGraphLaunch(graph.exec, m_streams[_index]));
+#else
+    run_ethash_search(m_settings.gridSize, m_settings.blockSize, m_streams[_index],
+        m_search_buf[_index], start_nonce, m_abort_device, m_settings.parallelHash,
+        m_settings.dagAccess == 1);
+#endif
+}
+
+void CUDAMiner::releaseGraphs()
+{
+#if CUDART_VERSION >= 10010
+    for (auto& graph : m_graphs)
+    {
+        if (graph.exec)
+            CUDA_SAFE_CALL(cudaGraphExecDestroy(graph.exec));
+        if (graph.graph)
+            CUDA_SAFE_CALL(cudaGraphDestroy(graph.graph));
+    }
+#endif
+    m_graphs.clear();
+}
+
+void CUDAMiner::uploadParams(uint8_t const* _header, uint64_t _target)
+{
+    if (!m_params)
+    {
+        CUDA_SAFE_CALL(cudaHostAlloc(
+            reinterpret_cast<void**>(&m_params), 2 * sizeof(search_params), cudaHostAllocDefault));
+        CUDA_SAFE_CALL(cudaEventCreateWithFlags(&m_paramsUploaded, cudaEventDisableTiming));
+    }
+
+    // Copies of previous job are complete : streams are
+    // synchronized when a search ends
+    m_paramsSlot ^= 1;
+    search_params& params = m_params[m_paramsSlot];
+    memcpy(&params.header, _header, sizeof(params.header));
+    params.target = _target;
+
+    cudaStream_t stream = m_streams[0];
+    set_params_async(&params, stream);
+    if (m_jit_active)
+        jit_set_params(m_jit, &params, stream);
+
+    // Other streams start their first batch once parameters are in
+    CUDA_SAFE_CALL(cudaEventRecord(m_paramsUploaded, stream));
+    for (size_t i = 1; i < m_streams.size(); i++)
+        CUDA_SAFE_CALL(cudaStreamWaitEvent(m_streams[i], m_paramsUploaded, 0));
+}
+
+void CUDAMiner::applyAccessPolicy()
+{
+#if CUDART_VERSION >= 11000
+    // Access policy windows are only honoured by Ampere and later
+    if (m_deviceDescriptor.cuComputeMajor < 8)
+        return;
+
+    cudaDeviceProp props;
+    CUDA_SAFE_CALL(cudaGetDeviceProperties(&props, m_deviceDescriptor.cuDeviceIndex));
+    if (!props.persistingL2CacheMaxSize || !props.accessPolicyMaxWindowSize)
+        return;
+
+    hash128_t* dag;
+    uint32_t dagItems;
+    get_constants(&dag, &dagItems, NULL, NULL);
+
+    // A zero sized window resets the policy of streams
+    cudaStreamAttrValue attr = {};
+    if (m_settings.dagAccess == 2 && dag)
+    {
+        size_t bytes = std::min((size_t)props.accessPolicyMaxWindowSize,
+            (size_t)dagItems * sizeof(hash128_t));
+        CUDA_SAFE_CALL(
+            cudaDeviceSetLimit(cudaLimitPersistingL2CacheSize, props.persistingL2CacheMaxSize));
+        attr.accessPolicyWindow.base_ptr = reinterpret_cast<void*>(dag);
+        attr.accessPolicyWindow.num_bytes = bytes;
+        attr.accessPolicyWindow.hitRatio =
+            std::min(1.0f, (float)props.persistingL2CacheMaxSize / (float)bytes);
+        attr.accessPolicyWindow.hitProp = cudaAccessPropertyPersisting;
+        attr.accessPolicyWindow.missProp = cudaAccessPropertyStreaming;
+    }
+    for (auto& stream : m_streams)
+        CUDA_SAFE_CALL(
+            cudaStreamSetAttribute(stream, cudaStreamAttributeAccessPolicyWindow, &attr));
+#endif
+}
+
+std::string CUDAMiner::profileKey()
+{
+    int driverVersion = 0;
+    cudaDriverGetVersion(&driverVersion);
+    return "cuda:" + m_deviceDescriptor.uniqueId + ":" + m_deviceDescriptor.cuName + ":" +
+           std::to_string(driverVersion);
+}
+
+void CUDAMiner::applyProfile(const ProfileValues& _profile)
+{
+    auto grid = _profile.find("grid");
+    auto block = _profile.find("block");
+    auto streams = _profile.find("streams");
+    if (grid == _profile.end() || block == _profile.end() || streams == _profile.end())
+        return;
+
+    // Discard anything out of the ranges accepted on command line
+    if (grid->second < 1 || grid->second > 131072 || streams->second < 1 ||
+        streams->second > 99 ||
+        (block->second != 32 && block->second != 64 && block->second != 128 &&
+            block->second != 256))
+        return;
+
+    m_settings.gridSize = (unsigned)grid->second;
+    m_settings.blockSize = (unsigned)block->second;
+    m_settings.streams = (unsigned)streams->second;
+    m_batch_size = m_settings.gridSize * m_settings.blockSize;
+    m_streams_batch_size = m_batch_size * m_settings.streams;
+
+    // Kernel variant is optional (older profiles do not have it)
+    auto parallelHash = _profile.find("parallel_hash");
+    if (parallelHash != _profile.end() &&
+        (parallelHash->second == 1 || parallelHash->second == 2 || parallelHash->second == 4 ||
+            parallelHash->second == 8))
+        m_settings.parallelHash = (unsigned)parallelHash->second;
+    auto dagAccess = _profile.find("dag_access");
+    if (dagAccess != _profile.end() && dagAccess->second <= 2)
+        m_settings.dagAccess = (unsigned)dagAccess->second;
+
+    cudalog << "Using tuned profile : grid " << m_settings.gridSize << " block "
+            << m_settings.blockSize << " streams " << m_settings.streams << " parallel hash "
+            << m_settings.parallelHash << " dag access " << m_settings.dagAccess;
+}
+
+void CUDAMiner::resizeStreams(unsigned _streams)
+{
+    releaseGraphs();
+
+    int leastPriority, greatestPriority;
+    CUDA_SAFE_CALL(cudaDeviceGetStreamPriorityRange(&leastPriority, &greatestPriority));
+
+    for (size_t i = _streams; i < m_streams.size(); i++)
+    {
+        CUDA_SAFE_CALL(cudaStreamDestroy(m_streams[i]));
+        CUDA_SAFE_CALL(cudaFreeHost((void*)m_search_buf[i]));
+    }
+
+    size_t current = m_streams.size();
+    m_streams.resize(_streams);
+    m_search_buf.resize(_streams);
+    m_stream_ctx.resize(_streams);
+    for (size_t i = current; i < _streams; i++)
+    {
+        CUDA_SAFE_CALL(cudaMallocHost(&m_search_buf[i], sizeof(Search_results)));
+        CUDA_SAFE_CALL(
+            cudaStreamCreateWithPriority(&m_streams[i], cudaStreamNonBlocking, greatestPriority));
+        m_stream_ctx[i] = {this, (unsigned)i, 0};
+    }
+    m_settings.streams = _streams;
+    applyAccessPolicy();
+}
+
+bool CUDAMiner::tuneMeasure(
+    unsigned _grid, unsigned _block, unsigned _streams, double& _hashrate, double& _latency)
+{
+    using namespace std::chrono;
+
+    resizeStreams(_streams);
+    m_settings.gridSize = _grid;
+    m_settings.blockSize = _block;
+    m_batch_size = _grid * _block;
+
+    // Prime all streams then keep them busy in round robin
+    // (as search() does) for a while
+    uint64_t nonce = 0;
+    uint64_t batches = 0;
+    for (unsigned i = 0; i < _streams; i++, nonce += m_batch_size)
+    {
+        m_search_buf[i]->count = 0;
+        runSearch(i, nonce);
+    }
+    for (unsigned i = 0; i < _streams; i++)
+        CUDA_SAFE_CALL(cudaStreamSynchronize(m_streams[i]));
+
+    auto start = steady_clock::now();
+    for (unsigned i = 0; i < _streams; i++, nonce += m_batch_size)
+        runSearch(i, nonce);
+    while (duration_cast<milliseconds>(steady_clock::now() - start).count() < 250)
+    {
+        for (unsigned i = 0; i < _streams; i++, nonce += m_batch_size)
+        {
+            CUDA_SAFE_CALL(cudaStreamSynchronize(m_streams[i]));
+            batches++;
+            runSearch(i, nonce);
+        }
+        if (shouldStop())
+            return false;
+    }
+
+    // Time to drain what's in flight is what a job switch costs
+    auto drainStart = steady_clock::now();
+    for (unsigned i = 0; i < _streams; i++)
+    {
+        CUDA_SAFE_CALL(cudaStreamSynchronize(m_streams[i]));
+        batches++;
+    }
+    auto end = steady_clock::now();
+
+    double us = (double)duration_cast<microseconds>(end - start).count();
+    _hashrate = us ? ((double)batches * m_batch_size * 1.0e6) / us : 0.0;
+    _latency = (double)duration_cast<microseconds>(end - drainStart).count();
+    return true;
+}
+
+void CUDAMiner::autoTune()
+{
+    struct Candidate
+    {
+        unsigned grid;
+        unsigned block;
+        unsigned streams;
+        unsigned parallelHash;
+        unsigned dagAccess;
+        double hashrate;
+        double latency;
+    };
+
+    auto measure = [this](Candidate& _c) {
+        m_settings.parallelHash = _c.parallelHash;
+        if (m_settings.dagAccess != _c.dagAccess)
+        {
+            m_settings.dagAccess = _c.dagAccess;
+            applyAccessPolicy();
+        }
+        return tuneMeasure(_c.grid, _c.block, _c.streams, _c.hashrate, _c.latency);
+    };
+
+    // Best is the fastest. Among candidates within 1% of it
+    // prefer the one with lower job switch latency
+    auto pickBest = [](const std::vector<Candidate>& _candidates) {
+        Candidate best = _candidates.front();
+        for (auto& c : _candidates)
+            if (c.hashrate > best.hashrate)
+                best = c;
+        Candidate pick = best;
+        for (auto& c : _candidates)
+            if (c.hashrate >= best.hashrate * 0.99 && c.latency < pick.latency)
+                pick = c;
+        return pick;
+    };
+
+    cudalog << "Autotuning launch parameters ...";
+    CUSettings original = m_settings;
+
+    // Tuning changes block size which the runtime compiled
+    // kernel is bound to
+    bool jit = m_jit_active;
+    m_jit_active = false;
+
+    uint8_t header[32] = {};
+    uploadParams(header, 0);
+    *m_abort = 0;
+
+    std::vector<Candidate> candidates;
+    try
+    {
+        for (unsigned block : {64U, 128U, 256U})
+            for (unsigned grid : {4096U, 8192U, 16384U, 32768U})
+            {
+                Candidate c = {grid, block, original.streams, original.parallelHash,
+                    original.dagAccess, 0.0, 0.0};
+                if (!measure(c))
+                    return;
+                candidates.push_back(c);
+            }
+
+        Candidate best = pickBest(candidates);
+        candidates.clear();
+        unsigned accessModes = (m_deviceDescriptor.cuComputeMajor >= 8) ? 3 : 2;
+        for (unsigned parallelHash : {1U, 2U, 4U, 8U})
+            for (unsigned dagAccess = 0; dagAccess < accessModes; dagAccess++)
+            {
+                Candidate c = {
+                    best.grid, best.block, best.streams, parallelHash, dagAccess, 0.0, 0.0};
+                if (!measure(c))
+                    return;
+                candidates.push_back(c);
+            }
+
+        best = pickBest(candidates);
+        candidates.clear();
+        for (unsigned streams : {1U, 2U, 3U, 4U})
+        {
+            Candidate c = {
+                best.grid, best.block, streams, best.parallelHash, best.dagAccess, 0.0, 0.0};
+            if (!measure(c))
+                return;
+            candidates.push_back(c);
+        }
+        best = pickBest(candidates);
+
+        resizeStreams(best.streams);
+        m_settings.gridSize = best.grid;
+        m_settings.blockSize = best.block;
+        m_settings.parallelHash = best.parallelHash;
+        m_settings.dagAccess = best.dagAccess;
+        applyAccessPolicy();
+        m_batch_size = m_settings.gridSize * m_settings.blockSize;
+        m_streams_batch_size = m_batch_size * m_settings.streams;
+
+        cudalog << "Autotune : grid " << best.grid << " block " << best.block << " streams "
+                << best.streams << " parallel hash " << best.parallelHash << " dag access "
+                << best.dagAccess << " " << dev::getFormattedHashes(best.hashrate) << " switch "
+                << (unsigned)(best.latency / 1000) << " ms.";
+
+        ProfileValues profile = {{"grid", best.grid}, {"block", best.block},
+            {"streams", best.streams}, {"parallel_hash", best.parallelHash},
+            {"dag_access", best.dagAccess}, {"hashrate", (uint64_t)best.hashrate},
+            {"latency_us", (uint64_t)best.latency}};
+        if (!MinerProfile::save(profileKey(), profile))
+            cudalog << "Unable to save tuning profile";
+    }
+    catch (const cuda_runtime_error& _e)
+    {
+        cudalog << "Autotune failed : " << _e.what();
+        m_settings.gridSize = original.gridSize;
+        m_settings.blockSize = original.blockSize;
+        m_settings.parallelHash = original.parallelHash;
+        m_settings.dagAccess = original.dagAccess;
+        resizeStreams(original.streams);
+        m_batch_size = m_settings.gridSize * m_settings.blockSize;
+        m_streams_batch_size = m_batch_size * m_settings.streams;
+    }
+
+    if (jit)
+    {
+        hash128_t* dag;
+        get_constants(&dag, NULL, NULL, NULL);
+        initJit(dag);
+    }
+}
+
+void CUDAMiner::prefetchNextEpoch(const WorkPackage& w)
+{
+    if (!m_settings.dagPrefetch || m_light_on_host || w.epoch < 0 ||
+        m_prepare_epoch.load(std::memory_order_relaxed) >= 0)
+        return;
+
+    // If pool provides block number wait till we're close to
+    // epoch boundary, otherwise start as soon as possible
+    if (m_next_epoch == -1 && w.block >= 0 &&
+        (ethash::epoch_length - (w.block % ethash::epoch_length)) > DAG_PREFETCH_BLOCKS)
+        return;
+
+    prefetchEpoch(w.epoch + 1);
+}
+
+void CUDAMiner::prefetchEpoch(int _epoch, const EpochContext* _ec)
+{
+    try
+    {
+        if (m_next_epoch != _epoch)
+        {
+            if (m_next_epoch != -1)
+                releaseNextEpoch();
+
+            // Mark this epoch as processed whatever the outcome
+            // so we won't retry on every job
+            m_next_epoch = _epoch;
+
+            // Next epoch's buffers must fit in memory left
+            // by current ones
+            size_t freeMem, totalMem;
+            CUDA_SAFE_CALL(cudaMemGetInfo(&freeMem, &totalMem));
+            uint64_t required =
+                ethash::get_full_dataset_size(ethash::calculate_full_dataset_num_items(_epoch)) +
+                ethash::get_light_cache_size(ethash::calculate_light_cache_num_items(_epoch));
+            if (freeMem < required + DAG_PREFETCH_RESERVE)
+            {
+                cudalog << "Epoch " << _epoch << " DAG can't be pre-generated. Requires "
+                        << dev::getFormattedMemory((double)required) << " memory, "
+                        << dev::getFormattedMemory((double)freeMem) << " available";
+                return;
+            }
+
+            cudalog << "Pre-generating DAG for epoch " << _epoch << " in background";
+            if (m_settings.lightGen)
+            {
+                // Built on device below. Host one, if any, is only held
+                // to check it once generation completes
+                if (_ec && _ec->lightCache)
+                {
+                    m_next_holder = _ec->lightHolder;
+                    m_next_cache = _ec->lightCache;
+                }
+                m_next_built = true;
+            }
+            else if (_ec && _ec->lightCache)
+            {
+                // Farm has it already
+                m_next_holder = _ec->lightHolder;
+                m_next_cache = _ec->lightCache;
+            }
+            else
+            {
+                // Light cache is built by EpochManager's thread not to
+                // stall mining, within the host memory it is allowed
+                EpochManager::m().prefetch(_epoch);
+                m_next_pending = true;
+                return;
+            }
+        }
+
+        // Generation already queued
+        if (m_next_dag)
+            return;
+
+        if (!m_next_cache && !m_next_built)
+        {
+            if (!m_next_pending)
+                return;
+            EpochManager::ContextPtr ec = EpochManager::m().tryGet(_epoch);
+            if (!ec)
+                return;
+            m_next_pending = false;
+            m_next_cache = ec->light_cache;
+            m_next_holder = ec;
+        }
+
+        if (!m_dag_stream)
+        {
+            int leastPriority, greatestPriority;
+            CUDA_SAFE_CALL(cudaDeviceGetStreamPriorityRange(&leastPriority, &greatestPriority));
+            CUDA_SAFE_CALL(
+                cudaStreamCreateWithPriority(&m_dag_stream, cudaStreamNonBlocking, leastPriority));
+        }
+
+        int lightNumItems = ethash::calculate_light_cache_num_items(_epoch);
+        int dagNumItems = ethash::calculate_full_dataset_num_items(_epoch);
+        size_t lightSize = ethash::get_light_cache_size(lightNumItems);
+        uint64_t dagSize = ethash::get_full_dataset_size(dagNumItems);
+        CUDA_SAFE_CALL(cudaMalloc(reinterpret_cast<void**>(&m_next_light), lightSize));
+        CUDA_SAFE_CALL(cudaMalloc(reinterpret_cast<void**>(&m_next_dag), dagSize));
+
+        // Host light cache is held till generation completes
+        // so the copy needs no wait
+        if (m_next_built)
+        {
+            ethash::hash512 first = EthashAux::lightCacheFirstItem(_epoch);
+            ethash_generate_light_async(
+                m_next_light, lightNumItems, *reinterpret_cast<hash64_t*>(&first), m_dag_stream);
+        }
+        else
+            CUDA_SAFE_CALL(cudaMemcpyAsync(reinterpret_cast<void*>(m_next_light), m_next_cache,
+                lightSize, cudaMemcpyHostToDevice, m_dag_stream));
+
+        // Queue DAG generation on the low priority stream.
+        // It will complete while mining goes on.
+        ethash_generate_dag_async(m_next_dag, dagNumItems, m_next_light, lightNumItems,
+            m_settings.gridSize, m_settings.blockSize, m_dag_stream);
+    }
+    catch (const cuda_runtime_error& _e)
+    {
+        cudalog << "Unable to pre-generate DAG for epoch " << _epoch << " : " << _e.what();
+        releaseNextEpoch();
+        m_next_epoch = _epoch;
+    }
+}
+
+bool CUDAMiner::prepareEpoch(EpochContext const& _ec)
+{
+    // Only record the request : buffers are handled by miner's thread
+    {
+        boost::mutex::scoped_lock l(x_prepare);
+        m_prepare_ec = _ec;
+    }
+    m_prepare_epoch.store(_ec.epochNumber, std::memory_order_relaxed);
+    return true;
+}
+
+void CUDAMiner::servicePreparedEpoch()
+{
+    int epoch = m_prepare_epoch.load(std::memory_order_relaxed);
+    if (epoch < 0)
+        return;
+
+    // Light cache on host takes too long to build aside : let
+    // the farm switch us the usual way
+    bool failed = m_light_on_host;
+    if (!failed)
+    {
+        EpochContext ec;
+        {
+            boost::mutex::scoped_lock l(x_prepare);
+            ec = m_prepare_ec;
+        }
+        prefetchEpoch(epoch, ec.epochNumber == epoch ? &ec : nullptr);
+        failed = m_next_epoch != epoch || (!m_next_dag && !m_next_pending);
+    }
+    if (!failed && (!m_next_dag || cudaStreamQuery(m_dag_stream) == cudaErrorNotReady))
+        return;
+
+    // Ready (or failed, in which case initEpoch builds it in place)
+    {
+        boost::mutex::scoped_lock l(x_prepare);
+        m_prepare_ec.lightHolder.reset();
+    }
+    m_prepare_epoch.store(-1, std::memory_order_relaxed);
+    Farm::f().epochPrepared(m_index, epoch);
+}
+
+bool CUDAMiner::switchToNextEpoch()
+{
+    if (m_next_epoch == -1)
+        return false;
+
+    if (m_next_epoch != m_epochContext.epochNumber || !m_next_dag)
+    {
+        // Either we jumped to an unexpected epoch or pre-generation
+        // did not get to device. Go the usual way
+        releaseNextEpoch();
+        return false;
+    }
+
+    // Wait for background generation to complete (if not already)
+    CUDA_SAFE_CALL(cudaStreamSynchronize(m_dag_stream));
+
+    // A light cache built on device which doesn't match host one
+    // sends us the usual way, which falls back to host one
+    if (m_next_built && m_next_cache &&
+        !lightMatches(m_next_light, m_next_cache, m_epochContext.lightSize))
+    {
+        cwarn << "Light cache built on device does not match host one. Rebuilding DAG";
+        releaseNextEpoch();
+        return false;
+    }
+
+    // Release current buffers and flip pointers
+    hash128_t* dag;
+    hash64_t* light;
+    get_constants(&dag, NULL, &light, NULL);
+    CUDA_SAFE_CALL(cudaFree(reinterpret_cast<void*>(dag)));
+    CUDA_SAFE_CALL(cudaFree(reinterpret_cast<void*>(light)));
+
+    set_constants(
+        m_next_dag, m_epochContext.dagNumItems, m_next_light, m_epochContext.lightNumItems);
+    m_allocated_memory_dag = m_epochContext.dagSize;
+    m_allocated_memory_light_cache = m_epochContext.lightSize;
+
+    m_next_dag = nullptr;
+    m_next_light = nullptr;
+    m_next_holder.reset();
+    m_next_cache = nullptr;
+    m_next_built = false;
+    m_next_epoch = -1;
+    return true;
+}
+
+void CUDAMiner::releaseNextEpoch()
+{
+    if (m_next_dag || m_next_light)
+    {
+        if (m_dag_stream)
+            cudaStreamSynchronize(m_dag_stream);
+        if (m_next_dag)
+            cudaFree(reinterpret_cast<void*>(m_next_dag));
+        if (m_next_light)
+            cudaFree(reinterpret_cast<void*>(m_next_light));
+    }
+
+    m_next_dag = nullptr;
+    m_next_light = nullptr;
+    m_next_holder.reset();
+    m_next_cache = nullptr;
+    m_next_pending = false;
+    m_next_built = false;
+    m_next_epoch = -1;
+}
+
 void CUDAMiner::kick_miner()
 {
+    if (!m_settings.noExit)
+    {
+        // Let kernels in flight exit early
+        boost::mutex::scoped_lock l(x_abort);
+        if (m_abort)
+            *m_abort = 1;
+    }
     m_new_work.store(true, std::memory_order_relaxed);
     m_new_work_signal.notify_one();
 }
@@ -276,6 +1206,40 @@ int CUDAMiner::getNumDevices()
 }
 
 void CUDAMiner::enumDevices(std::map<string, DeviceDescriptor>& _DevicesCollection)
+{
+    std::map<string, DeviceDescriptor> cuDevices;
+    enumCudaDevices(cuDevices);
+    mergeDevices(cuDevices, _DevicesCollection);
+}
+
+void CUDAMiner::mergeDevices(std::map<string, DeviceDescriptor> const& _cuDevices,
+    std::map<string, DeviceDescriptor>& _DevicesCollection)
+{
+    for (auto const& cu : _cuDevices)
+    {
+        auto it = _DevicesCollection.find(cu.first);
+        if (it == _DevicesCollection.end())
+        {
+            _DevicesCollection[cu.first] = cu.second;
+            continue;
+        }
+
+        // Device also seen by OpenCL : CUDA owned fields only
+        DeviceDescriptor& deviceDescriptor = it->second;
+        deviceDescriptor.name = cu.second.name;
+        deviceDescriptor.cuDetected = true;
+        deviceDescriptor.type = DeviceTypeEnum::Gpu;
+        deviceDescriptor.cuDeviceIndex = cu.second.cuDeviceIndex;
+        deviceDescriptor.cuDeviceOrdinal = cu.second.cuDeviceOrdinal;
+        deviceDescriptor.cuName = cu.second.cuName;
+        deviceDescriptor.totalMemory = cu.second.totalMemory;
+        deviceDescriptor.cuCompute = cu.second.cuCompute;
+        deviceDescriptor.cuComputeMajor = cu.second.cuComputeMajor;
+        deviceDescriptor.cuComputeMinor = cu.second.cuComputeMinor;
+    }
+}
+
+void CUDAMiner::enumCudaDevices(std::map<string, DeviceDescriptor>& _DevicesCollection)
 {
     int numDevices = getNumDevices();
 
@@ -295,11 +1259,6 @@ void CUDAMiner::enumDevices(std::map<string, DeviceDescriptor>& _DevicesCollecti
               << props.pciDeviceID << ".0";
             uniqueId = s.str();
 
-            if (_DevicesCollection.find(uniqueId) != _DevicesCollection.end())
-                deviceDescriptor = _DevicesCollection[uniqueId];
-            else
-                deviceDescriptor = DeviceDescriptor();
-
             deviceDescriptor.name = string(props.name);
             deviceDescriptor.cuDetected = true;
             deviceDescriptor.uniqueId = uniqueId;
@@ -322,27 +1281,24 @@ void CUDAMiner::enumDevices(std::map<string, DeviceDescriptor>& _DevicesCollecti
     }
 }
 
-void CUDAMiner::search(
-    uint8_t const* header, uint64_t target, uint64_t start_nonce, const dev::eth::WorkPackage& w)
+void CUDAMiner::search(uint8_t const* header, uint64_t target, uint64_t start_nonce,
+    std::shared_ptr<const WorkPackage> const& _wp)
 {
-    set_header(*reinterpret_cast<hash32_t const*>(header));
-    if (m_current_target != target)
-    {
-        set_target(target);
-        m_current_target = target;
-    }
+    const WorkPackage& w = *_wp;
+    uploadParams(header, target);
+
+    // clear abort flag from previous job
+    *m_abort = 0;
 
     // prime each stream, clear search result buffers and start the search
     uint32_t current_index;
     for (current_index = 0; current_index < m_settings.streams;
          current_index++, start_nonce += m_batch_size)
     {
-        cudaStream_t stream = m_streams[current_index];
-        volatile Search_results& buffer(*m_search_buf[current_index]);
-        buffer.count = 0;
+        m_search_buf[current_index]->count = 0;
 
         // Run the batch for this stream
-        run_ethash_search(m_settings.gridSize, m_settings.blockSize, stream, &buffer, start_nonce);
+        runSearch(current_index, start_nonce);
     }
 
     // process stream batches until we get new work.
@@ -402,8 +1358,10 @@ void CUDAMiner::search(
             // restart the stream on the next batch of nonces
             // unless we are done for this round.
             if (!done)
-                run_ethash_search(
-                    m_settings.gridSize, m_settings.blockSize, stream, &buffer, start_nonce);
+            {
+                throttle();
+                runSearch(current_index, start_nonce);
+            }
 
             if (found_count)
             {
@@ -413,15 +1371,20 @@ void CUDAMiner::search(
                     uint64_t nonce = nonce_base + gids[i];
 
                     Farm::f().submitProof(
-                        Solution{nonce, mixes[i], w, std::chrono::steady_clock::now(), m_index});
+                        Solution{nonce, mixes[i], _wp, std::chrono::steady_clock::now(), m_index});
                     cudalog << EthWhite << "Job: " << w.header.abridged() << " Sol: 0x"
                             << toHex(nonce) << EthReset;
                 }
             }
         }
 
-        // Update the hash rate
-        updateHashRate(m_batch_size, m_settings.streams);
+        // Update the hash rate (unless batches have been aborted)
+        if (!*m_abort)
+            updateHashRate(m_batch_size, m_settings.streams);
+
+        // Eventually let the farm know the next epoch is ready
+        if (!done)
+            servicePreparedEpoch();
 
         // Bail out if it's shutdown time
         if (shouldStop())
@@ -430,14 +1393,124 @@ void CUDAMiner::search(
             break;
         }
     }
+}
 
-#ifdef DEV_BUILD
-    // Optionally log job switch time
-    if (!shouldStop() && (g_logOptions & LOG_SWITCH))
-        cudalog << "Switch time: "
-                << std::chrono::duration_cast<std::chrono::milliseconds>(
-                       std::chrono::steady_clock::now() - m_workSwitchStart)
-                       .count()
-                << " ms.";
-#endif
+void CUDART_CB CUDAMiner::onStreamCompleted(cudaStream_t stream, cudaError_t status, void* userData)
+{
+    (void)stream;
+    (void)status;
+
+    // Runs on a CUDA driver thread : no CUDA calls allowed here.
+    // Just queue the index of the completed stream and wake up miner's thread
+    StreamContext* ctx = static_cast<StreamContext*>(userData);
+    CUDAMiner* miner = ctx->miner;
+    miner->m_streams_completed.push(ctx->index);
+    {
+        boost::mutex::scoped_lock l(miner->x_streams_completed);
+    }
+    miner->m_stream_completed_signal.notify_one();
+}
+
+void CUDAMiner::launchStream(unsigned _index, uint64_t _startNonce)
+{
+    volatile Search_results& buffer(*m_search_buf[_index]);
+    buffer.count = 0;
+    m_stream_ctx[_index].startNonce = _startNonce;
+    runSearch(_index, _startNonce);
+    CUDA_SAFE_CALL(cudaStreamAddCallback(
+        m_streams[_index], onStreamCompleted, &m_stream_ctx[_index], 0));
+}
+
+void CUDAMiner::search_events(uint8_t const* header, uint64_t target, uint64_t start_nonce,
+    std::shared_ptr<const WorkPackage> const& _wp)
+{
+    const WorkPackage& w = *_wp;
+    uploadParams(header, target);
+
+    // clear abort flag from previous job
+    *m_abort = 0;
+
+    // prime each stream
+    unsigned inflight = 0;
+    for (unsigned i = 0; i < m_settings.streams; i++, start_nonce += m_batch_size)
+    {
+        launchStream(i, start_nonce);
+        inflight++;
+    }
+
+    // Process streams in the order they complete and relaunch
+    // them immediately until we get new work. Then drain the
+    // ones still in flight.
+    bool done = false;
+    unsigned index;
+
+    while (inflight)
+    {
+        if (!m_streams_completed.pop(index))
+        {
+            boost::mutex::scoped_lock l(x_streams_completed);
+            if (m_streams_completed.empty())
+                m_stream_completed_signal.timed_wait(l, boost::posix_time::milliseconds(100));
+            continue;
+        }
+        inflight--;
+
+        if (!done)
+        {
+            // Exit as soon as there's new work awaiting
+            bool t = true;
+            done = m_new_work.compare_exchange_strong(t, false);
+
+            // Check on every batch if we need to suspend mining
+            if (!done)
+                done = paused();
+
+            if (shouldStop())
+            {
+                m_new_work.store(false, std::memory_order_relaxed);
+                done = true;
+            }
+        }
+
+        // Detect solutions in completed stream's solution buffer
+        volatile Search_results& buffer(*m_search_buf[index]);
+        uint32_t found_count = std::min((unsigned)buffer.count, MAX_SEARCH_RESULTS);
+        uint64_t nonce_base = m_stream_ctx[index].startNonce;
+
+        uint32_t gids[MAX_SEARCH_RESULTS];
+        h256 mixes[MAX_SEARCH_RESULTS];
+        for (uint32_t i = 0; i < found_count; i++)
+        {
+            gids[i] = buffer.result[i].gid;
+            memcpy(mixes[i].data(), (void*)&buffer.result[i].mix, sizeof(buffer.result[i].mix));
+        }
+
+        // restart the stream on the next batch of nonces
+        // unless we are done for this round.
+        if (!done)
+        {
+            throttle();
+            launchStream(index, start_nonce);
+            start_nonce += m_batch_size;
+            inflight++;
+        }
+
+        for (uint32_t i = 0; i < found_count; i++)
+        {
+            uint64_t nonce = nonce_base + gids[i];
+
+            Farm::f().submitProof(
+                Solution{nonce, mixes[i], _wp, std::chrono::steady_clock::now(), m_index});
+            cudalog << EthWhite << "Job: " << w.header.abridged() << " Sol: 0x" << toHex(nonce)
+                    << EthReset;
+        }
+
+        // Update the hash rate (unless batch has been aborted)
+        if (!*m_abort)
+            updateHashRate(m_batch_size, 1);
+
+        // Eventually let the farm know the next epoch is ready
+        if (!done)
+            servicePreparedEpoch();
+    }
 }
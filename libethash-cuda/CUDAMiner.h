@@ -17,13 +17,20 @@ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include "ethash_cuda_jit.h"
 #include "ethash_cuda_miner_kernel.h"
 
 #include <libdevcore/Worker.h>
 #include <libethcore/EthashAux.h>
 #include <libethcore/Miner.h>
+#include <libethcore/MinerProfile.h>
+
+#include <boost/lockfree/queue.hpp>
+
+#include <ethash/ethash.hpp>
 
 #include <functional>
+#include <future>
 
 namespace dev
 {
@@ -38,14 +45,31 @@ public:
     static int getNumDevices();
     static void enumDevices(std::map<string, DeviceDescriptor>& _DevicesCollection);
 
-    void search(
-        uint8_t const* header, uint64_t target, uint64_t _startN, const dev::eth::WorkPackage& w);
+    /**
+     * @brief Lists CUDA devices only, without touching other backends'
+     * entries. Can run concurrently with their enumeration and be
+     * merged afterwards with mergeDevices()
+     */
+    static void enumCudaDevices(std::map<string, DeviceDescriptor>& _DevicesCollection);
+    static void mergeDevices(std::map<string, DeviceDescriptor> const& _cuDevices,
+        std::map<string, DeviceDescriptor>& _DevicesCollection);
+
+    void search(uint8_t const* header, uint64_t target, uint64_t _startN,
+        std::shared_ptr<const WorkPackage> const& _wp);
+    void search_events(uint8_t const* header, uint64_t target, uint64_t _startN,
+        std::shared_ptr<const WorkPackage> const& _wp);
+
+    bool buildsLight() const override { return m_settings.lightGen; }
 
 protected:
     bool initDevice() override;
 
     bool initEpoch_internal() override;
 
+    bool canCopyDag() override { return true; }
+
+    bool prepareEpoch(EpochContext const& _ec) override;
+
     void kick_miner() override;
 
 private:
@@ -53,17 +77,120 @@ private:
 
     void workLoop() override;
 
+    static void CUDART_CB onStreamCompleted(
+        cudaStream_t stream, cudaError_t status, void* userData);
+    void launchStream(unsigned _index, uint64_t _startNonce);
+
+    void generateDag(hash128_t* dag, hash64_t* light);
+    void generateLight(hash64_t* light);
+    bool lightMatches(hash64_t* light, const ethash_hash512* _host, size_t _size);
+
+    void initJit(hash128_t* dag);
+
+    void publishDag(hash128_t* dag);
+    void withdrawDag();
+    bool copyDagFromPeer(hash128_t* dag);
+    void applyAccessPolicy();
+
+    std::string profileKey();
+    void applyProfile(const ProfileValues& _profile);
+    void resizeStreams(unsigned _streams);
+    void autoTune();
+    bool tuneMeasure(unsigned _grid, unsigned _block, unsigned _streams, double& _hashrate,
+        double& _latency);
+    void runSearch(unsigned _index, uint64_t start_nonce);
+    void runGraph(unsigned _index, uint64_t start_nonce);
+    void releaseGraphs();
+    void uploadParams(uint8_t const* _header, uint64_t _target);
+
+    void prefetchNextEpoch(const WorkPackage& w);
+    void prefetchEpoch(int _epoch, const EpochContext* _ec = nullptr);
+    void servicePreparedEpoch();
+    bool switchToNextEpoch();
+    void releaseNextEpoch();
+
     std::vector<volatile Search_results*> m_search_buf;
     std::vector<cudaStream_t> m_streams;
-    uint64_t m_current_target = 0;
+
+    // Job parameters staged in pinned memory and copied asynchronously on
+    // first stream. Two slots so a new job never overwrites a pending copy
+    search_params* m_params = nullptr;
+    unsigned m_paramsSlot = 0;
+    cudaEvent_t m_paramsUploaded = nullptr;
+
+    // Fast exit : zero-copy word polled by search kernel
+    volatile uint32_t* m_abort = nullptr;
+    volatile uint32_t* m_abort_device = nullptr;
+    boost::mutex x_abort;
+
+    // Runtime compiled search kernel (--cu-jit)
+    jit_search_kernel m_jit;
+    bool m_jit_active = false;
+
+    // Per stream graph holding the search kernel, relaunched
+    // with updated arguments on each batch (--cu-graphs)
+    struct SearchGraph
+    {
+        cudaGraph_t graph = nullptr;
+        cudaGraphExec_t exec = nullptr;
+        cudaGraphNode_t node = nullptr;
+        const void* func = nullptr;
+        uint32_t gridSize = 0;
+        uint32_t blockSize = 0;
+    };
+    std::vector<SearchGraph> m_graphs;
+
+    // Event driven search (--cu-event-loop)
+    struct StreamContext
+    {
+        CUDAMiner* miner;
+        unsigned index;
+        uint64_t startNonce;
+    };
+    std::vector<StreamContext> m_stream_ctx;
+    boost::lockfree::queue<unsigned, boost::lockfree::capacity<128>> m_streams_completed;
+    boost::mutex x_streams_completed;
+    boost::condition_variable m_stream_completed_signal;
 
     CUSettings m_settings;
 
-    const uint32_t m_batch_size;
-    const uint32_t m_streams_batch_size;
+    uint32_t m_batch_size;
+    uint32_t m_streams_batch_size;
+    bool m_tuned = false;
 
     uint64_t m_allocated_memory_dag = 0; // dag_size is a uint64_t in EpochContext struct
     size_t m_allocated_memory_light_cache = 0;
+    bool m_light_on_host = false;
+
+    // Background generation of next epoch's DAG (--cu-dag-prefetch)
+    int m_next_epoch = -1;
+    bool m_next_pending = false;  // Light cache awaited from EpochManager
+    bool m_next_built = false;    // Light cache built on device, checked on switch
+    std::shared_ptr<const void> m_next_holder;  // Host light cache, held till generated
+    const ethash_hash512* m_next_cache = nullptr;
+    hash128_t* m_next_dag = nullptr;
+    hash64_t* m_next_light = nullptr;
+    cudaStream_t m_dag_stream = nullptr;
+
+    // Epoch the farm waits for us to build in background (-1 = none).
+    // Builds go through the prefetch buffers above, from the light
+    // cache the farm hands over
+    atomic<int> m_prepare_epoch = {-1};
+    EpochContext m_prepare_ec;
+    boost::mutex x_prepare;
+
+    // DAG built by one device for peers to copy (-L 2).
+    // Shared lock held by peers while copying, exclusive
+    // by owner before releasing or overwriting it
+    struct SharedDag
+    {
+        int epoch = -1;
+        int device = -1;
+        hash128_t* dag = nullptr;
+        size_t size = 0;
+    };
+    static SharedDag s_sharedDag;
+    static boost::shared_mutex s_sharedDagMutex;
 };
 
 
@@ -1,8 +1,10 @@
 #pragma once
 
+#ifndef __CUDACC_RTC__
 #include <cuda.h>
 
 #include <cuda_runtime.h>
+#endif
 
 #define DEV_INLINE __device__ __forceinline__
 
@@ -23,6 +25,7 @@ void __threadfence(void);
 void __threadfence_block(void);
 #endif
 
+#ifndef __CUDACC_RTC__
 #include <stdint.h>
 
 #ifndef MAX_GPUS
@@ -48,6 +51,7 @@ extern void cudaReportHardwareFailure(int thr_id, cudaError_t error, const char*
 extern const dim3 blockDim;
 extern const uint3 threadIdx;
 #endif
+#endif  // __CUDACC_RTC__
 
 
 #ifndef SPH_C32
@@ -4,8 +4,15 @@
 
 #include "cuda_helper.h"
 
-#define _PARALLEL_HASH 4
-
+#ifdef ETHASH_BLOCK_SIZE
+#define ETHASH_SEARCH_BOUNDS __launch_bounds__(ETHASH_BLOCK_SIZE)
+#else
+#define ETHASH_SEARCH_BOUNDS
+#endif
+
+// PARALLEL_HASH : number of hashes computed at a time by a group of threads (1, 2, 4 or 8)
+// USE_LDG : load DAG items through read-only data cache
+template <int PARALLEL_HASH, bool USE_LDG>
 DEV_INLINE bool compute_hash(uint64_t nonce, uint2* mix_hash)
 {
     // sha3_512(header .. nonce)
@@ -19,14 +26,14 @@ DEV_INLINE bool compute_hash(uint64_t nonce, uint2* mix_hash)
     const int thread_id = threadIdx.x & (THREADS_PER_HASH - 1);
     const int mix_idx = thread_id & 3;
 
-    for (int i = 0; i < THREADS_PER_HASH; i += _PARALLEL_HASH)
+    for (int i = 0; i < THREADS_PER_HASH; i += PARALLEL_HASH)
     {
-        uint4 mix[_PARALLEL_HASH];
-        uint32_t offset[_PARALLEL_HASH];
-        uint32_t init0[_PARALLEL_HASH];
+        uint4 mix[PARALLEL_HASH];
+        uint32_t offset[PARALLEL_HASH];
+        uint32_t init0[PARALLEL_HASH];
 
         // share init among threads
-        for (int p = 0; p < _PARALLEL_HASH; p++)
+        for (int p = 0; p < PARALLEL_HASH; p++)
         {
             uint2 shuffle[8];
             for (int j = 0; j < 8; j++)
@@ -58,16 +65,17 @@ DEV_INLINE bool compute_hash(uint64_t nonce, uint2* mix_hash)
 
             for (uint32_t b = 0; b < 4; b++)
             {
-                for (int p = 0; p < _PARALLEL_HASH; p++)
+                for (int p = 0; p < PARALLEL_HASH; p++)
                 {
                     offset[p] = fnv(init0[p] ^ (a + b), ((uint32_t*)&mix[p])[b]) % d_dag_size;
                     offset[p] = SHFL(offset[p], t, THREADS_PER_HASH);
-                    mix[p] = fnv4(mix[p], d_dag[offset[p]].uint4s[thread_id]);
+                    mix[p] = fnv4(mix[p], USE_LDG ? LDG(d_dag[offset[p]].uint4s[thread_id]) :
+                                                    d_dag[offset[p]].uint4s[thread_id]);
                 }
             }
         }
 
-        for (int p = 0; p < _PARALLEL_HASH; p++)
+        for (int p = 0; p < PARALLEL_HASH; p++)
         {
             uint2 shuffle[4];
             uint32_t thread_mix = fnv_reduce(mix[p]);
@@ -94,7 +102,7 @@ DEV_INLINE bool compute_hash(uint64_t nonce, uint2* mix_hash)
     }
 
     // keccak_256(keccak_512(header..nonce) .. mix);
-    if (cuda_swab64(keccak_f1600_final(state)) > d_target)
+    if (cuda_swab64(keccak_f1600_final(state)) > d_params.target)
         return true;
 
     mix_hash[0] = state[8];
@@ -104,3 +112,34 @@ DEV_INLINE bool compute_hash(uint64_t nonce, uint2* mix_hash)
 
     return false;
 }
+
+template <int PARALLEL_HASH, bool USE_LDG>
+__global__ void ETHASH_SEARCH_BOUNDS ethash_search(
+    volatile Search_results* g_output, uint64_t start_nonce, volatile uint32_t* g_abort)
+{
+    // Abort word lives in host memory : read it once per block
+    // so blocks scheduled after a job switch exit immediately
+    __shared__ uint32_t s_abort;
+    if (threadIdx.x == 0)
+        s_abort = *g_abort;
+    __syncthreads();
+    if (s_abort)
+        return;
+
+    uint32_t const gid = blockIdx.x * blockDim.x + threadIdx.x;
+    uint2 mix[4];
+    if (compute_hash<PARALLEL_HASH, USE_LDG>(start_nonce + gid, mix))
+        return;
+    uint32_t index = atomicInc((uint32_t*)&g_output->count, 0xffffffff);
+    if (index >= MAX_SEARCH_RESULTS)
+        return;
+    g_output->result[index].gid = gid;
+    g_output->result[index].mix[0] = mix[0].x;
+    g_output->result[index].mix[1] = mix[0].y;
+    g_output->result[index].mix[2] = mix[1].x;
+    g_output->result[index].mix[3] = mix[1].y;
+    g_output->result[index].mix[4] = mix[2].x;
+    g_output->result[index].mix[5] = mix[2].y;
+    g_output->result[index].mix[6] = mix[3].x;
+    g_output->result[index].mix[7] = mix[3].y;
+}
@@ -0,0 +1,233 @@
+#include "ethash_cuda_jit.h"
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#ifdef ETH_ETHASHCUDA_NVRTC
+
+#include <nvrtc.h>
+
+// Kernel sources embedded at build time (see CMakeLists.txt)
+#include "jit/cuda_helper_h.h"
+#include "jit/dagger_shuffled_cuh.h"
+#include "jit/ethash_cuda_miner_kernel_globals_h.h"
+#include "jit/ethash_cuda_miner_kernel_h.h"
+#include "jit/fnv_cuh.h"
+#include "jit/keccak_cuh.h"
+
+#define CU_SAFE_CALL(call)                                                                \
+    do                                                                                    \
+    {                                                                                     \
+        CUresult result = call;                                                           \
+        if (CUDA_SUCCESS != result)                                                       \
+        {                                                                                 \
+            const char* msg = nullptr;                                                    \
+            cuGetErrorString(result, &msg);                                               \
+            std::stringstream ss;                                                         \
+            ss << "CUDA error in func " << __FUNCTION__ << " at line " << __LINE__ << ' ' \
+               << (msg ? msg : "unknown");                                                \
+            throw cuda_runtime_error(ss.str());                                           \
+        }                                                                                 \
+    } while (0)
+
+namespace
+{
+const char* jit_main_source =
+    "typedef unsigned char uint8_t;\n"
+    "typedef unsigned int uint32_t;\n"
+    "typedef int int32_t;\n"
+    "typedef unsigned long long uint64_t;\n"
+    "typedef long long int64_t;\n"
+    "#include \"ethash_cuda_miner_kernel.h\"\n"
+    "#include \"ethash_cuda_miner_kernel_globals.h\"\n"
+    "#include \"cuda_helper.h\"\n"
+    "#include \"fnv.cuh\"\n"
+    "#include \"keccak.cuh\"\n"
+    "#include \"dagger_shuffled.cuh\"\n";
+
+struct jit_program
+{
+    std::string ptx;
+    std::string name;
+};
+
+// Compiled programs are shared among devices of the same architecture
+std::map<std::string, jit_program> s_programs;
+std::deque<std::string> s_programs_order;
+std::mutex s_programs_mutex;
+
+bool jit_compile(jit_program& _program, uint32_t _dag_size, uint32_t _block_size,
+    unsigned _parallel_hash, bool _ldg, unsigned _compute_major, unsigned _compute_minor,
+    std::string& _error)
+{
+    std::string expression = "ethash_search<" + std::to_string(_parallel_hash) + ", " +
+                             (_ldg ? "true" : "false") + ">";
+
+    std::vector<const char*> headers;
+    std::vector<const char*> names;
+    std::vector<std::string> sources = {
+        std::string(cuda_helper_h, sizeof(cuda_helper_h)),
+        std::string(fnv_cuh, sizeof(fnv_cuh)),
+        std::string(keccak_cuh, sizeof(keccak_cuh)),
+        std::string(dagger_shuffled_cuh, sizeof(dagger_shuffled_cuh)),
+        std::string(ethash_cuda_miner_kernel_h, sizeof(ethash_cuda_miner_kernel_h)),
+        std::string(
+            ethash_cuda_miner_kernel_globals_h, sizeof(ethash_cuda_miner_kernel_globals_h))};
+    const char* sourceNames[] = {"cuda_helper.h", "fnv.cuh", "keccak.cuh", "dagger_shuffled.cuh",
+        "ethash_cuda_miner_kernel.h", "ethash_cuda_miner_kernel_globals.h"};
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        headers.push_back(sources[i].c_str());
+        names.push_back(sourceNames[i]);
+    }
+
+    nvrtcProgram prog;
+    if (nvrtcCreateProgram(&prog, jit_main_source, "ethash_jit.cu", (int)headers.size(),
+            headers.data(), names.data()) != NVRTC_SUCCESS)
+    {
+        _error = "Unable to create program";
+        return false;
+    }
+    nvrtcAddNameExpression(prog, expression.c_str());
+
+    std::vector<std::string> options = {
+        "--gpu-architecture=compute_" + std::to_string(_compute_major) +
+            std::to_string(_compute_minor),
+        "--use_fast_math", "-DCUDA_VERSION=" + std::to_string(CUDA_VERSION),
+        "-DETHASH_DAG_ITEMS=" + std::to_string(_dag_size) + "U",
+        "-DETHASH_BLOCK_SIZE=" + std::to_string(_block_size)};
+    std::vector<const char*> opts;
+    for (auto& option : options)
+        opts.push_back(option.c_str());
+
+    nvrtcResult result = nvrtcCompileProgram(prog, (int)opts.size(), opts.data());
+    if (result != NVRTC_SUCCESS)
+    {
+        size_t logSize;
+        _error = nvrtcGetErrorString(result);
+        if (nvrtcGetProgramLogSize(prog, &logSize) == NVRTC_SUCCESS && logSize > 1)
+        {
+            std::vector<char> log(logSize);
+            nvrtcGetProgramLog(prog, log.data());
+            _error.append(" : ").append(log.data());
+        }
+        nvrtcDestroyProgram(&prog);
+        return false;
+    }
+
+    size_t ptxSize;
+    const char* lowered;
+    nvrtcGetPTXSize(prog, &ptxSize);
+    std::vector<char> ptx(ptxSize);
+    nvrtcGetPTX(prog, ptx.data());
+    nvrtcGetLoweredName(prog, expression.c_str(), &lowered);
+    _program.ptx = std::string(ptx.data());
+    _program.name = lowered;
+    nvrtcDestroyProgram(&prog);
+    return true;
+}
+
+}  // namespace
+
+bool jit_load_search(jit_search_kernel& _kernel, int _epoch, uint32_t _dag_size,
+    uint32_t _block_size, unsigned _parallel_hash, bool _ldg, unsigned _compute_major,
+    unsigned _compute_minor, std::string& _error)
+{
+    jit_program program;
+    std::string key = std::to_string(_epoch) + ":" + std::to_string(_dag_size) + ":" +
+                      std::to_string(_block_size) + ":" + std::to_string(_parallel_hash) +
+                      (_ldg ? "L" : "G") + ":" + std::to_string(_compute_major) +
+                      std::to_string(_compute_minor);
+    {
+        std::lock_guard<std::mutex> l(s_programs_mutex);
+        auto it = s_programs.find(key);
+        if (it != s_programs.end())
+        {
+            program = it->second;
+        }
+        else
+        {
+            if (!jit_compile(program, _dag_size, _block_size, _parallel_hash, _ldg,
+                    _compute_major, _compute_minor, _error))
+                return false;
+
+            // Keep a few programs only (NiceHash may switch back and forth)
+            if (s_programs_order.size() >= 4)
+            {
+                s_programs.erase(s_programs_order.front());
+                s_programs_order.pop_front();
+            }
+            s_programs[key] = program;
+            s_programs_order.push_back(key);
+        }
+    }
+
+    try
+    {
+        jit_unload_search(_kernel);
+        CU_SAFE_CALL(cuModuleLoadDataEx(&_kernel.module, program.ptx.c_str(), 0, 0, 0));
+        CU_SAFE_CALL(cuModuleGetFunction(&_kernel.search, _kernel.module, program.name.c_str()));
+        size_t bytes;
+        CU_SAFE_CALL(cuModuleGetGlobal(&_kernel.d_dag, &bytes, _kernel.module, "d_dag"));
+        CU_SAFE_CALL(cuModuleGetGlobal(&_kernel.d_params, &bytes, _kernel.module, "d_params"));
+    }
+    catch (const cuda_runtime_error& _e)
+    {
+        _error = _e.what();
+        jit_unload_search(_kernel);
+        return false;
+    }
+    return true;
+}
+
+void jit_unload_search(jit_search_kernel& _kernel)
+{
+    if (_kernel.module)
+        cuModuleUnload(_kernel.module);
+    _kernel = jit_search_kernel();
+}
+
+void jit_set_dag(jit_search_kernel& _kernel, hash128_t* _dag)
+{
+    CU_SAFE_CALL(cuMemcpyHtoD(_kernel.d_dag, &_dag, sizeof(hash128_t*)));
+}
+
+void jit_set_params(
+    jit_search_kernel& _kernel, search_params const* _params, cudaStream_t stream)
+{
+    CU_SAFE_CALL(cuMemcpyHtoDAsync(
+        _kernel.d_params, _params, sizeof(search_params), reinterpret_cast<CUstream>(stream)));
+}
+
+void jit_run_search(jit_search_kernel& _kernel, uint32_t gridSize, uint32_t blockSize,
+    cudaStream_t stream, volatile Search_results* g_output, uint64_t start_nonce,
+    volatile uint32_t* g_abort)
+{
+    void* args[] = {&g_output, &start_nonce, &g_abort};
+    CU_SAFE_CALL(cuLaunchKernel(_kernel.search, gridSize, 1, 1, blockSize, 1, 1, 0,
+        reinterpret_cast<CUstream>(stream), args, nullptr));
+}
+
+#else
+
+bool jit_load_search(jit_search_kernel&, int, uint32_t, uint32_t, unsigned, bool, unsigned,
+    unsigned, std::string& _error)
+{
+    _error = "Not built with NVRTC support";
+    return false;
+}
+
+void jit_unload_search(jit_search_kernel&) {}
+
+void jit_set_dag(jit_search_kernel&, hash128_t*) {}
+
+void jit_set_params(jit_search_kernel&, search_params const*, cudaStream_t) {}
+
+void jit_run_search(jit_search_kernel&, uint32_t, uint32_t, cudaStream_t,
+    volatile Search_results*, uint64_t, volatile uint32_t*)
+{}
+
+#endif
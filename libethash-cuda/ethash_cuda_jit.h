@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+
+#include <cuda.h>
+
+#include "ethash_cuda_miner_kernel.h"
+
+// Search kernel compiled at runtime by NVRTC with DAG size and
+// launch parameters as compile time constants
+struct jit_search_kernel
+{
+    CUmodule module = nullptr;
+    CUfunction search = nullptr;
+    CUdeviceptr d_dag = 0;
+    CUdeviceptr d_params = 0;
+};
+
+// Compiles (or fetches from cache) the search kernel for the given
+// epoch, kernel variant and device architecture and loads it into current context.
+// On failure returns false and the reason in _error.
+bool jit_load_search(jit_search_kernel& _kernel, int _epoch, uint32_t _dag_size,
+    uint32_t _block_size, unsigned _parallel_hash, bool _ldg, unsigned _compute_major,
+    unsigned _compute_minor, std::string& _error);
+
+void jit_unload_search(jit_search_kernel& _kernel);
+
+void jit_set_dag(jit_search_kernel& _kernel, hash128_t* _dag);
+
+// Same requirements on _params as set_params_async()
+void jit_set_params(
+    jit_search_kernel& _kernel, search_params const* _params, cudaStream_t stream);
+
+void jit_run_search(jit_search_kernel& _kernel, uint32_t gridSize, uint32_t blockSize,
+    cudaStream_t stream, volatile Search_results* g_output, uint64_t start_nonce,
+    volatile uint32_t* g_abort);
@@ -16,47 +16,65 @@
 
 #include "dagger_shuffled.cuh"
 
-__global__ void ethash_search(volatile Search_results* g_output, uint64_t start_nonce)
+void run_ethash_search(uint32_t gridSize, uint32_t blockSize, cudaStream_t stream,
+    volatile Search_results* g_output, uint64_t start_nonce, volatile uint32_t* g_abort,
+    unsigned parallelHash, bool useLdg)
 {
-    uint32_t const gid = blockIdx.x * blockDim.x + threadIdx.x;
-    uint2 mix[4];
-    if (compute_hash(start_nonce + gid, mix))
-        return;
-    uint32_t index = atomicInc((uint32_t*)&g_output->count, 0xffffffff);
-    if (index >= MAX_SEARCH_RESULTS)
-        return;
-    g_output->result[index].gid = gid;
-    g_output->result[index].mix[0] = mix[0].x;
-    g_output->result[index].mix[1] = mix[0].y;
-    g_output->result[index].mix[2] = mix[1].x;
-    g_output->result[index].mix[3] = mix[1].y;
-    g_output->result[index].mix[4] = mix[2].x;
-    g_output->result[index].mix[5] = mix[2].y;
-    g_output->result[index].mix[6] = mix[3].x;
-    g_output->result[index].mix[7] = mix[3].y;
+#define ETHASH_SEARCH_CASE(P)                                                   \
+    case P:                                                                     \
+        if (useLdg)                                                             \
+            ethash_search<P, true>                                              \
+                <<<gridSize, blockSize, 0, stream>>>(g_output, start_nonce, g_abort); \
+        else                                                                    \
+            ethash_search<P, false>                                             \
+                <<<gridSize, blockSize, 0, stream>>>(g_output, start_nonce, g_abort); \
+        break;
+
+    switch (parallelHash)
+    {
+        ETHASH_SEARCH_CASE(1)
+        ETHASH_SEARCH_CASE(2)
+        ETHASH_SEARCH_CASE(8)
+    default:
+        ETHASH_SEARCH_CASE(4)
+    }
+#undef ETHASH_SEARCH_CASE
+    CUDA_SAFE_CALL(cudaGetLastError());
 }
 
-void run_ethash_search(uint32_t gridSize, uint32_t blockSize, cudaStream_t stream,
-    volatile Search_results* g_output, uint64_t start_nonce)
+const void* ethash_search_function(unsigned parallelHash, bool useLdg)
 {
-    ethash_search<<<gridSize, blockSize, 0, stream>>>(g_output, start_nonce);
-    CUDA_SAFE_CALL(cudaGetLastError());
+#define ETHASH_SEARCH_CASE(P)                                                         \
+    case P:                                                                           \
+        return useLdg ? (const void*)ethash_search<P, true> :                         \
+                        (const void*)ethash_search<P, false>;
+
+    switch (parallelHash)
+    {
+        ETHASH_SEARCH_CASE(1)
+        ETHASH_SEARCH_CASE(2)
+        ETHASH_SEARCH_CASE(8)
+    default:
+        ETHASH_SEARCH_CASE(4)
+    }
+#undef ETHASH_SEARCH_CASE
 }
 
 #define ETHASH_DATASET_PARENTS 256
 #define NODE_WORDS (64 / 4)
 
 
-__global__ void ethash_calculate_dag_item(uint32_t start)
+__global__ void ethash_calculate_dag_item(
+    uint32_t start, hash128_t* g_dag, uint32_t dag_size, hash64_t* g_light, uint32_t light_size)
 {
     uint32_t const node_index = start + blockIdx.x * blockDim.x + threadIdx.x;
-    if (((node_index >> 1) & (~1)) >= d_dag_size)
+    if (((node_index >> 1) & (~1)) >= dag_size)
         return;
     union {
        hash128_t dag_node;
        uint2 dag_node_mem[25];
     };
-    copy(dag_node.uint4s, d_light[node_index % d_light_size].uint4s, 4);
+    copy(dag_node.uint4s, g_light[node_index % light_size].uint4s, 4);
     dag_node.words[0] ^= node_index;
     SHA3_512(dag_node_mem);
 
@@ -64,12 +82,12 @@ __global__ void ethash_calculate_dag_item(uint32_t start)
 
     for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i)
     {
-        uint32_t parent_index = fnv(node_index ^ i, dag_node.words[i % NODE_WORDS]) % d_light_size;
+        uint32_t parent_index = fnv(node_index ^ i, dag_node.words[i % NODE_WORDS]) % light_size;
         for (uint32_t t = 0; t < 4; t++)
         {
             uint32_t shuffle_index = SHFL(parent_index, t, 4);
 
-            uint4 p4 = d_light[shuffle_index].uint4s[thread_id];
+            uint4 p4 = g_light[shuffle_index].uint4s[thread_id];
             for (int w = 0; w < 4; w++)
             {
                 uint4 s4 = make_uint4(SHFL(p4.x, w, 4), SHFL(p4.y, w, 4), SHFL(p4.z, w, 4), SHFL(p4.w, w, 4));
@@ -81,29 +99,81 @@ __global__ void ethash_calculate_dag_item(uint32_t start)
         }
     }
     SHA3_512(dag_node_mem);
-    hash64_t* dag_nodes = (hash64_t*)d_dag;
+    hash64_t* dag_nodes = (hash64_t*)g_dag;
     copy(dag_nodes[node_index].uint4s, dag_node.uint4s, 4);
 }
 
-void ethash_generate_dag(
-    uint64_t dag_size, uint32_t gridSize, uint32_t blockSize, cudaStream_t stream)
+void ethash_generate_dag_chunk(hash128_t* _dag, uint32_t _dag_size, hash64_t* _light,
+    uint32_t _light_size, uint32_t _start, uint32_t _count, uint32_t blockSize,
+    cudaStream_t stream)
+{
+    uint32_t gridSize = (_count + blockSize - 1) / blockSize;
+    ethash_calculate_dag_item<<<gridSize, blockSize, 0, stream>>>(
+        _start, _dag, _dag_size, _light, _light_size);
+    CUDA_SAFE_CALL(cudaGetLastError());
+}
+
+void ethash_generate_dag_async(hash128_t* _dag, uint32_t _dag_size, hash64_t* _light,
+    uint32_t _light_size, uint32_t gridSize, uint32_t blockSize, cudaStream_t stream)
 {
-    const uint32_t work = (uint32_t)(dag_size / sizeof(hash64_t));
+    // Only queues the chunks on the stream without waiting
+    // for them. Caller is in charge of synchronizing the stream.
+    const uint32_t work = _dag_size * 2;
     const uint32_t run = gridSize * blockSize;
 
-    uint32_t base;
-    for (base = 0; base <= work - run; base += run)
+    for (uint32_t base = 0; base < work; base += run)
+        ethash_generate_dag_chunk(_dag, _dag_size, _light, _light_size, base,
+            (work - base < run ? work - base : run), blockSize, stream);
+}
+
+#define ETHASH_LIGHT_ROUNDS 3
+#define LIGHT_CHUNK_ITEMS 16384
+
+// Light cache items depend on previous ones : a single thread walks them
+
+__global__ void ethash_calculate_light_chain(hash64_t* g_light, uint32_t start, uint32_t end)
+{
+    uint2 state[25];
+    for (int k = 0; k < 8; k++)
+        state[k] = g_light[start - 1].uint2s[k];
+    for (uint32_t i = start; i < end; i++)
     {
-        ethash_calculate_dag_item<<<gridSize, blockSize, 0, stream>>>(base);
-        CUDA_SAFE_CALL(cudaDeviceSynchronize());
+        SHA3_512(state);
+        for (int k = 0; k < 8; k++)
+            g_light[i].uint2s[k] = state[k];
     }
-    if (base < work)
+}
+
+__global__ void ethash_calculate_light_round(
+    hash64_t* g_light, uint32_t light_size, uint32_t start, uint32_t end)
+{
+    uint2 state[25];
+    for (uint32_t i = start; i < end; i++)
     {
-        uint32_t lastGrid = work - base;
-        lastGrid = (lastGrid + blockSize - 1) / blockSize;
-        ethash_calculate_dag_item<<<lastGrid, blockSize, 0, stream>>>(base);
-        CUDA_SAFE_CALL(cudaDeviceSynchronize());
+        uint32_t v = g_light[i].words[0] % light_size;
+        uint32_t w = (light_size + i - 1) % light_size;
+        for (int k = 0; k < 8; k++)
+            state[k] = g_light[v].uint2s[k] ^ g_light[w].uint2s[k];
+        SHA3_512(state);
+        for (int k = 0; k < 8; k++)
+            g_light[i].uint2s[k] = state[k];
     }
+}
+
+void ethash_generate_light_async(
+    hash64_t* _light, uint32_t _light_size, hash64_t const& _first, cudaStream_t stream)
+{
+    // Launches are kept short not to trip display watchdogs. First
+    // item comes from host : copied to staging before this returns
+    CUDA_SAFE_CALL(
+        cudaMemcpyAsync(_light, &_first, sizeof(hash64_t), cudaMemcpyHostToDevice, stream));
+    for (uint32_t base = 1; base < _light_size; base += LIGHT_CHUNK_ITEMS)
+        ethash_calculate_light_chain<<<1, 1, 0, stream>>>(_light, base,
+            (_light_size - base < LIGHT_CHUNK_ITEMS ? _light_size : base + LIGHT_CHUNK_ITEMS));
+    for (int round = 0; round < ETHASH_LIGHT_ROUNDS; round++)
+        for (uint32_t base = 0; base < _light_size; base += LIGHT_CHUNK_ITEMS)
+            ethash_calculate_light_round<<<1, 1, 0, stream>>>(_light, _light_size, base,
+                (_light_size - base < LIGHT_CHUNK_ITEMS ? _light_size : base + LIGHT_CHUNK_ITEMS));
     CUDA_SAFE_CALL(cudaGetLastError());
 }
 
@@ -147,12 +217,8 @@ void get_constants(hash128_t** _dag, uint32_t* _dag_size, hash64_t** _light, uin
     }
 }
 
-void set_header(hash32_t _header)
-{
-    CUDA_SAFE_CALL(cudaMemcpyToSymbol(d_header, &_header, sizeof(hash32_t)));
-}
-
-void set_target(uint64_t _target)
+void set_params_async(search_params const* _params, cudaStream_t stream)
 {
-    CUDA_SAFE_CALL(cudaMemcpyToSymbol(d_target, &_target, sizeof(uint64_t)));
+    CUDA_SAFE_CALL(cudaMemcpyToSymbolAsync(
+        d_params, _params, sizeof(search_params), 0, cudaMemcpyHostToDevice, stream));
 }
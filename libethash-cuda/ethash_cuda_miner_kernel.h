@@ -1,11 +1,13 @@
 #pragma once
 
+#ifndef __CUDACC_RTC__
 #include <stdint.h>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 
 #include "cuda_runtime.h"
+#endif
 
 // It is virtually impossible to get more than
 // one solution per stream hash calculation
@@ -49,17 +51,36 @@ typedef union
     uint4 uint4s[64 / sizeof(uint4)];
 } hash64_t;
 
+// Job parameters : uploaded together in one asynchronous copy
+struct search_params
+{
+    hash32_t header;
+    uint64_t target;
+};
+
+#ifndef __CUDACC_RTC__
 void set_constants(hash128_t* _dag, uint32_t _dag_size, hash64_t* _light, uint32_t _light_size);
 void get_constants(hash128_t** _dag, uint32_t* _dag_size, hash64_t** _light, uint32_t* _light_size);
 
-void set_header(hash32_t _header);
-
-void set_target(uint64_t _target);
+// _params must be pinned host memory left untouched until the copy completes
+void set_params_async(search_params const* _params, cudaStream_t stream);
 
 void run_ethash_search(uint32_t gridSize, uint32_t blockSize, cudaStream_t stream,
-    volatile Search_results* g_output, uint64_t start_nonce);
+    volatile Search_results* g_output, uint64_t start_nonce, volatile uint32_t* g_abort,
+    unsigned parallelHash, bool useLdg);
+
+// Search kernel instance as launched by run_ethash_search (for graph nodes)
+const void* ethash_search_function(unsigned parallelHash, bool useLdg);
+
+void ethash_generate_dag_chunk(hash128_t* _dag, uint32_t _dag_size, hash64_t* _light,
+    uint32_t _light_size, uint32_t _start, uint32_t _count, uint32_t threads, cudaStream_t stream);
+
+void ethash_generate_dag_async(hash128_t* _dag, uint32_t _dag_size, hash64_t* _light,
+    uint32_t _light_size, uint32_t blocks, uint32_t threads, cudaStream_t stream);
 
-void ethash_generate_dag(uint64_t dag_size, uint32_t blocks, uint32_t threads, cudaStream_t stream);
+// Builds the light cache in place from its first item (keccak512 of the seed)
+void ethash_generate_light_async(
+    hash64_t* _light, uint32_t _light_size, hash64_t const& _first, cudaStream_t stream);
 
 struct cuda_runtime_error : public virtual std::runtime_error
 {
@@ -78,3 +99,4 @@ struct cuda_runtime_error : public virtual std::runtime_error
             throw cuda_runtime_error(ss.str());                                           \
         }                                                                                 \
     } while (0)
+#endif  // __CUDACC_RTC__
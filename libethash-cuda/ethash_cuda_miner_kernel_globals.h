@@ -1,11 +1,15 @@
 #pragma once
 
+#ifdef ETHASH_DAG_ITEMS
+// Runtime compiled kernel : DAG size is a compile time constant
+#define d_dag_size ETHASH_DAG_ITEMS
+#else
 __constant__ uint32_t d_dag_size;
+#endif
 __constant__ hash128_t* d_dag;
 __constant__ uint32_t d_light_size;
 __constant__ hash64_t* d_light;
-__constant__ hash32_t d_header;
-__constant__ uint64_t d_target;
+__constant__ search_params d_params;
 
 #if (__CUDACC_VER_MAJOR__ > 8)
 #define SHFL(x, y, z) __shfl_sync(0xFFFFFFFF, (x), (y), (z))
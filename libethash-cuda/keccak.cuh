@@ -68,8 +68,8 @@ DEV_INLINE void keccak_f1600_init(uint2* state)
     uint2 t[5], u, v;
     const uint2 u2zero = make_uint2(0, 0);
 
-    devectorize2(d_header.uint4s[0], s[0], s[1]);
-    devectorize2(d_header.uint4s[1], s[2], s[3]);
+    devectorize2(d_params.header.uint4s[0], s[0], s[1]);
+    devectorize2(d_params.header.uint4s[1], s[2], s[3]);
     s[4] = state[4];
     s[5] = make_uint2(1, 0);
     s[6] = u2zero;
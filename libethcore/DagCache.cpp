@@ -0,0 +1,292 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <boost/filesystem.hpp>
+
+#include "DagCache.h"
+
+namespace dev
+{
+namespace eth
+{
+namespace
+{
+constexpr char c_magic[8] = {'E', 'T', 'H', 'M', 'C', 'A', 'C', 'H'};
+constexpr uint32_t c_version = 1;
+
+// Payload starts on a page boundary so it can be used in place
+constexpr uint64_t c_payloadOffset = 4096;
+
+struct FileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t kind;
+    int32_t epoch;
+    uint32_t reserved;
+    uint64_t size;
+    uint64_t checksum;
+};
+
+inline uint64_t rotl64(uint64_t _x, unsigned _s)
+{
+    return (_x << _s) | (_x >> (64 - _s));
+}
+
+// FNV-1a like checksum on 64 bits words. Independent
+// accumulators let it run at memory speed on large files.
+uint64_t checksum(const void* _data, uint64_t _size)
+{
+    const uint64_t prime = 0x100000001b3ULL;
+    const unsigned char* bytes = static_cast<const unsigned char*>(_data);
+    uint64_t h[4] = {0xcbf29ce484222325ULL, 0x84222325cbf29ce4ULL, 0x9ce484222325cbf2ULL,
+        0x2325cbf29ce48422ULL};
+
+    uint64_t i = 0;
+    for (; i + 32 <= _size; i += 32)
+    {
+        for (unsigned k = 0; k < 4; k++)
+        {
+            uint64_t w;
+            memcpy(&w, bytes + i + k * 8, 8);
+            h[k] = (h[k] ^ w) * prime;
+        }
+    }
+    for (; i < _size; i++)
+        h[0] = (h[0] ^ bytes[i]) * prime;
+
+    return h[0] ^ rotl64(h[1], 16) ^ rotl64(h[2], 32) ^ rotl64(h[3], 48) ^ _size;
+}
+
+const char* kindName(DagCache::Kind _kind)
+{
+    return _kind == DagCache::LightCache ? "light" : "dataset";
+}
+
+// _badSize is set when the file exists with a size other than _size. Other
+// failures (out of memory, too many open files ...) say nothing of the file
+std::shared_ptr<DagCacheFile> mapFile(const std::string& _file, uint64_t _size, bool& _badSize)
+{
+    _badSize = false;
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(_file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize))
+    {
+        CloseHandle(file);
+        return nullptr;
+    }
+    if (uint64_t(fileSize.QuadPart) != _size)
+    {
+        _badSize = true;
+        CloseHandle(file);
+        return nullptr;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping)
+        return nullptr;
+    void* map = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!map)
+        return nullptr;
+#else
+    int fd = ::open(_file.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return nullptr;
+    }
+    if (uint64_t(st.st_size) != _size)
+    {
+        _badSize = true;
+        ::close(fd);
+        return nullptr;
+    }
+    void* map = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return nullptr;
+    madvise(map, _size, MADV_WILLNEED);
+#endif
+    return std::make_shared<DagCacheFile>(map, _size, c_payloadOffset, _size - c_payloadOffset);
+}
+
+}  // namespace
+
+DagCacheFile::DagCacheFile(void* _map, uint64_t _mapSize, uint64_t _offset, uint64_t _size)
+  : m_map(_map), m_mapSize(_mapSize), m_offset(_offset), m_size(_size)
+{}
+
+DagCacheFile::~DagCacheFile()
+{
+#if defined(_WIN32)
+    UnmapViewOfFile(m_map);
+#else
+    munmap(m_map, m_mapSize);
+#endif
+}
+
+std::string DagCache::s_dir;
+std::mutex DagCache::s_mutex;
+
+void DagCache::setDirectory(const std::string& _dir)
+{
+    std::lock_guard<std::mutex> l(s_mutex);
+    s_dir = _dir;
+}
+
+bool DagCache::enabled()
+{
+    std::lock_guard<std::mutex> l(s_mutex);
+    return !s_dir.empty();
+}
+
+std::string DagCache::path(Kind _kind, int _epoch)
+{
+    boost::filesystem::path path(s_dir);
+    path /= std::string(kindName(_kind)) + "-" + std::to_string(_epoch) + ".bin";
+    return path.string();
+}
+
+std::shared_ptr<DagCacheFile> DagCache::open(Kind _kind, int _epoch, uint64_t _size)
+{
+    std::string file;
+    {
+        std::lock_guard<std::mutex> l(s_mutex);
+        if (s_dir.empty())
+            return nullptr;
+        file = path(_kind, _epoch);
+    }
+
+    boost::system::error_code ec;
+    if (!boost::filesystem::exists(file, ec))
+        return nullptr;
+
+    bool badSize;
+    auto map = mapFile(file, c_payloadOffset + _size, badSize);
+    if (!map)
+    {
+        // Can't be mapped right now (memory, descriptors ...) :
+        // the file may well be fine, keep it for next time
+        if (badSize)
+            boost::filesystem::remove(file, ec);
+        return nullptr;
+    }
+
+    FileHeader header;
+    memcpy(&header, static_cast<const char*>(map->data()) - c_payloadOffset, sizeof(header));
+    if (memcmp(header.magic, c_magic, sizeof(c_magic)) == 0 && header.version == c_version &&
+        header.kind == uint32_t(_kind) && header.epoch == _epoch && header.size == _size &&
+        header.checksum == checksum(map->data(), _size))
+        return map;
+    map.reset();
+
+    // Stale or corrupted
+    boost::filesystem::remove(file, ec);
+    return nullptr;
+}
+
+bool DagCache::store(Kind _kind, int _epoch, const void* _data, uint64_t _size)
+{
+    std::string file;
+    {
+        std::lock_guard<std::mutex> l(s_mutex);
+        if (s_dir.empty())
+            return false;
+        file = path(_kind, _epoch);
+    }
+
+    FileHeader header = {};
+    memcpy(header.magic, c_magic, sizeof(c_magic));
+    header.version = c_version;
+    header.kind = uint32_t(_kind);
+    header.epoch = _epoch;
+    header.size = _size;
+    header.checksum = checksum(_data, _size);
+
+    std::vector<char> block(c_payloadOffset, 0);
+    memcpy(block.data(), &header, sizeof(header));
+
+    // Write to a temporary file then rename so a crash or
+    // a concurrent instance never sees a partially written file
+    boost::system::error_code ec;
+    boost::filesystem::path path(file);
+    boost::filesystem::create_directories(path.parent_path(), ec);
+    boost::filesystem::path temp = path;
+    temp += boost::filesystem::unique_path(".%%%%%%");
+    {
+        std::ofstream out(temp.string(), std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        out.write(block.data(), block.size());
+        out.write(static_cast<const char*>(_data), std::streamsize(_size));
+        if (!out)
+        {
+            out.close();
+            boost::filesystem::remove(temp, ec);
+            return false;
+        }
+    }
+    boost::filesystem::rename(temp, path, ec);
+    if (ec)
+    {
+        boost::filesystem::remove(temp, ec);
+        return false;
+    }
+
+    // Only current and previous epochs are worth keeping
+    std::string prefix = std::string(kindName(_kind)) + "-";
+    for (boost::filesystem::directory_iterator it(path.parent_path(), ec), end; !ec && it != end;
+         it.increment(ec))
+    {
+        std::string name = it->path().filename().string();
+        if (name.compare(0, prefix.size(), prefix) != 0 || it->path().extension() != ".bin")
+            continue;
+        int epoch = std::atoi(name.c_str() + prefix.size());
+        boost::system::error_code removeEc;
+        if (epoch < _epoch - 1)
+            boost::filesystem::remove(it->path(), removeEc);
+    }
+    return true;
+}
+
+}  // namespace eth
+}  // namespace dev
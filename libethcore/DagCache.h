@@ -0,0 +1,95 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace dev
+{
+namespace eth
+{
+/**
+ * @brief Read only memory mapping of a cache file payload.
+ * Unmapped when the last reference goes away.
+ */
+class DagCacheFile
+{
+public:
+    DagCacheFile(void* _map, uint64_t _mapSize, uint64_t _offset, uint64_t _size);
+    ~DagCacheFile();
+
+    DagCacheFile(const DagCacheFile&) = delete;
+    DagCacheFile& operator=(const DagCacheFile&) = delete;
+
+    const void* data() const { return static_cast<const char*>(m_map) + m_offset; }
+    uint64_t size() const { return m_size; }
+
+private:
+    void* m_map;
+    uint64_t m_mapSize;
+    uint64_t m_offset;
+    uint64_t m_size;
+};
+
+/**
+ * @brief Persists per epoch data (light cache, full dataset) on disk
+ * so later starts map it instead of computing it again.
+ *
+ * Files hold a small versioned header with a checksum of the payload,
+ * which starts on a page boundary. Disabled until a directory is set.
+ */
+class DagCache
+{
+public:
+    enum Kind
+    {
+        LightCache = 1,
+        Dataset = 2
+    };
+
+    /**
+     * @brief Sets the directory files are kept in. Empty disables the cache.
+     */
+    static void setDirectory(const std::string& _dir);
+
+    static bool enabled();
+
+    /**
+     * @brief Maps cached data of _kind for _epoch. Returns nullptr if
+     * missing. Files not matching _size or checksum are removed.
+     */
+    static std::shared_ptr<DagCacheFile> open(Kind _kind, int _epoch, uint64_t _size);
+
+    /**
+     * @brief Writes data of _kind for _epoch. Files of the same kind older
+     * than the previous epoch are removed.
+     */
+    static bool store(Kind _kind, int _epoch, const void* _data, uint64_t _size);
+
+private:
+    static std::string path(Kind _kind, int _epoch);
+
+    static std::string s_dir;
+    static std::mutex s_mutex;
+};
+
+}  // namespace eth
+}  // namespace dev
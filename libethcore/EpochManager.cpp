@@ -0,0 +1,306 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "EpochManager.h"
+
+namespace dev
+{
+namespace eth
+{
+namespace
+{
+uint64_t lightSize(const ethash::epoch_context& _context)
+{
+    return ethash::get_light_cache_size(_context.light_cache_num_items);
+}
+
+uint64_t fullSize(const ethash::epoch_context& _context)
+{
+    return lightSize(_context) + ethash::get_full_dataset_size(_context.full_dataset_num_items);
+}
+
+}  // namespace
+
+EpochManager& EpochManager::m()
+{
+    static EpochManager manager;
+    return manager;
+}
+
+EpochManager::~EpochManager()
+{
+    {
+        std::lock_guard<std::mutex> l(m_mutex);
+        m_stop = true;
+    }
+    m_signal.notify_all();
+    if (m_worker.joinable())
+        m_worker.join();
+}
+
+EpochManager::ContextPtr EpochManager::get(int _epoch)
+{
+    std::unique_lock<std::mutex> l(m_mutex);
+    while (true)
+    {
+        if (auto context = find(_epoch))
+            return context;
+        if (!m_building.count(_epoch))
+            break;
+        m_signal.wait(l);
+    }
+
+    // Not requested before (or queued but not started yet) : build it here
+    m_queue.erase(std::remove(m_queue.begin(), m_queue.end(), _epoch), m_queue.end());
+    m_building.insert(_epoch);
+    l.unlock();
+    ContextPtr context = build(_epoch);
+    l.lock();
+    m_building.erase(_epoch);
+    if (context)
+        insert(_epoch, context);
+    m_signal.notify_all();
+    return context;
+}
+
+EpochManager::FullContextPtr EpochManager::getFull(int _epoch)
+{
+    std::unique_lock<std::mutex> l(m_mutex);
+    for (auto it = m_contexts.begin(); it != m_contexts.end(); it++)
+    {
+        if (it->full && it->epoch == _epoch)
+        {
+            m_contexts.splice(m_contexts.begin(), m_contexts, it);
+            return it->full;
+        }
+    }
+
+    // Datasets are large : don't let several miners allocate one each
+    while (m_buildingFull.count(_epoch))
+    {
+        m_signal.wait(l);
+        for (auto const& entry : m_contexts)
+            if (entry.full && entry.epoch == _epoch)
+                return entry.full;
+    }
+    m_buildingFull.insert(_epoch);
+
+    FullContextPtr full;
+    for (int attempt = 0; !full && attempt < 2; attempt++)
+    {
+        evict(ethash::get_full_dataset_size(ethash::calculate_full_dataset_num_items(_epoch)));
+        l.unlock();
+        ethash::epoch_context_full* context = ethash::create_epoch_context_full(_epoch).release();
+        l.lock();
+        if (context)
+        {
+            uint64_t size = fullSize(*context);
+            auto resident = m_resident;
+            *resident += size;
+            full = FullContextPtr(context, [resident, size](const ethash::epoch_context_full* _c) {
+                ethash_destroy_epoch_context_full(const_cast<ethash::epoch_context_full*>(_c));
+                *resident -= size;
+            });
+            insert(Entry{_epoch, nullptr, full, size});
+        }
+        else if (!evictUnused())
+            break;
+    }
+    m_buildingFull.erase(_epoch);
+    m_signal.notify_all();
+    return full;
+}
+
+EpochManager::ContextPtr EpochManager::build(int _epoch)
+{
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        {
+            // Make room first so the budget holds at peak too
+            std::lock_guard<std::mutex> l(m_mutex);
+            if (attempt)
+            {
+                // Out of memory : retry once without what only the cache holds
+                if (!evictUnused())
+                    break;
+            }
+            else
+            {
+                evict(ethash::get_light_cache_size(ethash::calculate_light_cache_num_items(_epoch)));
+            }
+        }
+
+        ethash::epoch_context* context = ethash::create_epoch_context(_epoch).release();
+        if (!context)
+            continue;
+
+        uint64_t size = lightSize(*context);
+        auto resident = m_resident;
+        *resident += size;
+        return ContextPtr(context, [resident, size](const ethash::epoch_context* _context) {
+            ethash_destroy_epoch_context(const_cast<ethash::epoch_context*>(_context));
+            *resident -= size;
+        });
+    }
+    return nullptr;
+}
+
+EpochManager::ContextPtr EpochManager::tryGet(int _epoch)
+{
+    std::lock_guard<std::mutex> l(m_mutex);
+    return find(_epoch);
+}
+
+void EpochManager::prefetch(int _epoch)
+{
+    if (_epoch < 0)
+        return;
+
+    std::lock_guard<std::mutex> l(m_mutex);
+    if (find(_epoch, false) || m_building.count(_epoch) ||
+        std::find(m_queue.begin(), m_queue.end(), _epoch) != m_queue.end())
+        return;
+
+    m_queue.push_back(_epoch);
+    if (!m_worker.joinable())
+        m_worker = std::thread(&EpochManager::workLoop, this);
+    m_signal.notify_all();
+}
+
+void EpochManager::setCapacity(unsigned _capacity)
+{
+    std::lock_guard<std::mutex> l(m_mutex);
+    m_capacity = std::max(_capacity, 1U);
+    evict(0);
+}
+
+void EpochManager::setMemoryBudget(uint64_t _bytes)
+{
+    std::lock_guard<std::mutex> l(m_mutex);
+    m_budget = _bytes;
+    evict(0);
+}
+
+EpochManager::Stats EpochManager::stats()
+{
+    std::lock_guard<std::mutex> l(m_mutex);
+    Stats stats;
+    for (auto const& entry : m_contexts)
+        (entry.full ? stats.fullContexts : stats.contexts)++;
+    stats.cached = m_cached;
+    stats.resident = m_resident->load(std::memory_order_relaxed);
+    stats.budget = m_budget;
+    stats.evictions = m_evictions;
+    return stats;
+}
+
+void EpochManager::workLoop()
+{
+    std::unique_lock<std::mutex> l(m_mutex);
+    while (!m_stop)
+    {
+        if (m_queue.empty())
+        {
+            m_signal.wait(l);
+            continue;
+        }
+
+        int epoch = m_queue.front();
+        m_queue.pop_front();
+        if (m_building.count(epoch) || find(epoch, false))
+            continue;
+
+        m_building.insert(epoch);
+        l.unlock();
+        ContextPtr context = build(epoch);
+        l.lock();
+        m_building.erase(epoch);
+        if (context)
+            insert(epoch, context);
+        m_signal.notify_all();
+    }
+}
+
+EpochManager::ContextPtr EpochManager::find(int _epoch, bool _touch)
+{
+    for (auto it = m_contexts.begin(); it != m_contexts.end(); it++)
+    {
+        if (it->epoch != _epoch || !it->context)
+            continue;
+        if (_touch)
+            m_contexts.splice(m_contexts.begin(), m_contexts, it);
+        return it->context;  // Still valid after splice
+    }
+    return nullptr;
+}
+
+void EpochManager::insert(int _epoch, ContextPtr _context)
+{
+    uint64_t size = lightSize(*_context);
+    insert(Entry{_epoch, std::move(_context), nullptr, size});
+}
+
+void EpochManager::insert(Entry&& _entry)
+{
+    m_cached += _entry.size;
+    m_contexts.push_front(std::move(_entry));
+    evict(0);
+}
+
+void EpochManager::evict(uint64_t _room)
+{
+    // Contexts held by someone else would not be freed : they stay.
+    // Room is made for a context about to be inserted : all others
+    // may go. Otherwise the most recent one stays.
+    auto over = [&]() {
+        return m_contexts.size() + (_room ? 1 : 0) > m_capacity ||
+               (m_budget && m_cached + _room > m_budget);
+    };
+    auto it = m_contexts.end();
+    while (over() && it != m_contexts.begin())
+    {
+        --it;
+        if ((!_room && it == m_contexts.begin()) || used(*it))
+            continue;
+        m_cached -= it->size;
+        it = m_contexts.erase(it);
+        m_evictions++;
+    }
+}
+
+bool EpochManager::evictUnused()
+{
+    bool freed = false;
+    for (auto it = m_contexts.begin(); it != m_contexts.end();)
+    {
+        if (used(*it))
+        {
+            it++;
+            continue;
+        }
+        m_cached -= it->size;
+        it = m_contexts.erase(it);
+        m_evictions++;
+        freed = true;
+    }
+    return freed;
+}
+
+}  // namespace eth
+}  // namespace dev
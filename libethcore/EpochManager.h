@@ -0,0 +1,144 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include <ethash/ethash.hpp>
+
+namespace dev
+{
+namespace eth
+{
+/**
+ * @brief Builds ethash epoch contexts (light caches) ahead of time
+ * on a background thread and keeps the most recently used ones.
+ *
+ * Contexts are reference counted : one evicted from the cache stays
+ * valid for as long as someone holds it. The cache is bounded both by
+ * count and by host memory : least recently used contexts nobody else
+ * holds are evicted first, the most recent one is always kept.
+ */
+class EpochManager
+{
+public:
+    typedef std::shared_ptr<const ethash::epoch_context> ContextPtr;
+    typedef std::shared_ptr<const ethash::epoch_context_full> FullContextPtr;
+
+    struct Stats
+    {
+        unsigned contexts = 0;      // Cached light contexts
+        unsigned fullContexts = 0;  // Cached full (light + dataset) contexts
+        uint64_t cached = 0;        // Bytes held by the cache
+        uint64_t resident = 0;      // Bytes of all live contexts, evicted ones included
+        uint64_t budget = 0;        // 0 means unbounded
+        uint64_t evictions = 0;
+    };
+
+    static EpochManager& m();
+
+    ~EpochManager();
+
+    /**
+     * @brief Returns the context of _epoch. Waits for it if being built
+     * in background, builds it on the calling thread if never requested.
+     */
+    ContextPtr get(int _epoch);
+
+    /**
+     * @brief Returns the context of _epoch if available. Never blocks.
+     */
+    ContextPtr tryGet(int _epoch);
+
+    /**
+     * @brief Queues the build of _epoch on the background thread
+     * unless already available or pending.
+     */
+    void prefetch(int _epoch);
+
+    /**
+     * @brief Returns the context of _epoch along with its full dataset,
+     * built on the calling thread if not cached. The dataset is computed
+     * lazily by ethash::search but accounted for its whole size.
+     */
+    FullContextPtr getFull(int _epoch);
+
+    /**
+     * @brief Sets how many contexts are kept (at least 1)
+     */
+    void setCapacity(unsigned _capacity);
+
+    /**
+     * @brief Sets the host memory, in bytes, the cache may hold (0 = unbounded)
+     */
+    void setMemoryBudget(uint64_t _bytes);
+
+    Stats stats();
+
+private:
+    EpochManager() = default;
+
+    struct Entry
+    {
+        int epoch;
+        ContextPtr context;   // Set for light contexts
+        FullContextPtr full;  // Set for full contexts
+        uint64_t size;
+    };
+
+    void workLoop();
+    ContextPtr build(int _epoch);
+    ContextPtr find(int _epoch, bool _touch = true);  // Requires m_mutex
+    void insert(int _epoch, ContextPtr _context);     // Requires m_mutex
+    void insert(Entry&& _entry);                      // Requires m_mutex
+    void evict(uint64_t _room);                       // Requires m_mutex
+    bool evictUnused();                               // Requires m_mutex
+    static bool used(const Entry& _entry)             // Held by someone else
+    {
+        return (_entry.context ? _entry.context.use_count() : _entry.full.use_count()) > 1;
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_signal;  // Work queued or context built
+
+    std::list<Entry> m_contexts;  // Most recently used first
+    std::deque<int> m_queue;      // Epochs to build in background
+    std::set<int> m_building;     // Epochs being built by anyone
+    std::set<int> m_buildingFull;  // Same for full contexts
+    unsigned m_capacity = 3;
+    uint64_t m_budget = 0;
+    uint64_t m_cached = 0;
+    uint64_t m_evictions = 0;
+
+    // Shared with deleters of contexts which may outlive the manager
+    std::shared_ptr<std::atomic<uint64_t>> m_resident =
+        std::make_shared<std::atomic<uint64_t>>(0);
+
+    std::thread m_worker;
+    bool m_stop = false;
+};
+
+}  // namespace eth
+}  // namespace dev
@@ -16,8 +16,10 @@
 */
 
 #include "EthashAux.h"
+#include "EpochManager.h"
 
 #include <ethash/ethash.hpp>
+#include <ethash/keccak.hpp>
 
 using namespace dev;
 using namespace eth;
@@ -25,9 +27,17 @@ using namespace eth;
 Result EthashAux::eval(int epoch, h256 const& _headerHash, uint64_t _nonce) noexcept
 {
     auto headerHash = ethash::hash256_from_bytes(_headerHash.data());
-    auto& context = ethash::get_global_epoch_context(epoch);
-    auto result = ethash::hash(context, headerHash, _nonce);
+    auto context = EpochManager::m().get(epoch);
+    if (!context)
+        return {~h256(), h256()};  // Out of memory : can't meet any boundary
+    auto result = ethash::hash(*context, headerHash, _nonce);
     h256 mix{reinterpret_cast<byte*>(result.mix_hash.bytes), h256::ConstructFromPointer};
     h256 final{reinterpret_cast<byte*>(result.final_hash.bytes), h256::ConstructFromPointer};
     return {final, mix};
-}
\ No newline at end of file
+}
+
+ethash::hash512 EthashAux::lightCacheFirstItem(int _epoch) noexcept
+{
+    auto seed = ethash::calculate_epoch_seed(_epoch);
+    return ethash::keccak512(seed.bytes, sizeof(seed));
+}
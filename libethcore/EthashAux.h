@@ -23,6 +23,8 @@
 
 #include <ethash/ethash.hpp>
 
+#include <memory>
+
 namespace dev
 {
 namespace eth
@@ -37,6 +39,12 @@ class EthashAux
 {
 public:
     static Result eval(int epoch, h256 const& _headerHash, uint64_t _nonce) noexcept;
+
+    /**
+     * @brief First item of the light cache of _epoch (keccak512 of its seed),
+     * the one devices building the light cache themselves start from
+     */
+    static ethash::hash512 lightCacheFirstItem(int _epoch) noexcept;
 };
 
 struct EpochContext
@@ -47,6 +55,7 @@ struct EpochContext
     const ethash_hash512* lightCache;
     int dagNumItems;
     uint64_t dagSize;
+    std::shared_ptr<const void> lightHolder;  // Keeps lightCache alive
 };
 
 struct WorkPackage
@@ -68,13 +77,16 @@ struct WorkPackage
     uint16_t exSizeBytes = 0;
 
     std::string algo = "ethash";
+
+    uint64_t generation = 0;  // Order of arrival of jobs (set by PoolManager)
+    bool clean = false;       // Pool declared previous jobs invalid (clean_jobs)
 };
 
 struct Solution
 {
     uint64_t nonce;                                // Solution found nonce
     h256 mixHash;                                  // Mix hash
-    WorkPackage work;                              // WorkPackage this solution refers to
+    std::shared_ptr<const WorkPackage> work;       // WorkPackage this solution refers to
     std::chrono::steady_clock::time_point tstamp;  // Timestamp of found solution
     unsigned midx;                                 // Originating miner Id
 };
@@ -50,6 +50,9 @@ Farm::Farm(std::map<std::string, DeviceDescriptor>& _DevicesCollection,
 
     m_this = this;
 
+    if (m_Settings.epochCacheMem)
+        EpochManager::m().setMemoryBudget(uint64_t(m_Settings.epochCacheMem) << 20);
+
     // Init HWMON if needed
     if (m_Settings.hwMon)
     {
@@ -149,6 +152,17 @@ Farm::Farm(std::map<std::string, DeviceDescriptor>& _DevicesCollection,
     // Initialize nonce_scrambler
     shuffle();
 
+    // Start solution verifiers. One is kept without solutions to
+    // verify (--noeval) for the shares of proxied workers
+    unsigned verifiers = m_Settings.noEval ? 1 : std::max(m_Settings.verifyThreads, 1U);
+    for (unsigned i = 0; i < verifiers; i++)
+        m_verifiers.emplace_back(&Farm::verifyLoop, this);
+
+    // Sensors are read on their own thread : drivers can
+    // take long and must not stall network i/o
+    if (m_Settings.hwMon)
+        m_sampler = std::thread(&Farm::hwmonLoop, this);
+
     // Start data collector timer
     // It should work for the whole lifetime of Farm
     // regardless it's mining state
@@ -166,6 +180,26 @@ Farm::~Farm()
     // Stop data collector (before monitors !!!)
     m_collectTimer.cancel();
 
+    // Stop solution verifiers
+    {
+        std::lock_guard<std::mutex> l(m_verifyMutex);
+        m_verifyStop = true;
+    }
+    m_verifySignal.notify_all();
+    for (auto& verifier : m_verifiers)
+        verifier.join();
+
+    // Stop hardware monitor sampler (before monitors !!!)
+    if (m_sampler.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> l(m_sensorsMutex);
+            m_sensorsStop = true;
+        }
+        m_sensorsSignal.notify_all();
+        m_sampler.join();
+    }
+
     // Deinit HWMON
 #if defined(__linux)
     if (sysfsh)
@@ -197,50 +231,254 @@ void Farm::shuffle()
     m_nonce_scrambler = uniform_int_distribution<uint64_t>()(engine);
 }
 
+bool Farm::hostLightNeeded() const
+{
+    // Solutions are verified against the host light cache
+    if (!m_Settings.noEval)
+        return true;
+    for (auto const& miner : m_miners)
+        if (!miner->buildsLight())
+            return true;
+    return false;
+}
+
 void Farm::setWork(WorkPackage const& _newWp)
 {
+    // Miners preparing the new epoch still hash the previous one : its
+    // jobs go to them only and leave the others, and the epoch the farm
+    // is on, alone. They join current work in epochPrepared().
+    // setWork is only called from PoolManager so reading m_epochWp is safe
+    if (m_epochWp.epoch != _newWp.epoch)
+    {
+        Guard l(x_minerWork);
+        bool routed = false;
+        for (unsigned i : m_preparing)
+        {
+            auto const& miner = m_miners.at(i);
+            if (miner->readyEpoch() != _newWp.epoch)
+                continue;
+            auto wp = std::make_shared<WorkPackage>(_newWp);
+            wp->startNonce = m_nonceSegments.at(i).first;
+            miner->setWork(std::move(wp));
+            routed = true;
+        }
+        if (routed)
+        {
+            // Still the latest job : solutions found on it aren't stale
+            m_currentWp = _newWp;
+            m_jobGeneration.store(_newWp.generation, std::memory_order_relaxed);
+            if (_newWp.clean)
+                m_cleanGeneration.store(_newWp.generation, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    // Light cache of a new epoch is looked up before taking the lock :
+    // it's ready when prefetched, otherwise it's built right here
+    std::shared_ptr<DagCacheFile> lightCacheFile;
+    EpochManager::ContextPtr context;
+    if (m_epochWp.epoch != _newWp.epoch && hostLightNeeded())
+    {
+        lightCacheFile = DagCache::open(DagCache::LightCache, _newWp.epoch,
+            ethash::get_light_cache_size(ethash::calculate_light_cache_num_items(_newWp.epoch)));
+        if (lightCacheFile)
+        {
+            // Solutions verification needs the context anyway
+            EpochManager::m().prefetch(_newWp.epoch);
+        }
+        else
+        {
+            context = EpochManager::m().get(_newWp.epoch);
+            if (!context)
+            {
+                cwarn << "Unable to allocate light cache of epoch " << _newWp.epoch
+                      << ". Work ignored";
+                return;
+            }
+            if (DagCache::enabled() &&
+                !DagCache::store(DagCache::LightCache, _newWp.epoch, context->light_cache,
+                    ethash::get_light_cache_size(context->light_cache_num_items)))
+                cwarn << "Unable to store light cache of epoch " << _newWp.epoch;
+        }
+
+        // Likely the next one to come
+        EpochManager::m().prefetch(_newWp.epoch + 1);
+    }
+
     // Set work to each miner giving it's own starting nonce
     Guard l(x_minerWork);
 
     // Retrieve appropriate EpochContext
-    if (m_currentWp.epoch != _newWp.epoch)
+    if (m_epochWp.epoch != _newWp.epoch)
     {
-        ethash::epoch_context _ec = ethash::get_global_epoch_context(_newWp.epoch);
         m_currentEc.epochNumber = _newWp.epoch;
-        m_currentEc.lightNumItems = _ec.light_cache_num_items;
-        m_currentEc.lightSize = ethash::get_light_cache_size(_ec.light_cache_num_items);
-        m_currentEc.dagNumItems = _ec.full_dataset_num_items;
-        m_currentEc.dagSize = ethash::get_full_dataset_size(_ec.full_dataset_num_items);
-        m_currentEc.lightCache = _ec.light_cache;
+        m_currentEc.lightNumItems = ethash::calculate_light_cache_num_items(_newWp.epoch);
+        m_currentEc.lightSize = ethash::get_light_cache_size(m_currentEc.lightNumItems);
+        m_currentEc.dagNumItems = ethash::calculate_full_dataset_num_items(_newWp.epoch);
+        m_currentEc.dagSize = ethash::get_full_dataset_size(m_currentEc.dagNumItems);
+
+        // Previous ones are kept as miners may still
+        // be reading them while switching epoch
+        m_prevLightCacheFile = m_lightCacheFile;
+        m_lightCacheFile = lightCacheFile;
+        m_prevContext = m_currentContext;
+        m_currentContext = context;
+        if (m_lightCacheFile)
+        {
+            m_currentEc.lightCache = static_cast<const ethash_hash512*>(m_lightCacheFile->data());
+            m_currentEc.lightHolder = m_lightCacheFile;
+        }
+        else if (m_currentContext)
+        {
+            m_currentEc.lightCache = m_currentContext->light_cache;
+            m_currentEc.lightHolder = m_currentContext;
+        }
+        else
+        {
+            // Every miner builds its own
+            m_currentEc.lightCache = nullptr;
+            m_currentEc.lightHolder.reset();
+        }
 
-        for (auto const& miner : m_miners)
+        // Miners able to build the new DAG in background keep searching
+        // their last work meanwhile. The others switch the blocking way.
+        // Dag load modes other than parallel rely on miners switching together.
+        for (unsigned int i = 0; i < m_miners.size(); i++)
+        {
+            auto const& miner = m_miners.at(i);
+            int ready = miner->readyEpoch();
+            if (ready != _newWp.epoch && ready >= 0 && m_Settings.epochOverlap &&
+                m_Settings.dagLoadMode == DAG_LOAD_MODE_PARALLEL && !miner->paused() &&
+                miner->prepareEpoch(m_currentEc))
+            {
+                m_preparing.insert(i);
+                continue;
+            }
+            m_preparing.erase(i);
             miner->setEpoch(m_currentEc);
+        }
+        if (!m_preparing.empty())
+            cnote << "Epoch " << _newWp.epoch << " : " << m_preparing.size()
+                  << " miner(s) keep hashing previous epoch till their DAG is ready";
     }
 
     m_currentWp = _newWp;
+    m_epochWp = _newWp;
+    m_jobGeneration.store(_newWp.generation, std::memory_order_relaxed);
+    if (_newWp.clean)
+        m_cleanGeneration.store(_newWp.generation, std::memory_order_relaxed);
 
     // Check if we need to shuffle per work (ergodicity == 2)
     if (m_Settings.ergodicity == 2 && m_currentWp.exSizeBytes == 0)
         shuffle();
 
-    uint64_t _startNonce;
+    uint64_t _startNonce, _total;
     if (m_currentWp.exSizeBytes > 0)
     {
-        // Equally divide the residual segment among miners
+        // Divide the residual segment among miners
         _startNonce = m_currentWp.startNonce;
         m_nonce_segment_with =
             (unsigned int)log2(pow(2, 64 - (m_currentWp.exSizeBytes * 4)) / m_miners.size());
+        _total = uint64_t(1) << (64 - (m_currentWp.exSizeBytes * 4));
     }
     else
     {
         // Get the randomly selected nonce
         _startNonce = m_nonce_scrambler;
+        _total = uint64_t(m_miners.size()) << m_nonce_segment_with;
     }
+    partitionNonces(_startNonce, _total);
 
+    // Each miner gets an immutable package it can hold without
+    // copying it : only the start nonce differs among them.
+    // Miners preparing the epoch get theirs once done.
     for (unsigned int i = 0; i < m_miners.size(); i++)
     {
-        m_currentWp.startNonce = _startNonce + ((uint64_t)i << m_nonce_segment_with);
-        m_miners.at(i)->setWork(m_currentWp);
+        if (m_preparing.count(i))
+            continue;
+        auto wp = std::make_shared<WorkPackage>(m_currentWp);
+        wp->startNonce = m_nonceSegments.at(i).first;
+        m_miners.at(i)->setWork(std::move(wp));
+    }
+}
+
+void Farm::epochPrepared(unsigned _minerIdx, int _epoch)
+{
+    g_io_service.post(m_io_strand.wrap([this, _minerIdx, _epoch]() {
+        Guard l(x_minerWork);
+        if (!m_preparing.count(_minerIdx) || _epoch != m_epochWp.epoch ||
+            _minerIdx >= m_miners.size())
+            return;
+
+        // Join the others on current job within the segment kept for it
+        m_preparing.erase(_minerIdx);
+        auto const& miner = m_miners.at(_minerIdx);
+        miner->setEpoch(m_currentEc);
+        auto wp = std::make_shared<WorkPackage>(m_epochWp);
+        wp->startNonce = m_nonceSegments.at(_minerIdx).first;
+        miner->setWork(std::move(wp));
+
+        // All miners on the new epoch : next job (re)partitions
+        // nonces on the hashrates they get there
+        if (m_preparing.empty())
+            cnote << "Epoch " << _epoch << " : all miners switched";
+    }));
+}
+
+void Farm::minerResumed(unsigned _minerIdx)
+{
+    g_io_service.post(m_io_strand.wrap([this, _minerIdx]() {
+        Guard l(x_minerWork);
+        if (!m_epochWp || _minerIdx >= m_miners.size() || m_preparing.count(_minerIdx) ||
+            _minerIdx >= m_nonceSegments.size())
+            return;
+
+        // Resume on current job within the segment kept for it
+        auto const& miner = m_miners.at(_minerIdx);
+        if (miner->paused())
+            return;
+        auto wp = std::make_shared<WorkPackage>(m_epochWp);
+        wp->startNonce = m_nonceSegments.at(_minerIdx).first;
+        miner->setWork(std::move(wp));
+    }));
+}
+
+/**
+ * @brief Splits _total nonces from _base among miners proportionally to
+ * their hashrates, so fast devices don't run out of a short (extranonce)
+ * space while slow ones hold untouched nonces.
+ * Miners with no measured hashrate yet (starting, paused) are given the
+ * rate of the slowest one. Equal split when none has been measured.
+ */
+void Farm::partitionNonces(uint64_t _base, uint64_t _total)
+{
+    const size_t count = m_miners.size();
+    std::vector<double> weights(count, 1.0);
+    if (m_Settings.nonceWeighting)
+    {
+        double slowest = 0.0;
+        for (size_t i = 0; i < count; i++)
+        {
+            weights[i] = m_miners.at(i)->RetrieveHashRate();
+            if (weights[i] > 0.0 && (slowest == 0.0 || weights[i] < slowest))
+                slowest = weights[i];
+        }
+        for (auto& weight : weights)
+            if (weight <= 0.0)
+                weight = slowest > 0.0 ? slowest : 1.0;
+    }
+    double sum = std::accumulate(weights.begin(), weights.end(), 0.0);
+
+    m_nonceSegments.resize(count);
+    double cumulated = 0.0;
+    uint64_t offset = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        cumulated += weights[i];
+        uint64_t next =
+            (i + 1 == count) ? _total : std::min(_total, uint64_t(_total * (cumulated / sum)));
+        m_nonceSegments[i] = {_base + offset, next - offset};
+        offset = next;
     }
 }
 
@@ -290,6 +528,18 @@ bool Farm::start()
 #endif
             if (minerTelemetry.prefix.empty())
                 continue;
+            if (minerTelemetry.prefix != "cp")
+            {
+                // CPU miners pin themselves (see CPSettings)
+                ThreadPolicy policy = m_Settings.gpuThreads;
+                if (m_Settings.gpuNumaLocal)
+                {
+                    policy.numaNode = pciNumaNode(it->second.uniqueId);
+                    if (policy.numaNode < 0)
+                        cwarn << "Unable to find NUMA node of " << it->second.uniqueId;
+                }
+                m_miners.back()->setThreadPolicy(policy);
+            }
             m_telemetry.miners.push_back(minerTelemetry);
             m_miners.back()->startWorking();
         }
@@ -329,6 +579,7 @@ void Farm::stop()
             }
 
             m_miners.clear();
+            m_preparing.clear();
             m_isMining.store(false, std::memory_order_relaxed);
         }
     }
@@ -437,6 +688,20 @@ void Farm::accountSolution(unsigned _minerIdx, SolutionAccountingEnum _accountin
         m_telemetry.miners.at(_minerIdx).solutions.tstamp = std::chrono::steady_clock::now();
         return;
     }
+    if (_accounting == SolutionAccountingEnum::Dropped)
+    {
+        m_telemetry.farm.solutions.dropped++;
+        m_telemetry.farm.solutions.tstamp = std::chrono::steady_clock::now();
+        m_telemetry.miners.at(_minerIdx).solutions.dropped++;
+        m_telemetry.miners.at(_minerIdx).solutions.tstamp = std::chrono::steady_clock::now();
+        return;
+    }
+    if (_accounting == SolutionAccountingEnum::Stale)
+    {
+        m_telemetry.farm.solutions.stale++;
+        m_telemetry.miners.at(_minerIdx).solutions.stale++;
+        return;
+    }
 }
 
 /**
@@ -463,6 +728,12 @@ SolutionAccountType Farm::getSolutions(unsigned _minerIdx)
     }
 }
 
+void Farm::accountAcceptLatency(unsigned _minerIdx, std::chrono::microseconds _latency)
+{
+    if (_minerIdx < m_miners.size())
+        m_miners.at(_minerIdx)->acceptLatency().record(_latency);
+}
+
 /**
  * @brief Provides the description of segments each miner is working on
  * @return a JsonObject
@@ -473,37 +744,105 @@ Json::Value Farm::get_nonce_scrambler_json()
     jRes["start_nonce"] = toHex(m_nonce_scrambler, HexPrefix::Add);
     jRes["device_width"] = m_nonce_segment_with;
     jRes["device_count"] = (uint64_t)m_miners.size();
+    jRes["weighted"] = m_Settings.nonceWeighting;
+
+    Json::Value jSegments = Json::Value(Json::arrayValue);
+    {
+        Guard l(x_minerWork);
+        for (size_t i = 0; i < m_nonceSegments.size(); i++)
+        {
+            Json::Value jSegment;
+            jSegment["device"] = (Json::UInt)i;
+            jSegment["start"] = toHex(m_nonceSegments[i].first, HexPrefix::Add);
+            jSegment["end"] =
+                toHex(m_nonceSegments[i].first + m_nonceSegments[i].second, HexPrefix::Add);
+            jSegment["size"] = (Json::UInt64)m_nonceSegments[i].second;
+            jSegments.append(jSegment);
+        }
+    }
+    jRes["segments"] = jSegments;
 
     return jRes;
 }
 
+bool Farm::get_nonce_segment(unsigned _index, uint64_t& _start, uint64_t& _size)
+{
+    Guard l(x_minerWork);
+    if (_index >= m_nonceSegments.size())
+        return false;
+    _start = m_nonceSegments[_index].first;
+    _size = m_nonceSegments[_index].second;
+    return true;
+}
+
 void Farm::setTStartTStop(unsigned tstart, unsigned tstop)
 {
     m_Settings.tempStart = tstart;
     m_Settings.tempStop = tstop;
 }
 
+bool Farm::isStale(Solution const& _s) const
+{
+    // Generations are 0 for work not coming from PoolManager (e.g. benchmarks)
+    uint64_t generation = _s.work->generation;
+    if (!generation || !m_Settings.staleDrop)
+        return false;
+    if (m_Settings.staleDrop >= 2)
+        return generation < m_jobGeneration.load(std::memory_order_relaxed);
+    return generation < m_cleanGeneration.load(std::memory_order_relaxed);
+}
+
 void Farm::submitProof(Solution const& _s)
 {
-    g_io_service.post(m_io_strand.wrap(boost::bind(&Farm::submitProofAsync, this, _s)));
+    // No point in verifying what would be refused anyway
+    if (isStale(_s))
+    {
+        g_io_service.post(m_io_strand.wrap(boost::bind(
+            &Farm::accountSolution, this, _s.midx, SolutionAccountingEnum::Dropped)));
+        return;
+    }
+
+    if (m_Settings.noEval)
+    {
+        g_io_service.post(m_io_strand.wrap(boost::bind(&Farm::submitProofAsync, this, _s)));
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> l(m_verifyMutex);
+        m_verifyQueue.push_back(_s);
+    }
+    m_verifySignal.notify_one();
+}
+
+void Farm::evalAsync(
+    int _epoch, h256 const& _header, uint64_t _nonce, std::function<void(Result)> _done)
+{
+    {
+        std::lock_guard<std::mutex> l(m_verifyMutex);
+        m_evalQueue.push_back([_epoch, _header, _nonce, _done]() {
+            _done(EthashAux::eval(_epoch, _header, _nonce));
+        });
+    }
+    m_verifySignal.notify_one();
 }
 
 void Farm::submitProofAsync(Solution const& _s)
 {
-    if (!m_Settings.noEval)
+    // Job may have been superseded while verifying
+    if (isStale(_s))
     {
-        Result r = EthashAux::eval(_s.work.epoch, _s.work.header, _s.nonce);
-        if (r.value > _s.work.boundary)
-        {
-            accountSolution(_s.midx, SolutionAccountingEnum::Failed);
-            cwarn << "GPU " << _s.midx
-                  << " gave incorrect result. Lower overclocking values if it happens frequently.";
-            return;
-        }
-        m_onSolutionFound(Solution{_s.nonce, r.mixHash, _s.work, _s.tstamp, _s.midx});
+        accountSolution(_s.midx, SolutionAccountingEnum::Dropped);
+        return;
     }
-    else
-        m_onSolutionFound(_s);
+    if (_s.work->generation &&
+        _s.work->generation < m_jobGeneration.load(std::memory_order_relaxed))
+        accountSolution(_s.midx, SolutionAccountingEnum::Stale);
+
+    m_onSolutionFound(_s);
+
+    if (_s.midx < m_miners.size())
+        m_miners.at(_s.midx)->submitLatency().record(std::chrono::steady_clock::now() - _s.tstamp);
 
 #ifdef DEV_BUILD
     if (g_logOptions & LOG_SUBMIT)
@@ -515,14 +854,90 @@ void Farm::submitProofAsync(Solution const& _s)
 #endif
 }
 
+void Farm::verifyLoop()
+{
+    // Solutions found meanwhile are handled
+    // together to spare a post per solution
+    constexpr size_t maxBatch = 16;
+
+    while (true)
+    {
+        std::vector<Solution> pending;
+        std::function<void()> eval;
+        {
+            std::unique_lock<std::mutex> l(m_verifyMutex);
+            m_verifySignal.wait(l, [this]() {
+                return m_verifyStop || !m_verifyQueue.empty() || !m_evalQueue.empty();
+            });
+            if (m_verifyStop)
+                return;
+            if (!m_evalQueue.empty())
+            {
+                eval = std::move(m_evalQueue.front());
+                m_evalQueue.pop_front();
+            }
+            while (!m_verifyQueue.empty() && pending.size() < maxBatch)
+            {
+                pending.push_back(m_verifyQueue.front());
+                m_verifyQueue.pop_front();
+            }
+        }
+
+        if (eval)
+            eval();
+        if (pending.empty())
+            continue;
+
+        std::vector<std::pair<Solution, bool>> batch;
+        for (auto const& s : pending)
+        {
+            auto start = std::chrono::steady_clock::now();
+            Result r = EthashAux::eval(s.work->epoch, s.work->header, s.nonce);
+            m_verifyTime.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(
+                                       std::chrono::steady_clock::now() - start)
+                                       .count(),
+                std::memory_order_relaxed);
+            m_verifyCount.fetch_add(1, std::memory_order_relaxed);
+
+            batch.emplace_back(Solution{s.nonce, r.mixHash, s.work, s.tstamp, s.midx},
+                r.value <= s.work->boundary);
+        }
+
+        g_io_service.post(m_io_strand.wrap(boost::bind(&Farm::submitVerified, this, batch)));
+    }
+}
+
+void Farm::submitVerified(std::vector<std::pair<Solution, bool>> const& _batch)
+{
+    for (auto const& verified : _batch)
+    {
+        if (!verified.second)
+        {
+            accountSolution(verified.first.midx, SolutionAccountingEnum::Failed);
+            cwarn << "GPU " << verified.first.midx
+                  << " gave incorrect result. Lower overclocking values if it happens frequently.";
+            continue;
+        }
+        submitProofAsync(verified.first);
+    }
+}
+
 // Collects data about hashing and hardware status
 void Farm::collectData(const boost::system::error_code& ec)
 {
     if (ec)
         return;
 
-    // Reset hashrate (it will accumulate from miners)
+    // Reset hashrate and latencies (they will accumulate from miners)
     float farm_hr = 0.0f;
+    LatencyHistogram::Snapshot farm_switch, farm_submit, farm_accept;
+
+    // Samples for hashrate histories
+    const uint64_t now = uint64_t(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - m_telemetry.start)
+                                      .count());
+    HashrateSample farm_sample;
+    farm_sample.tstamp = now;
 
     // Process miners
     for (auto const& miner : m_miners)
@@ -533,104 +948,29 @@ void Farm::collectData(const boost::system::error_code& ec)
         m_telemetry.miners.at(minerIdx).hashrate = hr;
         m_telemetry.miners.at(minerIdx).paused = miner->paused();
 
+        TelemetryAccountType& account = m_telemetry.miners.at(minerIdx);
+        account.switchLatency = miner->switchLatency().snapshot();
+        account.submitLatency = miner->submitLatency().snapshot();
+        account.acceptLatency = miner->acceptLatency().snapshot();
+        farm_switch += account.switchLatency;
+        farm_submit += account.submitLatency;
+        farm_accept += account.acceptLatency;
 
         if (m_Settings.hwMon)
         {
-            HwMonitorInfo hwInfo = miner->hwmonInfo();
-
-            unsigned int tempC = 0, fanpcnt = 0, powerW = 0;
-
-            if (hwInfo.deviceType == HwMonitorInfoType::NVIDIA && nvmlh)
+            // Latest readings of the sampler (never blocks on drivers)
+            HwSensorsType sensors;
             {
-                int devIdx = hwInfo.deviceIndex;
-                if (devIdx == -1 && !hwInfo.devicePciId.empty())
-                {
-                    if (map_nvml_handle.find(hwInfo.devicePciId) != map_nvml_handle.end())
-                    {
-                        devIdx = map_nvml_handle[hwInfo.devicePciId];
-                        miner->setHwmonDeviceIndex(devIdx);
-                    }
-                    else
-                    {
-                        // This will prevent further tries to map
-                        miner->setHwmonDeviceIndex(-2);
-                    }
-                }
-
-                if (devIdx >= 0)
-                {
-                    wrap_nvml_get_tempC(nvmlh, devIdx, &tempC);
-                    wrap_nvml_get_fanpcnt(nvmlh, devIdx, &fanpcnt);
-
-                    if (m_Settings.hwMon == 2)
-                        wrap_nvml_get_power_usage(nvmlh, devIdx, &powerW);
-                }
-            }
-            else if (hwInfo.deviceType == HwMonitorInfoType::AMD)
-            {
-#if defined(__linux)
-                if (sysfsh)
-                {
-                    int devIdx = hwInfo.deviceIndex;
-                    if (devIdx == -1 && !hwInfo.devicePciId.empty())
-                    {
-                        if (map_amdsysfs_handle.find(hwInfo.devicePciId) !=
-                            map_amdsysfs_handle.end())
-                        {
-                            devIdx = map_amdsysfs_handle[hwInfo.devicePciId];
-                            miner->setHwmonDeviceIndex(devIdx);
-                        }
-                        else
-                        {
-                            // This will prevent further tries to map
-                            miner->setHwmonDeviceIndex(-2);
-                        }
-                    }
-
-                    if (devIdx >= 0)
-                    {
-                        wrap_amdsysfs_get_tempC(sysfsh, devIdx, &tempC);
-                        wrap_amdsysfs_get_fanpcnt(sysfsh, devIdx, &fanpcnt);
-
-                        if (m_Settings.hwMon == 2)
-                            wrap_amdsysfs_get_power_usage(sysfsh, devIdx, &powerW);
-                    }
-                }
-#else
-                if (adlh)  // Windows only for AMD
-                {
-                    int devIdx = hwInfo.deviceIndex;
-                    if (devIdx == -1 && !hwInfo.devicePciId.empty())
-                    {
-                        if (map_adl_handle.find(hwInfo.devicePciId) != map_adl_handle.end())
-                        {
-                            devIdx = map_adl_handle[hwInfo.devicePciId];
-                            miner->setHwmonDeviceIndex(devIdx);
-                        }
-                        else
-                        {
-                            // This will prevent further tries to map
-                            miner->setHwmonDeviceIndex(-2);
-                        }
-                    }
-
-                    if (devIdx >= 0)
-                    {
-                        wrap_adl_get_tempC(adlh, devIdx, &tempC);
-                        wrap_adl_get_fanpcnt(adlh, devIdx, &fanpcnt);
-
-                        if (m_Settings.hwMon == 2)
-                            wrap_adl_get_power_usage(adlh, devIdx, &powerW);
-                    }
-                }
-#endif
+                std::lock_guard<std::mutex> l(m_sensorsMutex);
+                if (size_t(minerIdx) < m_sensors.size())
+                    sensors = m_sensors.at(minerIdx);
             }
 
-
             // If temperature control has been enabled call
             // check threshold
             if (m_Settings.tempStop)
             {
+                unsigned int tempC = unsigned(std::max(sensors.tempC, 0));
                 bool paused = miner->pauseTest(MinerPauseEnum::PauseDueToOverHeating);
                 if (!paused && (tempC >= m_Settings.tempStop))
                     miner->pause(MinerPauseEnum::PauseDueToOverHeating);
@@ -638,20 +978,203 @@ void Farm::collectData(const boost::system::error_code& ec)
                     miner->resume(MinerPauseEnum::PauseDueToOverHeating);
             }
 
-            m_telemetry.miners.at(minerIdx).sensors.tempC = tempC;
-            m_telemetry.miners.at(minerIdx).sensors.fanP = fanpcnt;
-            m_telemetry.miners.at(minerIdx).sensors.powerW = powerW / ((double)1000.0);
+            m_telemetry.miners.at(minerIdx).sensors = sensors;
+
+            if (m_Settings.powerCap || m_Settings.tempTarget)
+                govern(*miner, m_telemetry.miners.at(minerIdx));
         }
         m_telemetry.farm.hashrate = farm_hr;
+        m_telemetry.farm.switchLatency = farm_switch;
+        m_telemetry.farm.submitLatency = farm_submit;
+        m_telemetry.farm.acceptLatency = farm_accept;
         miner->TriggerHashRateUpdate();
+
+        const TelemetryAccountType& minerTelemetry = m_telemetry.miners.at(minerIdx);
+        HashrateSample sample;
+        sample.tstamp = now;
+        sample.hashrate = minerTelemetry.hashrate;
+        sample.accepted = minerTelemetry.solutions.accepted;
+        sample.rejected = minerTelemetry.solutions.rejected;
+        sample.failed = minerTelemetry.solutions.failed;
+        sample.tempC = minerTelemetry.sensors.tempC;
+        sample.powerW = minerTelemetry.sensors.powerW;
+        if (const HashrateSample* last = miner->hashrateHistory()->latest())
+            sample.hashes = uint64_t(double(sample.hashrate) * (now - last->tstamp) / 1000.0);
+        miner->recordSample(sample);
+
+        farm_sample.hashes += sample.hashes;
+        farm_sample.accepted += sample.accepted;
+        farm_sample.rejected += sample.rejected;
+        farm_sample.failed += sample.failed;
+        farm_sample.tempC = std::max(farm_sample.tempC, sample.tempC);
+        farm_sample.powerW += sample.powerW;
     }
 
+    farm_sample.hashrate = farm_hr;
+    std::atomic_store_explicit(
+        &m_history, hashrateHistory()->append(farm_sample), std::memory_order_release);
+
+    if (m_onTelemetryCollected)
+        m_onTelemetryCollected();
+
     // Resubmit timer for another loop
     m_collectTimer.expires_from_now(boost::posix_time::milliseconds(m_collectInterval));
     m_collectTimer.async_wait(
         m_io_strand.wrap(boost::bind(&Farm::collectData, this, boost::asio::placeholders::error)));
 }
 
+void Farm::govern(Miner& _miner, TelemetryAccountType& _account)
+{
+    // Duty cycle scales both hashrate and dynamic power draw.
+    // Each proposal moves duty half way to where the limit would be met
+    const HwSensorsType& sensors = _account.sensors;
+    double duty = _miner.dutyCycle();
+    double proposal = 100.0;
+    string limit;
+
+    if (m_Settings.powerCap && sensors.powerW > 0.0)
+    {
+        double p = duty * (1.0 + 0.5 * (m_Settings.powerCap / sensors.powerW - 1.0));
+        if (p < proposal)
+        {
+            proposal = p;
+            limit = "power";
+        }
+    }
+    if (m_Settings.tempTarget && sensors.tempC > 0)
+    {
+        // About 2 percent per degree off target
+        double p = duty + 2.0 * (int(m_Settings.tempTarget) - sensors.tempC);
+        if (p < proposal)
+        {
+            proposal = p;
+            limit = "temp";
+        }
+    }
+
+    unsigned newDuty = unsigned(std::min(std::max(proposal, 10.0), 100.0) + 0.5);
+    if (newDuty != _miner.dutyCycle())
+    {
+        _miner.setDutyCycle(newDuty);
+        if (g_logOptions & LOG_PER_GPU)
+            cnote << _account.prefix << _miner.Index() << " duty cycle " << newDuty << "%"
+                  << (limit.empty() ? "" : " (" + limit + ")");
+    }
+    _account.duty = newDuty;
+    _account.dutyLimit = (newDuty < 100 ? limit : "");
+}
+
+void Farm::hwmonLoop()
+{
+    std::unique_lock<std::mutex> lock(m_sensorsMutex);
+    while (!m_sensorsStop)
+    {
+        lock.unlock();
+
+        // Only miners' identities are taken under lock : drivers
+        // may take their time without holding anyone
+        std::vector<std::pair<unsigned, HwMonitorInfo>> devices;
+        {
+            Guard l(x_minerWork);
+            for (auto const& miner : m_miners)
+                devices.emplace_back(miner->Index(), miner->hwmonInfo());
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::pair<unsigned, HwSensorsType>> readings;
+        for (auto const& device : devices)
+            readings.emplace_back(device.first, readSensors(device.second));
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start)
+                           .count();
+        if (uint64_t(elapsed) > m_Settings.hwMonInterval)
+            cwarn << "Hardware monitor took " << elapsed << " ms to read sensors";
+
+        lock.lock();
+        for (auto const& reading : readings)
+        {
+            if (reading.first >= m_sensors.size())
+                m_sensors.resize(reading.first + 1);
+            m_sensors[reading.first] = reading.second;
+        }
+        m_sensorsSignal.wait_for(lock, std::chrono::milliseconds(m_Settings.hwMonInterval),
+            [this]() { return m_sensorsStop; });
+    }
+}
+
+HwSensorsType Farm::readSensors(const HwMonitorInfo& _hwInfo)
+{
+    unsigned int tempC = 0, fanpcnt = 0, powerW = 0;
+    HwSensorsType sensors;
+
+    if (_hwInfo.deviceType == HwMonitorInfoType::NVIDIA && nvmlh)
+    {
+        int devIdx = _hwInfo.deviceIndex;
+        if (devIdx == -1 && !_hwInfo.devicePciId.empty())
+        {
+            auto it = map_nvml_handle.find(_hwInfo.devicePciId);
+            devIdx = (it != map_nvml_handle.end() ? it->second : -2);
+        }
+
+        if (devIdx >= 0)
+        {
+            wrap_nvmlSensors_t nvSensors = {};
+            wrap_nvml_get_sensors(nvmlh, devIdx, m_Settings.hwMon == 2, &nvSensors);
+            tempC = nvSensors.tempC;
+            fanpcnt = nvSensors.fanpcnt;
+            powerW = nvSensors.milliwatts;
+            sensors.memTempC = int(nvSensors.memTempC);
+            sensors.coreClock = nvSensors.coreClock;
+            sensors.memClock = nvSensors.memClock;
+            sensors.throttleReasons = nvSensors.throttleReasons;
+        }
+    }
+    else if (_hwInfo.deviceType == HwMonitorInfoType::AMD)
+    {
+#if defined(__linux)
+        if (sysfsh)
+        {
+            int devIdx = _hwInfo.deviceIndex;
+            if (devIdx == -1 && !_hwInfo.devicePciId.empty())
+            {
+                auto it = map_amdsysfs_handle.find(_hwInfo.devicePciId);
+                devIdx = (it != map_amdsysfs_handle.end() ? it->second : -2);
+            }
+
+            if (devIdx >= 0)
+            {
+                wrap_amdsysfs_get_sensors(sysfsh, devIdx, &tempC, &fanpcnt,
+                    (m_Settings.hwMon == 2 ? &powerW : nullptr));
+            }
+        }
+#else
+        if (adlh)  // Windows only for AMD
+        {
+            int devIdx = _hwInfo.deviceIndex;
+            if (devIdx == -1 && !_hwInfo.devicePciId.empty())
+            {
+                auto it = map_adl_handle.find(_hwInfo.devicePciId);
+                devIdx = (it != map_adl_handle.end() ? it->second : -2);
+            }
+
+            if (devIdx >= 0)
+            {
+                wrap_adl_get_tempC(adlh, devIdx, &tempC);
+                wrap_adl_get_fanpcnt(adlh, devIdx, &fanpcnt);
+
+                if (m_Settings.hwMon == 2)
+                    wrap_adl_get_power_usage(adlh, devIdx, &powerW);
+            }
+        }
+#endif
+    }
+
+    sensors.tempC = int(tempC);
+    sensors.fanP = int(fanpcnt);
+    sensors.powerW = powerW / ((double)1000.0);
+    return sensors;
+}
+
 bool Farm::spawn_file_in_bin_dir(const char* filename, const std::vector<std::string>& args)
 {
     std::string fn = boost::dll::program_location().parent_path().string() +
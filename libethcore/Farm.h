@@ -18,7 +18,12 @@
 #pragma once
 
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <list>
+#include <mutex>
+#include <set>
 #include <thread>
 
 #include <boost/asio.hpp>
@@ -32,6 +37,8 @@
 #include <libdevcore/Common.h>
 #include <libdevcore/Worker.h>
 
+#include <libethcore/DagCache.h>
+#include <libethcore/EpochManager.h>
 #include <libethcore/Miner.h>
 
 #include <libhwmon/wrapnvml.h>
@@ -50,12 +57,22 @@ namespace eth
 {
 struct FarmSettings
 {
-    unsigned dagLoadMode = 0;  // 0 = Parallel; 1 = Serialized
+    unsigned dagLoadMode = 0;  // 0 = Parallel; 1 = Serialized; 2 = Single build
     bool noEval = false;       // Whether or not to re-evaluate solutions
     unsigned hwMon = 0;        // 0 - No monitor; 1 - Temp and Fan; 2 - Temp Fan Power
+    unsigned hwMonInterval = 2000;  // Milliseconds between sensors readings
     unsigned ergodicity = 0;   // 0=default, 1=per session, 2=per job
     unsigned tempStart = 40;   // Temperature threshold to restart mining (if paused)
     unsigned tempStop = 0;     // Temperature threshold to pause mining (overheating)
+    unsigned verifyThreads = 2;  // Threads verifying solutions before submission
+    bool nonceWeighting = false;  // Size nonce segments after miners' hashrates
+    bool epochOverlap = false;    // Keep hashing previous epoch while building new DAGs
+    unsigned powerCap = 0;       // Watts per device the governor keeps below (0 = off)
+    unsigned tempTarget = 0;     // Temperature the governor keeps devices below (0 = off)
+    ThreadPolicy gpuThreads;     // Scheduling of CUDA and OpenCL host threads
+    bool gpuNumaLocal = false;   // Run GPU host threads on the NUMA node of their device
+    unsigned epochCacheMem = 0;  // MB of host memory epoch contexts may take (0 = unbounded)
+    unsigned staleDrop = 0;      // 0 = never drop, 1 = jobs cleared by pool, 2 = superseded jobs
 };
 
 /**
@@ -145,6 +162,14 @@ public:
      */
     float HashRate() { return m_telemetry.farm.hashrate; };
 
+    /**
+     * @brief Gets recent hashrate samples of the whole farm. Never blocks.
+     */
+    HashrateHistoryPtr hashrateHistory() const
+    {
+        return std::atomic_load_explicit(&m_history, std::memory_order_acquire);
+    }
+
     /**
      * @brief Gets the collection of pointers to miner instances
      */
@@ -176,6 +201,14 @@ public:
      */
     void accountSolution(unsigned _minerIdx, SolutionAccountingEnum _accounting) override;
 
+    void epochPrepared(unsigned _minerIdx, int _epoch) override;
+    void minerResumed(unsigned _minerIdx) override;
+
+    /**
+     * @brief Accounts the time a pool took to accept a solution of a miner
+     */
+    void accountAcceptLatency(unsigned _minerIdx, std::chrono::microseconds _latency);
+
     /**
      * @brief Gets the solutions account for the whole farm
      */
@@ -188,6 +221,7 @@ public:
 
     using SolutionFound = std::function<void(const Solution&)>;
     using MinerRestart = std::function<void()>;
+    using TelemetryCollected = std::function<void()>;
 
     /**
      * @brief Provides a valid header based upon that received previously with setWork().
@@ -199,6 +233,14 @@ public:
 
     void onMinerRestart(MinerRestart const& _handler) { m_onMinerRestart = _handler; }
 
+    /**
+     * @brief Called on the farm strand each time telemetry has been collected
+     */
+    void onTelemetryCollected(TelemetryCollected const& _handler)
+    {
+        m_io_strand.dispatch([this, _handler]() { m_onTelemetryCollected = _handler; });
+    }
+
     /**
      * @brief Gets the actual start nonce of the segment picked by the farm
      */
@@ -229,6 +271,12 @@ public:
      */
     Json::Value get_nonce_scrambler_json();
 
+    /**
+     * @brief Gets start and size of the nonce segment assigned to a miner
+     * on last job. Returns false if it has not been assigned one yet.
+     */
+    bool get_nonce_segment(unsigned _index, uint64_t& _start, uint64_t& _size);
+
     void setTStartTStop(unsigned tstart, unsigned tstop);
 
     unsigned get_tstart() override { return m_Settings.tempStart; }
@@ -243,6 +291,26 @@ public:
      */
     void submitProof(Solution const& _s) override;
 
+    /**
+     * @brief Evaluates _nonce of _header on the solution verifiers, off the
+     * caller's thread. _done is called with the result on a verifier thread
+     */
+    void evalAsync(
+        int _epoch, h256 const& _header, uint64_t _nonce, std::function<void(Result)> _done);
+
+    /**
+     * @brief Gets the number of solutions verified and the
+     * total time (microseconds) spent verifying them
+     */
+    uint64_t getVerifyCount() const { return m_verifyCount.load(std::memory_order_relaxed); }
+    uint64_t getVerifyTime() const { return m_verifyTime.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Whether the job of a solution is stale enough (see --stale-drop)
+     * for the solution not to be worth submitting
+     */
+    bool isStale(Solution const& _s) const;
+
 private:
     std::atomic<bool> m_paused = {false};
 
@@ -250,9 +318,27 @@ private:
     // in Farm's strand
     void submitProofAsync(Solution const& _s);
 
+    // Verifies queued solutions off the io_service
+    void verifyLoop();
+
+    // Whether the host has to build the light cache of an epoch : solutions
+    // are verified against it and not every miner builds its own
+    bool hostLightNeeded() const;
+
+    // Hands a batch of verified solutions over in Farm's strand
+    void submitVerified(std::vector<std::pair<Solution, bool>> const& _batch);
+
     // Collects data about hashing and hardware status
     void collectData(const boost::system::error_code& ec);
 
+    // Efficiency governor : adjusts miner's duty cycle after its
+    // readings. Runs on each collection
+    void govern(Miner& _miner, TelemetryAccountType& _account);
+
+    // Reads hardware sensors of all miners on its own cadence
+    void hwmonLoop();
+    HwSensorsType readSensors(const HwMonitorInfo& _hwInfo);
+
     /**
      * @brief Spawn a file - must be located in the directory of ethminer binary
      * @return false if file was not found or it is not executeable
@@ -263,14 +349,26 @@ private:
     std::vector<std::shared_ptr<Miner>> m_miners;  // Collection of miners
 
     WorkPackage m_currentWp;
+    // Latest job of m_currentEc's epoch, the one non preparing miners are on.
+    // Differs from m_currentWp while previous epoch's jobs go to preparing ones
+    WorkPackage m_epochWp;
     EpochContext m_currentEc;
 
+    // Holders of m_currentEc.lightCache : either mapped from disk
+    // (see DagCache) or in a context built by EpochManager
+    std::shared_ptr<DagCacheFile> m_lightCacheFile;
+    std::shared_ptr<DagCacheFile> m_prevLightCacheFile;
+    EpochManager::ContextPtr m_currentContext;
+    EpochManager::ContextPtr m_prevContext;
+
     std::atomic<bool> m_isMining = {false};
 
     TelemetryType m_telemetry;  // Holds progress and status info for farm and miners
+    HashrateHistoryPtr m_history = std::make_shared<const HashrateHistory>();
 
     SolutionFound m_onSolutionFound;
     MinerRestart m_onMinerRestart;
+    TelemetryCollected m_onTelemetryCollected;
 
     FarmSettings m_Settings;  // Own Farm Settings
     CUSettings m_CUSettings;  // Cuda settings passed to CUDA Miner instantiator
@@ -279,8 +377,30 @@ private:
 
     boost::asio::io_service::strand m_io_strand;
     boost::asio::deadline_timer m_collectTimer;
+
+    // Solution verification pool
+    std::vector<std::thread> m_verifiers;
+    std::deque<Solution> m_verifyQueue;
+    std::deque<std::function<void()>> m_evalQueue;  // See evalAsync()
+    std::mutex m_verifyMutex;
+    std::condition_variable m_verifySignal;
+    bool m_verifyStop = false;
+    std::atomic<uint64_t> m_verifyCount = {0};
+    std::atomic<uint64_t> m_verifyTime = {0};  // Microseconds
+
+    // Generation of the latest job and of the latest one
+    // the pool declared every previous job invalid with
+    std::atomic<uint64_t> m_jobGeneration = {0};
+    std::atomic<uint64_t> m_cleanGeneration = {0};
     static const int m_collectInterval = 5000;
 
+    // Hardware monitor sampler and its last readings by miner index
+    std::thread m_sampler;
+    std::vector<HwSensorsType> m_sensors;
+    std::mutex m_sensorsMutex;
+    std::condition_variable m_sensorsSignal;
+    bool m_sensorsStop = false;
+
     string m_pool_addresses;
 
     // StartNonce (non-NiceHash Mode) and
@@ -291,6 +411,16 @@ private:
     uint64_t m_nonce_scrambler;
     unsigned int m_nonce_segment_with = 32;
 
+    // Nonce segments (start, size) given to each miner on last job.
+    // Sized after miners' hashrates unless disabled. Requires x_minerWork
+    std::vector<std::pair<uint64_t, uint64_t>> m_nonceSegments;
+
+    // Miners building current epoch's DAG in background while still
+    // searching previous epoch's work. Requires x_minerWork
+    std::set<unsigned> m_preparing;
+
+    void partitionNonces(uint64_t _base, uint64_t _total);  // Requires x_minerWork
+
     // Wrappers for hardware monitoring libraries and their mappers
     wrap_nvml_handle* nvmlh = nullptr;
     std::map<string, int> map_nvml_handle = {};
@@ -0,0 +1,101 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "HashrateHistory.h"
+
+namespace dev
+{
+namespace eth
+{
+namespace
+{
+// Time constants (seconds) of the moving averages
+constexpr double c_emaPeriods[3] = {60.0, 900.0, 3600.0};
+}  // namespace
+
+std::shared_ptr<const HashrateHistory> HashrateHistory::append(
+    const HashrateSample& _sample) const
+{
+    auto history = std::make_shared<HashrateHistory>(*this);
+
+    if (m_samples.empty())
+    {
+        for (auto& ema : history->m_ema)
+            ema = _sample.hashrate;
+    }
+    else
+    {
+        // Irregular intervals (i.e. a delayed collection) weigh
+        // as much as the time they cover
+        const HashrateSample& last = *latest();
+        double dt = _sample.tstamp > last.tstamp ? (_sample.tstamp - last.tstamp) / 1000.0 : 0.0;
+        for (unsigned i = 0; i < 3; i++)
+        {
+            double alpha = 1.0 - std::exp(-dt / c_emaPeriods[i]);
+            history->m_ema[i] += float(alpha * (_sample.hashrate - m_ema[i]));
+        }
+    }
+
+    if (history->m_samples.size() < Capacity)
+    {
+        history->m_samples.push_back(_sample);
+        history->m_next = history->m_samples.size() % Capacity;
+    }
+    else
+    {
+        history->m_samples[m_next] = _sample;
+        history->m_next = (m_next + 1) % Capacity;
+    }
+    return history;
+}
+
+std::vector<HashrateSample> HashrateHistory::samples() const
+{
+    std::vector<HashrateSample> samples;
+    samples.reserve(m_samples.size());
+    size_t first = m_samples.size() < Capacity ? 0 : m_next;
+    for (size_t i = 0; i < m_samples.size(); i++)
+        samples.push_back(m_samples[(first + i) % m_samples.size()]);
+    return samples;
+}
+
+float HashrateHistory::percentile(double _p, unsigned _seconds) const
+{
+    if (m_samples.empty())
+        return 0.0f;
+
+    uint64_t newest = 0;
+    for (const auto& sample : m_samples)
+        newest = std::max(newest, sample.tstamp);
+    uint64_t window = uint64_t(_seconds) * 1000;
+
+    std::vector<float> rates;
+    rates.reserve(m_samples.size());
+    for (const auto& sample : m_samples)
+        if (!_seconds || sample.tstamp + window >= newest)
+            rates.push_back(sample.hashrate);
+
+    size_t rank = size_t(std::min(1.0, std::max(0.0, _p)) * (rates.size() - 1) + 0.5);
+    std::nth_element(rates.begin(), rates.begin() + rank, rates.end());
+    return rates[rank];
+}
+
+}  // namespace eth
+}  // namespace dev
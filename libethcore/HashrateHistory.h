@@ -0,0 +1,84 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace dev
+{
+namespace eth
+{
+/// One telemetry collection of a miner
+struct HashrateSample
+{
+    uint64_t tstamp = 0;  // Milliseconds since the farm started
+    float hashrate = 0.0f;
+    uint64_t hashes = 0;  // Hashes computed since previous sample (estimated from hashrate)
+    unsigned accepted = 0;
+    unsigned rejected = 0;
+    unsigned failed = 0;
+    int tempC = 0;
+    double powerW = 0.0;
+};
+
+/**
+ * @brief Fixed size history of a miner's samples (one hour at the 5 seconds
+ * collection interval) with exponential moving averages of its hashrate.
+ *
+ * Instances are immutable : append() returns a new history so readers
+ * holding one never need to synchronize with the collecting thread.
+ */
+class HashrateHistory
+{
+public:
+    static constexpr size_t Capacity = 720;
+
+    std::shared_ptr<const HashrateHistory> append(const HashrateSample& _sample) const;
+
+    /// Samples from the oldest to the most recent
+    std::vector<HashrateSample> samples() const;
+
+    size_t size() const { return m_samples.size(); }
+
+    /// Most recent sample (nullptr if none yet)
+    const HashrateSample* latest() const
+    {
+        return m_samples.empty() ? nullptr :
+                                   &m_samples[(m_next + m_samples.size() - 1) % m_samples.size()];
+    }
+
+    /// Moving averages over 1 minute, 15 minutes and 1 hour
+    float ema1m() const { return m_ema[0]; }
+    float ema15m() const { return m_ema[1]; }
+    float ema1h() const { return m_ema[2]; }
+
+    /// _p (0..1) quantile of hashrates of the last _seconds (whole history if 0)
+    float percentile(double _p, unsigned _seconds = 0) const;
+
+private:
+    std::vector<HashrateSample> m_samples;  // Ring once full
+    size_t m_next = 0;                      // Where next sample goes once full
+    float m_ema[3] = {0.0f, 0.0f, 0.0f};
+};
+
+typedef std::shared_ptr<const HashrateHistory> HashrateHistoryPtr;
+
+}  // namespace eth
+}  // namespace dev
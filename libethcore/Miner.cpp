@@ -15,6 +15,8 @@
  along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <thread>
+
 #include "Miner.h"
 
 namespace dev
@@ -25,6 +27,11 @@ namespace eth
 unsigned Miner::s_dagLoadMode = 0;
 unsigned Miner::s_dagLoadIndex = 0;
 unsigned Miner::s_minersCount = 0;
+boost::mutex Miner::s_dagBuildMutex;
+boost::condition_variable Miner::s_dagBuildSignal;
+int Miner::s_dagBuildEpoch = -1;
+bool Miner::s_dagBuildPending = false;
+bool Miner::s_dagBuildOk = false;
 
 FarmFace* FarmFace::m_this = nullptr;
 
@@ -33,55 +40,49 @@ DeviceDescriptor Miner::getDescriptor()
     return m_deviceDescriptor;
 }
 
+namespace
+{
+const std::shared_ptr<const WorkPackage> c_noWork = std::make_shared<const WorkPackage>();
+}
+
 void Miner::setWork(WorkPackage const& _work)
 {
-    {
+    setWork(std::make_shared<const WorkPackage>(_work));
+}
 
+void Miner::setWork(std::shared_ptr<const WorkPackage> _work)
+{
+    {
         boost::mutex::scoped_lock l(x_work);
 
         // Void work if this miner is paused
-        if (paused())
-            m_work.header = h256();
-        else
-            m_work = _work;
-
-#ifdef DEV_BUILD
-        m_workSwitchStart = std::chrono::steady_clock::now();
-#endif
+        m_workSwitchStart.store(std::chrono::steady_clock::now().time_since_epoch().count(),
+            std::memory_order_relaxed);
+        publishWork(paused() ? c_noWork : std::move(_work));
     }
 
     kick_miner();
 }
 
-void Miner::pause(MinerPauseEnum what) 
+void Miner::pause(MinerPauseEnum what)
 {
-    boost::mutex::scoped_lock l(x_pause);
-    m_pauseFlags.set(what);
-    m_work.header = h256();
+    m_pauseFlags.fetch_or(1u << what, std::memory_order_release);
+    {
+        boost::mutex::scoped_lock l(x_work);
+        publishWork(c_noWork);
+    }
     kick_miner();
 }
 
-bool Miner::paused()
-{
-    boost::mutex::scoped_lock l(x_pause);
-    return m_pauseFlags.any();
-}
-
-bool Miner::pauseTest(MinerPauseEnum what)
-{
-    boost::mutex::scoped_lock l(x_pause);
-    return m_pauseFlags.test(what);
-}
-
 std::string Miner::pausedString()
 {
-    boost::mutex::scoped_lock l(x_pause);
+    uint32_t flags = m_pauseFlags.load(std::memory_order_acquire);
     std::string retVar;
-    if (m_pauseFlags.any())
+    if (flags)
     {
         for (int i = 0; i < MinerPauseEnum::Pause_MAX; i++)
         {
-            if (m_pauseFlags[(MinerPauseEnum)i])
+            if (flags & (1u << i))
             {
                 if (!retVar.empty())
                     retVar.append("; ");
@@ -103,16 +104,15 @@ std::string Miner::pausedString()
     return retVar;
 }
 
-void Miner::resume(MinerPauseEnum fromwhat) 
+void Miner::resume(MinerPauseEnum fromwhat)
 {
-    boost::mutex::scoped_lock l(x_pause);
-    m_pauseFlags.reset(fromwhat);
-    //if (!m_pauseFlags.any())
-    //{
-    //    // TODO Push most recent job from farm ?
-    //    // If we do not push a new job the miner will stay idle
-    //    // till a new job arrives
-    //}
+    uint32_t flag = 1u << fromwhat;
+    uint32_t flags = m_pauseFlags.fetch_and(~flag, std::memory_order_acq_rel);
+
+    // Don't stay idle till a new job arrives. Unless the whole farm
+    // resumes : that's on a new connection which is sending work
+    if (flags == flag && fromwhat != MinerPauseEnum::PauseDueToFarmPaused)
+        FarmFace::f().minerResumed(m_index);
 }
 
 float Miner::RetrieveHashRate() noexcept
@@ -131,31 +131,111 @@ void Miner::TriggerHashRateUpdate() noexcept
     m_hashRate = 0.0;
 }
 
-bool Miner::initEpoch()
+bool Miner::acquireDagTurn()
 {
+    if (m_dagTurnHeld)
+        return !shouldStop();
+    m_dagTurnAsked = std::chrono::steady_clock::now();
+
     // When loading of DAG is sequential wait for
     // this instance to become current
     if (s_dagLoadMode == DAG_LOAD_MODE_SEQUENTIAL)
     {
-        while (s_dagLoadIndex < m_index)
+        while (s_dagLoadIndex < m_index && !shouldStop())
         {
             boost::system_time const timeout =
                 boost::get_system_time() + boost::posix_time::seconds(3);
             boost::mutex::scoped_lock l(x_work);
             m_dag_loaded_signal.timed_wait(l, timeout);
         }
-        if (shouldStop())
-            return false;
+    }
+    m_dagTurnHeld = true;
+    m_dagTurnGiven = std::chrono::steady_clock::now();
+    return !shouldStop();
+}
+
+bool Miner::initEpoch()
+{
+    auto initStart = std::chrono::steady_clock::now();
+    m_dagTurnHeld = false;
+
+    // When dag is built once and copied to peers the first
+    // miner getting here for an epoch builds it while the
+    // others wait for it to complete
+    bool builder = false;
+    m_dagFromPeer = false;
+    if (s_dagLoadMode == DAG_LOAD_MODE_SINGLE && canCopyDag())
+    {
+        boost::mutex::scoped_lock l(s_dagBuildMutex);
+        if (s_dagBuildEpoch != m_epochContext.epochNumber)
+        {
+            s_dagBuildEpoch = m_epochContext.epochNumber;
+            s_dagBuildPending = true;
+            s_dagBuildOk = false;
+            builder = true;
+        }
+        else
+        {
+            while (s_dagBuildPending && s_dagBuildEpoch == m_epochContext.epochNumber &&
+                   !shouldStop())
+            {
+                boost::system_time const timeout =
+                    boost::get_system_time() + boost::posix_time::seconds(3);
+                s_dagBuildSignal.timed_wait(l, timeout);
+            }
+            if (shouldStop())
+                return false;
+            m_dagFromPeer = (s_dagBuildEpoch == m_epochContext.epochNumber && s_dagBuildOk);
+        }
     }
 
     // Run the internal initialization
     // specific for miner
     bool result = initEpoch_internal();
+    m_readyEpoch.store(result ? m_epochContext.epochNumber : -1, std::memory_order_relaxed);
+
+    // Whatever made it skip generation the turn still has
+    // to be taken so next miners get theirs
+    bool generated = m_dagTurnHeld;
+    acquireDagTurn();
+
+    if (!m_startupReported)
+    {
+        using namespace std::chrono;
+        m_startupReported = true;
+        auto now = steady_clock::now();
+        auto ms = [](steady_clock::duration _d) {
+            return std::to_string(duration_cast<milliseconds>(_d).count()) + " ms";
+        };
+        std::stringstream ss;
+        ss << "Miner " << m_index << " startup : " << ms(now - m_created) << " (device and first job "
+           << ms(initStart - m_created);
+        if (generated)
+            ss << ", setup " << ms(m_dagTurnAsked - initStart) << ", waiting DAG turn "
+               << ms(m_dagTurnGiven - m_dagTurnAsked) << ", DAG " << ms(now - m_dagTurnGiven);
+        else
+            ss << ", epoch " << ms(now - initStart);
+        ss << ")";
+        cnote << ss.str();
+    }
+
+    if (builder)
+    {
+        boost::mutex::scoped_lock l(s_dagBuildMutex);
+        if (s_dagBuildEpoch == m_epochContext.epochNumber)
+        {
+            s_dagBuildPending = false;
+            s_dagBuildOk = result;
+        }
+        s_dagBuildSignal.notify_all();
+    }
 
     // Advance to next miner or reset to zero for 
     // next run if all have processed
     if (s_dagLoadMode == DAG_LOAD_MODE_SEQUENTIAL)
     {
+        if (shouldStop())
+            return false;
         s_dagLoadIndex = (m_index + 1);
         if (s_minersCount == s_dagLoadIndex)
             s_dagLoadIndex = 0;
@@ -166,10 +246,80 @@ bool Miner::initEpoch()
     return result;
 }
 
-WorkPackage Miner::work() const
+void Miner::publishWork(std::shared_ptr<const WorkPackage> _work)
 {
-    boost::mutex::scoped_lock l(x_work);
-    return m_work;
+    m_workSeq.fetch_add(1, std::memory_order_acq_rel);
+    std::atomic_store_explicit(&m_work, std::move(_work), std::memory_order_release);
+    m_workSeq.fetch_add(1, std::memory_order_release);
+}
+
+uint64_t Miner::recordWorkSwitch(uint64_t _generation, bool _account) noexcept
+{
+    using namespace std::chrono;
+    steady_clock::duration elapsed = steady_clock::now().time_since_epoch() -
+                                     steady_clock::duration(m_workSwitchStart.load(
+                                         std::memory_order_relaxed));
+    uint64_t us = uint64_t(std::max<int64_t>(0, duration_cast<microseconds>(elapsed).count()));
+    if (_generation != m_switchGeneration)
+    {
+        m_switchGeneration = _generation;
+        if (_account)
+            m_switchLatency.record(us);
+    }
+    return us;
+}
+
+std::shared_ptr<const WorkPackage> Miner::workPtr(uint64_t* _generation) const
+{
+    for (;;)
+    {
+        uint64_t seq = m_workSeq.load(std::memory_order_acquire);
+        if (seq & 1)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        auto work = std::atomic_load_explicit(&m_work, std::memory_order_acquire);
+        if (m_workSeq.load(std::memory_order_acquire) == seq)
+        {
+            if (_generation)
+                *_generation = seq / 2;
+            return work;
+        }
+    }
+}
+
+void Miner::throttle()
+{
+    using namespace std::chrono;
+    unsigned duty = m_dutyCycle.load(std::memory_order_relaxed);
+    if (duty >= 100)
+    {
+        m_throttleTime = steady_clock::time_point();
+        return;
+    }
+
+    auto now = steady_clock::now();
+    if (m_throttleTime == steady_clock::time_point())
+    {
+        m_throttleTime = now;
+        return;
+    }
+
+    // Idle in proportion of the time spent searching since last idle.
+    // Short batches accumulate till there's a worthy amount to wait for.
+    auto idle = duration_cast<microseconds>(now - m_throttleTime) * (100 - duty) / duty;
+    if (idle < milliseconds(1))
+        return;
+    idle = std::min<microseconds>(idle, seconds(1));
+
+    uint64_t generation = workGeneration();
+    {
+        boost::mutex::scoped_lock l(x_work);
+        m_new_work_signal.timed_wait(l, boost::posix_time::microseconds(idle.count()),
+            [&]() { return workGeneration() != generation || shouldStop(); });
+    }
+    m_throttleTime = steady_clock::now();
 }
 
 void Miner::updateHashRate(uint32_t _groupSize, uint32_t _increment) noexcept
@@ -17,13 +17,18 @@
 
 #pragma once
 
-#include <bitset>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <list>
+#include <memory>
 #include <numeric>
 #include <string>
 
 #include "EthashAux.h"
+#include "HashrateHistory.h"
 #include <libdevcore/Common.h>
+#include <libdevcore/Histogram.h>
 #include <libdevcore/Log.h>
 #include <libdevcore/Worker.h>
 
@@ -32,6 +37,7 @@
 
 #define DAG_LOAD_MODE_PARALLEL 0
 #define DAG_LOAD_MODE_SEQUENTIAL 1
+#define DAG_LOAD_MODE_SINGLE 2
 
 using namespace std;
 
@@ -86,7 +92,9 @@ enum class SolutionAccountingEnum
     Accepted,
     Rejected,
     Wasted,
-    Failed
+    Failed,
+    Dropped,  // Not submitted : job was already stale (see --stale-drop)
+    Stale     // Submitted for a job superseded meanwhile (counted besides the outcome)
 };
 
 struct MinerSettings
@@ -101,6 +109,15 @@ struct CUSettings : public MinerSettings
     unsigned schedule = 4;
     unsigned gridSize = 8192;
     unsigned blockSize = 128;
+    bool dagPrefetch = false;
+    bool eventLoop = false;
+    bool noExit = false;
+    bool jit = false;
+    bool graphs = false;
+    bool autoTune = false;
+    bool lightGen = false;  // Build the light cache on device from the epoch seed
+    unsigned parallelHash = 4;
+    unsigned dagAccess = 0;  // 0 plain loads, 1 read-only cache (ldg), 2 L2 persisting window
 };
 
 // Holds settings for OpenCL Miner
@@ -111,11 +128,24 @@ struct CLSettings : public MinerSettings
     unsigned globalWorkSize = 0;
     unsigned globalWorkSizeMultiplier = 65536;
     unsigned localWorkSize = 128;
+    bool globalWorkSet = false;  // Given on command line : tuning leaves it alone
+    bool localWorkSet = false;   // Given on command line : tuning leaves it alone
+    unsigned streams = 2;
+    bool autoTune = false;
+    bool noCache = false;
+    bool lightGen = false;  // Build the light cache on device from the epoch seed
+    std::string cacheDir;  // Defaults to <home>/.ethminer/cl-cache
 };
 
 // Holds settings for CPU Miner
 struct CPSettings : public MinerSettings
 {
+    std::string engine = "scalar";      // scalar (ethash::search), auto, avx512, avx2 or generic
+    bool numa = false;                  // One dataset replica per NUMA node
+    unsigned hugePages = 1;             // 0 off, 1 transparent, 2 2MB, 3 1GB
+    std::string placement = "logical";  // logical (every cpu) or cores (one per physical core)
+    unsigned reserve = 0;               // Physical cores left to GPU host threads and io
+    vector<unsigned> cores;             // Explicit cpu list, overrides placement
 };
 
 struct SolutionAccountType
@@ -124,6 +154,8 @@ struct SolutionAccountType
     unsigned rejected = 0;
     unsigned wasted = 0;
     unsigned failed = 0;
+    unsigned dropped = 0;
+    unsigned stale = 0;
     std::chrono::steady_clock::time_point tstamp = std::chrono::steady_clock::now();
     string str()
     {
@@ -134,6 +166,10 @@ struct SolutionAccountType
             _ret.append(":R" + to_string(rejected));
         if (failed)
             _ret.append(":F" + to_string(failed));
+        if (dropped)
+            _ret.append(":D" + to_string(dropped));
+        if (stale)
+            _ret.append(":S" + to_string(stale));
         return _ret;
     };
 };
@@ -143,6 +179,10 @@ struct HwSensorsType
     int tempC = 0;
     int fanP = 0;
     double powerW = 0.0;
+    int memTempC = 0;              // Not available on all devices
+    unsigned coreClock = 0;        // MHz
+    unsigned memClock = 0;         // MHz
+    uint64_t throttleReasons = 0;  // NVML's clocks throttle reasons bitmask
     string str()
     {
         string _ret = to_string(tempC) + "C " + to_string(fanP) + "%";
@@ -159,6 +199,15 @@ struct TelemetryAccountType
     bool paused = false;
     HwSensorsType sensors;
     SolutionAccountType solutions;
+
+    // Latencies as of last collection
+    LatencyHistogram::Snapshot switchLatency;  // Work published -> device searching it
+    LatencyHistogram::Snapshot submitLatency;  // Solution found -> handed to pool client
+    LatencyHistogram::Snapshot acceptLatency;  // Solution submitted -> accepted by pool
+
+    // Efficiency governor (see FarmSettings::powerCap)
+    unsigned duty = 100;  // Percent of time searching
+    string dutyLimit;     // What keeps duty below 100 : "power", "temp" or empty
 };
 
 struct DeviceDescriptor
@@ -246,7 +295,13 @@ struct TelemetryType
         - speed       Actual speed at the same level of
                       magnitude for farm speed
         - sensors     Values of sensors (temp, fan, power)
+        - duty        Optional duty cycle set by efficiency governor
         - solutions   Optional (LOG_PER_GPU) Solutions detail per GPU
+
+        followed, once measured, by farm's latencies (p50/p99 in ms)
+        - sw          Work published -> devices searching it
+        - sub         Solution found -> handed to pool client
+        - acc         Solution submitted -> accepted by pool
         */
 
         /*
@@ -294,6 +349,8 @@ struct TelemetryType
 
             if (hwmon)
                 _ret << " " << EthTeal << miner.sensors.str() << EthReset;
+            if (miner.duty < 100)
+                _ret << " " << EthYellow << "d" << miner.duty << "%" << EthReset;
 
             // Eventually push also solutions per single GPU
             if (g_logOptions & LOG_PER_GPU)
@@ -304,6 +361,11 @@ struct TelemetryType
                 _ret << ", ";
         }
 
+        if (farm.switchLatency.count || farm.submitLatency.count)
+            _ret << " - " << EthGray << "sw " << farm.switchLatency.str() << " sub "
+                 << farm.submitLatency.str() << " acc " << farm.acceptLatency.str() << " ms"
+                 << EthReset;
+
         return _ret.str();
     };
 };
@@ -335,6 +397,19 @@ public:
     virtual uint64_t get_nonce_scrambler() = 0;
     virtual unsigned get_segment_width() = 0;
 
+    /**
+     * @brief Called from a Miner which has been asked to prepare an
+     * epoch in background (see Miner::prepareEpoch) once it is done
+     * building it, or gave up.
+     */
+    virtual void epochPrepared(unsigned _minerIdx, int _epoch) = 0;
+
+    /**
+     * @brief Called from a Miner which is no longer paused for any reason,
+     * so it can be given current work instead of idling till the next job.
+     */
+    virtual void minerResumed(unsigned _minerIdx) = 0;
+
 private:
     static FarmFace* m_this;
 };
@@ -371,11 +446,50 @@ public:
      */
     void setWork(WorkPackage const& _work);
 
+    /**
+     * @brief Assigns hashing work to this instance. The package is
+     * immutable and may be shared with other holders.
+     */
+    void setWork(std::shared_ptr<const WorkPackage> _work);
+
+    /**
+     * @brief Number of works published to this instance so far.
+     * Cheap enough to be polled from search loops.
+     */
+    uint64_t workGeneration() const noexcept
+    {
+        return m_workSeq.load(std::memory_order_acquire) / 2;
+    }
+
     /**
      * @brief Assigns Epoch context to this instance
      */
     void setEpoch(EpochContext const& _ec) { m_epochContext = _ec; }
 
+    /**
+     * @brief Asks this instance to build the DAG of _ec in background while
+     * it keeps searching its current work. FarmFace::epochPrepared() is
+     * called once done, then the epoch has to be assigned as usual.
+     * @return false if not supported, the epoch has then to be assigned
+     * straight away and will be built the blocking way
+     */
+    virtual bool prepareEpoch(EpochContext const& _ec)
+    {
+        (void)_ec;
+        return false;
+    }
+
+    /**
+     * @brief Epoch of the DAG this instance is searching on (-1 if none yet)
+     */
+    int readyEpoch() const noexcept { return m_readyEpoch.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Whether this instance builds the light cache of an epoch on its
+     * own, without the host one (EpochContext::lightCache may then be null)
+     */
+    virtual bool buildsLight() const { return false; }
+
     unsigned Index() { return m_index; };
 
     HwMonitorInfo hwmonInfo() { return m_hwmoninfo; }
@@ -395,12 +509,15 @@ public:
     /**
      * @brief Whether or not this miner is paused for any reason
      */
-    bool paused();
+    bool paused() const noexcept { return m_pauseFlags.load(std::memory_order_acquire) != 0; }
 
     /**
      * @brief Checks if the given reason for pausing is currently active
      */
-    bool pauseTest(MinerPauseEnum what);
+    bool pauseTest(MinerPauseEnum what) const noexcept
+    {
+        return (m_pauseFlags.load(std::memory_order_acquire) & (1u << what)) != 0;
+    }
 
     /**
      * @brief Returns the human readable reason for this miner being paused
@@ -409,7 +526,8 @@ public:
 
     /**
      * @brief Cancels a pause flag.
-     * @note Miner can be paused for multiple reasons at a time.
+     * @note Miner can be paused for multiple reasons at a time. Once none is
+     * left the miner is given the farm's current work (see FarmFace::minerResumed)
      */
     void resume(MinerPauseEnum fromwhat);
 
@@ -420,6 +538,54 @@ public:
 
     void TriggerHashRateUpdate() noexcept;
 
+    /**
+     * @brief Sets the share (percent, 1 .. 100) of time this instance keeps
+     * its device searching. Below 100 it idles between batches.
+     */
+    void setDutyCycle(unsigned _percent) noexcept
+    {
+        m_dutyCycle.store(std::min(std::max(_percent, 1U), 100U), std::memory_order_relaxed);
+    }
+    unsigned dutyCycle() const noexcept { return m_dutyCycle.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Retrieves progress (percent) of the last DAG generation
+     */
+    unsigned RetrieveDagProgress() noexcept
+    {
+        return m_dagProgress.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Retrieves throughput (bytes per second) of the last DAG generation
+     */
+    uint64_t RetrieveDagRate() noexcept { return m_dagRate.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Latency histograms of this instance (see TelemetryAccountType)
+     */
+    LatencyHistogram& switchLatency() noexcept { return m_switchLatency; }
+    LatencyHistogram& submitLatency() noexcept { return m_submitLatency; }
+    LatencyHistogram& acceptLatency() noexcept { return m_acceptLatency; }
+
+    /**
+     * @brief Recent hashrate samples of this instance. Never blocks.
+     */
+    HashrateHistoryPtr hashrateHistory() const
+    {
+        return std::atomic_load_explicit(&m_history, std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Appends a sample to hashrate history. Called by the farm
+     * on each telemetry collection.
+     */
+    void recordSample(const HashrateSample& _sample)
+    {
+        std::atomic_store_explicit(
+            &m_history, hashrateHistory()->append(_sample), std::memory_order_release);
+    }
+
 protected:
     /**
      * @brief Initializes miner's device.
@@ -436,42 +602,114 @@ protected:
      */
     virtual bool initEpoch_internal() = 0;
 
+    /**
+     * @brief Called from initEpoch_internal() right before generating the DAG.
+     * When DAG loading is sequential, waits for this miner's turn so only
+     * generation is serialized while setup (allocation, compilation) of
+     * all miners overlaps.
+     * @return false if the miner has been asked to stop meanwhile
+     */
+    bool acquireDagTurn();
+
+    /**
+     * @brief Whether this miner can copy the DAG from a peer which already
+     * built it for the same epoch (see DAG_LOAD_MODE_SINGLE)
+     */
+    virtual bool canCopyDag() { return false; }
+
     /**
      * @brief Returns current workpackage this miner is working on
      */
-    WorkPackage work() const;
+    WorkPackage work() const { return *workPtr(); }
+
+    /**
+     * @brief Returns current workpackage without copying it, and
+     * optionally the generation it has been published with
+     */
+    std::shared_ptr<const WorkPackage> workPtr(uint64_t* _generation = nullptr) const;
 
     void updateHashRate(uint32_t _groupSize, uint32_t _increment) noexcept;
 
+    /**
+     * @brief Accounts the time elapsed since work of _generation has been
+     * published. To be called when the device starts searching it, only
+     * the first call for a generation is accounted. With _account false
+     * the generation is only marked as seen (i.e. it caused an epoch switch)
+     * @return The elapsed time in microseconds
+     */
+    uint64_t recordWorkSwitch(uint64_t _generation, bool _account = true) noexcept;
+
+    /**
+     * @brief To be called by miner's thread before queueing a batch.
+     * Idles long enough to honor the duty cycle, or till new work arrives.
+     */
+    void throttle();
+
     static unsigned s_minersCount;   // Total Number of Miners
     static unsigned s_dagLoadMode;   // Way dag should be loaded
     static unsigned s_dagLoadIndex;  // In case of serialized load of dag this is the index of miner
                                      // which should load next
 
+    // In case of single build of dag : epoch being built, whether the
+    // build is still in progress and whether it succeeded
+    static boost::mutex s_dagBuildMutex;
+    static boost::condition_variable s_dagBuildSignal;
+    static int s_dagBuildEpoch;
+    static bool s_dagBuildPending;
+    static bool s_dagBuildOk;
+
+    bool m_dagFromPeer = false;  // Set by initEpoch() when a peer has already built the dag
+
+    // Startup phases, reported once after first epoch initialization
+    std::chrono::steady_clock::time_point m_created = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point m_dagTurnAsked, m_dagTurnGiven;
+    bool m_dagTurnHeld = false;
+    bool m_startupReported = false;
+
     const unsigned m_index = 0;           // Ordinal index of the Instance (not the device)
     DeviceDescriptor m_deviceDescriptor;  // Info about the device
 
     EpochContext m_epochContext;
 
-#ifdef DEV_BUILD
-    std::chrono::steady_clock::time_point m_workSwitchStart;
-#endif
+    std::atomic<unsigned> m_dagProgress = {0};
+    std::atomic<int> m_readyEpoch = {-1};
+    std::atomic<uint64_t> m_dagRate = {0};
+
+    // When last work has been published (steady clock ticks)
+    std::atomic<std::chrono::steady_clock::rep> m_workSwitchStart = {0};
 
     HwMonitorInfo m_hwmoninfo;
     mutable boost::mutex x_work;
-    mutable boost::mutex x_pause;
     boost::condition_variable m_new_work_signal;
     boost::condition_variable m_dag_loaded_signal;
 
 private:
-    bitset<MinerPauseEnum::Pause_MAX> m_pauseFlags;
+    std::atomic<uint32_t> m_pauseFlags = {0};  // One bit per MinerPauseEnum
 
-    WorkPackage m_work;
+    void publishWork(std::shared_ptr<const WorkPackage> _work);  // Requires x_work
+
+    // Current work is published seqlock like : m_workSeq is odd while
+    // m_work is being replaced so readers never pair a package with
+    // the generation of another one. Only polling the generation is
+    // lock free : atomic operations on shared_ptr take a short lock
+    // from a global pool in libstdc++ each time a package is fetched
+    std::shared_ptr<const WorkPackage> m_work = std::make_shared<const WorkPackage>();
+    std::atomic<uint64_t> m_workSeq = {0};
 
     std::chrono::steady_clock::time_point m_hashTime = std::chrono::steady_clock::now();
     std::atomic<float> m_hashRate = {0.0};
     uint64_t m_groupCount = 0;
     atomic<bool> m_hashRateUpdate = {false};
+
+    LatencyHistogram m_switchLatency;
+    LatencyHistogram m_submitLatency;
+    LatencyHistogram m_acceptLatency;
+    uint64_t m_switchGeneration = 0;  // Last generation accounted in m_switchLatency
+
+    std::atomic<unsigned> m_dutyCycle = {100};
+    std::chrono::steady_clock::time_point m_throttleTime;  // Busy since
+
+    HashrateHistoryPtr m_history = std::make_shared<const HashrateHistory>();
 };
 
 }  // namespace eth
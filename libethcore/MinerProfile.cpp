@@ -0,0 +1,126 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+
+#include <json/json.h>
+
+#include "MinerProfile.h"
+
+namespace dev
+{
+namespace eth
+{
+std::string MinerProfile::s_file;
+std::mutex MinerProfile::s_mutex;
+
+void MinerProfile::setFile(const std::string& _file)
+{
+    std::lock_guard<std::mutex> l(s_mutex);
+    s_file = _file;
+}
+
+std::string MinerProfile::dataDir()
+{
+#if defined(_WIN32)
+    const char* home = getenv("APPDATA");
+#else
+    const char* home = getenv("HOME");
+#endif
+    boost::filesystem::path path(home ? home : ".");
+    path /= ".ethminer";
+    return path.string();
+}
+
+std::string MinerProfile::file()
+{
+    if (!s_file.empty())
+        return s_file;
+
+    boost::filesystem::path path(dataDir());
+    path /= "profile.json";
+    return path.string();
+}
+
+bool MinerProfile::load(const std::string& _key, ProfileValues& _values)
+{
+    std::lock_guard<std::mutex> l(s_mutex);
+
+    std::ifstream in(file());
+    if (!in)
+        return false;
+
+    Json::Value jRoot;
+    Json::CharReaderBuilder builder;
+    std::string errs;
+    if (!Json::parseFromStream(builder, in, &jRoot, &errs) || !jRoot.isObject() ||
+        !jRoot.isMember(_key) || !jRoot[_key].isObject())
+        return false;
+
+    _values.clear();
+    for (auto const& name : jRoot[_key].getMemberNames())
+        if (jRoot[_key][name].isUInt64())
+            _values[name] = jRoot[_key][name].asUInt64();
+
+    return !_values.empty();
+}
+
+bool MinerProfile::save(const std::string& _key, const ProfileValues& _values)
+{
+    std::lock_guard<std::mutex> l(s_mutex);
+    std::string fileName = file();
+
+    // Preserve profiles of other devices
+    Json::Value jRoot(Json::objectValue);
+    {
+        std::ifstream in(fileName);
+        Json::CharReaderBuilder builder;
+        std::string errs;
+        if (!in || !Json::parseFromStream(builder, in, &jRoot, &errs) || !jRoot.isObject())
+            jRoot = Json::Value(Json::objectValue);
+    }
+
+    Json::Value jValues(Json::objectValue);
+    for (auto const& value : _values)
+        jValues[value.first] = Json::Value::UInt64(value.second);
+    jRoot[_key] = jValues;
+
+    try
+    {
+        boost::filesystem::path path(fileName);
+        if (path.has_parent_path())
+            boost::filesystem::create_directories(path.parent_path());
+    }
+    catch (...)
+    {
+        return false;
+    }
+
+    std::ofstream out(fileName, std::ios::trunc);
+    if (!out)
+        return false;
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "  ";
+    out << Json::writeString(writer, jRoot) << std::endl;
+    return out.good();
+}
+
+}  // namespace eth
+}  // namespace dev
@@ -0,0 +1,67 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace dev
+{
+namespace eth
+{
+typedef std::map<std::string, uint64_t> ProfileValues;
+
+/**
+ * @brief Persists per device tuning results.
+ * Profiles are stored in a json file and identified by a key
+ * which should include device unique id and driver version.
+ */
+class MinerProfile
+{
+public:
+    /**
+     * @brief Sets the file profiles are read from and written to.
+     * When empty defaults to <home>/.ethminer/profile.json
+     */
+    static void setFile(const std::string& _file);
+
+    /**
+     * @brief Loads values for the given key. Returns false if not found.
+     */
+    static bool load(const std::string& _key, ProfileValues& _values);
+
+    /**
+     * @brief Stores values for the given key replacing previous ones.
+     */
+    static bool save(const std::string& _key, const ProfileValues& _values);
+
+    /**
+     * @brief Returns the directory ethminer keeps its data in (<home>/.ethminer)
+     */
+    static std::string dataDir();
+
+private:
+    static std::string file();
+
+    static std::string s_file;
+    static std::mutex s_mutex;
+};
+
+}  // namespace eth
+}  // namespace dev
@@ -9,12 +9,15 @@
 #include <sys/types.h>
 #if defined(__linux)
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 
 #include <algorithm>
+#include <cctype>
 #include <climits>
 #include <cstdint>
 #include <cstring>
@@ -27,6 +30,8 @@
 #include "wrapamdsysfs.h"
 #include "wraphelper.h"
 
+#define AMDSYSFS_BUFFER_SIZE 4096
+
 static bool getFileContentValue(const char* filename, unsigned int& value)
 {
     value = 0;
@@ -42,6 +47,57 @@ static bool getFileContentValue(const char* filename, unsigned int& value)
     return (p != p2);
 }
 
+#if defined(__linux)
+static int openSensor(const char* filename)
+{
+    return ::open(filename, O_RDONLY | O_CLOEXEC);
+}
+
+// Reads whole content of a sensor file into sysfsh's buffer.
+// Returns the number of bytes read or -1
+static int readSensor(wrap_amdsysfs_handle* sysfsh, int fd)
+{
+    if (fd < 0)
+        return -1;
+    ssize_t n = pread(fd, sysfsh->sysfs_buffer, AMDSYSFS_BUFFER_SIZE - 1, 0);
+    if (n < 0)
+        return -1;
+    sysfsh->sysfs_buffer[n] = 0;
+    return int(n);
+}
+
+static bool readSensorValue(wrap_amdsysfs_handle* sysfsh, int fd, unsigned int& value)
+{
+    value = 0;
+    if (readSensor(sysfsh, fd) <= 0)
+        return false;
+    char* p = sysfsh->sysfs_buffer;
+    char* p2;
+    errno = 0;
+    value = strtoul(p, &p2, 0);
+    if (errno != 0)
+        return false;
+    return (p != p2);
+}
+
+// Looks for "<watts> W (average GPU)" in amdgpu_pm_info
+static bool readPmInfoPower(wrap_amdsysfs_handle* sysfsh, int fd, unsigned int& milliwatts)
+{
+    if (readSensor(sysfsh, fd) <= 0)
+        return false;
+    const char* tag = strstr(sysfsh->sysfs_buffer, " W (average GPU)");
+    if (!tag)
+        return false;
+    const char* begin = tag;
+    while (begin > sysfsh->sysfs_buffer && (isdigit(begin[-1]) || begin[-1] == '.'))
+        begin--;
+    if (begin == tag)
+        return false;
+    milliwatts = (unsigned int)(atof(begin) * 1000);
+    return true;
+}
+#endif
+
 wrap_amdsysfs_handle* wrap_amdsysfs_create()
 {
     wrap_amdsysfs_handle* sysfsh = nullptr;
@@ -181,12 +237,76 @@ wrap_amdsysfs_handle* wrap_amdsysfs_create()
         gpucount++;
     }
 
+    // Open sensors once for all
+    sysfsh->sysfs_temp_fd = (int*)calloc(gpucount, sizeof(int));
+    sysfsh->sysfs_pwm_fd = (int*)calloc(gpucount, sizeof(int));
+    sysfsh->sysfs_power_fd = (int*)calloc(gpucount, sizeof(int));
+    sysfsh->sysfs_pm_info_fd = (int*)calloc(gpucount, sizeof(int));
+    sysfsh->sysfs_pwm_min = (unsigned int*)calloc(gpucount, sizeof(unsigned int));
+    sysfsh->sysfs_pwm_max = (unsigned int*)calloc(gpucount, sizeof(unsigned int));
+    sysfsh->sysfs_buffer = (char*)calloc(AMDSYSFS_BUFFER_SIZE, 1);
+
+    for (unsigned int i = 0; i < gpucount; i++)
+    {
+        unsigned int gpuindex = sysfsh->sysfs_device_id[i];
+        unsigned int hwmonindex = sysfsh->sysfs_hwmon_id[i];
+
+        snprintf(dbuf, 120, "/sys/class/drm/card%u/device/hwmon/hwmon%u/temp1_input", gpuindex,
+            hwmonindex);
+        sysfsh->sysfs_temp_fd[i] = openSensor(dbuf);
+
+        snprintf(
+            dbuf, 120, "/sys/class/drm/card%u/device/hwmon/hwmon%u/pwm1", gpuindex, hwmonindex);
+        sysfsh->sysfs_pwm_fd[i] = openSensor(dbuf);
+
+        // Fan range does not change : read it now
+        sysfsh->sysfs_pwm_max[i] = 255;
+        snprintf(dbuf, 120, "/sys/class/drm/card%u/device/hwmon/hwmon%u/pwm1_max", gpuindex,
+            hwmonindex);
+        getFileContentValue(dbuf, sysfsh->sysfs_pwm_max[i]);
+        snprintf(dbuf, 120, "/sys/class/drm/card%u/device/hwmon/hwmon%u/pwm1_min", gpuindex,
+            hwmonindex);
+        getFileContentValue(dbuf, sysfsh->sysfs_pwm_min[i]);
+
+        // Prefer hwmon's power over parsing debugfs
+        snprintf(dbuf, 120, "/sys/class/drm/card%u/device/hwmon/hwmon%u/power1_average",
+            gpuindex, hwmonindex);
+        sysfsh->sysfs_power_fd[i] = openSensor(dbuf);
+        sysfsh->sysfs_pm_info_fd[i] = -1;
+        if (sysfsh->sysfs_power_fd[i] < 0)
+        {
+            snprintf(dbuf, 120, "/sys/kernel/debug/dri/%u/amdgpu_pm_info", gpuindex);
+            sysfsh->sysfs_pm_info_fd[i] = openSensor(dbuf);
+        }
+    }
+
 #endif
     return sysfsh;
 }
 
 int wrap_amdsysfs_destroy(wrap_amdsysfs_handle* sysfsh)
 {
+#if defined(__linux)
+    for (int i = 0; i < sysfsh->sysfs_gpucount; i++)
+    {
+        for (int* fds : {sysfsh->sysfs_temp_fd, sysfsh->sysfs_pwm_fd, sysfsh->sysfs_power_fd,
+                 sysfsh->sysfs_pm_info_fd})
+            if (fds && fds[i] >= 0)
+                ::close(fds[i]);
+    }
+#endif
+    free(sysfsh->sysfs_device_id);
+    free(sysfsh->sysfs_hwmon_id);
+    free(sysfsh->sysfs_pci_domain_id);
+    free(sysfsh->sysfs_pci_bus_id);
+    free(sysfsh->sysfs_pci_device_id);
+    free(sysfsh->sysfs_temp_fd);
+    free(sysfsh->sysfs_pwm_fd);
+    free(sysfsh->sysfs_power_fd);
+    free(sysfsh->sysfs_pm_info_fd);
+    free(sysfsh->sysfs_pwm_min);
+    free(sysfsh->sysfs_pwm_max);
+    free(sysfsh->sysfs_buffer);
     free(sysfsh);
     return 0;
 }
@@ -199,90 +319,84 @@ int wrap_amdsysfs_get_gpucount(wrap_amdsysfs_handle* sysfsh, int* gpucount)
 
 int wrap_amdsysfs_get_tempC(wrap_amdsysfs_handle* sysfsh, int index, unsigned int* tempC)
 {
+#if defined(__linux)
     if (index < 0 || index >= sysfsh->sysfs_gpucount)
         return -1;
 
-    int gpuindex = sysfsh->sysfs_device_id[index];
-
-    int hwmonindex = sysfsh->sysfs_hwmon_id[index];
-    if (hwmonindex < 0)
-        return -1;
-
-    char dbuf[120];
-    snprintf(
-        dbuf, 120, "/sys/class/drm/card%d/device/hwmon/hwmon%d/temp1_input", gpuindex, hwmonindex);
-
     unsigned int temp = 0;
-    getFileContentValue(dbuf, temp);
+    if (!readSensorValue(sysfsh, sysfsh->sysfs_temp_fd[index], temp))
+        return -1;
 
     if (temp > 0)
         *tempC = temp / 1000;
 
     return 0;
+#else
+    (void)sysfsh;
+    (void)index;
+    (void)tempC;
+    return -1;
+#endif
 }
 
 int wrap_amdsysfs_get_fanpcnt(wrap_amdsysfs_handle* sysfsh, int index, unsigned int* fanpcnt)
 {
+#if defined(__linux)
     if (index < 0 || index >= sysfsh->sysfs_gpucount)
         return -1;
 
-    int gpuindex = sysfsh->sysfs_device_id[index];
-    int hwmonindex = sysfsh->sysfs_hwmon_id[index];
-    if (hwmonindex < 0)
+    unsigned int pwm = 0;
+    unsigned int pwmMax = sysfsh->sysfs_pwm_max[index];
+    unsigned int pwmMin = sysfsh->sysfs_pwm_min[index];
+    if (!readSensorValue(sysfsh, sysfsh->sysfs_pwm_fd[index], pwm) || pwmMax <= pwmMin)
         return -1;
 
-    unsigned int pwm = 0, pwmMax = 255, pwmMin = 0;
-
-    char dbuf[120];
-    snprintf(dbuf, 120, "/sys/class/drm/card%d/device/hwmon/hwmon%d/pwm1", gpuindex, hwmonindex);
-    getFileContentValue(dbuf, pwm);
-
-    snprintf(
-        dbuf, 120, "/sys/class/drm/card%d/device/hwmon/hwmon%d/pwm1_max", gpuindex, hwmonindex);
-    getFileContentValue(dbuf, pwmMax);
-
-    snprintf(
-        dbuf, 120, "/sys/class/drm/card%d/device/hwmon/hwmon%d/pwm1_min", gpuindex, hwmonindex);
-    getFileContentValue(dbuf, pwmMin);
-
     *fanpcnt = (unsigned int)(double(pwm - pwmMin) / double(pwmMax - pwmMin) * 100.0);
     return 0;
+#else
+    (void)sysfsh;
+    (void)index;
+    (void)fanpcnt;
+    return -1;
+#endif
 }
 
 int wrap_amdsysfs_get_power_usage(wrap_amdsysfs_handle* sysfsh, int index, unsigned int* milliwatts)
 {
-    try
-    {
-        if (index < 0 || index >= sysfsh->sysfs_gpucount)
-            return -1;
-
-        int gpuindex = sysfsh->sysfs_device_id[index];
-
-        char dbuf[120];
-        snprintf(dbuf, 120, "/sys/kernel/debug/dri/%d/amdgpu_pm_info", gpuindex);
-
-        std::ifstream ifs(dbuf, std::ios::binary);
-        std::string line;
+#if defined(__linux)
+    if (index < 0 || index >= sysfsh->sysfs_gpucount)
+        return -1;
 
-        while (std::getline(ifs, line))
-        {
-            std::smatch sm;
-            std::regex regex(R"(([\d|\.]+) W \(average GPU\))");
-            if (std::regex_search(line, sm, regex))
-            {
-                if (sm.size() == 2)
-                {
-                    double watt = atof(sm.str(1).c_str());
-                    *milliwatts = (unsigned int)(watt * 1000);
-                    return 0;
-                }
-            }
-        }
-    }
-    catch (const std::exception& ex)
+    unsigned int microwatts = 0;
+    if (readSensorValue(sysfsh, sysfsh->sysfs_power_fd[index], microwatts))
     {
-        cwarn << "Error in amdsysfs_get_power_usage: " << ex.what();
+        *milliwatts = microwatts / 1000;
+        return 0;
     }
 
+    if (readPmInfoPower(sysfsh, sysfsh->sysfs_pm_info_fd[index], *milliwatts))
+        return 0;
+#else
+    (void)sysfsh;
+    (void)index;
+    (void)milliwatts;
+#endif
+
     return -1;
 }
+
+int wrap_amdsysfs_get_sensors(wrap_amdsysfs_handle* sysfsh, int index, unsigned int* tempC,
+    unsigned int* fanpcnt, unsigned int* milliwatts)
+{
+    if (index < 0 || index >= sysfsh->sysfs_gpucount)
+        return -1;
+
+    int ret = 0;
+    if (wrap_amdsysfs_get_tempC(sysfsh, index, tempC) != 0)
+        ret = -1;
+    if (wrap_amdsysfs_get_fanpcnt(sysfsh, index, fanpcnt) != 0)
+        ret = -1;
+    if (milliwatts && wrap_amdsysfs_get_power_usage(sysfsh, index, milliwatts) != 0)
+        ret = -1;
+    return ret;
+}
@@ -15,6 +15,15 @@ typedef struct
     unsigned int* sysfs_pci_domain_id;
     unsigned int* sysfs_pci_bus_id;
     unsigned int* sysfs_pci_device_id;
+
+    // Sensors files are opened once and read with pread
+    int* sysfs_temp_fd;
+    int* sysfs_pwm_fd;
+    int* sysfs_power_fd;    // hwmon power1_average (microwatts)
+    int* sysfs_pm_info_fd;  // debugfs amdgpu_pm_info when power1_average is missing
+    unsigned int* sysfs_pwm_min;
+    unsigned int* sysfs_pwm_max;
+    char* sysfs_buffer;  // Reused by reads : handle is not thread safe
 } wrap_amdsysfs_handle;
 
 typedef struct
@@ -38,3 +47,10 @@ int wrap_amdsysfs_get_fanpcnt(wrap_amdsysfs_handle* sysfsh, int index, unsigned
 
 int wrap_amdsysfs_get_power_usage(
     wrap_amdsysfs_handle* sysfsh, int index, unsigned int* milliwatts);
+
+/*
+ * Reads all sensors of a GPU in one pass. milliwatts may be null
+ * to skip power reading.
+ */
+int wrap_amdsysfs_get_sensors(wrap_amdsysfs_handle* sysfsh, int index, unsigned int* tempC,
+    unsigned int* fanpcnt, unsigned int* milliwatts);
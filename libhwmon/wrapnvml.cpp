@@ -22,6 +22,17 @@
 
 #include "wrapnvml.h"
 
+/* Constants of nvml.h we use */
+#define WRAPNVML_FI_DEV_MEMORY_TEMP 82
+#define WRAPNVML_TOTAL_POWER_SAMPLES 0
+#define WRAPNVML_CLOCK_GRAPHICS 0
+#define WRAPNVML_CLOCK_MEM 2
+#define WRAPNVML_VALUE_TYPE_DOUBLE 0
+#define WRAPNVML_VALUE_TYPE_UNSIGNED_INT 1
+#define WRAPNVML_VALUE_TYPE_UNSIGNED_LONG 2
+#define WRAPNVML_VALUE_TYPE_UNSIGNED_LONG_LONG 3
+#define WRAPNVML_VALUE_TYPE_SIGNED_LONG_LONG 4
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
@@ -88,6 +99,17 @@ wrap_nvml_handle* wrap_nvml_create()
     nvmlh->nvmlDeviceGetPowerUsage = (wrap_nvmlReturn_t(*)(
         wrap_nvmlDevice_t, unsigned int*))wrap_dlsym(nvmlh->nvml_dll, "nvmlDeviceGetPowerUsage");
     nvmlh->nvmlShutdown = (wrap_nvmlReturn_t(*)())wrap_dlsym(nvmlh->nvml_dll, "nvmlShutdown");
+    nvmlh->nvmlDeviceGetFieldValues =
+        (wrap_nvmlReturn_t(*)(wrap_nvmlDevice_t, int, wrap_nvmlFieldValue_t*))wrap_dlsym(
+            nvmlh->nvml_dll, "nvmlDeviceGetFieldValues");
+    nvmlh->nvmlDeviceGetSamples = (wrap_nvmlReturn_t(*)(wrap_nvmlDevice_t, int,
+        unsigned long long, int*, unsigned int*, wrap_nvmlSample_t*))wrap_dlsym(nvmlh->nvml_dll,
+        "nvmlDeviceGetSamples");
+    nvmlh->nvmlDeviceGetClockInfo = (wrap_nvmlReturn_t(*)(wrap_nvmlDevice_t, int,
+        unsigned int*))wrap_dlsym(nvmlh->nvml_dll, "nvmlDeviceGetClockInfo");
+    nvmlh->nvmlDeviceGetCurrentClocksThrottleReasons =
+        (wrap_nvmlReturn_t(*)(wrap_nvmlDevice_t, unsigned long long*))wrap_dlsym(
+            nvmlh->nvml_dll, "nvmlDeviceGetCurrentClocksThrottleReasons");
 
     if (nvmlh->nvmlInit == nullptr || nvmlh->nvmlShutdown == nullptr ||
         nvmlh->nvmlDeviceGetCount == nullptr || nvmlh->nvmlDeviceGetHandleByIndex == nullptr ||
@@ -110,6 +132,13 @@ wrap_nvml_handle* wrap_nvml_create()
     nvmlh->nvml_pci_domain_id = (unsigned int*)calloc(nvmlh->nvml_gpucount, sizeof(unsigned int));
     nvmlh->nvml_pci_bus_id = (unsigned int*)calloc(nvmlh->nvml_gpucount, sizeof(unsigned int));
     nvmlh->nvml_pci_device_id = (unsigned int*)calloc(nvmlh->nvml_gpucount, sizeof(unsigned int));
+    nvmlh->nvml_last_sample =
+        (unsigned long long*)calloc(nvmlh->nvml_gpucount, sizeof(unsigned long long));
+    nvmlh->nvml_samples =
+        (wrap_nvmlSample_t*)calloc(WRAPNVML_MAX_SAMPLES, sizeof(wrap_nvmlSample_t));
+    nvmlh->nvml_readings = (unsigned int*)calloc(nvmlh->nvml_gpucount, sizeof(unsigned int));
+    nvmlh->nvml_clocks =
+        (wrap_nvmlSensors_t*)calloc(nvmlh->nvml_gpucount, sizeof(wrap_nvmlSensors_t));
 
     /* Obtain GPU device handles we're going to need repeatedly... */
     for (int i = 0; i < nvmlh->nvml_gpucount; i++)
@@ -137,6 +166,14 @@ int wrap_nvml_destroy(wrap_nvml_handle* nvmlh)
     nvmlh->nvmlShutdown();
 
     wrap_dlclose(nvmlh->nvml_dll);
+    free(nvmlh->devs);
+    free(nvmlh->nvml_pci_domain_id);
+    free(nvmlh->nvml_pci_bus_id);
+    free(nvmlh->nvml_pci_device_id);
+    free(nvmlh->nvml_last_sample);
+    free(nvmlh->nvml_samples);
+    free(nvmlh->nvml_readings);
+    free(nvmlh->nvml_clocks);
     free(nvmlh);
     return 0;
 }
@@ -192,6 +229,99 @@ int wrap_nvml_get_power_usage(wrap_nvml_handle* nvmlh, int gpuindex, unsigned in
     return 0;
 }
 
+static double wrap_nvml_value(int type, wrap_nvmlValue_t value)
+{
+    switch (type)
+    {
+    case WRAPNVML_VALUE_TYPE_DOUBLE:
+        return value.dVal;
+    case WRAPNVML_VALUE_TYPE_UNSIGNED_INT:
+        return value.uiVal;
+    case WRAPNVML_VALUE_TYPE_UNSIGNED_LONG:
+        return (double)value.ulVal;
+    case WRAPNVML_VALUE_TYPE_UNSIGNED_LONG_LONG:
+        return (double)value.ullVal;
+    case WRAPNVML_VALUE_TYPE_SIGNED_LONG_LONG:
+        return (double)value.sllVal;
+    default:
+        return 0;
+    }
+}
+
+/* Average of driver's power samples since last call. -1 if none */
+static int wrap_nvml_get_power_average(
+    wrap_nvml_handle* nvmlh, int gpuindex, unsigned int* milliwatts)
+{
+    if (nvmlh->nvmlDeviceGetSamples == nullptr || nvmlh->nvml_samples == nullptr)
+        return -1;
+
+    int type = 0;
+    unsigned int count = WRAPNVML_MAX_SAMPLES;
+    if (nvmlh->nvmlDeviceGetSamples(nvmlh->devs[gpuindex], WRAPNVML_TOTAL_POWER_SAMPLES,
+            nvmlh->nvml_last_sample[gpuindex], &type, &count,
+            nvmlh->nvml_samples) != WRAPNVML_SUCCESS ||
+        count == 0)
+        return -1;
+
+    double total = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        total += wrap_nvml_value(type, nvmlh->nvml_samples[i].sampleValue);
+        if (nvmlh->nvml_samples[i].timeStamp > nvmlh->nvml_last_sample[gpuindex])
+            nvmlh->nvml_last_sample[gpuindex] = nvmlh->nvml_samples[i].timeStamp;
+    }
+    *milliwatts = (unsigned int)(total / count);
+    return 0;
+}
+
+int wrap_nvml_get_sensors(
+    wrap_nvml_handle* nvmlh, int gpuindex, int power, wrap_nvmlSensors_t* sensors)
+{
+    if (gpuindex < 0 || gpuindex >= nvmlh->nvml_gpucount)
+        return -1;
+
+    wrap_nvmlDevice_t dev = nvmlh->devs[gpuindex];
+    int ret = 0;
+
+    if (wrap_nvml_get_tempC(nvmlh, gpuindex, &sensors->tempC) != 0)
+        ret = -1;
+    if (wrap_nvml_get_fanpcnt(nvmlh, gpuindex, &sensors->fanpcnt) != 0)
+        ret = -1;
+
+    /* Metrics without a dedicated entry point all come in one query */
+    if (nvmlh->nvmlDeviceGetFieldValues)
+    {
+        wrap_nvmlFieldValue_t fields[1] = {};
+        fields[0].fieldId = WRAPNVML_FI_DEV_MEMORY_TEMP;
+        if (nvmlh->nvmlDeviceGetFieldValues(dev, 1, fields) == WRAPNVML_SUCCESS &&
+            fields[0].nvmlReturn == WRAPNVML_SUCCESS)
+            sensors->memTempC =
+                (unsigned int)wrap_nvml_value(fields[0].valueType, fields[0].value);
+    }
+
+    /* Slow moving ones are refreshed every few readings only */
+    wrap_nvmlSensors_t* clocks = &nvmlh->nvml_clocks[gpuindex];
+    if (nvmlh->nvml_readings[gpuindex]++ % WRAPNVML_CLOCKS_EVERY == 0)
+    {
+        if (nvmlh->nvmlDeviceGetClockInfo)
+        {
+            nvmlh->nvmlDeviceGetClockInfo(dev, WRAPNVML_CLOCK_GRAPHICS, &clocks->coreClock);
+            nvmlh->nvmlDeviceGetClockInfo(dev, WRAPNVML_CLOCK_MEM, &clocks->memClock);
+        }
+        if (nvmlh->nvmlDeviceGetCurrentClocksThrottleReasons)
+            nvmlh->nvmlDeviceGetCurrentClocksThrottleReasons(dev, &clocks->throttleReasons);
+    }
+    sensors->coreClock = clocks->coreClock;
+    sensors->memClock = clocks->memClock;
+    sensors->throttleReasons = clocks->throttleReasons;
+
+    if (power && wrap_nvml_get_power_average(nvmlh, gpuindex, &sensors->milliwatts) != 0 &&
+        wrap_nvml_get_power_usage(nvmlh, gpuindex, &sensors->milliwatts) != 0)
+        ret = -1;
+
+    return ret;
+}
+
 #if defined(__cplusplus)
 }
 #endif
@@ -46,6 +46,53 @@ typedef struct
     unsigned int res3;
 } wrap_nvmlPciInfo_t;
 
+/* nvmlValue_t */
+typedef union
+{
+    double dVal;
+    unsigned int uiVal;
+    unsigned long ulVal;
+    unsigned long long ullVal;
+    signed long long sllVal;
+} wrap_nvmlValue_t;
+
+/* nvmlFieldValue_t */
+typedef struct
+{
+    unsigned int fieldId;
+    unsigned int scopeId;
+    long long timestamp;
+    long long latencyUsec;
+    int valueType;
+    wrap_nvmlReturn_t nvmlReturn;
+    wrap_nvmlValue_t value;
+} wrap_nvmlFieldValue_t;
+
+/* nvmlSample_t */
+typedef struct
+{
+    unsigned long long timeStamp;
+    wrap_nvmlValue_t sampleValue;
+} wrap_nvmlSample_t;
+
+/* Power samples kept between two readings of a device */
+#define WRAPNVML_MAX_SAMPLES 128
+
+/* Clocks and throttle reasons are refreshed once every that many readings */
+#define WRAPNVML_CLOCKS_EVERY 10
+
+/* Readings of all sensors of a device (0 when not available) */
+typedef struct
+{
+    unsigned int tempC;
+    unsigned int memTempC;
+    unsigned int fanpcnt;
+    unsigned int milliwatts; /* Average since previous reading when samples are available */
+    unsigned int coreClock;  /* MHz */
+    unsigned int memClock;   /* MHz */
+    unsigned long long throttleReasons;
+} wrap_nvmlSensors_t;
+
 
 /*
  * Handle to hold the function pointers for the entry points we need,
@@ -68,6 +115,22 @@ typedef struct
     wrap_nvmlReturn_t (*nvmlDeviceGetFanSpeed)(wrap_nvmlDevice_t, unsigned int*);
     wrap_nvmlReturn_t (*nvmlDeviceGetPowerUsage)(wrap_nvmlDevice_t, unsigned int*);
     wrap_nvmlReturn_t (*nvmlShutdown)(void);
+
+    /* Optional entry points (older drivers may lack them) */
+    wrap_nvmlReturn_t (*nvmlDeviceGetFieldValues)(wrap_nvmlDevice_t, int, wrap_nvmlFieldValue_t*);
+    wrap_nvmlReturn_t (*nvmlDeviceGetSamples)(wrap_nvmlDevice_t, int, unsigned long long, int*,
+        unsigned int*, wrap_nvmlSample_t*);
+    wrap_nvmlReturn_t (*nvmlDeviceGetClockInfo)(wrap_nvmlDevice_t, int, unsigned int*);
+    wrap_nvmlReturn_t (*nvmlDeviceGetCurrentClocksThrottleReasons)(
+        wrap_nvmlDevice_t, unsigned long long*);
+
+    /* Per device timestamp of last power sample read, and a buffer for samples */
+    unsigned long long* nvml_last_sample;
+    wrap_nvmlSample_t* nvml_samples;
+
+    /* Per device readings count, and clocks (with throttle reasons) last read */
+    unsigned int* nvml_readings;
+    wrap_nvmlSensors_t* nvml_clocks;
 } wrap_nvml_handle;
 
 
@@ -104,6 +167,18 @@ int wrap_nvml_get_fanpcnt(wrap_nvml_handle* nvmlh, int gpuindex, unsigned int* f
  */
 int wrap_nvml_get_power_usage(wrap_nvml_handle* nvmlh, int gpuindex, unsigned int* milliwatts);
 
+/*
+ * Query all sensors of a GPU. Temperatures, fan and power are read on
+ * each call : memory temperature comes from a field values query; power,
+ * when requested, is averaged over the samples taken by the driver
+ * since the previous call (instant reading if not supported).
+ * Clocks and throttle reasons only change with load or limits : they are
+ * refreshed once every WRAPNVML_CLOCKS_EVERY calls, last values otherwise.
+ * Not thread safe : the handle holds the samples buffer.
+ */
+int wrap_nvml_get_sensors(
+    wrap_nvml_handle* nvmlh, int gpuindex, int power, wrap_nvmlSensors_t* sensors);
+
 
 #if defined(__cplusplus)
 }
@@ -0,0 +1,287 @@
+/*
+    This file is part of ethminer.
+
+    ethminer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ethminer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+#include <libdevcore/Log.h>
+
+#include "LatencyProbe.h"
+
+using namespace std;
+using boost::asio::ip::tcp;
+
+namespace dev
+{
+namespace eth
+{
+namespace
+{
+// Weight of a new sample in smoothed values
+constexpr double c_alpha = 0.3;
+
+// Connect attempts longer than this count as failures
+constexpr unsigned c_connectTimeout = 3;  // Seconds
+
+// Number of recent blocks compared across pools
+constexpr size_t c_blocksKept = 16;
+
+}  // namespace
+
+LatencyProbe* LatencyProbe::m_this = nullptr;
+
+struct LatencyProbe::Attempt
+{
+    Attempt(boost::asio::io_service& _io_service) : socket(_io_service), timer(_io_service) {}
+
+    std::string key;
+    tcp::endpoint endpoint;
+    tcp::socket socket;
+    boost::asio::deadline_timer timer;
+    std::chrono::steady_clock::time_point start;
+    bool done = false;
+};
+
+LatencyProbe::LatencyProbe(boost::asio::io_service& _io_service)
+  : m_io_service(_io_service), m_io_strand(_io_service)
+{
+    m_this = this;
+}
+
+LatencyProbe::~LatencyProbe()
+{
+    m_this = nullptr;
+}
+
+std::string LatencyProbe::key(const URI& _uri)
+{
+    return _uri.Host() + ":" + to_string(_uri.Port());
+}
+
+void LatencyProbe::probe(const std::vector<std::shared_ptr<URI>>& _connections)
+{
+    for (auto& uri : _connections)
+    {
+        if (uri->Host() == "exit" || uri->Family() == ProtocolFamily::SIMULATION)
+            continue;
+
+        std::string k = key(*uri);
+        auto resolver = std::make_shared<tcp::resolver>(m_io_service);
+        tcp::resolver::query q(uri->Host(), to_string(uri->Port()));
+        resolver->async_resolve(q,
+            m_io_strand.wrap(boost::bind(&LatencyProbe::resolved, this, k,
+                boost::asio::placeholders::error, boost::asio::placeholders::iterator, resolver)));
+    }
+}
+
+void LatencyProbe::resolved(const std::string& _key, const boost::system::error_code& ec,
+    tcp::resolver::iterator i, std::shared_ptr<tcp::resolver>)
+{
+    if (ec)
+    {
+        std::lock_guard<std::mutex> l(m_mutex);
+        for (auto& a : m_targets[_key].addresses)
+            a.reached = false;
+        return;
+    }
+
+    std::vector<tcp::endpoint> endpoints;
+    for (; i != tcp::resolver::iterator(); i++)
+        endpoints.push_back(i->endpoint());
+
+    {
+        // Keep statistics of addresses still resolved
+        std::lock_guard<std::mutex> l(m_mutex);
+        Target& t = m_targets[_key];
+        std::vector<Address> addresses;
+        for (auto& ep : endpoints)
+        {
+            auto it = std::find_if(t.addresses.begin(), t.addresses.end(),
+                [&](const Address& _a) { return _a.endpoint == ep; });
+            if (it != t.addresses.end())
+                addresses.push_back(*it);
+            else
+            {
+                addresses.emplace_back();
+                addresses.back().endpoint = ep;
+            }
+        }
+        t.addresses.swap(addresses);
+    }
+
+    for (auto& ep : endpoints)
+        connect(_key, ep);
+}
+
+void LatencyProbe::connect(const std::string& _key, tcp::endpoint _endpoint)
+{
+    auto attempt = std::make_shared<Attempt>(m_io_service);
+    attempt->key = _key;
+    attempt->endpoint = _endpoint;
+    attempt->start = std::chrono::steady_clock::now();
+
+    attempt->timer.expires_from_now(boost::posix_time::seconds(c_connectTimeout));
+    attempt->timer.async_wait(m_io_strand.wrap([this, attempt](const boost::system::error_code& ec) {
+        if (ec != boost::asio::error::operation_aborted)
+            account(attempt, false);
+    }));
+    attempt->socket.async_connect(
+        _endpoint, m_io_strand.wrap([this, attempt](const boost::system::error_code& ec) {
+            account(attempt, !ec);
+        }));
+}
+
+void LatencyProbe::account(std::shared_ptr<Attempt> _attempt, bool _reached)
+{
+    if (_attempt->done)
+        return;
+    _attempt->done = true;
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - _attempt->start);
+
+    boost::system::error_code ignored;
+    _attempt->timer.cancel(ignored);
+    _attempt->socket.close(ignored);
+
+    std::lock_guard<std::mutex> l(m_mutex);
+    for (auto& a : m_targets[_attempt->key].addresses)
+    {
+        if (a.endpoint != _attempt->endpoint)
+            continue;
+        a.reached = _reached;
+        if (!_reached)
+            a.failures++;
+        else if (!a.rtt)
+            a.rtt = double(elapsed.count());
+        else
+            a.rtt += c_alpha * (double(elapsed.count()) - a.rtt);
+    }
+}
+
+unsigned LatencyProbe::rtt(const URI& _uri)
+{
+    std::lock_guard<std::mutex> l(m_mutex);
+    auto it = m_targets.find(key(_uri));
+    if (it == m_targets.end())
+        return 0;
+
+    double best = 0;
+    for (auto& a : it->second.addresses)
+        if (a.reached && a.rtt && (!best || a.rtt < best))
+            best = a.rtt;
+    return unsigned(best);
+}
+
+bool LatencyProbe::reachable(const URI& _uri)
+{
+    std::lock_guard<std::mutex> l(m_mutex);
+    auto it = m_targets.find(key(_uri));
+    if (it == m_targets.end())
+        return false;
+    return std::any_of(it->second.addresses.begin(), it->second.addresses.end(),
+        [](const Address& _a) { return _a.reached; });
+}
+
+void LatencyProbe::sort(const URI& _uri, std::vector<tcp::endpoint>& _endpoints)
+{
+    std::map<tcp::endpoint, double> rtts;
+    {
+        std::lock_guard<std::mutex> l(m_mutex);
+        auto it = m_targets.find(key(_uri));
+        if (it == m_targets.end())
+            return;
+        for (auto& a : it->second.addresses)
+            if (a.reached && a.rtt)
+                rtts[a.endpoint] = a.rtt;
+    }
+
+    std::stable_sort(_endpoints.begin(), _endpoints.end(),
+        [&](const tcp::endpoint& _a, const tcp::endpoint& _b) {
+            auto a = rtts.find(_a);
+            auto b = rtts.find(_b);
+            if (a == rtts.end())
+                return false;
+            return b == rtts.end() || a->second < b->second;
+        });
+}
+
+void LatencyProbe::noteJob(const URI& _uri, int _block)
+{
+    if (_block < 0)
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> l(m_mutex);
+
+    // First pool notifying a block sets its arrival
+    auto it = m_blocks.find(_block);
+    if (it == m_blocks.end())
+    {
+        if (m_blocks.size() >= c_blocksKept)
+        {
+            if (_block < m_blocks.begin()->first)
+                return;
+            m_blocks.erase(m_blocks.begin());
+        }
+        it = m_blocks.emplace(_block, now).first;
+    }
+
+    // Only the first job of a block from this pool counts
+    Target& t = m_targets[key(_uri)];
+    if (_block <= t.lastBlock)
+        return;
+    t.lastBlock = _block;
+    auto lag = std::chrono::duration_cast<std::chrono::microseconds>(now - it->second);
+    if (lag > std::chrono::seconds(30))
+        return;
+    if (!t.jobs++)
+        t.jobLag = double(lag.count());
+    else
+        t.jobLag += c_alpha * (double(lag.count()) - t.jobLag);
+}
+
+Json::Value LatencyProbe::json(const URI& _uri)
+{
+    Json::Value jRes;
+    std::lock_guard<std::mutex> l(m_mutex);
+    auto it = m_targets.find(key(_uri));
+    if (it == m_targets.end())
+        return jRes;
+
+    double best = 0;
+    Json::Value jAddresses = Json::Value(Json::arrayValue);
+    for (auto& a : it->second.addresses)
+    {
+        Json::Value jAddr;
+        jAddr["address"] = a.endpoint.address().to_string() + ":" + to_string(a.endpoint.port());
+        jAddr["reachable"] = a.reached;
+        jAddr["rtt"] = double(unsigned(a.rtt / 10)) / 100;  // Milliseconds
+        jAddr["failures"] = a.failures;
+        jAddresses.append(jAddr);
+        if (a.reached && a.rtt && (!best || a.rtt < best))
+            best = a.rtt;
+    }
+    jRes["rtt"] = double(unsigned(best / 10)) / 100;
+    jRes["joblag"] = double(unsigned(it->second.jobLag / 10)) / 100;
+    jRes["endpoints"] = jAddresses;
+    return jRes;
+}
+
+}  // namespace eth
+}  // namespace dev
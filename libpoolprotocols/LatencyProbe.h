@@ -0,0 +1,112 @@
+/*
+    This file is part of ethminer.
+
+    ethminer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ethminer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include <json/json.h>
+
+#include "PoolURI.h"
+
+namespace dev
+{
+namespace eth
+{
+/**
+ * @brief Measures how far pools are.
+ *
+ * Each round resolves every probed host and times a TCP connect (one
+ * round trip) to each address it resolves to. Times are smoothed per
+ * address. Besides, the arrival of new blocks is compared across the
+ * connections receiving jobs, giving how late each pool notifies them.
+ *
+ * Rounds run asynchronously on the global io_service. Statistics may
+ * be read from any thread.
+ */
+class LatencyProbe
+{
+public:
+    LatencyProbe(boost::asio::io_service& _io_service);
+    ~LatencyProbe();
+
+    static LatencyProbe* p() { return m_this; }  // nullptr when not probing
+
+    /// Starts a probing round of the given pools
+    void probe(const std::vector<std::shared_ptr<URI>>& _connections);
+
+    /// Best smoothed round trip (microseconds) among the addresses of _uri. 0 if unknown
+    unsigned rtt(const URI& _uri);
+
+    /// Whether the last round reached at least one address of _uri
+    bool reachable(const URI& _uri);
+
+    /// Orders _endpoints of _uri by increasing round trip, unknown ones last
+    void sort(const URI& _uri, std::vector<boost::asio::ip::tcp::endpoint>& _endpoints);
+
+    /// Accounts a job of _block received from _uri
+    void noteJob(const URI& _uri, int _block);
+
+    /// Statistics of _uri for the API
+    Json::Value json(const URI& _uri);
+
+private:
+    struct Address
+    {
+        boost::asio::ip::tcp::endpoint endpoint;
+        double rtt = 0;  // Smoothed, microseconds
+        unsigned failures = 0;
+        bool reached = false;  // During last round
+    };
+
+    struct Target
+    {
+        std::vector<Address> addresses;
+        double jobLag = 0;  // Smoothed, microseconds behind the first pool
+        unsigned jobs = 0;
+        int lastBlock = -1;
+    };
+
+    struct Attempt;
+
+    static std::string key(const URI& _uri);
+    void resolved(const std::string& _key, const boost::system::error_code& ec,
+        boost::asio::ip::tcp::resolver::iterator i, std::shared_ptr<boost::asio::ip::tcp::resolver>);
+    void connect(const std::string& _key, boost::asio::ip::tcp::endpoint _endpoint);
+    void account(std::shared_ptr<Attempt> _attempt, bool _reached);
+
+    boost::asio::io_service& m_io_service;
+    boost::asio::io_service::strand m_io_strand;
+
+    std::mutex m_mutex;
+    std::map<std::string, Target> m_targets;  // By host:port
+
+    // Arrival of most recent blocks
+    std::map<int, std::chrono::steady_clock::time_point> m_blocks;
+
+    static LatencyProbe* m_this;
+};
+
+}  // namespace eth
+}  // namespace dev
@@ -6,6 +6,7 @@
 
 #include <libethcore/Miner.h>
 #include <libpoolprotocols/PoolURI.h>
+#include <libpoolprotocols/TrafficCapture.h>
 
 extern boost::asio::io_service g_io_service;
 
@@ -102,7 +103,27 @@ public:
     void onConnected(Connected const& _handler) { m_onConnected = _handler; }
     void onWorkReceived(WorkReceived const& _handler) { m_onWorkReceived = _handler; }
 
+    // Records the traffic of the client into _capture (nullptr stops).
+    // Only clients with a line based protocol record anything
+    virtual void setCapture(std::shared_ptr<TrafficCapture> _capture)
+    {
+        std::atomic_store(&m_capture, std::move(_capture));
+    }
+
 protected:
+    void capture(TrafficCapture::Direction _direction, const char* _data, size_t _size)
+    {
+        auto capture = std::atomic_load(&m_capture);
+        if (capture)
+            capture->record(_direction, _data, _size);
+    }
+    void capture(TrafficCapture::Direction _direction, const std::string& _text)
+    {
+        capture(_direction, _text.data(), _text.size());
+    }
+
+    std::shared_ptr<TrafficCapture> m_capture;
+
     unique_ptr<Session> m_session = nullptr;
 
     std::atomic<bool> m_connected = {false};  // This is related to socket ! Not session
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <chrono>
 
 #include "PoolManager.h"
@@ -13,7 +14,9 @@ PoolManager::PoolManager(PoolSettings _settings)
     m_io_strand(g_io_service),
     m_failovertimer(g_io_service),
     m_submithrtimer(g_io_service),
-    m_reconnecttimer(g_io_service)
+    m_reconnecttimer(g_io_service),
+    m_standbytimer(g_io_service),
+    m_probetimer(g_io_service)
 {
     DEV_BUILD_LOG_PROGRAMFLOW(cnote, "PoolManager::PoolManager() begin");
 
@@ -21,6 +24,9 @@ PoolManager::PoolManager(PoolSettings _settings)
 
     m_currentWp.header = h256();
 
+    if (!m_Settings.captureFile.empty())
+        m_capture = std::make_shared<TrafficCapture>(m_Settings.captureFile);
+
     Farm::f().onMinerRestart([&]() {
         cnote << "Restart miners...";
 
@@ -35,20 +41,9 @@ PoolManager::PoolManager(PoolSettings _settings)
     });
 
     Farm::f().onSolutionFound([&](const Solution& sol) {
-        // Solution should passthrough only if client is
-        // properly connected. Otherwise we'll have the bad behavior
-        // to log nonce submission but receive no response
-
-        if (p_client && p_client->isConnected())
-        {
-            p_client->submitSolution(sol);
-        }
-        else
-        {
+        if (!submit(sol))
             cnote << string(EthOrange "Solution 0x") + toHex(sol.nonce)
                   << " wasted. Waiting for connection...";
-        }
-
         return false;
     });
 
@@ -58,68 +53,9 @@ PoolManager::PoolManager(PoolSettings _settings)
 
 void PoolManager::setClientHandlers()
 {
-    p_client->onConnected([&]() {
-        {
-
-            // If HostName is already an IP address no need to append the
-            // effective ip address.
-            if (p_client->getConnection()->HostNameType() == dev::UriHostNameType::Dns ||
-                p_client->getConnection()->HostNameType() == dev::UriHostNameType::Basic)
-            {
-                string ep = p_client->ActiveEndPoint();
-                if (!ep.empty())
-                    m_selectedHost = p_client->getConnection()->Host() + ep;
-            }
-
-            cnote << "Established connection to " << m_selectedHost;
-            m_connectionAttempt = 0;
+    p_client->setCapture(m_capture);
 
-            // Reset current WorkPackage
-            m_currentWp.job.clear();
-            m_currentWp.header = h256();
-
-            // Shuffle if needed
-            if (Farm::f().get_ergodicity() == 1U)
-                Farm::f().shuffle();
-
-            // Rough implementation to return to primary pool
-            // after specified amount of time
-            if (m_activeConnectionIdx != 0 && m_Settings.poolFailoverTimeout)
-            {
-                m_failovertimer.expires_from_now(
-                    boost::posix_time::minutes(m_Settings.poolFailoverTimeout));
-                m_failovertimer.async_wait(m_io_strand.wrap(boost::bind(
-                    &PoolManager::failovertimer_elapsed, this, boost::asio::placeholders::error)));
-            }
-            else
-            {
-                m_failovertimer.cancel();
-            }
-        }
-
-        if (!Farm::f().isMining())
-        {
-            cnote << "Spinning up miners...";
-            Farm::f().start();
-        }
-        else if (Farm::f().paused())
-        {
-            cnote << "Resume mining ...";
-            Farm::f().resume();
-        }
-
-        // Activate timing for HR submission
-        if (m_Settings.reportHashrate)
-        {
-            m_submithrtimer.expires_from_now(boost::posix_time::seconds(m_Settings.hashRateInterval));
-            m_submithrtimer.async_wait(m_io_strand.wrap(boost::bind(
-                &PoolManager::submithrtimer_elapsed, this, boost::asio::placeholders::error)));
-        }
-
-        // Signal async operations have completed
-        m_async_pending.store(false, std::memory_order_relaxed);
-
-    });
+    p_client->onConnected([&]() { clientConnected(); });
 
     p_client->onDisconnected([&]() {
         cnote << "Disconnected from " << m_selectedHost;
@@ -147,80 +83,434 @@ void PoolManager::setClientHandlers()
             m_async_pending.store(true, std::memory_order_relaxed);
 
             // Suspend mining and submit new connection request
-            cnote << "No connection. Suspend mining ...";
-            Farm::f().pause();
+            if (StratumProxy::p())
+            {
+                cnote << "No connection. Suspend proxied mining ...";
+                StratumProxy::p()->suspend();
+            }
+            else
+            {
+                cnote << "No connection. Suspend mining ...";
+                Farm::f().pause();
+            }
             g_io_service.post(m_io_strand.wrap(boost::bind(&PoolManager::rotateConnect, this)));
         }
     });
 
-    p_client->onWorkReceived([&](WorkPackage const& wp) {
+    p_client->onWorkReceived([&](WorkPackage const& wp) { workReceived(wp); });
 
-        // Should not happen !
-        if (!wp)
-            return;
+    p_client->onSolutionAccepted(
+        [&](std::chrono::milliseconds const& _responseDelay, unsigned const& _minerIdx, bool _asStale) {
+            std::stringstream ss;
+            ss << std::setw(4) << std::setfill(' ') << _responseDelay.count() << " ms. "
+               << m_selectedHost;
+            cnote << EthLime "**Accepted" << (_asStale ? " stale": "") << EthReset << ss.str();
+            if (StratumProxy::isTag(_minerIdx) && StratumProxy::p())
+            {
+                StratumProxy::p()->shareResult(_minerIdx, true);
+            }
+            else
+            {
+                Farm::f().accountSolution(_minerIdx, SolutionAccountingEnum::Accepted);
+                Farm::f().accountAcceptLatency(_minerIdx, _responseDelay);
+            }
+            {
+                std::lock_guard<std::mutex> l(m_acceptLatencyMutex);
+                auto& histogram = m_acceptLatency[latencyKey(*p_client->getConnection())];
+                if (!histogram)
+                    histogram.reset(new LatencyHistogram());
+                histogram->record(_responseDelay);
+            }
+        });
+
+    p_client->onSolutionRejected(
+        [&](std::chrono::milliseconds const& _responseDelay, unsigned const& _minerIdx) {
+            std::stringstream ss;
+            ss << std::setw(4) << std::setfill(' ') << _responseDelay.count() << " ms. "
+               << m_selectedHost;
+            cwarn << EthRed "**Rejected" EthReset << ss.str();
+            if (StratumProxy::isTag(_minerIdx) && StratumProxy::p())
+                StratumProxy::p()->shareResult(_minerIdx, false);
+            else
+                Farm::f().accountSolution(_minerIdx, SolutionAccountingEnum::Rejected);
+        });
+}
+
+void PoolManager::clientConnected()
+{
+    // If HostName is already an IP address no need to append the
+    // effective ip address.
+    if (p_client->getConnection()->HostNameType() == dev::UriHostNameType::Dns ||
+        p_client->getConnection()->HostNameType() == dev::UriHostNameType::Basic)
+    {
+        string ep = p_client->ActiveEndPoint();
+        if (!ep.empty())
+            m_selectedHost = p_client->getConnection()->Host() + ep;
+    }
+
+    cnote << "Established connection to " << m_selectedHost;
+    m_connectionAttempt = 0;
+    m_activeSince = std::chrono::steady_clock::now();
+    m_latencyVotes = 0;
+
+    // Reset current WorkPackage
+    m_currentWp.job.clear();
+    m_currentWp.header = h256();
+    m_newSession = true;
+
+    // Shuffle if needed
+    if (Farm::f().get_ergodicity() == 1U)
+        Farm::f().shuffle();
 
-        int _currentEpoch = m_currentWp.epoch;
-        bool newEpoch = (_currentEpoch == -1);
+    // Rough implementation to return to primary pool
+    // after specified amount of time
+    if (m_activeConnectionIdx != 0 && m_Settings.poolFailoverTimeout)
+    {
+        m_failovertimer.expires_from_now(
+            boost::posix_time::minutes(m_Settings.poolFailoverTimeout));
+        m_failovertimer.async_wait(m_io_strand.wrap(boost::bind(
+            &PoolManager::failovertimer_elapsed, this, boost::asio::placeholders::error)));
+    }
+    else
+    {
+        m_failovertimer.cancel();
+    }
 
-        // In EthereumStratum/2.0.0 epoch number is set in session
-        if (!newEpoch)
+    if (StratumProxy::p())
+    {
+        // Proxied miners are given work as soon as it comes
+    }
+    else if (!Farm::f().isMining())
+    {
+        cnote << "Spinning up miners...";
+        Farm::f().start();
+    }
+    else if (Farm::f().paused())
+    {
+        cnote << "Resume mining ...";
+        Farm::f().resume();
+    }
+
+    // Activate timing for HR submission
+    if (m_Settings.reportHashrate)
+    {
+        m_submithrtimer.expires_from_now(boost::posix_time::seconds(m_Settings.hashRateInterval));
+        m_submithrtimer.async_wait(m_io_strand.wrap(boost::bind(
+            &PoolManager::submithrtimer_elapsed, this, boost::asio::placeholders::error)));
+    }
+
+    // Signal async operations have completed
+    m_async_pending.store(false, std::memory_order_relaxed);
+
+    // Keep the next pools ready for failover
+    refreshStandby();
+}
+
+void PoolManager::workReceived(WorkPackage const& wp)
+{
+    // Should not happen !
+    if (!wp)
+        return;
+
+    if (m_probe)
+        m_probe->noteJob(*p_client->getConnection(), wp.block);
+
+    int _currentEpoch = m_currentWp.epoch;
+    bool newEpoch = (_currentEpoch == -1);
+
+    // In EthereumStratum/2.0.0 epoch number is set in session
+    if (!newEpoch)
+    {
+        if (p_client->getConnection()->StratumMode() == 3)
+            newEpoch = (wp.epoch != m_currentWp.epoch);
+        else
+            newEpoch = (wp.seed != m_currentWp.seed);
+    }
+
+    bool newDiff = (wp.boundary != m_currentWp.boundary);
+
+    m_currentWp = wp;
+    m_currentWp.generation = ++m_jobGeneration;
+    m_currentWp.clean = wp.clean || m_newSession;
+    m_newSession = false;
+
+    if (newEpoch)
+    {
+        m_epochChanges.fetch_add(1, std::memory_order_relaxed);
+
+        // If epoch is valued in workpackage take it
+        if (wp.epoch == -1)
         {
-            if (p_client->getConnection()->StratumMode() == 3)
-                newEpoch = (wp.epoch != m_currentWp.epoch);
+            if (m_currentWp.block >= 0)
+                m_currentWp.epoch = m_currentWp.block / 30000;
             else
-                newEpoch = (wp.seed != m_currentWp.seed);
+                m_currentWp.epoch = ethash::find_epoch_number(
+                    ethash::hash256_from_bytes(m_currentWp.seed.data()));
         }
+    }
+    else
+    {
+        m_currentWp.epoch = _currentEpoch;
+    }
+
+    if (newDiff || newEpoch)
+        showMiningAt();
+
+    cnote << "Job: " EthWhite << m_currentWp.header.abridged()
+          << (m_currentWp.block != -1 ? (" block " + to_string(m_currentWp.block)) : "")
+          << EthReset << " " << m_selectedHost;
+
+    if (StratumProxy::p())
+        StratumProxy::p()->setWork(m_currentWp);
+    else
+        Farm::f().setWork(m_currentWp);
+}
+
+bool PoolManager::submit(const Solution& _sol)
+{
+    // Solution should passthrough only if client is
+    // properly connected. Otherwise we'll have the bad behavior
+    // to log nonce submission but receive no response
+    if (!p_client || !p_client->isConnected())
+        return false;
+    p_client->submitSolution(_sol);
+    return true;
+}
+
+PoolClient* PoolManager::createClient(const URI& _uri)
+{
+    if (_uri.Family() == ProtocolFamily::GETWORK)
+        return new EthGetworkClient(
+            m_Settings.noWorkTimeout, m_Settings.getWorkPollInterval, m_Settings.getWorkLongPoll);
+    if (_uri.Family() == ProtocolFamily::STRATUM)
+        return new EthStratumClient(m_Settings.noWorkTimeout, m_Settings.noResponseTimeout);
+    if (_uri.Family() == ProtocolFamily::SIMULATION && !m_Settings.replayFile.empty())
+        return new ReplayClient(m_Settings.replayFile, m_Settings.replaySpeed);
+    if (_uri.Family() == ProtocolFamily::SIMULATION)
+        return new SimulateClient(m_Settings.simulation);
+    return nullptr;
+}
+
+bool PoolManager::promoteStandby(unsigned int idx)
+{
+    auto it = std::find_if(m_standby.begin(), m_standby.end(), [&](const Standby& _s) {
+        return _s.uri == m_Settings.connections.at(idx);
+    });
+    if (it == m_standby.end() || it->dropping || it->state != Standby::Ready ||
+        !it->client->isConnected() || !it->client->isAuthorized())
+        return false;
+
+    // The standby client becomes the active one as it is : no new
+    // handshake and its latest job can be mined straight away
+    m_selectedHost = it->uri->Host() + ":" + to_string(it->uri->Port());
+    cnote << "Switching to standby pool " << m_selectedHost;
+
+    WorkPackage wp = it->wp;
+    p_client = std::move(it->client);
+    m_standby.erase(it);
+    m_standbyCount.store(unsigned(m_standby.size()), std::memory_order_relaxed);
 
-        bool newDiff = (wp.boundary != m_currentWp.boundary);
+    // Handlers below (failover timer, standby refresh) work on
+    // the active connection : it has to be the new one already
+    if (idx != m_activeConnectionIdx)
+        m_connectionSwitches.fetch_add(1, std::memory_order_relaxed);
+    m_activeConnectionIdx = idx;
 
-        m_currentWp = wp;
+    setClientHandlers();
+    clientConnected();
+    if (wp)
+        workReceived(wp);
+    return true;
+}
 
-        if (newEpoch)
+void PoolManager::refreshStandby()
+{
+    // Pools wanted in standby : the ones following the active connection
+    // up to the first "exit" failover
+    std::vector<std::shared_ptr<URI>> wanted;
+    size_t count = m_Settings.connections.size();
+    if (!m_stopping.load(std::memory_order_relaxed))
+    {
+        for (size_t i = 1; i < count && wanted.size() < m_Settings.hotStandby; i++)
         {
-            m_epochChanges.fetch_add(1, std::memory_order_relaxed);
+            auto& uri = m_Settings.connections.at((m_activeConnectionIdx + i) % count);
+            if (uri->Host() == "exit")
+                break;
+            if (uri->IsUnrecoverable() || uri->Family() == ProtocolFamily::SIMULATION)
+                continue;
+            wanted.push_back(uri);
+        }
+    }
 
-            // If epoch is valued in workpackage take it
-            if (wp.epoch == -1)
+    // Release the ones not wanted anymore. Clients with a connection in
+    // progress are released by standbyDisconnected
+    for (auto it = m_standby.begin(); it != m_standby.end();)
+    {
+        if (!it->dropping && std::find(wanted.begin(), wanted.end(), it->uri) == wanted.end())
+        {
+            if (it->state == Standby::Idle)
             {
-                if (m_currentWp.block >= 0)
-                    m_currentWp.epoch = m_currentWp.block / 30000;
-                else
-                    m_currentWp.epoch = ethash::find_epoch_number(
-                        ethash::hash256_from_bytes(m_currentWp.seed.data()));
+                it = m_standby.erase(it);
+                continue;
             }
+            it->dropping = true;
+            if (it->state == Standby::Ready)
+                it->client->disconnect();
         }
-        else
+        it++;
+    }
+
+    for (auto& uri : wanted)
+    {
+        if (std::find_if(m_standby.begin(), m_standby.end(),
+                [&](const Standby& _s) { return _s.uri == uri; }) != m_standby.end())
+            continue;
+
+        m_standby.emplace_back();
+        Standby* sb = &m_standby.back();
+        sb->uri = uri;
+        sb->client.reset(createClient(*uri));
+        sb->client->setConnection(uri);
+        sb->client->onConnected([this, sb]() {
+            if (sb->dropping)
+            {
+                sb->client->disconnect();
+                return;
+            }
+            sb->state = Standby::Ready;
+            cnote << "Standby connection to " << sb->uri->Host() << ":" << sb->uri->Port()
+                  << sb->client->ActiveEndPoint() << " ready";
+        });
+        sb->client->onDisconnected([this, sb]() {
+            g_io_service.post(
+                m_io_strand.wrap(boost::bind(&PoolManager::standbyDisconnected, this, sb)));
+        });
+        sb->client->onWorkReceived([this, sb](WorkPackage const& wp) {
+            sb->wp = wp;
+            if (m_probe)
+                m_probe->noteJob(*sb->uri, wp.block);
+        });
+    }
+    m_standbyCount.store(unsigned(m_standby.size()), std::memory_order_relaxed);
+
+    auto now = std::chrono::steady_clock::now();
+    for (auto& sb : m_standby)
+    {
+        if (sb.state == Standby::Idle && !sb.dropping && now >= sb.retry)
         {
-            m_currentWp.epoch = _currentEpoch;
+            sb.state = Standby::Connecting;
+            sb.client->connect();
         }
+    }
+}
 
-        if (newDiff || newEpoch)
-            showMiningAt();
+void PoolManager::standbyDisconnected(Standby* _standby)
+{
+    auto it = std::find_if(
+        m_standby.begin(), m_standby.end(), [&](const Standby& _s) { return &_s == _standby; });
+    if (it == m_standby.end())
+        return;
 
-        cnote << "Job: " EthWhite << m_currentWp.header.abridged()
-              << (m_currentWp.block != -1 ? (" block " + to_string(m_currentWp.block)) : "")
-              << EthReset << " " << m_selectedHost;
+    if (it->dropping || m_stopping.load(std::memory_order_relaxed))
+    {
+        m_standby.erase(it);
+        m_standbyCount.store(unsigned(m_standby.size()), std::memory_order_relaxed);
+        return;
+    }
 
-        Farm::f().setWork(m_currentWp);
-    });
+    if (it->state == Standby::Ready)
+        cnote << "Standby connection to " << it->uri->Host() << ":" << it->uri->Port()
+              << " lost";
 
-    p_client->onSolutionAccepted(
-        [&](std::chrono::milliseconds const& _responseDelay, unsigned const& _minerIdx, bool _asStale) {
-            std::stringstream ss;
-            ss << std::setw(4) << std::setfill(' ') << _responseDelay.count() << " ms. "
-               << m_selectedHost;
-            cnote << EthLime "**Accepted" << (_asStale ? " stale": "") << EthReset << ss.str();
-            Farm::f().accountSolution(_minerIdx, SolutionAccountingEnum::Accepted);
-        });
+    // Retried by standbytimer
+    it->state = Standby::Idle;
+    it->wp = WorkPackage();
+    it->retry = std::chrono::steady_clock::now() +
+                std::chrono::seconds(std::max(10u, m_Settings.delayBeforeRetry));
+}
 
-    p_client->onSolutionRejected(
-        [&](std::chrono::milliseconds const& _responseDelay, unsigned const& _minerIdx) {
-            std::stringstream ss;
-            ss << std::setw(4) << std::setfill(' ') << _responseDelay.count() << " ms. "
-               << m_selectedHost;
-            cwarn << EthRed "**Rejected" EthReset << ss.str();
-            Farm::f().accountSolution(_minerIdx, SolutionAccountingEnum::Rejected);
-        });
+void PoolManager::standbytimer_elapsed(const boost::system::error_code& ec)
+{
+    if (ec || !m_running.load(std::memory_order_relaxed))
+        return;
+
+    refreshStandby();
+
+    m_standbytimer.expires_from_now(boost::posix_time::seconds(5));
+    m_standbytimer.async_wait(m_io_strand.wrap(boost::bind(
+        &PoolManager::standbytimer_elapsed, this, boost::asio::placeholders::error)));
+}
+
+void PoolManager::selectLowLatency()
+{
+    // Only switch away from a steady connection
+    if (!p_client || !p_client->isConnected() || m_async_pending.load(std::memory_order_relaxed) ||
+        std::chrono::steady_clock::now() - m_activeSince < std::chrono::minutes(1))
+        return;
+
+    unsigned activeRtt = m_probe->rtt(*m_Settings.connections.at(m_activeConnectionIdx));
+    if (!activeRtt)
+        return;
+
+    // Nearest reachable pool before any "exit" failover
+    unsigned best = m_activeConnectionIdx;
+    unsigned bestRtt = activeRtt;
+    for (unsigned i = 0; i < m_Settings.connections.size(); i++)
+    {
+        auto& uri = m_Settings.connections.at(i);
+        if (uri->Host() == "exit")
+            break;
+        if (uri->IsUnrecoverable() || uri->Family() == ProtocolFamily::SIMULATION ||
+            !m_probe->reachable(*uri))
+            continue;
+        unsigned rtt = m_probe->rtt(*uri);
+        if (rtt && rtt < bestRtt)
+        {
+            best = i;
+            bestRtt = rtt;
+        }
+    }
+
+    // Hysteresis : the other pool has to be clearly nearer (by 25% and
+    // at least 5 ms) on two probes in a row
+    if (best == m_activeConnectionIdx || bestRtt * 4 > activeRtt * 3 || activeRtt - bestRtt < 5000)
+    {
+        m_latencyVotes = 0;
+        return;
+    }
+    if (best != m_latencyCandidate)
+    {
+        m_latencyCandidate = best;
+        m_latencyVotes = 0;
+    }
+    if (++m_latencyVotes < 2)
+        return;
+
+    cnote << "Switching to nearer pool " << m_Settings.connections.at(best)->Host() << " ("
+          << bestRtt / 1000 << " ms vs " << activeRtt / 1000 << " ms)";
+    m_latencyVotes = 0;
+    try
+    {
+        setActiveConnectionCommon(best);
+    }
+    catch (const std::exception&)
+    {
+        // Outstanding operations : retried on next probe
+    }
+}
+
+void PoolManager::probetimer_elapsed(const boost::system::error_code& ec)
+{
+    if (ec || !m_running.load(std::memory_order_relaxed))
+        return;
+
+    // Selection uses the results of previous rounds
+    selectLowLatency();
+    m_probe->probe(m_Settings.connections);
+
+    m_probetimer.expires_from_now(boost::posix_time::seconds(m_Settings.latencyProbeInterval));
+    m_probetimer.async_wait(m_io_strand.wrap(boost::bind(
+        &PoolManager::probetimer_elapsed, this, boost::asio::placeholders::error)));
 }
 
 void PoolManager::stop()
@@ -231,6 +521,11 @@ void PoolManager::stop()
         m_async_pending.store(true, std::memory_order_relaxed);
         m_stopping.store(true, std::memory_order_relaxed);
 
+        // Release standby connections
+        m_standbytimer.cancel();
+        m_probetimer.cancel();
+        g_io_service.post(m_io_strand.wrap(boost::bind(&PoolManager::refreshStandby, this)));
+
         if (p_client && p_client->isConnected())
         {
             p_client->disconnect();
@@ -253,6 +548,10 @@ void PoolManager::stop()
                 Farm::f().stop();
             }
         }
+
+        // Give standby connections a chance to close gracefully
+        for (unsigned i = 0; i < 50 && m_standbyCount.load(std::memory_order_relaxed); i++)
+            this_thread::sleep_for(chrono::milliseconds(100));
     }
     DEV_BUILD_LOG_PROGRAMFLOW(cnote, "PoolManager::stop() end");
 }
@@ -307,6 +606,7 @@ void PoolManager::setActiveConnectionCommon(unsigned int idx)
         m_connectionSwitches.fetch_add(1, std::memory_order_relaxed);
         m_activeConnectionIdx = idx;
         m_connectionAttempt = 0;
+        m_switchRequested = true;
         p_client->disconnect();
     }
     else
@@ -363,17 +663,52 @@ Json::Value PoolManager::getConnectionsJson()
         JConn["index"] = (unsigned)i;
         JConn["active"] = (i == m_activeConnectionIdx ? true : false);
         JConn["uri"] = m_Settings.connections[i]->str();
+        if (m_probe)
+            JConn["probe"] = m_probe->json(*m_Settings.connections[i]);
         jRes.append(JConn);
     }
     return jRes;
 }
 
+std::string PoolManager::latencyKey(const URI& _uri)
+{
+    return _uri.Host() + ":" + std::to_string(_uri.Port());
+}
+
+LatencyHistogram::Snapshot PoolManager::getAcceptLatency(unsigned int idx)
+{
+    if (idx >= m_Settings.connections.size())
+        return LatencyHistogram::Snapshot();
+    std::string key = latencyKey(*m_Settings.connections.at(idx));
+
+    std::lock_guard<std::mutex> l(m_acceptLatencyMutex);
+    auto it = m_acceptLatency.find(key);
+    if (it == m_acceptLatency.end())
+        return LatencyHistogram::Snapshot();
+    return it->second->snapshot();
+}
+
 void PoolManager::start()
 {
     m_running.store(true, std::memory_order_relaxed);
     m_async_pending.store(true, std::memory_order_relaxed);
     m_connectionSwitches.fetch_add(1, std::memory_order_relaxed);
     g_io_service.post(m_io_strand.wrap(boost::bind(&PoolManager::rotateConnect, this)));
+
+    if (m_Settings.hotStandby)
+    {
+        m_standbytimer.expires_from_now(boost::posix_time::seconds(5));
+        m_standbytimer.async_wait(m_io_strand.wrap(boost::bind(
+            &PoolManager::standbytimer_elapsed, this, boost::asio::placeholders::error)));
+    }
+
+    if (m_Settings.latencyProbeInterval)
+    {
+        if (!m_probe)
+            m_probe.reset(new LatencyProbe(g_io_service));
+        g_io_service.post(m_io_strand.wrap(
+            boost::bind(&PoolManager::probetimer_elapsed, this, boost::system::error_code())));
+    }
 }
 
 void PoolManager::rotateConnect()
@@ -381,6 +716,9 @@ void PoolManager::rotateConnect()
     if (p_client && p_client->isConnected())
         return;
 
+    bool switchRequested = m_switchRequested;
+    m_switchRequested = false;
+
     // Check we're within bounds
     if (m_activeConnectionIdx >= m_Settings.connections.size())
         m_activeConnectionIdx = 0;
@@ -418,14 +756,23 @@ void PoolManager::rotateConnect()
         if (p_client)
             p_client = nullptr;
 
-        if (m_Settings.connections.at(m_activeConnectionIdx)->Family() == ProtocolFamily::GETWORK)
-            p_client =
-                std::unique_ptr<PoolClient>(new EthGetworkClient(m_Settings.noWorkTimeout, m_Settings.getWorkPollInterval));
-        if (m_Settings.connections.at(m_activeConnectionIdx)->Family() == ProtocolFamily::STRATUM)
-            p_client = std::unique_ptr<PoolClient>(
-                new EthStratumClient(m_Settings.noWorkTimeout, m_Settings.noResponseTimeout));
-        if (m_Settings.connections.at(m_activeConnectionIdx)->Family() == ProtocolFamily::SIMULATION)
-            p_client = std::unique_ptr<PoolClient>(new SimulateClient(m_Settings.benchmarkBlock));
+        // Swap in a connected standby : the requested pool if any,
+        // otherwise the first one following the lost connection
+        if (m_Settings.hotStandby)
+        {
+            size_t count = m_Settings.connections.size();
+            for (size_t i = 0; i < count && (i == 0 || !switchRequested); i++)
+            {
+                unsigned idx = unsigned((m_activeConnectionIdx + i) % count);
+                if (m_Settings.connections.at(idx)->Host() == "exit")
+                    break;
+                if (promoteStandby(idx))
+                    return;
+            }
+        }
+
+        p_client = std::unique_ptr<PoolClient>(
+            createClient(*m_Settings.connections.at(m_activeConnectionIdx)));
 
         if (p_client)
             setClientHandlers();
@@ -494,6 +841,7 @@ void PoolManager::failovertimer_elapsed(const boost::system::error_code& ec)
                 m_activeConnectionIdx = 0;
                 m_connectionAttempt = 0;
                 m_connectionSwitches.fetch_add(1, std::memory_order_relaxed);
+                m_switchRequested = true;
                 cnote << "Failover timeout reached, retrying connection to primary pool";
                 p_client->disconnect();
             }
@@ -509,7 +857,12 @@ void PoolManager::submithrtimer_elapsed(const boost::system::error_code& ec)
         {
 
             if (p_client && p_client->isConnected())
-                p_client->submitHashrate((uint32_t)Farm::f().HashRate(), m_Settings.hashRateId);
+            {
+                // A proxy reports the sum of what its miners report
+                uint64_t rate = StratumProxy::p() ? StratumProxy::p()->hashRate() :
+                                                    (uint32_t)Farm::f().HashRate();
+                p_client->submitHashrate(rate, m_Settings.hashRateId);
+            }
 
             // Resubmit actor
             m_submithrtimer.expires_from_now(boost::posix_time::seconds(m_Settings.hashRateInterval));
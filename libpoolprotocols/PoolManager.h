@@ -1,16 +1,23 @@
 #pragma once
 
 #include <iostream>
+#include <list>
+#include <map>
+#include <mutex>
 
 #include <json/json.h>
 
+#include <libdevcore/Histogram.h>
 #include <libdevcore/Worker.h>
 #include <libethcore/Farm.h>
 #include <libethcore/Miner.h>
 
+#include "LatencyProbe.h"
 #include "PoolClient.h"
 #include "getwork/EthGetworkClient.h"
+#include "proxy/StratumProxy.h"
 #include "stratum/EthStratumClient.h"
+#include "testing/ReplayClient.h"
 #include "testing/SimulateClient.h"
 
 using namespace std;
@@ -23,6 +30,7 @@ struct PoolSettings
 {
     std::vector<std::shared_ptr<URI>> connections;  // List of connection definitions
     unsigned getWorkPollInterval = 500;             // Interval (ms) between getwork requests
+    bool getWorkLongPoll = false;                   // Use long polling when the node offers it
     unsigned noWorkTimeout = 180;       // If no new jobs in this number of seconds drop connection
     unsigned noResponseTimeout = 2;     // If no response in this number of seconds drop connection
     unsigned poolFailoverTimeout = 0;   // Return to primary pool after this number of minutes
@@ -32,7 +40,12 @@ struct PoolSettings
         h256::random().hex(HexPrefix::Add);  // Unique identifier for HashRate submission
     unsigned connectionMaxRetries = 3;  // Max number of connection retries
     unsigned delayBeforeRetry = 0;      // Delay seconds before connect retry
-    unsigned benchmarkBlock = 0;        // Block number used by SimulateClient to test performances
+    SimulationSettings simulation;      // Workload generated by SimulateClient to test performances
+    unsigned hotStandby = 0;            // Number of next pools kept connected for failover
+    unsigned latencyProbeInterval = 0;  // Seconds between latency probes (0 = select in order)
+    std::string captureFile;            // Records the traffic of the active connection
+    std::string replayFile;             // Capture replayed by simulation instead of a fixed job
+    float replaySpeed = 1.0f;           // Replay time scale (2 = twice as fast)
 };
 
 class PoolManager
@@ -46,6 +59,7 @@ public:
     void setActiveConnection(unsigned int idx);
     void setActiveConnection(std::string& _connstring);
     std::shared_ptr<URI> getActiveConnection();
+    unsigned int getActiveConnectionIdx() { return m_activeConnectionIdx; }
     void removeConnection(unsigned int idx);
     void start();
     void stop();
@@ -56,10 +70,51 @@ public:
     unsigned getConnectionSwitches();
     unsigned getEpochChanges();
 
+    /**
+     * @brief Submits a solution through the active connection
+     * @return false if not connected
+     */
+    bool submit(const Solution& _sol);
+
+    /**
+     * @brief Gets the latencies (submitted -> accepted) of a configured
+     * connection. Empty if it never accepted a solution.
+     */
+    LatencyHistogram::Snapshot getAcceptLatency(unsigned int idx);
+
 private:
     void rotateConnect();
 
     void setClientHandlers();
+    void clientConnected();
+    void workReceived(WorkPackage const& wp);
+
+    // A pool kept connected and authorized in background. Its jobs are
+    // remembered but never mined, and no hashrate is reported to it
+    struct Standby
+    {
+        enum State
+        {
+            Idle,        // Not connected, waiting for retry
+            Connecting,  // Connection in progress
+            Ready        // Connected and authorized
+        };
+        std::shared_ptr<URI> uri;
+        std::unique_ptr<PoolClient> client;
+        State state = Idle;
+        bool dropping = false;  // No longer wanted : released once disconnected
+        std::chrono::steady_clock::time_point retry;
+        WorkPackage wp;  // Latest job
+    };
+
+    PoolClient* createClient(const URI& _uri);
+    bool promoteStandby(unsigned int idx);
+    void refreshStandby();
+    void standbyDisconnected(Standby* _standby);
+    void standbytimer_elapsed(const boost::system::error_code& ec);
+
+    void selectLowLatency();
+    void probetimer_elapsed(const boost::system::error_code& ec);
 
     void showMiningAt();
 
@@ -84,15 +139,38 @@ private:
 
     WorkPackage m_currentWp;
 
+    // Jobs get increasing generations. First one of a connection
+    // invalidates all the previous ones (see WorkPackage::clean)
+    uint64_t m_jobGeneration = 0;
+    bool m_newSession = true;
+
     boost::asio::io_service::strand m_io_strand;
     boost::asio::deadline_timer m_failovertimer;
     boost::asio::deadline_timer m_submithrtimer;
     boost::asio::deadline_timer m_reconnecttimer;
+    boost::asio::deadline_timer m_standbytimer;
+    boost::asio::deadline_timer m_probetimer;
 
     std::unique_ptr<PoolClient> p_client = nullptr;
 
+    std::list<Standby> m_standby;           // Only accessed on io_service thread
+    std::atomic<unsigned> m_standbyCount = {0};
+    bool m_switchRequested = false;         // Active connection chosen by user or failover timer
+
+    std::unique_ptr<LatencyProbe> m_probe;
+
+    std::shared_ptr<TrafficCapture> m_capture;  // Of the active connection
+    std::chrono::steady_clock::time_point m_activeSince;  // Established active connection
+    unsigned m_latencyCandidate = 0;  // Nearer pool found by previous probes
+    unsigned m_latencyVotes = 0;      // Consecutive probes finding it nearer
+
     std::atomic<unsigned> m_epochChanges = {0};
 
+    // Latencies (submitted -> accepted) by pool host:port
+    std::map<std::string, std::unique_ptr<LatencyHistogram>> m_acceptLatency;
+    std::mutex m_acceptLatencyMutex;
+    static std::string latencyKey(const URI& _uri);
+
     static PoolManager* m_this;
 };
 
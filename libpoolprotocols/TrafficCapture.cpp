@@ -0,0 +1,92 @@
+/*
+    This file is part of ethminer.
+
+    ethminer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ethminer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdlib>
+#include <stdexcept>
+
+#include "TrafficCapture.h"
+
+namespace dev
+{
+namespace eth
+{
+TrafficCapture::TrafficCapture(const std::string& _path)
+  : m_out(_path, std::ios::out | std::ios::trunc), m_start(std::chrono::steady_clock::now())
+{
+    if (!m_out)
+        throw std::runtime_error("Unable to open capture file " + _path);
+}
+
+void TrafficCapture::record(Direction _direction, const char* _data, size_t _size)
+{
+    // Lines sent carry their terminator
+    while (_size && (_data[_size - 1] == '\n' || _data[_size - 1] == '\r'))
+        _size--;
+
+    auto offset = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - m_start)
+                      .count();
+
+    std::lock_guard<std::mutex> l(m_mutex);
+    m_out << offset << ' ' << char(_direction) << ' ';
+    m_out.write(_data, std::streamsize(_size));
+    m_out << '\n';
+
+    // Captures are opt in : losing the tail on exit is worse than a write per line
+    m_out.flush();
+}
+
+bool TrafficCapture::load(
+    const std::string& _path, std::vector<Record>& _records, std::string& _error)
+{
+    std::ifstream in(_path);
+    if (!in)
+    {
+        _error = "Unable to open " + _path;
+        return false;
+    }
+
+    std::string line;
+    unsigned number = 0;
+    while (std::getline(in, line))
+    {
+        number++;
+        if (line.empty())
+            continue;
+
+        char* end = nullptr;
+        uint64_t offset = std::strtoull(line.c_str(), &end, 10);
+        size_t pos = size_t(end - line.c_str());
+        if (pos == 0 || pos + 1 >= line.size() || line[pos] != ' ' ||
+            (line[pos + 1] != Inbound && line[pos + 1] != Outbound && line[pos + 1] != Event))
+        {
+            _error = "Bad record at line " + std::to_string(number) + " of " + _path;
+            return false;
+        }
+
+        Record r;
+        r.offset = offset;
+        r.direction = Direction(line[pos + 1]);
+        if (pos + 3 < line.size())
+            r.text = line.substr(pos + 3);
+        _records.push_back(std::move(r));
+    }
+    return true;
+}
+
+}  // namespace eth
+}  // namespace dev
@@ -0,0 +1,83 @@
+/*
+    This file is part of ethminer.
+
+    ethminer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ethminer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dev
+{
+namespace eth
+{
+/**
+ * @brief Recording of the lines exchanged with pools.
+ *
+ * A capture is a text file with one record per line :
+ *   <microseconds since capture start> <direction> <text>
+ * where direction is '<' for lines received, '>' for lines sent and '!'
+ * for client events ("connect host:port", "mode N", "disconnect").
+ *
+ * Records may be written from any thread.
+ */
+class TrafficCapture
+{
+public:
+    enum Direction : char
+    {
+        Inbound = '<',
+        Outbound = '>',
+        Event = '!'
+    };
+
+    struct Record
+    {
+        uint64_t offset;  // Microseconds
+        Direction direction;
+        std::string text;
+    };
+
+    /// Opens (truncates) _path. Throws std::runtime_error on failure
+    explicit TrafficCapture(const std::string& _path);
+
+    TrafficCapture(const TrafficCapture&) = delete;
+    TrafficCapture& operator=(const TrafficCapture&) = delete;
+
+    void record(Direction _direction, const char* _data, size_t _size);
+    void record(Direction _direction, const std::string& _text)
+    {
+        record(_direction, _text.data(), _text.size());
+    }
+
+    /**
+     * @brief Reads the capture in _path
+     * @return false with _error set if the file can't be read
+     */
+    static bool load(const std::string& _path, std::vector<Record>& _records, std::string& _error);
+
+private:
+    std::mutex m_mutex;
+    std::ofstream m_out;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+}  // namespace eth
+}  // namespace dev
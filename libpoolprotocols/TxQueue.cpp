@@ -0,0 +1,98 @@
+/*
+    This file is part of ethminer.
+
+    ethminer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ethminer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TxQueue.h"
+
+namespace dev
+{
+namespace eth
+{
+TxQueue::TxQueue() : m_queue(PoolSize)
+{
+    for (unsigned i = 0; i < PoolSize; i++)
+    {
+        std::string* buffer = new std::string();
+        buffer->reserve(BufferReserve);
+        m_free.push(buffer);
+    }
+    m_inflight.reserve(PoolSize);
+    m_buffers.reserve(PoolSize);
+}
+
+TxQueue::~TxQueue()
+{
+    clear();
+    m_free.consume_all([](std::string* b) { delete b; });
+}
+
+std::string* TxQueue::acquire()
+{
+    std::string* buffer;
+    if (m_free.pop(buffer))
+        return buffer;
+
+    // Pool exhausted by a burst : the extra buffer is freed on release
+    buffer = new std::string();
+    buffer->reserve(BufferReserve);
+    return buffer;
+}
+
+void TxQueue::release(std::string* _buffer)
+{
+    _buffer->clear();
+    if (!m_free.push(_buffer))
+        delete _buffer;
+}
+
+void TxQueue::push(std::string* _line)
+{
+    m_queue.push(_line);
+}
+
+size_t TxQueue::take(size_t _max)
+{
+    std::string* line;
+    while (m_inflight.size() < _max && m_queue.pop(line))
+    {
+        m_inflight.push_back(line);
+        m_buffers.push_back(boost::asio::buffer(*line));
+    }
+    return m_inflight.size();
+}
+
+void TxQueue::done()
+{
+    for (std::string* line : m_inflight)
+        release(line);
+    m_inflight.clear();
+    m_buffers.clear();
+}
+
+void TxQueue::detach()
+{
+    m_inflight.clear();
+    m_buffers.clear();
+}
+
+void TxQueue::clear()
+{
+    done();
+    m_queue.consume_all([this](std::string* l) { release(l); });
+}
+
+}  // namespace eth
+}  // namespace dev
@@ -0,0 +1,95 @@
+/*
+    This file is part of ethminer.
+
+    ethminer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ethminer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/lockfree/queue.hpp>
+
+namespace dev
+{
+namespace eth
+{
+/**
+ * @brief Transmit queue of pool clients.
+ *
+ * Lines are written into buffers recycled through a fixed size pool so
+ * steady traffic does not hit the allocator, and all lines queued when
+ * a write begins leave with a single gather write.
+ *
+ * acquire(), release() and push() may be called from any thread. The
+ * in flight batch (take(), buffers(), done()) belongs to the one writer
+ * currently owning the socket.
+ */
+class TxQueue
+{
+public:
+    static constexpr unsigned PoolSize = 64;
+    static constexpr size_t BufferReserve = 512;
+
+    TxQueue();
+    ~TxQueue();
+
+    TxQueue(const TxQueue&) = delete;
+    TxQueue& operator=(const TxQueue&) = delete;
+
+    /// Returns an empty buffer to fill and push()
+    std::string* acquire();
+
+    /// Gives a buffer back to the pool, or frees it when the pool is full
+    void release(std::string* _buffer);
+
+    /// Queues a line (ownership is taken)
+    void push(std::string* _line);
+
+    bool empty() const { return m_queue.empty(); }
+
+    /**
+     * @brief Moves up to _max queued lines into the in flight batch.
+     * @return number of lines in the batch
+     */
+    size_t take(size_t _max = SIZE_MAX);
+
+    const std::vector<std::string*>& lines() const { return m_inflight; }
+
+    /// Buffer sequence covering the in flight batch
+    const std::vector<boost::asio::const_buffer>& buffers() const { return m_buffers; }
+
+    /// Releases the in flight batch once written (or failed)
+    void done();
+
+    /// Empties the in flight batch leaving its buffers to the caller,
+    /// who gives them back with release()
+    void detach();
+
+    /// Drops queued lines and the in flight batch
+    void clear();
+
+private:
+    boost::lockfree::queue<std::string*> m_queue;
+    boost::lockfree::queue<std::string*, boost::lockfree::capacity<PoolSize>> m_free;
+
+    std::vector<std::string*> m_inflight;
+    std::vector<boost::asio::const_buffer> m_buffers;
+};
+
+}  // namespace eth
+}  // namespace dev
@@ -1,6 +1,9 @@
 #include "EthGetworkClient.h"
 
+#include <algorithm>
+#include <cctype>
 #include <chrono>
+#include <cstring>
 
 #include <ethash/ethash.hpp>
 
@@ -10,18 +13,47 @@ using namespace eth;
 
 using boost::asio::ip::tcp;
 
-EthGetworkClient::EthGetworkClient(int worktimeout, unsigned farmRecheckPeriod)
+namespace
+{
+// Persistent connections idle longer than this are not reused as
+// servers may close them meanwhile
+constexpr std::chrono::seconds c_keepAliveIdle(15);
+
+// Nodes holding long polling requests longer than this are assumed lost
+constexpr unsigned c_longPollTimeout = 120;  // Seconds
+
+inline bool iequals(const char* _a, size_t _size, const char* _b)
+{
+    size_t n = strlen(_b);
+    if (_size != n)
+        return false;
+    for (size_t i = 0; i < n; i++)
+        if (tolower(_a[i]) != _b[i])
+            return false;
+    return true;
+}
+
+}  // namespace
+
+EthGetworkClient::EthGetworkClient(int worktimeout, unsigned farmRecheckPeriod, bool longPoll)
   : PoolClient(),
     m_farmRecheckPeriod(farmRecheckPeriod),
     m_io_strand(g_io_service),
     m_socket(g_io_service),
     m_resolver(g_io_service),
     m_endpoints(),
+    m_longPoll(longPoll),
+    m_lpSocket(g_io_service),
+    m_lp_timer(g_io_service),
     m_getwork_timer(g_io_service),
     m_worktimeout(worktimeout)
 {
     m_jSwBuilder.settings_["indentation"] = "";
 
+    Json::CharReaderBuilder jRdrBuilder;
+    jRdrBuilder.settings_["collectComments"] = false;
+    m_jReader.reset(jRdrBuilder.newCharReader());
+
     Json::Value jGetWork;
     jGetWork["id"] = unsigned(1);
     jGetWork["jsonrpc"] = "2.0";
@@ -34,6 +66,8 @@ EthGetworkClient::~EthGetworkClient()
 {
     // Do not stop io service.
     // It's global
+    for (auto& r : m_requests)
+        m_txQueue.release(r.line);
 }
 
 void EthGetworkClient::connect()
@@ -86,10 +120,21 @@ void EthGetworkClient::disconnect()
     m_connecting.store(false, std::memory_order_relaxed);
     m_txPending.store(false, std::memory_order_relaxed);
     m_getwork_timer.cancel();
-
-    m_txQueue.consume_all([](std::string* l) { delete l; });
-    m_request.consume(m_request.capacity());
-    m_response.consume(m_response.capacity());
+    m_lp_timer.cancel();
+
+    boost::system::error_code ignored;
+    m_socket.close(ignored);
+    m_lpSocket.close(ignored);
+    m_socketConnecting = m_writing = m_reading = m_keepAlive = false;
+    m_lpActive = false;
+    m_lpPath.clear();
+
+    for (auto& r : m_requests)
+        m_txQueue.release(r.line);
+    m_requests.clear();
+    m_txQueue.clear();
+    m_response.consume(m_response.size());
+    m_lpResponse.consume(m_lpResponse.size());
 
     if (m_onDisconnected)
         m_onDisconnected();
@@ -102,8 +147,10 @@ void EthGetworkClient::begin_connect()
         // Pick the first endpoint in list.
         // Eventually endpoints get discarded on connection errors
         m_endpoint = m_endpoints.front();
+        m_socketConnecting = true;
         m_socket.async_connect(
-            m_endpoint, m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_connect, this, _1)));
+            m_endpoint, m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_connect, this,
+                            boost::asio::placeholders::error)));
     }
     else
     {
@@ -114,6 +161,8 @@ void EthGetworkClient::begin_connect()
 
 void EthGetworkClient::handle_connect(const boost::system::error_code& ec)
 {
+    m_socketConnecting = false;
+
     if (!ec && m_socket.is_open())
     {
 
@@ -133,54 +182,13 @@ void EthGetworkClient::handle_connect(const boost::system::error_code& ec)
             m_current_tstamp = std::chrono::steady_clock::now();
         }
 
-        // Retrieve 1st line waiting in the queue and submit
-        // if other lines waiting they will be processed 
-        // at the end of the processed request
-        Json::Reader jRdr;
-        std::string* line;
-        std::ostream os(&m_request);
-        if (!m_txQueue.empty())
-        {
-            while (m_txQueue.pop(line))
-            {
-                if (line->size())
-                {
-
-                    jRdr.parse(*line, m_pendingJReq);
-                    m_pending_tstamp = std::chrono::steady_clock::now();
-
-                    // Make sure path begins with "/"
-                    string _path = (m_conn->Path().empty() ? "/" : m_conn->Path());
-
-                    os << "POST " << _path << " HTTP/1.0\r\n";
-                    os << "Host: " << m_conn->Host() << "\r\n";
-                    os << "Content-Type: application/json"
-                       << "\r\n";
-                    os << "Content-Length: " << line->length() << "\r\n";
-                    os << "Connection: close\r\n\r\n";  // Double line feed to mark the
-                                                        // beginning of body
-                    // The payload
-                    os << *line;
-
-                    // Out received message only for debug purpouses
-                    if (g_logOptions & LOG_JSON)
-                        cnote << " >> " << *line;
-
-                    delete line;
-
-                    async_write(m_socket, m_request,
-                        m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_write, this,
-                            boost::asio::placeholders::error)));
-                    break;
-                }
-                delete line;
-            }
-        }
-        else
-        {
-            m_txPending.store(false, std::memory_order_relaxed);
-        }
-
+        // Until the server shows it keeps connections open
+        // requests are not pipelined
+        boost::system::error_code ignored;
+        m_socket.set_option(tcp::no_delay(true), ignored);
+        m_keepAlive = false;
+        m_lastResponse = std::chrono::steady_clock::now();
+        write();
     }
     else
     {
@@ -190,162 +198,378 @@ void EthGetworkClient::handle_connect(const boost::system::error_code& ec)
             // Pop it and retry
             cwarn << "Error connecting to " << m_conn->Host() << ":" << toString(m_conn->Port())
                   << " : " << ec.message();
+            boost::system::error_code ignored;
+            m_socket.close(ignored);
             m_endpoints.pop();
             begin_connect();
         }
     }
 }
 
+void EthGetworkClient::flush()
+{
+    m_txPending.store(false, std::memory_order_relaxed);
+    if (!m_conn || m_socketConnecting || m_writing)
+        return;
+
+    // Do not reuse a connection the server may have dropped meanwhile
+    if (m_socket.is_open() && m_requests.empty() &&
+        std::chrono::steady_clock::now() - m_lastResponse > c_keepAliveIdle)
+    {
+        boost::system::error_code ignored;
+        m_socket.close(ignored);
+        m_response.consume(m_response.size());
+    }
+
+    if (!m_socket.is_open())
+    {
+        if (!m_requests.empty() || !m_txQueue.empty())
+            begin_connect();
+        return;
+    }
+    write();
+}
+
+void EthGetworkClient::write()
+{
+    // All requests are pipelined once the server showed it keeps the
+    // connection open. Otherwise one at a time, unanswered ones first
+    bool inFlight = std::any_of(
+        m_requests.begin(), m_requests.end(), [](const Request& _r) { return _r.sent; });
+    bool resend = std::any_of(
+        m_requests.begin(), m_requests.end(), [](const Request& _r) { return !_r.sent; });
+    if (!m_keepAlive && inFlight)
+        return;
+
+    if ((m_keepAlive || !resend) && m_txQueue.take(m_keepAlive ? SIZE_MAX : 1))
+    {
+        for (std::string* line : m_txQueue.lines())
+        {
+            if (line->empty())
+            {
+                m_txQueue.release(line);
+                continue;
+            }
+
+            // Responses do not always carry the id of the request (for
+            // instance Dwarfpool always responds with "id":0)
+            Json::Value jReq;
+            m_jReader->parse(line->data(), line->data() + line->size(), &jReq, nullptr);
+
+            Request r;
+            r.line = line;
+            r.id = jReq.get("id", unsigned(0)).asUInt();
+            m_requests.push_back(r);
+        }
+        m_txQueue.detach();
+    }
+
+    // Make sure path begins with "/"
+    const string& _path = (m_conn->Path().empty() ? "/" : m_conn->Path());
+
+    size_t count = 0;
+    for (auto& r : m_requests)
+        if (!r.sent)
+            count++;
+    if (m_headers.size() < count)
+        m_headers.resize(count);
+
+    // Headers go in their own reused buffers, payloads are written from
+    // their queue buffers
+    m_buffers.clear();
+    auto now = std::chrono::steady_clock::now();
+    size_t h = 0;
+    for (auto& r : m_requests)
+    {
+        if (r.sent)
+            continue;
+
+        std::string& headers = m_headers[h++];
+        headers = "POST " + _path + " HTTP/1.1\r\n";
+        headers += "Host: " + m_conn->Host() + "\r\n";
+        headers += "Content-Type: application/json\r\n";
+        headers += "Content-Length: " + std::to_string(r.line->length()) + "\r\n";
+        headers += "Connection: keep-alive\r\n\r\n";  // Double line feed to mark the
+                                                      // beginning of body
+
+        // Out received message only for debug purpouses
+        if (g_logOptions & LOG_JSON)
+            cnote << " >> " << *r.line;
+
+        m_buffers.push_back(boost::asio::buffer(headers));
+        m_buffers.push_back(boost::asio::buffer(*r.line));
+        r.sent = true;
+        r.tstamp = now;
+        if (!m_keepAlive)
+            break;
+    }
+    if (m_buffers.empty())
+        return;
+
+    m_writing = true;
+    async_write(m_socket, m_buffers,
+        m_io_strand.wrap(boost::bind(
+            &EthGetworkClient::handle_write, this, boost::asio::placeholders::error)));
+}
+
 void EthGetworkClient::handle_write(const boost::system::error_code& ec)
 {
+    m_writing = false;
+
     if (!ec)
     {
         // Transmission succesfully sent.
-        // Read the response async. 
-        async_read(m_socket, m_response, boost::asio::transfer_all(),
-            m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_read, this,
-                boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+        // Read the responses async.
+        if (!m_reading)
+            read();
+
+        // Anything queued meanwhile
+        if (m_keepAlive && !m_txQueue.empty())
+            flush();
     }
     else
     {
         if (ec != boost::asio::error::operation_aborted)
+            connectionLost("Error writing to " + m_conn->Host() + ":" +
+                           toString(m_conn->Port()) + " : " + ec.message());
+    }
+}
+
+void EthGetworkClient::read()
+{
+    m_reading = true;
+    async_read(m_socket, m_response, boost::asio::transfer_at_least(1),
+        m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_read, this,
+            boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+}
+
+void EthGetworkClient::connectionLost(const std::string& _reason)
+{
+    boost::system::error_code ignored;
+    m_socket.close(ignored);
+    m_response.consume(m_response.size());
+    m_keepAlive = false;
+
+    // Unanswered requests are sent again once on a new connection
+    bool retry = true;
+    for (auto& r : m_requests)
+    {
+        if (r.sent && r.retries++)
+            retry = false;
+        r.sent = false;
+    }
+    if (!retry)
+    {
+        cwarn << _reason;
+        m_endpoints.pop();
+        disconnect();
+        return;
+    }
+    if (!m_requests.empty())
+        begin_connect();
+}
+
+int EthGetworkClient::extractResponse(
+    boost::asio::streambuf& _buffer, bool _eof, HttpResponse& _res)
+{
+    const char* data = boost::asio::buffer_cast<const char*>(_buffer.data());
+    const char* end = data + _buffer.size();
+    static const char delimiter[] = "\r\n\r\n";
+    const char* headEnd = std::search(data, end, delimiter, delimiter + 4);
+    if (headEnd == end)
+        return (_eof && data != end) ? -1 : 0;
+
+    // Http status
+    const char* eol = std::search(data, headEnd, delimiter, delimiter + 2);
+    if (eol - data < 12 || memcmp(data, "HTTP/1.", 7) != 0 || data[8] != ' ')
+        return -1;
+    _res.status = unsigned(atoi(data + 9));
+    _res.close = (data[7] == '0');
+    _res.longPoll.clear();
+    _res.body.clear();
+
+    // Headers
+    bool chunked = false;
+    long long length = -1;
+    for (const char* line = eol + 2; line < headEnd;)
+    {
+        const char* next = std::search(line, headEnd, delimiter, delimiter + 2);
+        const char* colon = std::find(line, next, ':');
+        if (colon != next)
         {
-            cwarn << "Error writing to " << m_conn->Host() << ":" << toString(m_conn->Port())
-                  << " : " << ec.message();
-            m_endpoints.pop();
-            begin_connect();
+            const char* value = colon + 1;
+            while (value < next && *value == ' ')
+                value++;
+            std::string v(value, next);
+            size_t n = size_t(colon - line);
+            if (iequals(line, n, "content-length"))
+                length = atoll(v.c_str());
+            else if (iequals(line, n, "transfer-encoding"))
+                chunked = (v.find("chunked") != std::string::npos);
+            else if (iequals(line, n, "connection"))
+            {
+                boost::algorithm::to_lower(v);
+                if (v.find("close") != std::string::npos)
+                    _res.close = true;
+                else if (v.find("keep-alive") != std::string::npos)
+                    _res.close = false;
+            }
+            else if (iequals(line, n, "x-long-polling"))
+                _res.longPoll = v;
         }
+        line = next + 2;
+    }
+
+    // Body
+    const char* body = headEnd + 4;
+    const char* bodyEnd = nullptr;
+    if (chunked)
+    {
+        const char* p = body;
+        while (true)
+        {
+            const char* sizeEnd = std::search(p, end, delimiter, delimiter + 2);
+            if (sizeEnd == end)
+                return _eof ? -1 : 0;
+            size_t chunk = size_t(strtoul(std::string(p, sizeEnd).c_str(), nullptr, 16));
+            p = sizeEnd + 2;
+            if (!chunk)
+            {
+                // Trailers up to an empty line
+                const char* trailers = (end - p >= 2 && p[0] == '\r' && p[1] == '\n') ?
+                                           p :
+                                           std::search(p, end, delimiter, delimiter + 4);
+                if (trailers == end)
+                    return _eof ? -1 : 0;
+                bodyEnd = trailers + (trailers == p ? 2 : 4);
+                break;
+            }
+            if (size_t(end - p) < chunk + 2)
+                return _eof ? -1 : 0;
+            _res.body.append(p, chunk);
+            p += chunk + 2;
+        }
+    }
+    else if (length >= 0)
+    {
+        if (end - body < length)
+            return _eof ? -1 : 0;
+        _res.body.assign(body, size_t(length));
+        bodyEnd = body + length;
+    }
+    else
+    {
+        // Delimited by the end of connection
+        if (!_eof)
+            return 0;
+        _res.body.assign(body, end);
+        _res.close = true;
+        bodyEnd = end;
     }
+
+    _buffer.consume(size_t(bodyEnd - data));
+    return 1;
 }
 
 void EthGetworkClient::handle_read(
     const boost::system::error_code& ec, std::size_t bytes_transferred)
 {
-    if (!ec || ec == boost::asio::error::eof)
-    {
-        // Close socket
-        if (m_socket.is_open())
-            m_socket.close();
+    (void)bytes_transferred;
+    m_reading = false;
 
-        // Get the whole message
-        std::string rx_message(
-            boost::asio::buffer_cast<const char*>(m_response.data()), bytes_transferred);
-        m_response.consume(bytes_transferred);
+    bool eof = (ec == boost::asio::error::eof);
+    if (ec && !eof)
+    {
+        if (ec != boost::asio::error::operation_aborted)
+            connectionLost("Error reading from :" + m_conn->Host() + ":" +
+                           toString(m_conn->Port()) + " : " + ec.message());
+        return;
+    }
 
-        // Empty response ?
-        if (!rx_message.size())
+    // Process every complete response
+    HttpResponse res;
+    bool close = false;
+    int got;
+    while (!m_requests.empty() && (got = extractResponse(m_response, eof, res)) != 0)
+    {
+        if (got < 0)
         {
             cwarn << "Invalid response from " << m_conn->Host() << ":" << toString(m_conn->Port());
             disconnect();
             return;
         }
-
-        // Read message by lines.
-        // First line is http status
-        // Other lines are headers
-        // A double "\r\n" identifies begin of body
-        // The rest is body
-        std::string line;
-        std::string linedelimiter = "\r\n";
-        std::size_t delimiteroffset = rx_message.find(linedelimiter);
-
-        unsigned int linenum = 0;
-        bool isHeader = true;
-        while (rx_message.length() && delimiteroffset != std::string::npos)
+        if (res.status != 200)
         {
-            linenum++;
-            line = rx_message.substr(0, delimiteroffset);
-            rx_message.erase(0, delimiteroffset + 2);
-            
-            // This identifies the beginning of body
-            if (line.empty())
-            {
-                isHeader = false;
-                delimiteroffset = rx_message.find(linedelimiter);
-                if (delimiteroffset != std::string::npos)
-                    continue;
-                boost::replace_all(rx_message, "\n", "");
-                line = rx_message;
-            }
-
-            // Http status
-            if (isHeader && linenum == 1)
-            {
-                if (line.substr(0, 7) != "HTTP/1.")
-                {
-                    cwarn << "Invalid response from " << m_conn->Host() << ":"
-                          << toString(m_conn->Port());
-                    disconnect();
-                    return;
-                }
-                std::size_t spaceoffset = line.find(' ');
-                if (spaceoffset == std::string::npos)
-                {
-                    cwarn << "Invalid response from " << m_conn->Host() << ":"
-                          << toString(m_conn->Port());
-                    disconnect();
-                    return;
-                }
-                std::string status = line.substr(spaceoffset + 1);
-                if (status.substr(0, 3) != "200")
-                {
-                    cwarn << m_conn->Host() << ":" << toString(m_conn->Port())
-                          << " reported status " << status;
-                    disconnect();
-                    return;
-                }
-            }
-
-            // Body
-            if (!isHeader)
-            {
-                // Out received message only for debug purpouses
-                if (g_logOptions & LOG_JSON)
-                    cnote << " << " << line;
-
-                // Test validity of chunk and process
-                Json::Value jRes;
-                Json::Reader jRdr;
-                if (jRdr.parse(line, jRes))
-                {
-                    // Run in sync so no 2 different async reads may overlap
-                    processResponse(jRes);
-                }
-                else
-                {
-                    string what = jRdr.getFormattedErrorMessages();
-                    boost::replace_all(what, "\n", " ");
-                    cwarn << "Got invalid Json message : " << what;
-                }
+            cwarn << m_conn->Host() << ":" << toString(m_conn->Port()) << " reported status "
+                  << res.status;
+            disconnect();
+            return;
+        }
 
-            }
+        Request req = m_requests.front();
+        m_requests.pop_front();
+        m_lastResponse = std::chrono::steady_clock::now();
+        m_keepAlive = !res.close;
+        close = res.close;
 
-            delimiteroffset = rx_message.find(linedelimiter);
-        }
+        // Out received message only for debug purpouses
+        if (g_logOptions & LOG_JSON)
+            cnote << " << " << res.body;
 
-        // Is there anything else in the queue
-        if (!m_txQueue.empty())
+        // Test validity of chunk and process
+        Json::Value jRes;
+        std::string what;
+        if (m_jReader->parse(res.body.data(), res.body.data() + res.body.size(), &jRes, &what))
         {
-            begin_connect();
+            // Run in sync so no 2 different async reads may overlap
+            processResponse(jRes, req);
         }
         else
         {
-            // Signal end of async send/receive operations
-            m_txPending.store(false, std::memory_order_relaxed);
+            boost::replace_all(what, "\n", " ");
+            cwarn << "Got invalid Json message : " << what;
+        }
+        m_txQueue.release(req.line);
+
+        // Node supports long polling
+        if (m_longPoll && !res.longPoll.empty() && m_lpPath.empty() && m_lpFailures < 3)
+        {
+            size_t scheme = res.longPoll.find("://");
+            size_t path = res.longPoll.find('/', scheme == string::npos ? 0 : scheme + 3);
+            m_lpPath = (path == string::npos ? "/" : res.longPoll.substr(path));
+            cnote << "Long polling " << m_conn->Host() << m_lpPath;
+            longpoll_begin();
         }
 
+        if (!isConnected())
+            return;
+        if (close)
+            break;
     }
-    else
+
+    if (close || eof)
     {
-        if (ec != boost::asio::error::operation_aborted)
+        // Server closed the connection
+        boost::system::error_code ignored;
+        m_socket.close(ignored);
+        m_response.consume(m_response.size());
+        m_keepAlive = false;
+        if (!m_requests.empty())
         {
-            cwarn << "Error reading from :" << m_conn->Host() << ":" << toString(m_conn->Port())
-                  << " : "
-                  << ec.message();
-            disconnect();
+            connectionLost("Connection closed by " + m_conn->Host() + ":" +
+                           toString(m_conn->Port()));
+            return;
         }
-       
     }
+    else if (!m_requests.empty())
+    {
+        read();
+        return;
+    }
+
+    // Is there anything else in the queue
+    if (!m_txQueue.empty())
+        flush();
 }
 
 void EthGetworkClient::handle_resolve(
@@ -353,13 +577,20 @@ void EthGetworkClient::handle_resolve(
 {
     if (!ec)
     {
+        std::vector<tcp::endpoint> endpoints;
         while (i != tcp::resolver::iterator())
         {
-            m_endpoints.push(i->endpoint());
+            endpoints.push_back(i->endpoint());
             i++;
         }
         m_resolver.cancel();
 
+        // Try the nearest addresses first
+        if (LatencyProbe::p())
+            LatencyProbe::p()->sort(*m_conn, endpoints);
+        for (auto& ep : endpoints)
+            m_endpoints.push(ep);
+
         // Resolver has finished so invoke connection asynchronously
         send(m_jsonGetWork);
     }
@@ -370,7 +601,7 @@ void EthGetworkClient::handle_resolve(
     }
 }
 
-void EthGetworkClient::processResponse(Json::Value& JRes) 
+void EthGetworkClient::processResponse(Json::Value& JRes, const Request& _req)
 {
     unsigned _id = 0;  // This SHOULD be the same id as the request it is responding to 
     bool _isSuccess = false;  // Whether or not this is a succesful or failed response
@@ -385,7 +616,7 @@ void EthGetworkClient::processResponse(Json::Value& JRes)
     // We get the id from pending jrequest
     // It's not guaranteed we get response labelled with same id
     // For instance Dwarfpool always responds with "id":0
-    _id = m_pendingJReq.get("id", unsigned(0)).asUInt();
+    _id = _req.id;
     _isSuccess = JRes.get("error", Json::Value::null).empty();
     _errReason = (_isSuccess ? "" : processError(JRes));
 
@@ -420,20 +651,7 @@ void EthGetworkClient::processResponse(Json::Value& JRes)
             else
             {
                 Json::Value JPrm = JRes.get("result", Json::Value::null);
-                WorkPackage newWp;
-                
-                newWp.header = h256(JPrm.get(Json::Value::ArrayIndex(0), "").asString());
-                newWp.seed = h256(JPrm.get(Json::Value::ArrayIndex(1), "").asString());
-                newWp.boundary = h256(JPrm.get(Json::Value::ArrayIndex(2), "").asString());
-                newWp.job = newWp.header.hex();
-                if (m_current.header != newWp.header)
-                {
-                    m_current = newWp;
-                    m_current_tstamp = std::chrono::steady_clock::now();
-
-                    if (m_onWorkReceived)
-                        m_onWorkReceived(m_current);
-                }
+                processWork(JPrm);
                 m_getwork_timer.expires_from_now(boost::posix_time::milliseconds(m_farmRecheckPeriod));
                 m_getwork_timer.async_wait(
                     m_io_strand.wrap(boost::bind(&EthGetworkClient::getwork_timer_elapsed, this,
@@ -453,7 +671,7 @@ void EthGetworkClient::processResponse(Json::Value& JRes)
             _isSuccess = JRes["result"].asBool();
 
         std::chrono::milliseconds _delay = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::steady_clock::now() - m_pending_tstamp);
+            std::chrono::steady_clock::now() - _req.tstamp);
 
         const unsigned miner_index = _id - 40;
         if (_isSuccess)
@@ -470,6 +688,24 @@ void EthGetworkClient::processResponse(Json::Value& JRes)
 
 }
 
+void EthGetworkClient::processWork(Json::Value& JPrm)
+{
+    WorkPackage newWp;
+
+    newWp.header = h256(JPrm.get(Json::Value::ArrayIndex(0), "").asString());
+    newWp.seed = h256(JPrm.get(Json::Value::ArrayIndex(1), "").asString());
+    newWp.boundary = h256(JPrm.get(Json::Value::ArrayIndex(2), "").asString());
+    newWp.job = newWp.header.hex();
+    if (m_current.header != newWp.header)
+    {
+        m_current = newWp;
+        m_current_tstamp = std::chrono::steady_clock::now();
+
+        if (m_onWorkReceived)
+            m_onWorkReceived(m_current);
+    }
+}
+
 std::string EthGetworkClient::processError(Json::Value& JRes)
 {
     std::string retVar;
@@ -513,12 +749,13 @@ void EthGetworkClient::send(Json::Value const& jReq)
 
 void EthGetworkClient::send(std::string const& sReq) 
 {
-    std::string* line = new std::string(sReq);
+    std::string* line = m_txQueue.acquire();
+    line->assign(sReq);
     m_txQueue.push(line);
 
     bool ex = false;
     if (m_txPending.compare_exchange_strong(ex, true, std::memory_order_relaxed))
-        begin_connect();
+        g_io_service.post(m_io_strand.wrap(boost::bind(&EthGetworkClient::flush, this)));
 }
 
 void EthGetworkClient::submitHashrate(uint64_t const& rate, string const& id)
@@ -553,7 +790,7 @@ void EthGetworkClient::submitSolution(const Solution& solution)
         jReq["method"] = "eth_submitWork";
         jReq["params"] = Json::Value(Json::arrayValue);
         jReq["params"].append("0x" + nonceHex);
-        jReq["params"].append("0x" + solution.work.header.hex());
+        jReq["params"].append("0x" + solution.work->header.hex());
         jReq["params"].append("0x" + solution.mixHash.hex());
         send(jReq);
     }
@@ -581,3 +818,117 @@ void EthGetworkClient::getwork_timer_elapsed(const boost::system::error_code& ec
 
     }
 }
+
+void EthGetworkClient::longpoll_begin()
+{
+    if (!isConnected() || m_lpActive)
+        return;
+
+    // A separate connection holds the request until the node has new work
+    m_lpActive = true;
+    m_lpRequest = "POST " + m_lpPath + " HTTP/1.0\r\n";
+    m_lpRequest += "Host: " + m_conn->Host() + "\r\n";
+    m_lpRequest += "Content-Type: application/json\r\n";
+    m_lpRequest += "Content-Length: " + std::to_string(m_jsonGetWork.length()) + "\r\n";
+    m_lpRequest += "Connection: close\r\n\r\n";
+    m_lpRequest += m_jsonGetWork;
+    m_lpResponse.consume(m_lpResponse.size());
+
+    m_lpSocket.async_connect(m_endpoint,
+        m_io_strand.wrap(boost::bind(
+            &EthGetworkClient::longpoll_connected, this, boost::asio::placeholders::error)));
+}
+
+void EthGetworkClient::longpoll_connected(const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        if (ec != boost::asio::error::operation_aborted)
+            longpoll_failed(ec.message());
+        return;
+    }
+
+    async_write(m_lpSocket, boost::asio::buffer(m_lpRequest),
+        m_io_strand.wrap(boost::bind(
+            &EthGetworkClient::longpoll_written, this, boost::asio::placeholders::error)));
+}
+
+void EthGetworkClient::longpoll_written(const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        if (ec != boost::asio::error::operation_aborted)
+            longpoll_failed(ec.message());
+        return;
+    }
+
+    // Give up on nodes holding the request for too long
+    m_lp_timer.expires_from_now(boost::posix_time::seconds(c_longPollTimeout));
+    m_lp_timer.async_wait(m_io_strand.wrap([this](const boost::system::error_code& ec) {
+        if (!ec)
+        {
+            boost::system::error_code ignored;
+            m_lpSocket.close(ignored);
+        }
+    }));
+
+    async_read(m_lpSocket, m_lpResponse, boost::asio::transfer_all(),
+        m_io_strand.wrap(boost::bind(&EthGetworkClient::longpoll_read, this,
+            boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+}
+
+void EthGetworkClient::longpoll_read(
+    const boost::system::error_code& ec, std::size_t bytes_transferred)
+{
+    (void)bytes_transferred;
+    m_lp_timer.cancel();
+    boost::system::error_code ignored;
+    m_lpSocket.close(ignored);
+
+    if (ec && ec != boost::asio::error::eof)
+    {
+        if (ec != boost::asio::error::operation_aborted || isConnected())
+            longpoll_failed(ec.message());
+        return;
+    }
+
+    HttpResponse res;
+    Json::Value jRes;
+    if (extractResponse(m_lpResponse, true, res) <= 0 || res.status != 200 ||
+        !m_jReader->parse(res.body.data(), res.body.data() + res.body.size(), &jRes, nullptr) ||
+        !jRes.get("error", Json::Value::null).empty() || !jRes.isMember("result"))
+    {
+        longpoll_failed("invalid response");
+        return;
+    }
+
+    // Out received message only for debug purpouses
+    if (g_logOptions & LOG_JSON)
+        cnote << " << " << res.body;
+
+    m_lpFailures = 0;
+    m_lpActive = false;
+    Json::Value JPrm = jRes.get("result", Json::Value::null);
+    processWork(JPrm);
+    longpoll_begin();
+}
+
+void EthGetworkClient::longpoll_failed(const std::string& _reason)
+{
+    m_lpActive = false;
+    if (!isConnected())
+        return;
+
+    // Regular polling goes on meanwhile
+    if (++m_lpFailures >= 3)
+    {
+        cwarn << "Long polling " << m_conn->Host() << m_lpPath << " disabled : " << _reason;
+        m_lpPath.clear();
+        return;
+    }
+    m_lp_timer.expires_from_now(boost::posix_time::seconds(5));
+    m_lp_timer.async_wait(m_io_strand.wrap([this](const boost::system::error_code& ec) {
+        if (!ec)
+            longpoll_begin();
+    }));
+}
@@ -1,16 +1,19 @@
 #pragma once
 
+#include <deque>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include <boost/asio.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/lexical_cast.hpp>
-#include <boost/lockfree/queue.hpp>
 
 #include <json/json.h>
 
+#include "../LatencyProbe.h"
 #include "../PoolClient.h"
+#include "../TxQueue.h"
 
 using namespace std;
 using namespace dev;
@@ -19,7 +22,7 @@ using namespace eth;
 class EthGetworkClient : public PoolClient
 {
 public:
-    EthGetworkClient(int worktimeout, unsigned farmRecheckPeriod);
+    EthGetworkClient(int worktimeout, unsigned farmRecheckPeriod, bool longPoll = false);
     ~EthGetworkClient();
 
     void connect() override;
@@ -31,23 +34,54 @@ public:
 private:
     unsigned m_farmRecheckPeriod = 500;  // In milliseconds
 
+    // A request sent on the persistent connection. Responses come back
+    // in order, so the oldest one is the one being answered
+    struct Request
+    {
+        std::string* line = nullptr;  // Payload, out of m_txQueue until answered
+        unsigned id = 0;
+        std::chrono::steady_clock::time_point tstamp;
+        bool sent = false;
+        unsigned retries = 0;
+    };
+
+    struct HttpResponse
+    {
+        unsigned status = 0;
+        bool close = false;    // Server does not keep the connection
+        std::string longPoll;  // Path advertised by X-Long-Polling
+        std::string body;
+    };
+
     void begin_connect();
     void handle_resolve(
         const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator i);
     void handle_connect(const boost::system::error_code& ec);
     void handle_write(const boost::system::error_code& ec);
     void handle_read(const boost::system::error_code& ec, std::size_t bytes_transferred);
+    void flush();
+    void write();
+    void read();
+    void connectionLost(const std::string& _reason);
+    static int extractResponse(boost::asio::streambuf& _buffer, bool _eof, HttpResponse& _res);
     std::string processError(Json::Value& JRes);
-    void processResponse(Json::Value& JRes);
+    void processResponse(Json::Value& JRes, const Request& _req);
+    void processWork(Json::Value& JPrm);
     void send(Json::Value const& jReq);
     void send(std::string const& sReq);
     void getwork_timer_elapsed(const boost::system::error_code& ec);
 
+    void longpoll_begin();
+    void longpoll_connected(const boost::system::error_code& ec);
+    void longpoll_written(const boost::system::error_code& ec);
+    void longpoll_read(const boost::system::error_code& ec, std::size_t bytes_transferred);
+    void longpoll_failed(const std::string& _reason);
+
     WorkPackage m_current;
 
     std::atomic<bool> m_connecting = {false};  // Whether or not socket is on first try connect
-    std::atomic<bool> m_txPending = {false};  // Whether or not an async socket operation is pending
-    boost::lockfree::queue<std::string*> m_txQueue;
+    std::atomic<bool> m_txPending = {false};  // Whether or not a flush is posted
+    TxQueue m_txQueue;
 
     boost::asio::io_service::strand m_io_strand;
 
@@ -55,12 +89,30 @@ private:
     boost::asio::ip::tcp::resolver m_resolver;
     std::queue<boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>> m_endpoints;
 
-    boost::asio::streambuf m_request;
+    // Persistent connection state (only accessed on m_io_strand)
+    std::deque<Request> m_requests;     // Unanswered requests
+    std::vector<std::string> m_headers;  // Reused headers of requests being written
+    std::vector<boost::asio::const_buffer> m_buffers;
+    bool m_socketConnecting = false;
+    bool m_writing = false;
+    bool m_reading = false;
+    bool m_keepAlive = false;  // Server answered keeping the connection open
+    std::chrono::steady_clock::time_point m_lastResponse;
+
     boost::asio::streambuf m_response;
     Json::StreamWriterBuilder m_jSwBuilder;
+    std::unique_ptr<Json::CharReader> m_jReader;
     std::string m_jsonGetWork;
-    Json::Value m_pendingJReq;
-    std::chrono::time_point<std::chrono::steady_clock> m_pending_tstamp;
+
+    // Long polling : a getwork request the node holds until new work
+    bool m_longPoll;
+    std::string m_lpPath;  // Empty if node does not support it
+    bool m_lpActive = false;
+    unsigned m_lpFailures = 0;
+    boost::asio::ip::tcp::socket m_lpSocket;
+    std::string m_lpRequest;
+    boost::asio::streambuf m_lpResponse;
+    boost::asio::deadline_timer m_lp_timer;
 
     boost::asio::deadline_timer m_getwork_timer;  // The timer which triggers getWork requests
 
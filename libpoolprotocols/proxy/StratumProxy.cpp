@@ -0,0 +1,719 @@
+/*
+    This file is part of ethminer.
+
+    ethminer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ethminer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cctype>
+#include <cstring>
+#include <future>
+#include <sstream>
+
+#include <boost/bind.hpp>
+
+#include <json/json.h>
+
+#include <libdevcore/Log.h>
+#include <libethcore/EpochManager.h>
+
+#include "../PoolManager.h"
+#include "StratumProxy.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+using boost::asio::ip::tcp;
+
+namespace
+{
+// Longest extranonce given to a downstream miner, in hex digits.
+// What is left (at least 24 bits) is the nonce space of the miner
+constexpr size_t c_maxExtranonce = 10;
+
+// Jobs a share may still refer to
+constexpr size_t c_jobsKept = 4;
+
+// Longest line accepted from a miner
+constexpr size_t c_maxLine = 4096;
+
+// Lines queued to a miner not reading them
+constexpr size_t c_maxBacklog = 256;
+
+constexpr unsigned c_timerInterval = 5;                     // Seconds
+constexpr std::chrono::seconds c_authorizeTimeout(30);      // Connected to authorized
+constexpr std::chrono::seconds c_shareTimeout(60);          // Submitted to answered
+constexpr std::chrono::seconds c_hashRateValidity(5 * 60);  // Reported hashrate
+
+}  // namespace
+
+StratumProxy* StratumProxy::m_this = nullptr;
+
+struct StratumProxy::Session
+{
+    Session(boost::asio::io_service& _io_service) : socket(_io_service), recvBuffer(c_maxLine) {}
+
+    tcp::socket socket;
+    boost::asio::streambuf recvBuffer;
+
+    // Jobs are the same buffer for every session
+    std::deque<std::shared_ptr<const std::string>> txQueue;
+    std::vector<boost::asio::const_buffer> txBuffers;
+    size_t txInflight = 0;
+
+    bool closed = false;
+    unsigned slot = 0;
+    bool subscribed = false;
+    bool authorized = false;
+    std::string worker;
+    std::string endpoint;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    uint64_t hashRate = 0;
+    std::chrono::steady_clock::time_point hashRateStamp;
+};
+
+StratumProxy::StratumProxy(std::string _address, unsigned _port)
+  : m_address(std::move(_address)),
+    m_port(_port),
+    m_acceptor(g_io_service),
+    m_io_strand(g_io_service),
+    m_timer(g_io_service)
+{
+    m_this = this;
+}
+
+StratumProxy::~StratumProxy()
+{
+    m_this = nullptr;
+}
+
+bool StratumProxy::start()
+{
+    boost::system::error_code ec;
+    auto address = boost::asio::ip::address::from_string(m_address, ec);
+    if (ec)
+    {
+        cwarn << "Invalid stratum proxy address " << m_address;
+        return false;
+    }
+
+    tcp::endpoint endpoint(address, m_port);
+    try
+    {
+        m_acceptor.open(endpoint.protocol());
+        m_acceptor.set_option(tcp::acceptor::reuse_address(true));
+        m_acceptor.bind(endpoint);
+        m_acceptor.listen(128);
+    }
+    catch (const std::exception& _ex)
+    {
+        cwarn << "Could not start stratum proxy on " << endpoint << " : " << _ex.what();
+        return false;
+    }
+
+    cnote << "Stratum proxy listening on " << endpoint;
+    m_running = true;
+
+    m_timer.expires_from_now(boost::posix_time::seconds(c_timerInterval));
+    m_timer.async_wait(m_io_strand.wrap(
+        boost::bind(&StratumProxy::timer_elapsed, this, boost::asio::placeholders::error)));
+    m_io_strand.post(boost::bind(&StratumProxy::begin_accept, this));
+    return true;
+}
+
+void StratumProxy::stop()
+{
+    if (!m_acceptor.is_open())
+        return;
+
+    // Handlers of the aborted operations are queued once sockets are
+    // closed : the second post lets them run before returning
+    auto done = std::make_shared<std::promise<void>>();
+    m_io_strand.post([this, done]() {
+        m_running = false;
+        boost::system::error_code ec;
+        m_acceptor.close(ec);
+        m_timer.cancel();
+        auto sessions = m_sessions;
+        for (auto& s : sessions)
+            close(s.second);
+        m_pending.clear();
+        m_io_strand.post([done]() { done->set_value(); });
+    });
+    done->get_future().wait_for(std::chrono::seconds(5));
+}
+
+void StratumProxy::begin_accept()
+{
+    if (!m_running)
+        return;
+
+    auto session = std::make_shared<Session>(g_io_service);
+    m_acceptor.async_accept(session->socket,
+        m_io_strand.wrap(boost::bind(
+            &StratumProxy::handle_accept, this, session, boost::asio::placeholders::error)));
+}
+
+void StratumProxy::handle_accept(SessionPtr _session, const boost::system::error_code& ec)
+{
+    if (!m_running)
+        return;
+
+    if (!ec)
+    {
+        boost::system::error_code sec;
+        std::stringstream ss;
+        ss << _session->socket.remote_endpoint(sec);
+        _session->endpoint = ss.str();
+
+        const unsigned capacity = 1U << (4 * m_slotDigits);
+        if (!m_usable || m_sessions.size() >= capacity)
+        {
+            cwarn << "Stratum proxy full. Refused " << _session->endpoint;
+            _session->socket.close(sec);
+        }
+        else
+        {
+            while (m_sessions.count(m_nextSlot))
+                m_nextSlot = (m_nextSlot + 1) % capacity;
+            _session->slot = m_nextSlot;
+            m_nextSlot = (m_nextSlot + 1) % capacity;
+
+            _session->socket.set_option(tcp::no_delay(true), sec);
+            m_sessions[_session->slot] = _session;
+            read(_session);
+        }
+    }
+
+    begin_accept();
+}
+
+void StratumProxy::timer_elapsed(const boost::system::error_code& ec)
+{
+    if (ec || !m_running)
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+
+    // Drop sessions never authorized and sum reported hashrates
+    uint64_t rate = 0;
+    auto sessions = m_sessions;
+    for (auto& s : sessions)
+    {
+        const SessionPtr& session = s.second;
+        if (!session->authorized)
+        {
+            if (now - session->start > c_authorizeTimeout)
+                close(session);
+        }
+        else if (now - session->hashRateStamp < c_hashRateValidity)
+        {
+            rate += session->hashRate;
+        }
+    }
+    m_hashRate.store(rate, std::memory_order_relaxed);
+
+    // Fail shares the pool never answered
+    for (auto it = m_pending.begin(); it != m_pending.end();)
+    {
+        if (now - it->second.tstamp > c_shareTimeout)
+        {
+            auto session = it->second.session.lock();
+            if (session)
+                replyError(session, it->second.id, 20, "No answer from pool");
+            it = m_pending.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
+
+    m_timer.expires_from_now(boost::posix_time::seconds(c_timerInterval));
+    m_timer.async_wait(m_io_strand.wrap(
+        boost::bind(&StratumProxy::timer_elapsed, this, boost::asio::placeholders::error)));
+}
+
+void StratumProxy::read(SessionPtr _session)
+{
+    boost::asio::async_read_until(_session->socket, _session->recvBuffer, '\n',
+        m_io_strand.wrap(boost::bind(
+            &StratumProxy::onRead, this, _session, boost::asio::placeholders::error)));
+}
+
+void StratumProxy::onRead(SessionPtr _session, const boost::system::error_code& ec)
+{
+    if (_session->closed)
+        return;
+    if (ec)
+    {
+        // Also a line longer than the receive buffer
+        close(_session);
+        return;
+    }
+
+    // Lines are scanned in place as the stratum client does
+    const char* data = boost::asio::buffer_cast<const char*>(_session->recvBuffer.data());
+    const size_t size = _session->recvBuffer.size();
+    size_t consumed = 0;
+
+    while (!_session->closed)
+    {
+        const char* begin = data + consumed;
+        const char* nl = static_cast<const char*>(memchr(begin, '\n', size - consumed));
+        if (!nl)
+            break;
+        consumed = size_t(nl - data) + 1;
+
+        const char* end = nl;
+        while (end > begin && isspace(static_cast<unsigned char>(end[-1])))
+            end--;
+        while (begin < end && isspace(static_cast<unsigned char>(*begin)))
+            begin++;
+        if (begin == end)
+            continue;
+
+        // Miners' requests are all flat : whatever the parser does not
+        // handle is not something to forward
+        StratumParser::Message msg;
+        if (!StratumParser::parse(begin, end, msg) || msg.method.type != StratumParser::String)
+        {
+            replyError(_session, "null", 20, "Unsupported message");
+            continue;
+        }
+        process(_session, msg);
+    }
+
+    _session->recvBuffer.consume(consumed);
+    if (!_session->closed)
+        read(_session);
+}
+
+void StratumProxy::send(SessionPtr _session, std::shared_ptr<const std::string> _line)
+{
+    if (_session->closed)
+        return;
+    if (_session->txQueue.size() >= c_maxBacklog)
+    {
+        cwarn << "Stratum proxy worker " << _session->endpoint << " not reading. Dropped.";
+        close(_session);
+        return;
+    }
+
+    _session->txQueue.push_back(std::move(_line));
+    if (!_session->txInflight)
+        write(_session);
+}
+
+void StratumProxy::write(SessionPtr _session)
+{
+    // All lines queued leave with a single gather write
+    _session->txBuffers.clear();
+    for (auto& line : _session->txQueue)
+        _session->txBuffers.push_back(boost::asio::buffer(*line));
+    _session->txInflight = _session->txQueue.size();
+
+    boost::asio::async_write(_session->socket, _session->txBuffers,
+        m_io_strand.wrap(boost::bind(
+            &StratumProxy::onWritten, this, _session, boost::asio::placeholders::error)));
+}
+
+void StratumProxy::onWritten(SessionPtr _session, const boost::system::error_code& ec)
+{
+    if (_session->closed)
+        return;
+    if (ec)
+    {
+        close(_session);
+        return;
+    }
+
+    _session->txQueue.erase(
+        _session->txQueue.begin(), _session->txQueue.begin() + _session->txInflight);
+    _session->txInflight = 0;
+    if (!_session->txQueue.empty())
+        write(_session);
+}
+
+void StratumProxy::close(SessionPtr _session)
+{
+    if (_session->closed)
+        return;
+    _session->closed = true;
+
+    boost::system::error_code ec;
+    _session->socket.shutdown(tcp::socket::shutdown_both, ec);
+    _session->socket.close(ec);
+
+    if (_session->authorized)
+    {
+        m_workers.fetch_sub(1, std::memory_order_relaxed);
+        cnote << "Stratum proxy worker " << _session->worker << " left " << _session->endpoint;
+    }
+
+    auto it = m_sessions.find(_session->slot);
+    if (it != m_sessions.end() && it->second == _session)
+        m_sessions.erase(it);
+}
+
+void StratumProxy::process(SessionPtr _session, const StratumParser::Message& _msg)
+{
+    // Echo the request id as received. Parsed strings have no escapes
+    std::string id = "null";
+    if (_msg.id.type == StratumParser::Number)
+        id.assign(_msg.id.data, _msg.id.size);
+    else if (_msg.id.type == StratumParser::String)
+        id = "\"" + std::string(_msg.id.data, _msg.id.size) + "\"";
+
+    if (_msg.method.equals("mining.submit"))
+    {
+        submit(_session, id, _msg);
+    }
+    else if (_msg.method.equals("mining.subscribe"))
+    {
+        subscribe(_session, id);
+    }
+    else if (_msg.method.equals("mining.authorize"))
+    {
+        authorize(_session, id, _msg);
+    }
+    else if (_msg.method.equals("mining.extranonce.subscribe"))
+    {
+        // Extranonce changes are always notified
+        reply(_session, id, true);
+    }
+    else if (_msg.method.equals("eth_submitHashrate"))
+    {
+        if (_msg.count && _msg.values[0].type == StratumParser::String)
+        {
+            std::string rate(_msg.values[0].data, _msg.values[0].size);
+            _session->hashRate = strtoull(rate.c_str(), nullptr, 16);
+            _session->hashRateStamp = std::chrono::steady_clock::now();
+        }
+        reply(_session, id, true);
+    }
+    else
+    {
+        replyError(_session, id, 20, "Method not supported");
+    }
+}
+
+void StratumProxy::subscribe(SessionPtr _session, const std::string& _id)
+{
+    _session->subscribed = true;
+
+    std::string sessionId = toHex(uint32_t(_session->slot)).substr(8 - m_slotDigits);
+    auto line = std::make_shared<std::string>();
+    *line = "{\"id\":" + _id + ",\"result\":[[\"mining.notify\",\"" + sessionId +
+            "\",\"EthereumStratum/1.0.0\"],\"" + extranonce(*_session) + "\"],\"error\":null}\n";
+    send(_session, std::move(line));
+}
+
+void StratumProxy::authorize(
+    SessionPtr _session, const std::string& _id, const StratumParser::Message& _msg)
+{
+    if (!_session->subscribed)
+    {
+        replyError(_session, _id, 25, "Not subscribed");
+        return;
+    }
+
+    // Workers are not checked : shares are submitted with the
+    // credentials of the upstream connection
+    if (!_session->authorized)
+    {
+        if (_msg.count && _msg.values[0].type == StratumParser::String)
+            _session->worker.assign(_msg.values[0].data, _msg.values[0].size);
+        _session->authorized = true;
+        m_workers.fetch_add(1, std::memory_order_relaxed);
+        cnote << "Stratum proxy worker " << _session->worker << " joined from "
+              << _session->endpoint;
+    }
+    reply(_session, _id, true);
+
+    if (m_difficulty)
+        send(_session, m_difficulty);
+    if (m_notify)
+        send(_session, m_notify);
+}
+
+void StratumProxy::submit(
+    SessionPtr _session, const std::string& _id, const StratumParser::Message& _msg)
+{
+    if (!_session->authorized)
+    {
+        replyError(_session, _id, 24, "Unauthorized worker");
+        return;
+    }
+    if (_msg.count < 3 || _msg.values[1].type != StratumParser::String ||
+        _msg.values[2].type != StratumParser::String)
+    {
+        replyError(_session, _id, 20, "Invalid parameters");
+        return;
+    }
+
+    Job* job = nullptr;
+    for (auto it = m_jobs.rbegin(); it != m_jobs.rend() && !job; it++)
+        if (_msg.values[1].equals(it->id.c_str()))
+            job = &(*it);
+    if (!job)
+    {
+        m_invalid.fetch_add(1, std::memory_order_relaxed);
+        replyError(_session, _id, 21, "Job not found");
+        return;
+    }
+
+    // Miners send the part of the nonce after their extranonce
+    const StratumParser::Token& token = _msg.values[2];
+    std::string nonceHex(token.data, token.size);
+    if (nonceHex.size() > 2 && nonceHex[0] == '0' && (nonceHex[1] == 'x' || nonceHex[1] == 'X'))
+        nonceHex.erase(0, 2);
+    std::string enonce = extranonce(*_session);
+    if (nonceHex.size() + enonce.size() == 16)
+        nonceHex.insert(0, enonce);
+    bool valid = (nonceHex.size() == 16 && nonceHex.compare(0, enonce.size(), enonce) == 0);
+    for (size_t i = 0; valid && i < nonceHex.size(); i++)
+        valid = (isxdigit(static_cast<unsigned char>(nonceHex[i])) != 0);
+    if (!valid)
+    {
+        m_invalid.fetch_add(1, std::memory_order_relaxed);
+        replyError(_session, _id, 20, "Invalid nonce");
+        return;
+    }
+
+    uint64_t nonce = std::stoull(nonceHex, nullptr, 16);
+    if (!job->nonces.insert(nonce).second)
+    {
+        m_invalid.fetch_add(1, std::memory_order_relaxed);
+        replyError(_session, _id, 22, "Duplicate share");
+        return;
+    }
+
+    // The pool needs the mix hash, which also proves the share. It's
+    // computed by the farm's verifiers, not to stall other sessions
+    WorkPackage wp = job->wp;
+    std::string id = _id;
+    Farm::f().evalAsync(wp.epoch, wp.header, nonce, [this, _session, id, wp, nonce](Result r) {
+        m_io_strand.post(
+            boost::bind(&StratumProxy::submitEvaluated, this, _session, id, wp, nonce, r));
+    });
+}
+
+void StratumProxy::submitEvaluated(SessionPtr _session, const std::string& _id,
+    const WorkPackage& _wp, uint64_t _nonce, const Result& _r)
+{
+    if (_r.value > _wp.boundary)
+    {
+        m_invalid.fetch_add(1, std::memory_order_relaxed);
+        replyError(_session, _id, 23, "Low difficulty share");
+        return;
+    }
+
+    if (m_pending.size() >= TagSpan)
+    {
+        replyError(_session, _id, 20, "Too many pending shares");
+        return;
+    }
+    while (m_pending.count(TagBase + m_nextTag))
+        m_nextTag = (m_nextTag + 1) % TagSpan;
+    unsigned tag = TagBase + m_nextTag;
+    m_nextTag = (m_nextTag + 1) % TagSpan;
+
+    // Shares of all sessions queued in the same round leave upstream
+    // with one write of the client's transmit queue
+    Solution sol{_nonce, _r.mixHash, std::make_shared<const WorkPackage>(_wp),
+        std::chrono::steady_clock::now(), tag};
+    if (!PoolManager::p().submit(sol))
+    {
+        replyError(_session, _id, 20, "Not connected to pool");
+        return;
+    }
+    m_pending[tag] = {_session, _id, sol.tstamp};
+}
+
+void StratumProxy::reply(SessionPtr _session, const std::string& _id, bool _result)
+{
+    auto line = std::make_shared<std::string>();
+    *line = "{\"id\":" + _id + ",\"result\":" + (_result ? "true" : "false") + ",\"error\":null}\n";
+    send(_session, std::move(line));
+}
+
+void StratumProxy::replyError(
+    SessionPtr _session, const std::string& _id, int _code, const char* _what)
+{
+    auto line = std::make_shared<std::string>();
+    *line = "{\"id\":" + _id + ",\"result\":null,\"error\":[" + std::to_string(_code) + ",\"" +
+            _what + "\",null]}\n";
+    send(_session, std::move(line));
+}
+
+void StratumProxy::setWork(const WorkPackage& _wp)
+{
+    m_io_strand.post(boost::bind(&StratumProxy::updateWork, this, _wp));
+}
+
+void StratumProxy::suspend()
+{
+    m_io_strand.post([this]() {
+        m_jobs.clear();
+        m_notify.reset();
+        for (auto& p : m_pending)
+        {
+            auto session = p.second.session.lock();
+            if (session)
+                replyError(session, p.second.id, 20, "Pool connection lost");
+        }
+        m_pending.clear();
+    });
+}
+
+void StratumProxy::shareResult(unsigned _tag, bool _accepted)
+{
+    m_io_strand.post([this, _tag, _accepted]() {
+        auto it = m_pending.find(_tag);
+        if (it == m_pending.end())
+            return;
+        Pending pending = std::move(it->second);
+        m_pending.erase(it);
+
+        if (_accepted)
+            m_accepted.fetch_add(1, std::memory_order_relaxed);
+        else
+            m_rejected.fetch_add(1, std::memory_order_relaxed);
+
+        auto session = pending.session.lock();
+        if (!session)
+            return;
+        if (_accepted)
+            reply(session, pending.id, true);
+        else
+            replyError(session, pending.id, 23, "Rejected by pool");
+    });
+}
+
+void StratumProxy::updateWork(const WorkPackage& _wp)
+{
+    if (!m_running)
+        return;
+
+    std::string prefix = _wp.exSizeBytes ? toHex(_wp.startNonce).substr(0, _wp.exSizeBytes) : "";
+    if (prefix != m_prefix || !m_usable)
+        updateExtranonce(prefix);
+    if (!m_usable)
+        return;
+
+    // Shares of a previous epoch would be stale anyway
+    if (_wp.epoch != m_epoch)
+    {
+        m_epoch = _wp.epoch;
+        m_jobs.clear();
+        EpochManager::m().prefetch(_wp.epoch);
+    }
+
+    bool newDifficulty =
+        (!m_difficulty || m_jobs.empty() || m_jobs.back().wp.boundary != _wp.boundary);
+
+    m_jobs.emplace_back();
+    Job& job = m_jobs.back();
+    job.id = toCompactHex(uint32_t(++m_jobSequence));
+    job.wp = _wp;
+    if (!job.wp.seed)
+    {
+        // EthereumStratum/2.0.0 pools only give the epoch
+        auto seed = ethash::calculate_epoch_seed(job.wp.epoch);
+        job.wp.seed = h256(seed.bytes, h256::ConstructFromPointer);
+    }
+    if (m_jobs.size() > c_jobsKept)
+        m_jobs.pop_front();
+
+    if (newDifficulty)
+    {
+        // Targets of EthereumStratum/1.0.0 are 0x00000000ffff0000... / difficulty
+        double difficulty = getHashesToTarget(_wp.boundary.hex(HexPrefix::Add)) / 65536.0;
+        m_difficulty = std::make_shared<std::string>(
+            "{\"id\":null,\"method\":\"mining.set_difficulty\",\"params\":[" +
+            Json::valueToString(difficulty) + "]}\n");
+    }
+    m_notify = notification(m_jobs.back());
+
+    for (auto& s : m_sessions)
+    {
+        if (!s.second->authorized)
+            continue;
+        if (newDifficulty)
+            send(s.second, m_difficulty);
+        send(s.second, m_notify);
+    }
+}
+
+void StratumProxy::updateExtranonce(const std::string& _prefix)
+{
+    m_prefix = _prefix;
+    m_jobs.clear();
+    m_notify.reset();
+
+    m_usable = (m_prefix.size() + 2 <= c_maxExtranonce);
+    if (!m_usable)
+    {
+        cwarn << "Upstream extranonce " << m_prefix << " leaves no room for proxied miners";
+        auto sessions = m_sessions;
+        for (auto& s : sessions)
+            close(s.second);
+        return;
+    }
+
+    m_slotDigits = unsigned(std::min<size_t>(4, c_maxExtranonce - m_prefix.size()));
+    const unsigned capacity = 1U << (4 * m_slotDigits);
+    m_nextSlot %= capacity;
+
+    auto sessions = m_sessions;
+    for (auto& s : sessions)
+    {
+        const SessionPtr& session = s.second;
+        if (session->slot >= capacity)
+        {
+            close(session);
+        }
+        else if (session->subscribed)
+        {
+            send(session, std::make_shared<std::string>(
+                              "{\"id\":null,\"method\":\"mining.set_extranonce\",\"params\":[\"" +
+                              extranonce(*session) + "\"]}\n"));
+        }
+    }
+}
+
+std::string StratumProxy::extranonce(const Session& _session) const
+{
+    return m_prefix + toHex(uint32_t(_session.slot)).substr(8 - m_slotDigits);
+}
+
+std::shared_ptr<const std::string> StratumProxy::notification(const Job& _job) const
+{
+    return std::make_shared<std::string>(
+        "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"" + _job.id + "\",\"" +
+        _job.wp.seed.hex() + "\",\"" + _job.wp.header.hex() + "\",true]}\n");
+}
+
+std::string StratumProxy::str() const
+{
+    std::stringstream ss;
+    ss << "Proxy " << m_workers.load(std::memory_order_relaxed) << " workers "
+       << getFormattedHashes(double(m_hashRate.load(std::memory_order_relaxed))) << " A"
+       << m_accepted.load(std::memory_order_relaxed) << ":R"
+       << m_rejected.load(std::memory_order_relaxed) << ":I"
+       << m_invalid.load(std::memory_order_relaxed);
+    return ss.str();
+}
@@ -0,0 +1,164 @@
+/*
+    This file is part of ethminer.
+
+    ethminer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ethminer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+#include <boost/asio.hpp>
+
+#include <libethcore/EthashAux.h>
+
+#include "../stratum/StratumParser.h"
+
+namespace dev
+{
+namespace eth
+{
+/**
+ * @brief Local stratum server sharing the upstream session of PoolManager
+ * among many downstream miners.
+ *
+ * Downstream miners speak EthereumStratum/1.0.0 (stratum2+tcp:// in
+ * ethminer). Each session gets its own extranonce : the upstream one
+ * followed by the slot of the session, so miners never overlap and their
+ * shares can be forwarded as is. Jobs are serialized once and the same
+ * buffer is queued to every session. Shares are verified, then submitted
+ * upstream tagged so the pool's answer is routed back to the miner.
+ *
+ * Everything runs on the global io_service. Public methods may be called
+ * from any thread.
+ */
+class StratumProxy
+{
+public:
+    // Solution::midx of the shares submitted upstream
+    static constexpr unsigned TagBase = 1000;
+    static constexpr unsigned TagSpan = 4096;
+
+    StratumProxy(std::string _address, unsigned _port);
+    ~StratumProxy();
+
+    static StratumProxy* p() { return m_this; }  // nullptr when not proxying
+    static bool isTag(unsigned _midx) { return _midx >= TagBase && _midx < TagBase + TagSpan; }
+
+    /// Binds the listening socket. False if the address can't be used
+    bool start();
+    void stop();
+
+    /// New upstream job
+    void setWork(const WorkPackage& _wp);
+
+    /// Upstream connection lost : jobs are void and pending shares failed
+    void suspend();
+
+    /// Upstream answer to the share submitted as _tag. Stale shares
+    /// accepted by the pool are accepted
+    void shareResult(unsigned _tag, bool _accepted);
+
+    /// Sum of the hashrates reported by authorized workers
+    uint64_t hashRate() const { return m_hashRate.load(std::memory_order_relaxed); }
+
+    /// One line summary for the console
+    std::string str() const;
+
+private:
+    struct Session;
+    using SessionPtr = std::shared_ptr<Session>;
+
+    struct Job
+    {
+        std::string id;
+        WorkPackage wp;
+        std::unordered_set<uint64_t> nonces;  // Submitted so far
+    };
+
+    struct Pending
+    {
+        std::weak_ptr<Session> session;
+        std::string id;  // Json id of the downstream request
+        std::chrono::steady_clock::time_point tstamp;
+    };
+
+    void begin_accept();
+    void handle_accept(SessionPtr _session, const boost::system::error_code& ec);
+    void timer_elapsed(const boost::system::error_code& ec);
+
+    void read(SessionPtr _session);
+    void onRead(SessionPtr _session, const boost::system::error_code& ec);
+    void send(SessionPtr _session, std::shared_ptr<const std::string> _line);
+    void write(SessionPtr _session);
+    void onWritten(SessionPtr _session, const boost::system::error_code& ec);
+    void close(SessionPtr _session);
+
+    void process(SessionPtr _session, const StratumParser::Message& _msg);
+    void subscribe(SessionPtr _session, const std::string& _id);
+    void authorize(SessionPtr _session, const std::string& _id, const StratumParser::Message& _msg);
+    void submit(SessionPtr _session, const std::string& _id, const StratumParser::Message& _msg);
+    void submitEvaluated(SessionPtr _session, const std::string& _id, const WorkPackage& _wp,
+        uint64_t _nonce, const Result& _r);
+
+    void reply(SessionPtr _session, const std::string& _id, bool _result);
+    void replyError(SessionPtr _session, const std::string& _id, int _code, const char* _what);
+
+    void updateWork(const WorkPackage& _wp);
+    void updateExtranonce(const std::string& _prefix);
+    std::string extranonce(const Session& _session) const;
+    std::shared_ptr<const std::string> notification(const Job& _job) const;
+
+    std::string m_address;
+    unsigned m_port;
+    bool m_running = false;
+
+    boost::asio::ip::tcp::acceptor m_acceptor;
+    boost::asio::io_service::strand m_io_strand;
+    boost::asio::deadline_timer m_timer;
+
+    std::map<unsigned, SessionPtr> m_sessions;  // By slot
+    unsigned m_nextSlot = 0;
+
+    // Downstream extranonces are the upstream one and the session slot
+    std::string m_prefix;
+    unsigned m_slotDigits = 4;
+    bool m_usable = true;  // Upstream extranonce leaves room for slots
+
+    std::deque<Job> m_jobs;  // Most recent last
+    unsigned m_jobSequence = 0;
+    std::shared_ptr<const std::string> m_notify;      // Of the latest job
+    std::shared_ptr<const std::string> m_difficulty;  // Of the latest job
+    int m_epoch = -1;
+
+    std::map<unsigned, Pending> m_pending;  // By tag
+    unsigned m_nextTag = 0;
+
+    std::atomic<unsigned> m_workers = {0};
+    std::atomic<uint64_t> m_hashRate = {0};
+    std::atomic<unsigned> m_accepted = {0};
+    std::atomic<unsigned> m_rejected = {0};
+    std::atomic<unsigned> m_invalid = {0};  // Refused without reaching the pool
+
+    static StratumProxy* m_this;
+};
+
+}  // namespace eth
+}  // namespace dev
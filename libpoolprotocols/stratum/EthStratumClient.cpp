@@ -1,3 +1,6 @@
+#include <cctype>
+#include <cstring>
+
 #include <ethminer/buildinfo.h>
 #include <libdevcore/Log.h>
 #include <ethash/ethash.hpp>
@@ -20,12 +23,15 @@ EthStratumClient::EthStratumClient(int worktimeout, int responsetimeout)
     m_socket(nullptr),
     m_workloop_timer(g_io_service),
     m_response_plea_times(64),
-    m_txQueue(64),
     m_resolver(g_io_service),
     m_endpoints()
 {
     m_jSwBuilder.settings_["indentation"] = "";
 
+    Json::CharReaderBuilder jRdrBuilder;
+    jRdrBuilder.settings_["collectComments"] = false;
+    m_jReader.reset(jRdrBuilder.newCharReader());
+
     // Initialize workloop_timer to infinite wait
     m_workloop_timer.expires_at(boost::posix_time::pos_infin);
     m_workloop_timer.async_wait(m_io_strand.wrap(boost::bind(
@@ -241,7 +247,10 @@ void EthStratumClient::disconnect_finalize()
 
     // Release session if exits
     if (m_session)
+    {
         m_conn->addDuration(m_session->duration());
+        capture(TrafficCapture::Event, "disconnect");
+    }
     m_session = nullptr;
 
     m_authpending.store(false, std::memory_order_relaxed);
@@ -292,13 +301,20 @@ void EthStratumClient::resolve_handler(
 {
     if (!ec)
     {
+        std::vector<tcp::endpoint> endpoints;
         while (i != tcp::resolver::iterator())
         {
-            m_endpoints.push(i->endpoint());
+            endpoints.push_back(i->endpoint());
             i++;
         }
         m_resolver.cancel();
 
+        // Try the nearest addresses first
+        if (LatencyProbe::p())
+            LatencyProbe::p()->sort(*m_conn, endpoints);
+        for (auto& ep : endpoints)
+            m_endpoints.push(ep);
+
         // Resolver has finished so invoke connection asynchronously
         m_io_service.post(m_io_strand.wrap(boost::bind(&EthStratumClient::start_connect, this)));
     }
@@ -507,11 +523,14 @@ void EthStratumClient::connect_handler(const boost::system::error_code& ec)
     // We got a socket connection established
     m_conn->Responds(true);
     m_connected.store(true, memory_order_relaxed);
+    capture(TrafficCapture::Event, "connect " + m_conn->Host() + ":" + to_string(m_conn->Port()));
 
-    m_message.clear();
+    m_recvBuffer.consume(m_recvBuffer.size());
+    m_recvScanned = 0;
 
     // Clear txqueue
-    m_txQueue.consume_all([](std::string* l) { delete l; });
+    m_txQueue.clear();
+    clearSubmitTemplates();
 
 #ifdef DEV_BUILD
     if (g_logOptions & LOG_CONNECT)
@@ -569,8 +588,6 @@ void EthStratumClient::connect_handler(const boost::system::error_code& ec)
         m_nonsecuresocket->set_option(tcp::no_delay(true));
     }
 
-    // Clean buffer from any previous stale data
-    m_sendBuffer.consume(4096);
     clear_response_pleas();
 
     /*
@@ -668,6 +685,9 @@ void EthStratumClient::startSession()
     m_session = unique_ptr<Session>(new Session());
     m_current_timestamp = std::chrono::steady_clock::now();
 
+    // Replays need the flavour to make sense of the lines
+    capture(TrafficCapture::Event, "mode " + to_string(m_conn->StratumMode()));
+
     // Invoke higher level handlers
     if (m_onConnected)
         m_onConnected();
@@ -1328,6 +1348,8 @@ void EthStratumClient::processResponse(Json::Value& responseObject)
                         m_current.exSizeBytes = m_session->extraNonceSizeBytes;
                         m_current_timestamp = std::chrono::steady_clock::now();
                         m_current.block = -1;
+                        m_current.clean = jPrm.get(Json::Value::ArrayIndex(3), false).isBool() &&
+                                          jPrm.get(Json::Value::ArrayIndex(3), false).asBool();
 
                         // This will signal to dispatch the job
                         // at the end of the transmission.
@@ -1379,6 +1401,7 @@ void EthStratumClient::processResponse(Json::Value& responseObject)
                     m_current.header = h256(sHeaderHash);
                     m_current.boundary = h256(sShareTarget);
                     m_current_timestamp = std::chrono::steady_clock::now();
+                    m_current.clean = false;  // Not carried by these flavours
 
                     // This will signal to dispatch the job
                     // at the end of the transmission.
@@ -1428,6 +1451,12 @@ void EthStratumClient::processResponse(Json::Value& responseObject)
             m_current.exSizeBytes = m_session->extraNonceSizeBytes;
             m_current_timestamp = std::chrono::steady_clock::now();
 
+            // Last parameter is the clean_jobs flag
+            Json::Value jClean = jPrm.get(Json::Value::ArrayIndex(3), "0");
+            m_current.clean = jClean.isBool() ?
+                                  jClean.asBool() :
+                                  (jClean.asString() != "0" && jClean.asString() != "false");
+
             // This will signal to dispatch the job
             // at the end of the transmission.
             m_newjobprocessed = true;
@@ -1589,67 +1618,151 @@ void EthStratumClient::submitHashrate(uint64_t const& rate, string const& id)
     send(jReq);
 }
 
-void EthStratumClient::submitSolution(const Solution& solution)
+namespace
 {
-    if (!isAuthorized())
+inline void putHex(char* _out, const byte* _data, size_t _bytes)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < _bytes; i++)
     {
-        cwarn << "Solution not submitted. Not authorized.";
-        return;
+        *_out++ = digits[_data[i] >> 4];
+        *_out++ = digits[_data[i] & 0x0f];
     }
+}
 
-    Json::Value jReq;
+}  // namespace
 
-    unsigned id = 40 + solution.midx;
-    jReq["id"] = id;
-    m_solution_submitted_max_id = max(m_solution_submitted_max_id, id);
-    jReq["method"] = "mining.submit";
-    jReq["params"] = Json::Value(Json::arrayValue);
+void EthStratumClient::clearSubmitTemplates()
+{
+    std::lock_guard<std::mutex> l(m_submitMutex);
+    for (auto& t : m_submitTemplates)
+        t.job.clear();
+}
 
-    switch (m_conn->StratumMode())
+const EthStratumClient::SubmitTemplate& EthStratumClient::submitTemplate(const Solution& _s)
+{
+    unsigned mode = m_conn->StratumMode();
+    for (auto& t : m_submitTemplates)
+        if (!t.job.empty() && t.mode == mode && t.job == _s.work->job &&
+            t.header == _s.work->header && t.exSizeBytes == _s.work->exSizeBytes)
+            return t;
+
+    // Build the request once with placeholders for the varying slots.
+    // Members are laid out as Json::StreamWriter would have them.
+    SubmitTemplate& t = m_submitTemplates[m_submitNext];
+    m_submitNext = (m_submitNext + 1) % m_submitTemplates.size();
+    t.mode = mode;
+    t.job = _s.work->job;
+    t.header = _s.work->header;
+    t.exSizeBytes = _s.work->exSizeBytes;
+    t.mixAt = std::string::npos;
+
+    std::string& r = t.text;
+    auto nonceSlot = [&](bool _prefix) {
+        r += _prefix ? "\"0x" : "\"";
+        t.nonceAt = r.size();
+        t.nonceDigits = _prefix ? 16 : 16 - std::min(16u, t.exSizeBytes);
+        r.append(t.nonceDigits, '0');
+        r += "\"";
+    };
+    auto mixSlot = [&]() {
+        r += "\"0x";
+        t.mixAt = r.size();
+        r.append(64, '0');
+        r += "\"";
+    };
+    auto worker = [&]() {
+        if (!m_conn->Workername().empty())
+            r += ",\"worker\":" + Json::valueToQuotedString(m_conn->Workername().c_str());
+    };
+    std::string job = Json::valueToQuotedString(_s.work->job.c_str());
+
+    switch (mode)
     {
     case EthStratumClient::STRATUM:
 
-        jReq["jsonrpc"] = "2.0";
-        jReq["params"].append(m_conn->User());
-        jReq["params"].append(solution.work.job);
-        jReq["params"].append(toHex(solution.nonce, HexPrefix::Add));
-        jReq["params"].append(solution.work.header.hex(HexPrefix::Add));
-        jReq["params"].append(solution.mixHash.hex(HexPrefix::Add));
-        if (!m_conn->Workername().empty())
-            jReq["worker"] = m_conn->Workername();
-
+        r = ",\"jsonrpc\":\"2.0\",\"method\":\"mining.submit\",\"params\":[";
+        r += Json::valueToQuotedString(m_conn->User().c_str()) + "," + job + ",";
+        nonceSlot(true);
+        r += ",\"" + _s.work->header.hex(HexPrefix::Add) + "\",";
+        mixSlot();
+        r += "]";
+        worker();
         break;
 
     case EthStratumClient::ETHPROXY:
 
-        jReq["method"] = "eth_submitWork";
-        jReq["params"].append(toHex(solution.nonce, HexPrefix::Add));
-        jReq["params"].append(solution.work.header.hex(HexPrefix::Add));
-        jReq["params"].append(solution.mixHash.hex(HexPrefix::Add));
-        if (!m_conn->Workername().empty())
-            jReq["worker"] = m_conn->Workername();
-
+        r = ",\"method\":\"eth_submitWork\",\"params\":[";
+        nonceSlot(true);
+        r += ",\"" + _s.work->header.hex(HexPrefix::Add) + "\",";
+        mixSlot();
+        r += "]";
+        worker();
         break;
 
     case EthStratumClient::ETHEREUMSTRATUM:
 
-        jReq["params"].append(m_conn->UserDotWorker());
-        jReq["params"].append(solution.work.job);
-        jReq["params"].append(
-            toHex(solution.nonce, HexPrefix::DontAdd).substr(solution.work.exSizeBytes));
+        r = ",\"method\":\"mining.submit\",\"params\":[";
+        r += Json::valueToQuotedString(m_conn->UserDotWorker().c_str()) + "," + job + ",";
+        nonceSlot(false);
+        r += "]";
         break;
-        
+
     case EthStratumClient::ETHEREUMSTRATUM2:
 
-        jReq["params"].append(solution.work.job);
-        jReq["params"].append(
-            toHex(solution.nonce, HexPrefix::DontAdd).substr(solution.work.exSizeBytes));
-        jReq["params"].append(m_session->workerId);
-        break;        
+        r = ",\"method\":\"mining.submit\",\"params\":[" + job + ",";
+        nonceSlot(false);
+        r += "," + Json::valueToQuotedString(m_session->workerId.c_str()) + "]";
+        break;
+    }
+    r += "}";
+    return t;
+}
+
+void EthStratumClient::submitSolution(const Solution& solution)
+{
+    if (!isAuthorized())
+    {
+        cwarn << "Solution not submitted. Not authorized.";
+        return;
+    }
+
+    unsigned id = 40 + solution.midx;
+    m_solution_submitted_max_id = max(m_solution_submitted_max_id, id);
+
+    // Only the json id, the nonce and the mix hash change from one
+    // solution of a job to the next : patch them into the job's template
+    std::string* line = m_txQueue.acquire();
+    *line = "{\"id\":";
+    {
+        std::lock_guard<std::mutex> l(m_submitMutex);
+        const SubmitTemplate& t = submitTemplate(solution);
+        line->reserve(line->size() + 10 + t.text.size());
+        *line += std::to_string(id);
+        size_t base = line->size();
+        *line += t.text;
+
+        byte nonce[8];
+        for (unsigned i = 0; i < 8; i++)
+            nonce[i] = byte(solution.nonce >> (56 - i * 8));
+        char hex[16];
+        putHex(hex, nonce, 8);
+        memcpy(&(*line)[base + t.nonceAt], hex + (16 - t.nonceDigits), t.nonceDigits);
+        if (t.mixAt != std::string::npos)
+            putHex(&(*line)[base + t.mixAt], solution.mixHash.data(), 32);
     }
 
     enqueue_response_plea();
-    send(jReq);
+    send(line);
+}
+
+void EthStratumClient::setCapture(std::shared_ptr<TrafficCapture> _capture)
+{
+    PoolClient::setCapture(std::move(_capture));
+
+    // A client promoted from standby starts recording mid session
+    if (m_session && m_conn && m_conn->StratumModeConfirmed())
+        capture(TrafficCapture::Event, "mode " + to_string(m_conn->StratumMode()));
 }
 
 void EthStratumClient::recvSocketData()
@@ -1696,58 +1809,35 @@ void EthStratumClient::onRecvSocketDataCompleted(
             thus invalidating the previous point 2
         */
 
-        // Extract received message and free the buffer
-        std::string rx_message(
-            boost::asio::buffer_cast<const char*>(m_recvBuffer.data()), bytes_transferred);
-        m_recvBuffer.consume(bytes_transferred);
-        m_message.append(rx_message);
+        // Lines are scanned in place. Only complete ones are consumed,
+        // a partial line stays in the buffer for following reads
+        (void)bytes_transferred;
+        const char* data = boost::asio::buffer_cast<const char*>(m_recvBuffer.data());
+        const size_t size = m_recvBuffer.size();
+        size_t consumed = 0;
 
         // Process each line in the transmission
         // NOTE : as multiple jobs may come in with
         // a single transmission only the last will be dispatched
         m_newjobprocessed = false;
-        std::string line;
-        size_t offset = m_message.find("\n");
-        while (offset != string::npos)
+        const char* newline;
+        while ((newline = static_cast<const char*>(
+                    memchr(data + m_recvScanned, '\n', size - m_recvScanned))) != nullptr)
         {
-            if (offset > 0)
-            {
-                line = m_message.substr(0, offset);
-                boost::trim(line);
-
-                if (!line.empty())
-                {
-                    // Out received message only for debug purpouses
-                    if (g_logOptions & LOG_JSON)
-                        cnote << " << " << line;
-
-                    // Test validity of chunk and process
-                    Json::Value jMsg;
-                    Json::Reader jRdr;
-                    if (jRdr.parse(line, jMsg))
-                    {
-                        try
-                        {
-                            // Run in sync so no 2 different async reads may overlap
-                            processResponse(jMsg);
-                        }
-                        catch (const std::exception& _ex)
-                        {
-                            cwarn << "Stratum got invalid Json message : " << _ex.what();
-                        }
-                    }
-                    else
-                    {
-                        string what = jRdr.getFormattedErrorMessages();
-                        boost::replace_all(what, "\n", " ");
-                        cwarn << "Stratum got invalid Json message : " << what;
-                    }
-                }
-            }
-
-            m_message.erase(0, offset + 1);
-            offset = m_message.find("\n");
+            const char* begin = data + consumed;
+            const char* end = newline;
+            while (begin < end && isspace((unsigned char)*begin))
+                begin++;
+            while (end > begin && isspace((unsigned char)end[-1]))
+                end--;
+            if (begin < end)
+                processLine(begin, end);
+
+            consumed = size_t(newline - data) + 1;
+            m_recvScanned = consumed;
         }
+        m_recvBuffer.consume(consumed);
+        m_recvScanned = size - consumed;
 
         // There is a new job - dispatch it
         if (m_newjobprocessed)
@@ -1787,10 +1877,186 @@ void EthStratumClient::onRecvSocketDataCompleted(
     }
 }
 
+void EthStratumClient::processLine(const char* _begin, const char* _end)
+{
+    // Out received message only for debug purpouses
+    if (g_logOptions & LOG_JSON)
+        cnote << " << " << std::string(_begin, _end);
+    capture(TrafficCapture::Inbound, _begin, size_t(_end - _begin));
+
+    if (processFastPath(_begin, _end))
+        return;
+
+    // Test validity of chunk and process
+    Json::Value jMsg;
+    std::string what;
+    if (m_jReader->parse(_begin, _end, &jMsg, &what))
+    {
+        try
+        {
+            // Run in sync so no 2 different async reads may overlap
+            processResponse(jMsg);
+        }
+        catch (const std::exception& _ex)
+        {
+            cwarn << "Stratum got invalid Json message : " << _ex.what();
+        }
+    }
+    else
+    {
+        boost::replace_all(what, "\n", " ");
+        cwarn << "Stratum got invalid Json message : " << what;
+    }
+}
+
+bool EthStratumClient::processFastPath(const char* _begin, const char* _end)
+{
+    // Handles the most frequent messages without building a json tree.
+    // Outcome must be the same of processResponse() : anything not
+    // plainly valid is left to it
+    StratumParser::Message msg;
+    if (!StratumParser::parse(_begin, _end, msg))
+        return false;
+    if (!m_conn->StratumModeConfirmed() || m_conn->StratumMode() == ETHEREUMSTRATUM2 ||
+        (msg.jsonrpc.type != StratumParser::Absent && !msg.jsonrpc.equals("2.0")))
+        return false;
+
+    unsigned id = 0;
+    if (msg.id.type == StratumParser::Number)
+    {
+        char* idEnd;
+        id = unsigned(strtoul(msg.id.data, &idEnd, 10));
+        if (idEnd != msg.id.data + msg.id.size)
+            return false;
+    }
+    else if (msg.id.type != StratumParser::Absent && msg.id.type != StratumParser::Null)
+        return false;
+
+    const bool isNotification = (msg.method.type != StratumParser::Absent || id == 0);
+    const bool noError =
+        (msg.error.type == StratumParser::Absent || msg.error.type == StratumParser::Null);
+
+    if (!isNotification)
+    {
+        // Response to solution submission
+        if (id < 40 || id > m_solution_submitted_max_id || !noError ||
+            msg.result.type != StratumParser::Bool)
+            return false;
+
+        std::chrono::milliseconds response_delay_ms = dequeue_response_plea();
+        const unsigned miner_index = id - 40;
+        if (msg.result.equals("true"))
+        {
+            if (m_onSolutionAccepted)
+                m_onSolutionAccepted(response_delay_ms, miner_index, false);
+        }
+        else if (m_onSolutionRejected)
+        {
+            cwarn << "Reject reason : Unspecified";
+            m_onSolutionRejected(response_delay_ms, miner_index);
+        }
+        return true;
+    }
+
+    if (msg.method.type != StratumParser::Absent && msg.method.type != StratumParser::String)
+        return false;
+
+    const bool isProxyJob = (msg.method.type == StratumParser::Absent &&
+                             m_conn->StratumMode() == ETHPROXY && msg.fromResult);
+    if (msg.method.equals("mining.notify") || isProxyJob)
+    {
+        // As processResponse() in eth-proxy mode a result member, even
+        // not an array, supersedes params
+        if (!msg.count || (m_conn->StratumMode() == ETHPROXY && !msg.fromResult &&
+                              msg.result.type != StratumParser::Absent))
+            return false;
+        if (!isSubscribed() || m_newjobprocessed)
+            return true;
+
+        const StratumParser::Token* prm = msg.values;
+        if (prm[0].type != StratumParser::String)
+            return false;
+
+        h256 seed, header, boundary;
+        if (m_conn->StratumMode() == ETHEREUMSTRATUM)
+        {
+            if (msg.count < 3 || !StratumParser::toHash(prm[1], seed) ||
+                !StratumParser::toHash(prm[2], header))
+                return false;
+
+            m_current.job.assign(prm[0].data, prm[0].size);
+            m_current.seed = seed;
+            m_current.header = header;
+            m_current.boundary = m_session->nextWorkBoundary;
+            m_current.startNonce = m_session->extraNonce;
+            m_current.exSizeBytes = m_session->extraNonceSizeBytes;
+            m_current_timestamp = std::chrono::steady_clock::now();
+            m_current.block = -1;
+            m_current.clean = (msg.count > 3 && prm[3].type == StratumParser::Bool &&
+                               prm[3].equals("true"));
+            m_newjobprocessed = true;
+            return true;
+        }
+
+        unsigned prmIdx = (msg.fromResult ? 0 : 1);
+        if (msg.count < prmIdx + 3 || !StratumParser::toHash(prm[prmIdx], header) ||
+            !StratumParser::toHash(prm[prmIdx + 1], seed) ||
+            !StratumParser::toHash(prm[prmIdx + 2], boundary, true))
+            return false;
+
+        // Only some eth-proxy compatible implementations carry the block number
+        int block = -1;
+        const StratumParser::Token& blockPrm = prm[prmIdx + 3];
+        if (m_conn->StratumMode() == ETHPROXY && msg.count > prmIdx + 3)
+        {
+            if (blockPrm.type != StratumParser::String)
+                return false;
+            if (blockPrm.size > 2 && blockPrm.data[0] == '0' && blockPrm.data[1] == 'x')
+            {
+                // Token is followed by its closing quote
+                unsigned long number = strtoul(blockPrm.data, nullptr, 16);
+                if (number <= 0x9660180)
+                    block = int(number);
+            }
+        }
+
+        m_current.job.assign(prm[0].data, prm[0].size);
+        m_current.block = block;
+        m_current.seed = seed;
+        m_current.header = header;
+        m_current.boundary = boundary;
+        m_current_timestamp = std::chrono::steady_clock::now();
+        m_current.clean = false;
+        m_newjobprocessed = true;
+        return true;
+    }
+
+    if (msg.method.equals("mining.set_difficulty") && m_conn->StratumMode() == ETHEREUMSTRATUM)
+    {
+        if (!msg.hasArray || msg.fromResult || !msg.count ||
+            msg.values[0].type != StratumParser::Number)
+            return false;
+
+        double nextWorkDifficulty = max(strtod(msg.values[0].data, nullptr), 0.0001);
+        m_session->nextWorkBoundary = h256(dev::getTargetFromDiff(nextWorkDifficulty));
+        return true;
+    }
+
+    return false;
+}
+
 void EthStratumClient::send(Json::Value const& jReq)
 {
-    std::string* line = new std::string(Json::writeString(m_jSwBuilder, jReq));
-    m_txQueue.push(line);
+    std::string* line = m_txQueue.acquire();
+    line->assign(Json::writeString(m_jSwBuilder, jReq));
+    send(line);
+}
+
+void EthStratumClient::send(std::string* _line)
+{
+    capture(TrafficCapture::Outbound, *_line);
+    _line->push_back('\n');
+    m_txQueue.push(_line);
 
     bool ex = false;
     if (m_txPending.compare_exchange_strong(ex, true, std::memory_order_relaxed))
@@ -1801,33 +2067,28 @@ void EthStratumClient::sendSocketData()
 {
     if (!isConnected() || m_txQueue.empty())
     {
-        m_sendBuffer.consume(m_sendBuffer.capacity());
-        m_txQueue.consume_all([](std::string* l) { delete l; });
+        m_txQueue.clear();
         m_txPending.store(false, std::memory_order_relaxed);
         return;
     }
 
-    std::string* line;
-    std::ostream os(&m_sendBuffer);
-    while (m_txQueue.pop(line))
-    {
-        os << *line << std::endl;
-        // Out received message only for debug purpouses
-        if (g_logOptions & LOG_JSON)
-            cnote << " >> " << *line;
+    // Everything queued so far leaves with one gather write
+    m_txQueue.take();
 
-        delete line;
-    }
+    // Out received message only for debug purpouses
+    if (g_logOptions & LOG_JSON)
+        for (const std::string* line : m_txQueue.lines())
+            cnote << " >> " << line->substr(0, line->size() - 1);
 
     if (m_conn->SecLevel() != SecureLevel::NONE)
     {
-        async_write(*m_securesocket, m_sendBuffer,
+        async_write(*m_securesocket, m_txQueue.buffers(),
             m_io_strand.wrap(boost::bind(&EthStratumClient::onSendSocketDataCompleted, this,
                 boost::asio::placeholders::error)));
     }
     else
     {
-        async_write(*m_nonsecuresocket, m_sendBuffer,
+        async_write(*m_nonsecuresocket, m_txQueue.buffers(),
             m_io_strand.wrap(boost::bind(&EthStratumClient::onSendSocketDataCompleted, this,
                 boost::asio::placeholders::error)));
     }
@@ -1837,8 +2098,7 @@ void EthStratumClient::onSendSocketDataCompleted(const boost::system::error_code
 {
     if (ec)
     {
-        m_sendBuffer.consume(m_sendBuffer.capacity());
-        m_txQueue.consume_all([](std::string* l) { delete l; });
+        m_txQueue.clear();
         m_txPending.store(false, std::memory_order_relaxed);
 
         if ((ec.category() == boost::asio::error::get_ssl_category()) &&
@@ -1861,6 +2121,7 @@ void EthStratumClient::onSendSocketDataCompleted(const boost::system::error_code
         if (m_session && m_conn->StratumMode() == 3)
             m_session->lastTxStamp = chrono::steady_clock::now();
 
+        m_txQueue.done();
         if (m_txQueue.empty())
             m_txPending.store(false, std::memory_order_relaxed);
         else
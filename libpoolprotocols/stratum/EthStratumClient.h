@@ -1,6 +1,8 @@
 #pragma once
 
+#include <array>
 #include <iostream>
+#include <mutex>
 
 #include <boost/array.hpp>
 #include <boost/asio.hpp>
@@ -16,7 +18,10 @@
 #include <libethcore/Farm.h>
 #include <libethcore/Miner.h>
 
+#include "../LatencyProbe.h"
 #include "../PoolClient.h"
+#include "../TxQueue.h"
+#include "StratumParser.h"
 
 using namespace std;
 using namespace dev;
@@ -80,6 +85,8 @@ public:
     void submitHashrate(uint64_t const& rate, string const& id) override;
     void submitSolution(const Solution& solution) override;
 
+    void setCapture(std::shared_ptr<TrafficCapture> _capture) override;
+
     h256 currentHeaderHash() { return m_current.header; }
     bool current() { return static_cast<bool>(m_current); }
 
@@ -95,6 +102,8 @@ private:
     void connect_handler(const boost::system::error_code& ec);
     void workloop_timer_elapsed(const boost::system::error_code& ec);
 
+    void processLine(const char* _begin, const char* _end);
+    bool processFastPath(const char* _begin, const char* _end);
     void processResponse(Json::Value& responseObject);
     std::string processError(Json::Value& erroresponseObject);
     void processExtranonce(std::string& enonce);
@@ -103,6 +112,7 @@ private:
     void onRecvSocketDataCompleted(
         const boost::system::error_code& ec, std::size_t bytes_transferred);
     void send(Json::Value const& jReq);
+    void send(std::string* _line);
     void sendSocketData();
     void onSendSocketDataCompleted(const boost::system::error_code& ec);
     void onSSLShutdownCompleted(const boost::system::error_code& ec);
@@ -126,7 +136,6 @@ private:
     boost::asio::io_service& m_io_service;  // The IO service reference passed in the constructor
     boost::asio::io_service::strand m_io_strand;
     boost::asio::ip::tcp::socket* m_socket;
-    std::string m_message;  // The internal message string buffer
     bool m_newjobprocessed = false;
 
     // Use shared ptrs to avoid crashes due to async_writes
@@ -135,9 +144,10 @@ private:
     std::shared_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>> m_securesocket;
     std::shared_ptr<boost::asio::ip::tcp::socket> m_nonsecuresocket;
 
-    boost::asio::streambuf m_sendBuffer;
     boost::asio::streambuf m_recvBuffer;
+    size_t m_recvScanned = 0;  // Bytes of m_recvBuffer known not to hold a newline
     Json::StreamWriterBuilder m_jSwBuilder;
+    std::unique_ptr<Json::CharReader> m_jReader;
 
     boost::asio::deadline_timer m_workloop_timer;
 
@@ -146,13 +156,33 @@ private:
     boost::lockfree::queue<std::chrono::steady_clock::time_point> m_response_plea_times;
 
     std::atomic<bool> m_txPending = {false};
-    boost::lockfree::queue<std::string*> m_txQueue;
+    TxQueue m_txQueue;
 
     boost::asio::ip::tcp::resolver m_resolver;
     std::queue<boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>> m_endpoints;
 
     unsigned m_solution_submitted_max_id;  // maximum json id we used to send a solution
 
+    // Pre serialized mining.submit request of a job. Once built only the id,
+    // the nonce and the mix hash are patched in for each solution
+    struct SubmitTemplate
+    {
+        unsigned mode = 0;
+        std::string job;
+        h256 header;
+        unsigned exSizeBytes = 0;
+        std::string text;                  // Whole request after '{"id":'
+        size_t nonceAt = 0;                // Offset of nonce slot
+        size_t nonceDigits = 0;            // Width of nonce slot
+        size_t mixAt = std::string::npos;  // Offset of mix hash slot (if any)
+    };
+    const SubmitTemplate& submitTemplate(const Solution& _s);  // Requires m_submitMutex
+    void clearSubmitTemplates();
+
+    std::mutex m_submitMutex;
+    std::array<SubmitTemplate, 4> m_submitTemplates;  // Most recent jobs
+    unsigned m_submitNext = 0;
+
     ///@brief Auxiliary function to make verbose_verification objects.
     template <typename Verifier>
     verbose_verification<Verifier> make_verbose_verification(Verifier verifier)
@@ -0,0 +1,223 @@
+/*
+    This file is part of ethminer.
+
+    ethminer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ethminer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "StratumParser.h"
+
+namespace dev
+{
+namespace eth
+{
+namespace
+{
+inline void skipWs(const char*& _p, const char* _end)
+{
+    while (_p < _end && (*_p == ' ' || *_p == '\t' || *_p == '\r' || *_p == '\n'))
+        _p++;
+}
+
+inline bool match(const char*& _p, const char* _end, const char* _word)
+{
+    size_t n = strlen(_word);
+    if (size_t(_end - _p) < n || memcmp(_p, _word, n) != 0)
+        return false;
+    _p += n;
+    return true;
+}
+
+// Scans a scalar value. Arrays and objects are not scalars
+bool scalar(const char*& _p, const char* _end, StratumParser::Token& _token)
+{
+    if (_p >= _end)
+        return false;
+
+    if (*_p == '"')
+    {
+        const char* begin = ++_p;
+        while (_p < _end && *_p != '"')
+        {
+            if (*_p == '\\')
+                return false;
+            _p++;
+        }
+        if (_p >= _end)
+            return false;
+        _token.data = begin;
+        _token.size = size_t(_p - begin);
+        _token.type = StratumParser::String;
+        _p++;
+        return true;
+    }
+
+    const char* begin = _p;
+    if (match(_p, _end, "null"))
+        _token.type = StratumParser::Null;
+    else if (match(_p, _end, "true") || match(_p, _end, "false"))
+        _token.type = StratumParser::Bool;
+    else
+    {
+        while (_p < _end && ((*_p >= '0' && *_p <= '9') || *_p == '-' || *_p == '+' ||
+                                *_p == '.' || *_p == 'e' || *_p == 'E'))
+            _p++;
+        if (_p == begin)
+            return false;
+        _token.type = StratumParser::Number;
+    }
+    _token.data = begin;
+    _token.size = size_t(_p - begin);
+    return true;
+}
+
+inline int nibble(char _c)
+{
+    if (_c >= '0' && _c <= '9')
+        return _c - '0';
+    if (_c >= 'a' && _c <= 'f')
+        return _c - 'a' + 10;
+    if (_c >= 'A' && _c <= 'F')
+        return _c - 'A' + 10;
+    return -1;
+}
+
+}  // namespace
+
+bool StratumParser::parse(const char* _begin, const char* _end, Message& _msg)
+{
+    const char* p = _begin;
+    skipWs(p, _end);
+    if (p >= _end || *p++ != '{')
+        return false;
+
+    skipWs(p, _end);
+    if (p < _end && *p == '}')
+        return false;
+
+    while (true)
+    {
+        Token key;
+        skipWs(p, _end);
+        if (p >= _end || *p != '"' || !scalar(p, _end, key))
+            return false;
+        skipWs(p, _end);
+        if (p >= _end || *p++ != ':')
+            return false;
+        skipWs(p, _end);
+        if (p >= _end)
+            return false;
+
+        if (*p == '[')
+        {
+            // Only one array, made of scalars, as params or result
+            bool isResult = key.equals("result");
+            if ((!isResult && !key.equals("params")) || _msg.hasArray)
+                return false;
+            _msg.hasArray = true;
+            _msg.fromResult = isResult;
+            p++;
+            skipWs(p, _end);
+            if (p < _end && *p == ']')
+                p++;
+            else
+            {
+                while (true)
+                {
+                    if (_msg.count == MaxValues)
+                        return false;
+                    skipWs(p, _end);
+                    if (!scalar(p, _end, _msg.values[_msg.count++]))
+                        return false;
+                    skipWs(p, _end);
+                    if (p < _end && *p == ',')
+                    {
+                        p++;
+                        continue;
+                    }
+                    if (p < _end && *p == ']')
+                    {
+                        p++;
+                        break;
+                    }
+                    return false;
+                }
+            }
+        }
+        else
+        {
+            Token value;
+            if (!scalar(p, _end, value))
+                return false;
+            if (key.equals("id"))
+                _msg.id = value;
+            else if (key.equals("jsonrpc"))
+                _msg.jsonrpc = value;
+            else if (key.equals("method"))
+                _msg.method = value;
+            else if (key.equals("error"))
+                _msg.error = value;
+            else if (key.equals("result"))
+                _msg.result = value;
+        }
+
+        skipWs(p, _end);
+        if (p < _end && *p == ',')
+        {
+            p++;
+            continue;
+        }
+        if (p < _end && *p == '}')
+        {
+            p++;
+            break;
+        }
+        return false;
+    }
+
+    skipWs(p, _end);
+    return p == _end;
+}
+
+bool StratumParser::toHash(const Token& _token, h256& _hash, bool _alignRight)
+{
+    if (_token.type != String)
+        return false;
+
+    const char* p = _token.data;
+    size_t n = _token.size;
+    bool prefixed = (n >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'));
+    if (prefixed)
+    {
+        p += 2;
+        n -= 2;
+    }
+    if (n > 64 || (n % 2) || (_alignRight ? !prefixed : n != 64))
+        return false;
+
+    h256 hash;
+    byte* out = hash.data() + (32 - n / 2);
+    for (size_t i = 0; i < n; i += 2)
+    {
+        int hi = nibble(p[i]);
+        int lo = nibble(p[i + 1]);
+        if (hi < 0 || lo < 0)
+            return false;
+        *out++ = byte((hi << 4) | lo);
+    }
+    _hash = hash;
+    return true;
+}
+
+}  // namespace eth
+}  // namespace dev
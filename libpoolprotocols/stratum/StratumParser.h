@@ -0,0 +1,94 @@
+/*
+    This file is part of ethminer.
+
+    ethminer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ethminer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+#include <libdevcore/FixedHash.h>
+
+namespace dev
+{
+namespace eth
+{
+/**
+ * @brief Allocation free scanner of the flat json objects making most of
+ * stratum traffic (jobs, difficulty changes, submission responses).
+ *
+ * Values are left in place : tokens point into the scanned line. Objects
+ * holding anything else than scalars, or one array of scalars as "params"
+ * or "result", or strings with escapes, are reported as not handled so
+ * the caller falls back to a full json parser.
+ */
+class StratumParser
+{
+public:
+    enum TokenType
+    {
+        Absent = 0,
+        Null,
+        Bool,
+        Number,
+        String
+    };
+
+    struct Token
+    {
+        const char* data = nullptr;  // Unquoted for strings
+        size_t size = 0;
+        TokenType type = Absent;
+
+        bool equals(const char* _s) const
+        {
+            return type != Absent && strlen(_s) == size && memcmp(data, _s, size) == 0;
+        }
+    };
+
+    static constexpr unsigned MaxValues = 8;
+
+    struct Message
+    {
+        Token id;
+        Token jsonrpc;
+        Token method;
+        Token error;
+        Token result;  // When scalar
+
+        // Members of "params" or "result" array
+        Token values[MaxValues];
+        unsigned count = 0;
+        bool hasArray = false;
+        bool fromResult = false;  // Array is "result"
+    };
+
+    /**
+     * @brief Scans the json object in [_begin, _end)
+     * @return false if the line is not in the handled subset
+     */
+    static bool parse(const char* _begin, const char* _end, Message& _msg);
+
+    /**
+     * @brief Decodes a hex string token straight into _hash. With _alignRight
+     * shorter strings (which then require a 0x prefix) are left padded with
+     * zeroes, otherwise exactly 64 digits are expected.
+     */
+    static bool toHash(const Token& _token, h256& _hash, bool _alignRight = false);
+};
+
+}  // namespace eth
+}  // namespace dev
@@ -0,0 +1,312 @@
+#include <libdevcore/Log.h>
+#include <chrono>
+#include <iomanip>
+
+#include <json/json.h>
+
+#include "../TrafficCapture.h"
+#include "ReplayClient.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace dev;
+using namespace eth;
+
+ReplayClient::ReplayClient(string const& _path, float _speed)
+  : PoolClient(), Worker("replay"), m_path(_path), m_speed(_speed > 0 ? _speed : 1.0f)
+{
+}
+
+ReplayClient::~ReplayClient() = default;
+
+void ReplayClient::connect()
+{
+    string error;
+    if (m_jobs.empty() && !load(error))
+    {
+        cwarn << "Replay of " << m_path << " failed : " << error;
+        m_conn->MarkUnrecoverable();
+        if (m_onDisconnected)
+            m_onDisconnected();
+        return;
+    }
+
+    cnote << "Replaying " << m_jobs.size() << " jobs of " << m_path << " at speed " << m_speed;
+
+    // Initialize new session
+    m_connected.store(true, memory_order_relaxed);
+    m_session = unique_ptr<Session>(new Session);
+    m_session->subscribed.store(true, memory_order_relaxed);
+    m_session->authorized.store(true, memory_order_relaxed);
+    m_replaying.store(true, memory_order_relaxed);
+
+    if (m_onConnected)
+        m_onConnected();
+
+    startWorking();
+}
+
+void ReplayClient::disconnect()
+{
+    bool ex = true;
+    if (!m_connected.compare_exchange_strong(ex, false, memory_order_relaxed))
+        return;
+
+    m_replaying.store(false, memory_order_relaxed);
+    report();
+
+    m_conn->addDuration(m_session->duration());
+    m_session = nullptr;
+
+    if (m_onDisconnected)
+        m_onDisconnected();
+}
+
+void ReplayClient::submitHashrate(uint64_t const& rate, string const& id)
+{
+    (void)rate;
+    (void)id;
+}
+
+void ReplayClient::submitSolution(const Solution& solution)
+{
+    // Evaluated locally as SimulateClient does
+    steady_clock::time_point submit_start = steady_clock::now();
+    bool accepted =
+        EthashAux::eval(solution.work->epoch, solution.work->header, solution.nonce).value <=
+        solution.work->boundary;
+    milliseconds response_delay_ms =
+        duration_cast<milliseconds>(steady_clock::now() - submit_start);
+
+    bool stale;
+    {
+        std::lock_guard<std::mutex> l(m_mutex);
+        auto it = m_byHeader.find(solution.work->header);
+        stale = (it == m_byHeader.end() || it->second != m_current);
+        if (accepted)
+        {
+            m_accepted++;
+            if (stale)
+                m_stale++;
+            if (it != m_byHeader.end())
+                m_jobs[it->second].solutions++;
+        }
+        else
+        {
+            m_rejected++;
+        }
+    }
+
+    if (accepted)
+    {
+        if (m_onSolutionAccepted)
+            m_onSolutionAccepted(response_delay_ms, solution.midx, stale);
+    }
+    else
+    {
+        if (m_onSolutionRejected)
+            m_onSolutionRejected(response_delay_ms, solution.midx);
+    }
+}
+
+bool ReplayClient::load(string& _error)
+{
+    vector<TrafficCapture::Record> records;
+    if (!TrafficCapture::load(m_path, records, _error))
+        return false;
+
+    // Jobs are rebuilt as EthStratumClient does for the flavour
+    // the capture was taken with
+    unsigned mode = 999;
+    h256 boundary(getTargetFromDiff(1));
+    string extranonce;
+    int epoch = -1;
+    Json::Reader reader;
+
+    for (auto& r : records)
+    {
+        m_end = r.offset;
+        if (r.direction == TrafficCapture::Event)
+        {
+            if (r.text.compare(0, 5, "mode ") == 0)
+                mode = unsigned(stoul(r.text.substr(5)));
+            else if (r.text == "disconnect")
+                extranonce.clear();
+            continue;
+        }
+        if (r.direction != TrafficCapture::Inbound)
+            continue;
+
+        Json::Value msg;
+        if (!reader.parse(r.text, msg, false) || !msg.isObject())
+            continue;
+
+        WorkPackage wp;
+        bool isJob = false;
+        try
+        {
+            string method = msg.get("method", "").asString();
+            unsigned id = msg["id"].isIntegral() ? msg["id"].asUInt() : 0;
+            Json::Value prm = msg.get("params", Json::Value::null);
+
+            if (mode == 2)
+            {
+                // EthereumStratum/1.0.0
+                if (id == 1 && msg["result"].isArray() && msg["result"].size() > 1)
+                    extranonce = msg["result"][1].asString();
+                else if (method == "mining.set_extranonce" && prm.isArray() && prm.size())
+                    extranonce = prm[0].asString();
+                else if (method == "mining.set_difficulty" && prm.isArray() && prm.size())
+                    boundary = h256(getTargetFromDiff(max(prm[0].asDouble(), 0.0001)));
+                else if (method == "mining.notify" && prm.isArray() && prm.size() >= 3)
+                {
+                    wp.job = prm[0].asString();
+                    wp.seed = h256(prm[1].asString());
+                    wp.header = h256(prm[2].asString());
+                    isJob = true;
+                }
+            }
+            else if (mode == 3)
+            {
+                // EthereumStratum/2.0.0
+                if (method == "mining.set" && prm.isObject())
+                {
+                    if (prm.isMember("epoch"))
+                        epoch = int(stoul(prm["epoch"].asString(), nullptr, 16));
+                    if (prm.isMember("target"))
+                        boundary = h256("0x" + padLeft(prm["target"].asString(), 64, '0'));
+                    if (prm.isMember("extranonce"))
+                        extranonce = prm["extranonce"].asString();
+                }
+                else if (method == "mining.notify" && prm.isArray() && prm.size() >= 3)
+                {
+                    wp.job = prm[0].asString();
+                    wp.block = int(stoul(prm[1].asString(), nullptr, 16));
+                    wp.header = h256("0x" + padLeft(prm[2].asString(), 64, '0'));
+                    wp.epoch = epoch;
+                    isJob = true;
+                }
+            }
+            else
+            {
+                // Stratum and eth-proxy : header, seed, target [, block]
+                Json::Value jobPrm;
+                Json::ArrayIndex i = 0;
+                if (mode == 1 && method.empty() && msg["result"].isArray())
+                {
+                    jobPrm = msg["result"];
+                }
+                else if (method == "mining.notify" && prm.isArray() && prm.size())
+                {
+                    jobPrm = prm;
+                    i = 1;
+                }
+                if (jobPrm.size() >= i + 3)
+                {
+                    wp.job = jobPrm[0].asString();
+                    wp.header = h256(jobPrm[i].asString());
+                    wp.seed = h256(jobPrm[i + 1].asString());
+                    string target = jobPrm[i + 2].asString();
+                    if (target.size() < 66)
+                        target = "0x" + string(66 - target.size(), '0') + target.substr(2);
+                    boundary = h256(target);
+                    if (jobPrm.size() > i + 3 && jobPrm[i + 3].asString().substr(0, 2) == "0x")
+                        wp.block = int(stoul(jobPrm[i + 3].asString(), nullptr, 16));
+                    isJob = true;
+                }
+            }
+        }
+        catch (const std::exception&)
+        {
+            // Not something EthStratumClient would have mined either
+            continue;
+        }
+
+        if (!isJob || !wp || (!m_jobs.empty() && m_jobs.back().wp.header == wp.header))
+            continue;
+
+        wp.boundary = boundary;
+        if (!extranonce.empty())
+        {
+            string enonce = extranonce;
+            wp.exSizeBytes = uint16_t(enonce.size());
+            enonce.resize(16, '0');
+            wp.startNonce = stoull(enonce, nullptr, 16);
+        }
+
+        m_byHeader[wp.header] = m_jobs.size();
+        m_jobs.push_back({r.offset, wp, 0});
+    }
+
+    if (m_jobs.empty())
+    {
+        _error = "No job found in capture";
+        return false;
+    }
+    return true;
+}
+
+bool ReplayClient::waitUntil(steady_clock::time_point _due)
+{
+    while (m_replaying.load(memory_order_relaxed))
+    {
+        auto now = steady_clock::now();
+        if (now >= _due)
+            return true;
+        this_thread::sleep_for(min<steady_clock::duration>(_due - now, milliseconds(100)));
+    }
+    return false;
+}
+
+// Handles all logic here
+void ReplayClient::workLoop()
+{
+    m_start = steady_clock::now();
+    const uint64_t base = m_jobs.front().offset;
+    auto due = [&](uint64_t _offset) {
+        return m_start + microseconds(uint64_t((_offset - base) / m_speed));
+    };
+
+    for (size_t i = 0; i < m_jobs.size(); i++)
+    {
+        if (!waitUntil(due(m_jobs[i].offset)))
+            return;
+        {
+            std::lock_guard<std::mutex> l(m_mutex);
+            m_current = i;
+            m_dispatched = i + 1;
+        }
+        m_onWorkReceived(m_jobs[i].wp);
+    }
+
+    // The last job lasts as long as the capture went on after it
+    if (!waitUntil(due(m_end)))
+        return;
+
+    cnote << "Replay of " << m_path << " completed";
+    m_conn->MarkUnrecoverable();
+    g_io_service.post([this]() { disconnect(); });
+}
+
+void ReplayClient::report()
+{
+    std::lock_guard<std::mutex> l(m_mutex);
+
+    unsigned mined = 0, maxPerJob = 0;
+    for (size_t i = 0; i < m_dispatched; i++)
+    {
+        mined += m_jobs[i].solutions;
+        maxPerJob = max(maxPerJob, m_jobs[i].solutions);
+    }
+    double elapsed = duration_cast<milliseconds>(steady_clock::now() - m_start).count() / 1000.0;
+
+    std::stringstream ss;
+    ss << fixed << setprecision(2) << m_dispatched << " jobs in " << elapsed << " s. Solutions "
+       << m_accepted << " (" << m_stale << " stale "
+       << (m_accepted ? 100.0 * m_stale / m_accepted : 0.0) << "%) rejected " << m_rejected
+       << ". Per job mean " << (m_dispatched ? double(mined) / m_dispatched : 0.0) << " max "
+       << maxPerJob;
+    cnote << "Replay results : " << EthWhiteBold << ss.str() << EthReset;
+    cnote << "Job switch latency p50/p99 : " << EthWhiteBold
+          << Farm::f().Telemetry().farm.switchLatency.str() << " ms" << EthReset;
+}
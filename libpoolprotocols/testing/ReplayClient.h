@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+#include <libdevcore/Worker.h>
+#include <libethcore/EthashAux.h>
+#include <libethcore/Farm.h>
+#include <libethcore/Miner.h>
+
+#include "../PoolClient.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+/**
+ * @brief Replays the jobs of a capture (see TrafficCapture) with their
+ * original cadence, optionally sped up or slowed down.
+ *
+ * Solutions are verified locally. A solution of a job already replaced
+ * when it comes out is accounted as stale. Once the capture is over the
+ * results are reported and ethminer exits.
+ */
+class ReplayClient : public PoolClient, Worker
+{
+public:
+    ReplayClient(string const& _path, float _speed);
+    ~ReplayClient() override;
+
+    void connect() override;
+    void disconnect() override;
+
+    bool isPendingState() override { return false; }
+    string ActiveEndPoint() override { return ""; };
+
+    void submitHashrate(uint64_t const& rate, string const& id) override;
+    void submitSolution(const Solution& solution) override;
+
+private:
+    struct Job
+    {
+        uint64_t offset;  // Microseconds into the capture
+        WorkPackage wp;
+        unsigned solutions;  // Accepted ones
+    };
+
+    bool load(string& _error);
+    void workLoop() override;
+    bool waitUntil(std::chrono::steady_clock::time_point _due);
+    void report();
+
+    string m_path;
+    float m_speed;
+
+    vector<Job> m_jobs;
+    map<h256, size_t> m_byHeader;  // Index of jobs by header
+    uint64_t m_end = 0;            // Offset of the last record
+
+    std::atomic<bool> m_replaying = {false};
+    std::chrono::steady_clock::time_point m_start;
+
+    std::mutex m_mutex;       // Protects the accounting below
+    size_t m_current = 0;     // Job being mined
+    size_t m_dispatched = 0;  // Jobs sent to the farm so far
+    unsigned m_accepted = 0;
+    unsigned m_rejected = 0;
+    unsigned m_stale = 0;
+};
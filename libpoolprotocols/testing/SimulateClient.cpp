@@ -1,5 +1,9 @@
 #include <libdevcore/Log.h>
 #include <chrono>
+#include <fstream>
+
+#include <boost/format.hpp>
+#include <json/json.h>
 
 #include "SimulateClient.h"
 
@@ -8,9 +12,9 @@ using namespace std::chrono;
 using namespace dev;
 using namespace eth;
 
-SimulateClient::SimulateClient(unsigned const& block) : PoolClient(), Worker("sim")
+SimulateClient::SimulateClient(SimulationSettings const& settings)
+  : PoolClient(), Worker("sim"), m_settings(settings)
 {
-    m_block = block;
 }
 
 SimulateClient::~SimulateClient() = default;
@@ -22,6 +26,7 @@ void SimulateClient::connect()
     m_session = unique_ptr<Session>(new Session);
     m_session->subscribed.store(true, memory_order_relaxed);
     m_session->authorized.store(true, memory_order_relaxed);
+    m_simulating.store(true, memory_order_relaxed);
 
     if (m_onConnected)
         m_onConnected();
@@ -33,13 +38,15 @@ void SimulateClient::connect()
 
 void SimulateClient::disconnect()
 {
-    cnote << "Simulation results : " << EthWhiteBold << "Max "
-          << dev::getFormattedHashes((double)hr_max, ScaleSuffix::Add, 6) << " Mean "
-          << dev::getFormattedHashes((double)hr_mean, ScaleSuffix::Add, 6) << EthReset;
-    
+    bool ex = true;
+    if (!m_connected.compare_exchange_strong(ex, false, memory_order_relaxed))
+        return;
+
+    m_simulating.store(false, memory_order_relaxed);
+    report();
+
     m_conn->addDuration(m_session->duration());
     m_session = nullptr;
-    m_connected.store(false, memory_order_relaxed);
 
     if (m_onDisconnected)
         m_onDisconnected();
@@ -56,19 +63,21 @@ void SimulateClient::submitSolution(const Solution& solution)
     // This is a fake submission only evaluated locally
     std::chrono::steady_clock::time_point submit_start = std::chrono::steady_clock::now();
     bool accepted =
-        EthashAux::eval(solution.work.epoch, solution.work.header, solution.nonce).value <=
-        solution.work.boundary;
+        EthashAux::eval(solution.work->epoch, solution.work->header, solution.nonce).value <=
+        solution.work->boundary;
     std::chrono::milliseconds response_delay_ms =
         std::chrono::duration_cast<std::chrono::milliseconds>(
             std::chrono::steady_clock::now() - submit_start);
 
     if (accepted)
     {
+        m_found.fetch_add(1, memory_order_relaxed);
         if (m_onSolutionAccepted)
             m_onSolutionAccepted(response_delay_ms, solution.midx, false);
     }
     else
     {
+        m_rejected.fetch_add(1, memory_order_relaxed);
         if (m_onSolutionRejected)
             m_onSolutionRejected(response_delay_ms, solution.midx);
     }
@@ -79,24 +88,160 @@ void SimulateClient::workLoop()
 {
     m_start_time = std::chrono::steady_clock::now();
 
-    // apply exponential sliding average
-    // ref: https://en.wikipedia.org/wiki/Moving_average#Exponential_moving_average
-
-
     WorkPackage current;
     current.seed = h256::random();  // We don't actually need a real seed as the epoch
                                     // is calculated upon block number (see poolmanager)
     current.header = h256::random();
-    current.block = m_block;
-    current.boundary = h256(dev::getTargetFromDiff(1));
-    m_onWorkReceived(current);  // submit new fake job
+    current.block = m_settings.block;
+    current.boundary = h256(dev::getTargetFromDiff(m_settings.difficulty));
+
+    auto nextJob = m_start_time;
+    auto nextEpoch = m_start_time;
+    auto lastSample = m_start_time;
 
-    while (m_session)
+    while (m_simulating.load(memory_order_relaxed))
     {
-        float hr = Farm::f().HashRate();
-        hr_max = std::max(hr_max, hr);
-        hr_mean = hr_alpha * hr_mean + (1.0f - hr_alpha) * hr;
+        auto now = std::chrono::steady_clock::now();
+
+        // A new seed is a new epoch for PoolManager. Jump a whole epoch
+        // so every switch needs a DAG build
+        bool newEpoch = (now >= nextEpoch);
+        if (newEpoch || now >= nextJob)
+        {
+            if (newEpoch && m_jobs)
+            {
+                current.seed = h256::random();
+                current.block += 30000;
+            }
+            current.header = h256::random();
+            {
+                std::lock_guard<std::mutex> l(m_mutex);
+                m_jobs++;
+                if (newEpoch)
+                {
+                    m_epochs++;
+                    m_dagEpoch = current.block / 30000;
+                    m_dagStart = now;
+                }
+            }
+            m_onWorkReceived(current);  // submit new fake job
+
+            nextJob = m_settings.jobInterval ?
+                          now + std::chrono::milliseconds(m_settings.jobInterval) :
+                          std::chrono::steady_clock::time_point::max();
+            if (newEpoch)
+                nextEpoch = m_settings.epochInterval ?
+                                now + std::chrono::seconds(m_settings.epochInterval) :
+                                std::chrono::steady_clock::time_point::max();
+        }
 
-        this_thread::sleep_for(chrono::milliseconds(200));
+        float hr = Farm::f().HashRate();
+        {
+            // apply exponential sliding average
+            // ref: https://en.wikipedia.org/wiki/Moving_average#Exponential_moving_average
+            std::lock_guard<std::mutex> l(m_mutex);
+            double dt =
+                std::chrono::duration_cast<std::chrono::microseconds>(now - lastSample).count() /
+                1000000.0;
+            hr_max = std::max(hr_max, hr);
+            hr_mean = hr_alpha * hr_mean + (1.0f - hr_alpha) * hr;
+            m_hashes += hr * dt;
+            m_elapsed += dt;
+        }
+        lastSample = now;
+        checkDag();
+
+        if (m_settings.duration &&
+            now - m_start_time >= std::chrono::seconds(m_settings.duration))
+        {
+            cnote << "Simulation completed";
+            m_conn->MarkUnrecoverable();
+            g_io_service.post([this]() { disconnect(); });
+            return;
+        }
+
+        auto wake = std::min(nextJob, now + chrono::milliseconds(200));
+        this_thread::sleep_until(wake);
     }
 }
+
+void SimulateClient::checkDag()
+{
+    std::lock_guard<std::mutex> l(m_mutex);
+    if (m_dagEpoch == -1)
+        return;
+
+    // The DAG is built once every miner searches on it
+    for (auto const& miner : Farm::f().getMiners())
+        if (miner->readyEpoch() != m_dagEpoch)
+            return;
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - m_dagStart);
+    m_dagTimes.push_back(unsigned(ms.count()));
+    m_dagEpoch = -1;
+}
+
+void SimulateClient::report()
+{
+    std::lock_guard<std::mutex> l(m_mutex);
+
+    double hashesPerSolution = dev::getHashesToTarget(dev::getTargetFromDiff(m_settings.difficulty));
+    unsigned found = m_found.load(memory_order_relaxed);
+    double expected = m_hashes / hashesPerSolution;
+    double mean = m_elapsed ? m_hashes / m_elapsed : 0.0;
+    double effective = m_elapsed ? found * hashesPerSolution / m_elapsed : 0.0;
+
+    cnote << "Simulation results : " << EthWhiteBold << "Max "
+          << dev::getFormattedHashes((double)hr_max, ScaleSuffix::Add, 6) << " Mean "
+          << dev::getFormattedHashes(mean, ScaleSuffix::Add, 6) << " Effective "
+          << dev::getFormattedHashes(effective, ScaleSuffix::Add, 6) << EthReset;
+    cnote << "Solutions found " << found << " expected "
+          << boost::str(boost::format("%0.1f") % expected) << " rejected "
+          << m_rejected.load(memory_order_relaxed);
+
+    if (m_settings.reportFile.empty())
+        return;
+
+    Json::Value jRoot(Json::objectValue);
+    jRoot["duration"] = m_elapsed;
+    jRoot["difficulty"] = m_settings.difficulty;
+    jRoot["jobs"] = m_jobs;
+    jRoot["epochs"] = m_epochs;
+
+    Json::Value jHashrate(Json::objectValue);
+    jHashrate["max"] = hr_max;
+    jHashrate["mean"] = mean;
+    jHashrate["effective"] = effective;
+    jRoot["hashrate"] = jHashrate;
+
+    Json::Value jSolutions(Json::objectValue);
+    jSolutions["found"] = found;
+    jSolutions["expected"] = expected;
+    jSolutions["rejected"] = m_rejected.load(memory_order_relaxed);
+    jRoot["solutions"] = jSolutions;
+
+    Json::Value jDag(Json::arrayValue);
+    for (auto ms : m_dagTimes)
+        jDag.append(ms);
+    jRoot["dag_build_ms"] = jDag;
+
+    // Job switches of the farm (microseconds)
+    auto const& switches = Farm::f().Telemetry().farm.switchLatency;
+    Json::Value jSwitch(Json::objectValue);
+    jSwitch["count"] = Json::Value::UInt64(switches.count);
+    jSwitch["mean"] = Json::Value::UInt64(switches.mean());
+    jSwitch["p50"] = Json::Value::UInt64(switches.percentile(0.5));
+    jSwitch["p99"] = Json::Value::UInt64(switches.percentile(0.99));
+    jSwitch["max"] = Json::Value::UInt64(switches.max);
+    jRoot["switch_latency_us"] = jSwitch;
+
+    std::ofstream out(m_settings.reportFile, std::ios::trunc);
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "  ";
+    out << Json::writeString(writer, jRoot) << std::endl;
+    if (!out.good())
+        cwarn << "Unable to write simulation report to " << m_settings.reportFile;
+    else
+        cnote << "Simulation report written to " << m_settings.reportFile;
+}
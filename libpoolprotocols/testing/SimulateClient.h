@@ -1,6 +1,8 @@
 #pragma once
 
+#include <atomic>
 #include <iostream>
+#include <mutex>
 
 #include <libdevcore/Worker.h>
 #include <libethcore/EthashAux.h>
@@ -13,10 +15,20 @@ using namespace std;
 using namespace dev;
 using namespace eth;
 
+struct SimulationSettings
+{
+    unsigned block = 0;          // Block number of the first job
+    unsigned jobInterval = 0;    // Milliseconds between new headers (0 = a single job)
+    double difficulty = 1;       // Difficulty of the jobs
+    unsigned epochInterval = 0;  // Seconds spent on an epoch before the next (0 = no sweep)
+    unsigned duration = 0;       // Seconds the simulation lasts (0 = until interrupted)
+    string reportFile;           // Where the JSON report is written (empty = log only)
+};
+
 class SimulateClient : public PoolClient, Worker
 {
 public:
-    SimulateClient(unsigned const& block);
+    SimulateClient(SimulationSettings const& settings);
     ~SimulateClient() override;
 
     void connect() override;
@@ -31,10 +43,26 @@ public:
 private:
 
     void workLoop() override;
-    unsigned m_block;
+    void checkDag();
+    void report();
+
+    SimulationSettings m_settings;
+    std::atomic<bool> m_simulating = {false};
     std::chrono::steady_clock::time_point m_start_time;
 
+    std::mutex m_mutex;  // Protects the accounting below
     float hr_alpha = 0.45f;
     float hr_max = 0.0f;
     float hr_mean = 0.0f;
+    double m_hashes = 0;   // Integral of the farm hashrate
+    double m_elapsed = 0;  // Seconds
+    unsigned m_jobs = 0;
+    unsigned m_epochs = 0;
+    std::atomic<unsigned> m_found = {0};
+    std::atomic<unsigned> m_rejected = {0};
+
+    // Epoch whose DAG is being built by the farm and since when
+    int m_dagEpoch = -1;
+    std::chrono::steady_clock::time_point m_dagStart;
+    std::vector<unsigned> m_dagTimes;  // Milliseconds of each DAG build
 };